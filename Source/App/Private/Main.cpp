@@ -4,6 +4,7 @@
 #include "core/Logging.h"
 
 CUSTOM_MAIN(RE::FPlatform &Platform) {
+    RE::FLogging::Init();
 
     RE::FWindow::FProperties Properties{
         .Title = "RelightEngine",
@@ -12,5 +13,6 @@ CUSTOM_MAIN(RE::FPlatform &Platform) {
 
     Platform.EngineLoop();
 
+    RE::FLogging::Shutdown();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,17 @@
+﻿#include "Asset/MeshData.h"
+
+#include <glm/common.hpp>
+
+namespace RE {
+void FMeshData::ComputeBounds() {
+    if(Positions.empty()) {
+        BoundsMin = BoundsMax = glm::vec3(0.0f);
+        return;
+    }
+    BoundsMin = BoundsMax = Positions[0];
+    for(const glm::vec3 &Position: Positions) {
+        BoundsMin = glm::min(BoundsMin, Position);
+        BoundsMax = glm::max(BoundsMax, Position);
+    }
+}
+}
@@ -0,0 +1,220 @@
+﻿#include "Asset/MeshImporter.h"
+#include "Asset/MeshletBuilder.h"
+#include "Core/FileSystem.h"
+#include "Core/Logging.h"
+
+#include <cstring>
+
+#include <tiny_gltf.h>
+
+namespace RE {
+namespace {
+bool VfsFileExists(const std::string &Path, void *) {
+    return FVirtualFileSystem::Get().Exists(Path);
+}
+
+std::string VfsExpandFilePath(const std::string &Path, void *) { return Path; }
+
+bool VfsReadWholeFile(
+    std::vector<unsigned char> *Out, std::string *Error, const std::string &Path, void *) {
+    FFileData Data;
+    if(!FVirtualFileSystem::Get().Read(Path, Data)) {
+        if(Error != nullptr) { *Error += "File not found: " + Path + "\n"; }
+        return false;
+    }
+    Out->assign(Data.GetData(), Data.GetData() + Data.GetSize());
+    return true;
+}
+
+// Images are imported by the texture pipeline, the mesh importer only needs geometry.
+bool SkipImageData(
+    tinygltf::Image *, const int, std::string *, std::string *, int, int,
+    const unsigned char *, int, void *) {
+    return true;
+}
+
+float ReadComponent(const uint8_t *Data, int ComponentType, bool bNormalized) {
+    switch(ComponentType) {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+            float Value;
+            std::memcpy(&Value, Data, sizeof(Value));
+            return Value;
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return bNormalized ? float(*Data) / 255.0f : float(*Data);
+        case TINYGLTF_COMPONENT_TYPE_BYTE: {
+            const float Value = float(*reinterpret_cast<const int8_t *>(Data));
+            return bNormalized ? std::max(Value / 127.0f, -1.0f) : Value;
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+            uint16_t Value;
+            std::memcpy(&Value, Data, sizeof(Value));
+            return bNormalized ? float(Value) / 65535.0f : float(Value);
+        }
+        case TINYGLTF_COMPONENT_TYPE_SHORT: {
+            int16_t Value;
+            std::memcpy(&Value, Data, sizeof(Value));
+            return bNormalized ? std::max(float(Value) / 32767.0f, -1.0f) : float(Value);
+        }
+        default: return 0.0f;
+    }
+}
+
+/* Reads a float vector attribute of N components, converting normalized integers. */
+template<int N, typename T>
+bool ReadAttribute(const tinygltf::Model &Model, int AccessorIndex, std::vector<T> &Out) {
+    if(AccessorIndex < 0 || AccessorIndex >= int(Model.accessors.size())) { return false; }
+    const tinygltf::Accessor &Accessor = Model.accessors[AccessorIndex];
+    if(Accessor.bufferView < 0 ||
+       tinygltf::GetTypeSizeInBytes(static_cast<uint32_t>(Accessor.type)) < N) {
+        return false;
+    }
+    const tinygltf::BufferView &View = Model.bufferViews[Accessor.bufferView];
+    const tinygltf::Buffer &Buffer = Model.buffers[View.buffer];
+    const int Stride = Accessor.ByteStride(View);
+    const int ComponentSize =
+        tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(Accessor.componentType));
+    if(Stride <= 0 || ComponentSize <= 0) { return false; }
+
+    const uint8_t *Base = Buffer.data.data() + View.byteOffset + Accessor.byteOffset;
+    if(View.byteOffset + Accessor.byteOffset +
+           (Accessor.count > 0 ? (Accessor.count - 1) * Stride + N * ComponentSize : 0) >
+       Buffer.data.size()) {
+        return false;
+    }
+
+    Out.resize(Accessor.count);
+    for(size_t i = 0; i < Accessor.count; i++) {
+        const uint8_t *Element = Base + i * Stride;
+        for(int c = 0; c < N; c++) {
+            Out[i][c] = ReadComponent(
+                Element + c * ComponentSize, Accessor.componentType, Accessor.normalized);
+        }
+    }
+    return true;
+}
+
+bool ReadIndices(const tinygltf::Model &Model, int AccessorIndex, std::vector<uint32_t> &Out) {
+    const tinygltf::Accessor &Accessor = Model.accessors[AccessorIndex];
+    if(Accessor.bufferView < 0) { return false; }
+    const tinygltf::BufferView &View = Model.bufferViews[Accessor.bufferView];
+    const tinygltf::Buffer &Buffer = Model.buffers[View.buffer];
+    const int Stride = Accessor.ByteStride(View);
+    if(Stride <= 0 ||
+       View.byteOffset + Accessor.byteOffset + Accessor.count * Stride > Buffer.data.size()) {
+        return false;
+    }
+
+    const uint8_t *Base = Buffer.data.data() + View.byteOffset + Accessor.byteOffset;
+    Out.resize(Accessor.count);
+    for(size_t i = 0; i < Accessor.count; i++) {
+        const uint8_t *Element = Base + i * Stride;
+        switch(Accessor.componentType) {
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: Out[i] = *Element; break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+                uint16_t Value;
+                std::memcpy(&Value, Element, sizeof(Value));
+                Out[i] = Value;
+                break;
+            }
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+                std::memcpy(&Out[i], Element, sizeof(uint32_t));
+                break;
+            default: return false;
+        }
+    }
+    return true;
+}
+
+bool ImportPrimitive(
+    const tinygltf::Model &Model, const tinygltf::Mesh &Mesh,
+    const tinygltf::Primitive &Primitive, FMeshData &OutMesh) {
+    auto Attribute = [&Primitive](const char *Name) {
+        auto It = Primitive.attributes.find(Name);
+        return It != Primitive.attributes.end() ? It->second : -1;
+    };
+
+    if(!ReadAttribute<3>(Model, Attribute("POSITION"), OutMesh.Positions)) { return false; }
+    ReadAttribute<3>(Model, Attribute("NORMAL"), OutMesh.Normals);
+    ReadAttribute<4>(Model, Attribute("TANGENT"), OutMesh.Tangents);
+    ReadAttribute<2>(Model, Attribute("TEXCOORD_0"), OutMesh.TexCoords);
+
+    // Optional streams must match the position count or they are dropped.
+    const size_t VertexCount = OutMesh.Positions.size();
+    if(OutMesh.Normals.size() != VertexCount) { OutMesh.Normals.clear(); }
+    if(OutMesh.Tangents.size() != VertexCount) { OutMesh.Tangents.clear(); }
+    if(OutMesh.TexCoords.size() != VertexCount) { OutMesh.TexCoords.clear(); }
+
+    if(Primitive.indices >= 0) {
+        if(!ReadIndices(Model, Primitive.indices, OutMesh.Indices)) { return false; }
+    } else {
+        OutMesh.Indices.resize(VertexCount);
+        for(uint32_t i = 0; i < VertexCount; i++) {
+            OutMesh.Indices[i] = i;
+        }
+    }
+    OutMesh.Indices.resize(OutMesh.Indices.size() / 3 * 3);
+    for(uint32_t Index: OutMesh.Indices) {
+        if(Index >= VertexCount) { return false; }
+    }
+
+    OutMesh.Name = Mesh.name;
+    OutMesh.MaterialIndex = Primitive.material >= 0 ? uint32_t(Primitive.material) : 0;
+    OutMesh.ComputeBounds();
+    return true;
+}
+}
+
+bool FMeshImporter::Import(
+    std::string_view Path, const FMeshImportOptions &Options,
+    std::vector<FMeshData> &OutMeshes) {
+    FFileData File;
+    if(!FVirtualFileSystem::Get().Read(Path, File)) { return false; }
+
+    tinygltf::TinyGLTF Loader;
+    Loader.SetFsCallbacks(
+        {VfsFileExists, VfsExpandFilePath, VfsReadWholeFile, nullptr, nullptr});
+    Loader.SetImageLoader(SkipImageData, nullptr);
+
+    const std::string Normalized = FVirtualFileSystem::NormalizePath(Path);
+    const size_t Slash = Normalized.find_last_of('/');
+    const std::string BaseDir =
+        Slash == std::string::npos ? std::string() : Normalized.substr(0, Slash);
+
+    tinygltf::Model Model;
+    std::string Error;
+    std::string Warning;
+    const bool bBinary = File.GetSize() >= 4 && std::memcmp(File.GetData(), "glTF", 4) == 0;
+    const bool bLoaded =
+        bBinary ? Loader.LoadBinaryFromMemory(
+                      &Model, &Error, &Warning, File.GetData(),
+                      static_cast<unsigned int>(File.GetSize()), BaseDir)
+                : Loader.LoadASCIIFromString(
+                      &Model, &Error, &Warning, reinterpret_cast<const char *>(File.GetData()),
+                      static_cast<unsigned int>(File.GetSize()), BaseDir);
+    if(!Warning.empty()) { RE_LOGW("glTF {}: {}", Normalized, Warning); }
+    if(!bLoaded) {
+        RE_LOGE("Failed to load glTF {}: {}", Normalized, Error);
+        return false;
+    }
+
+    const size_t FirstMesh = OutMeshes.size();
+    for(const tinygltf::Mesh &Mesh: Model.meshes) {
+        for(const tinygltf::Primitive &Primitive: Mesh.primitives) {
+            if(Primitive.mode != TINYGLTF_MODE_TRIANGLES) { continue; }
+            FMeshData MeshData;
+            if(!ImportPrimitive(Model, Mesh, Primitive, MeshData)) {
+                RE_LOGW("glTF {}: skipping malformed primitive of '{}'", Normalized, Mesh.name);
+                continue;
+            }
+            OutMeshes.push_back(std::move(MeshData));
+        }
+    }
+
+    const std::span<FMeshData> Imported = std::span(OutMeshes).subspan(FirstMesh);
+    if(Options.bOptimize) { FMeshOptimizer::OptimizeMeshes(Imported, Options.Optimize); }
+    if(Options.bGenerateLods) { FMeshSimplifier::BuildMeshLods(Imported, Options.Lods); }
+    if(Options.bBuildMeshlets) { FMeshletBuilder::BuildMeshes(Imported); }
+    return true;
+}
+}
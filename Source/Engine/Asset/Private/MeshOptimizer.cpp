@@ -0,0 +1,371 @@
+﻿#include "Asset/MeshOptimizer.h"
+#include "Core/Logging.h"
+#include "Core/TaskSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace RE {
+namespace {
+constexpr uint32_t InvalidIndex = std::numeric_limits<uint32_t>::max();
+
+// Forsyth's tuning constants, scored against a 32 entry LRU cache.
+constexpr uint32_t ScoringCacheSize = 32;
+constexpr float CacheDecayPower = 1.5f;
+constexpr float LastTriangleScore = 0.75f;
+constexpr float ValenceBoostScale = 2.0f;
+constexpr float ValenceBoostPower = 0.5f;
+
+float VertexScore(int32_t CachePosition, uint32_t RemainingTriangles) {
+    if(RemainingTriangles == 0) { return -1.0f; }
+
+    float Score = 0.0f;
+    if(CachePosition >= 0) {
+        if(CachePosition < 3) {
+            // The vertices of the triangle just emitted get a fixed score so the next
+            // triangle does not simply reuse the same edge every time.
+            Score = LastTriangleScore;
+        } else {
+            const float Scale = 1.0f / float(ScoringCacheSize - 3);
+            Score = std::pow(1.0f - float(CachePosition - 3) * Scale, CacheDecayPower);
+        }
+    }
+    // Favour vertices with few triangles left so they get finished off and leave the cache.
+    Score += ValenceBoostScale * std::pow(float(RemainingTriangles), -ValenceBoostPower);
+    return Score;
+}
+
+/* Post-transform FIFO cache simulation; timestamps avoid clearing the cache on reset. */
+class FFifoCache {
+public:
+    FFifoCache(uint32_t VertexCount, uint32_t CacheSize)
+        : Timestamps(VertexCount, 0), CacheSize(CacheSize), Timestamp(CacheSize + 1) {}
+
+    bool Access(uint32_t Vertex) {
+        if(Timestamp - Timestamps[Vertex] > CacheSize) {
+            Timestamps[Vertex] = Timestamp++;
+            return true;
+        }
+        return false;
+    }
+
+    void Reset() { Timestamp += CacheSize + 1; }
+
+private:
+    std::vector<uint32_t> Timestamps;
+    uint32_t CacheSize;
+    uint32_t Timestamp;
+};
+
+template<typename T>
+void RemapStream(std::vector<T> &Stream, const std::vector<uint32_t> &Remap, uint32_t Count) {
+    if(Stream.empty()) { return; }
+    std::vector<T> Result(Count);
+    for(size_t i = 0; i < Remap.size(); i++) {
+        if(Remap[i] != InvalidIndex) { Result[Remap[i]] = Stream[i]; }
+    }
+    Stream = std::move(Result);
+}
+}
+
+FVertexCacheStats FMeshOptimizer::AnalyzeVertexCache(
+    std::span<const uint32_t> Indices, uint32_t VertexCount, uint32_t CacheSize) {
+    FVertexCacheStats Stats;
+    if(Indices.empty() || VertexCount == 0) { return Stats; }
+
+    FFifoCache Cache(VertexCount, CacheSize);
+    for(uint32_t Index: Indices) {
+        Stats.TransformedVertices += Cache.Access(Index) ? 1 : 0;
+    }
+    Stats.ACMR = float(Stats.TransformedVertices) / float(Indices.size() / 3);
+    Stats.ATVR = float(Stats.TransformedVertices) / float(VertexCount);
+    return Stats;
+}
+
+void FMeshOptimizer::OptimizeVertexCache(std::span<uint32_t> Indices, uint32_t VertexCount) {
+    const uint32_t TriangleCount = static_cast<uint32_t>(Indices.size() / 3);
+    if(TriangleCount == 0) { return; }
+
+    // Vertex -> triangle adjacency. The live triangles of vertex V occupy
+    // Adjacency[Offsets[V], Offsets[V] + Remaining[V]).
+    std::vector<uint32_t> Remaining(VertexCount, 0);
+    for(uint32_t Index: Indices) {
+        Remaining[Index]++;
+    }
+    std::vector<uint32_t> Offsets(VertexCount + 1, 0);
+    std::partial_sum(Remaining.begin(), Remaining.end(), Offsets.begin() + 1);
+    std::vector<uint32_t> Adjacency(Indices.size());
+    {
+        std::vector<uint32_t> Fill(Offsets.begin(), Offsets.end() - 1);
+        for(uint32_t i = 0; i < Indices.size(); i++) {
+            Adjacency[Fill[Indices[i]]++] = i / 3;
+        }
+    }
+
+    std::vector<int32_t> CachePositions(VertexCount, -1);
+    std::vector<float> VertexScores(VertexCount);
+    for(uint32_t v = 0; v < VertexCount; v++) {
+        VertexScores[v] = VertexScore(-1, Remaining[v]);
+    }
+
+    std::vector<float> TriangleScores(TriangleCount);
+    std::vector<uint8_t> Emitted(TriangleCount, 0);
+    uint32_t BestTriangle = 0;
+    for(uint32_t t = 0; t < TriangleCount; t++) {
+        TriangleScores[t] = VertexScores[Indices[t * 3 + 0]] +
+                            VertexScores[Indices[t * 3 + 1]] +
+                            VertexScores[Indices[t * 3 + 2]];
+        if(TriangleScores[t] > TriangleScores[BestTriangle]) { BestTriangle = t; }
+    }
+
+    std::vector<uint32_t> Result(Indices.size());
+    uint32_t Cache[ScoringCacheSize + 3];
+    uint32_t CacheCount = 0;
+    uint32_t NewCache[ScoringCacheSize + 3];
+    uint32_t FallbackCursor = 0;
+
+    for(uint32_t Output = 0; Output < TriangleCount; Output++) {
+        if(BestTriangle == InvalidIndex) {
+            // Nothing in the cache has triangles left: continue with the next unemitted one.
+            while(Emitted[FallbackCursor]) {
+                FallbackCursor++;
+            }
+            BestTriangle = FallbackCursor;
+        }
+
+        const uint32_t Triangle[3] = {
+            Indices[BestTriangle * 3 + 0], Indices[BestTriangle * 3 + 1],
+            Indices[BestTriangle * 3 + 2]};
+        Result[Output * 3 + 0] = Triangle[0];
+        Result[Output * 3 + 1] = Triangle[1];
+        Result[Output * 3 + 2] = Triangle[2];
+        Emitted[BestTriangle] = 1;
+
+        for(uint32_t Vertex: Triangle) {
+            uint32_t *List = Adjacency.data() + Offsets[Vertex];
+            const uint32_t Count = Remaining[Vertex];
+            for(uint32_t i = 0; i < Count; i++) {
+                if(List[i] == BestTriangle) {
+                    List[i] = List[Count - 1];
+                    break;
+                }
+            }
+            Remaining[Vertex]--;
+        }
+
+        // The emitted triangle moves to the front of the LRU cache.
+        uint32_t NewCount = 0;
+        for(uint32_t k = 0; k < 3; k++) {
+            // Degenerate triangles must not put a vertex into the cache twice.
+            if(std::find(NewCache, NewCache + NewCount, Triangle[k]) == NewCache + NewCount) {
+                NewCache[NewCount++] = Triangle[k];
+            }
+        }
+        for(uint32_t i = 0; i < CacheCount; i++) {
+            const uint32_t Vertex = Cache[i];
+            if(Vertex != Triangle[0] && Vertex != Triangle[1] && Vertex != Triangle[2]) {
+                NewCache[NewCount++] = Vertex;
+            }
+        }
+
+        for(uint32_t i = 0; i < NewCount; i++) {
+            const uint32_t Vertex = NewCache[i];
+            CachePositions[Vertex] = i < ScoringCacheSize ? int32_t(i) : -1;
+
+            const float Score = VertexScore(CachePositions[Vertex], Remaining[Vertex]);
+            const float Delta = Score - VertexScores[Vertex];
+            VertexScores[Vertex] = Score;
+
+            const uint32_t *List = Adjacency.data() + Offsets[Vertex];
+            for(uint32_t j = 0; j < Remaining[Vertex]; j++) {
+                TriangleScores[List[j]] += Delta;
+            }
+        }
+
+        // Only triangles touching the cache are candidates, the rest kept their score.
+        BestTriangle = InvalidIndex;
+        float BestScore = -std::numeric_limits<float>::max();
+        for(uint32_t i = 0; i < std::min(NewCount, ScoringCacheSize); i++) {
+            const uint32_t *List = Adjacency.data() + Offsets[NewCache[i]];
+            for(uint32_t j = 0; j < Remaining[NewCache[i]]; j++) {
+                if(TriangleScores[List[j]] > BestScore) {
+                    BestScore = TriangleScores[List[j]];
+                    BestTriangle = List[j];
+                }
+            }
+        }
+
+        CacheCount = std::min(NewCount, ScoringCacheSize);
+        std::copy(NewCache, NewCache + CacheCount, Cache);
+    }
+
+    std::copy(Result.begin(), Result.end(), Indices.begin());
+}
+
+void FMeshOptimizer::OptimizeOverdraw(
+    std::span<uint32_t> Indices, std::span<const glm::vec3> Positions, float Threshold) {
+    const uint32_t TriangleCount = static_cast<uint32_t>(Indices.size() / 3);
+    const uint32_t VertexCount = static_cast<uint32_t>(Positions.size());
+    constexpr uint32_t CacheSize = 16;
+    if(TriangleCount < 2) { return; }
+
+    // Hard boundaries: triangles where the cache order restarted (all three vertices miss).
+    std::vector<uint32_t> HardClusters;
+    FFifoCache Cache(VertexCount, CacheSize);
+    for(uint32_t t = 0; t < TriangleCount; t++) {
+        uint32_t Misses = 0;
+        for(uint32_t k = 0; k < 3; k++) {
+            Misses += Cache.Access(Indices[t * 3 + k]) ? 1 : 0;
+        }
+        if(t == 0 || Misses == 3) { HardClusters.push_back(t); }
+    }
+    HardClusters.push_back(TriangleCount);
+
+    // Soft boundaries: split hard clusters wherever the prefix ACMR is already within the
+    // threshold, so reordering the pieces costs little vertex reuse.
+    std::vector<uint32_t> Clusters;
+    for(size_t c = 0; c + 1 < HardClusters.size(); c++) {
+        const uint32_t Begin = HardClusters[c];
+        const uint32_t End = HardClusters[c + 1];
+
+        Cache.Reset();
+        uint32_t ClusterMisses = 0;
+        for(uint32_t t = Begin; t < End; t++) {
+            for(uint32_t k = 0; k < 3; k++) {
+                ClusterMisses += Cache.Access(Indices[t * 3 + k]) ? 1 : 0;
+            }
+        }
+        const float ClusterThreshold =
+            Threshold * float(ClusterMisses) / float(End - Begin);
+
+        Clusters.push_back(Begin);
+        Cache.Reset();
+        uint32_t Start = Begin;
+        uint32_t Misses = 0;
+        for(uint32_t t = Begin; t < End; t++) {
+            for(uint32_t k = 0; k < 3; k++) {
+                Misses += Cache.Access(Indices[t * 3 + k]) ? 1 : 0;
+            }
+            if(t + 1 < End && float(Misses) / float(t + 1 - Start) <= ClusterThreshold) {
+                Clusters.push_back(t + 1);
+                Cache.Reset();
+                Start = t + 1;
+                Misses = 0;
+            }
+        }
+    }
+    Clusters.push_back(TriangleCount);
+    const size_t ClusterCount = Clusters.size() - 1;
+    if(ClusterCount < 2) { return; }
+
+    glm::vec3 MeshCentroid(0.0f);
+    for(uint32_t Index: Indices) {
+        MeshCentroid += Positions[Index];
+    }
+    MeshCentroid /= float(Indices.size());
+
+    // Clusters facing away from the mesh center are likely occluders, draw them first.
+    std::vector<float> SortKeys(ClusterCount);
+    for(size_t c = 0; c < ClusterCount; c++) {
+        glm::vec3 Centroid(0.0f);
+        glm::vec3 Normal(0.0f);
+        float Area = 0.0f;
+        for(uint32_t t = Clusters[c]; t < Clusters[c + 1]; t++) {
+            const glm::vec3 &P0 = Positions[Indices[t * 3 + 0]];
+            const glm::vec3 &P1 = Positions[Indices[t * 3 + 1]];
+            const glm::vec3 &P2 = Positions[Indices[t * 3 + 2]];
+            const glm::vec3 Cross = glm::cross(P1 - P0, P2 - P0);
+            const float TriangleArea = glm::length(Cross);
+            Centroid += (P0 + P1 + P2) * (TriangleArea / 3.0f);
+            Normal += Cross;
+            Area += TriangleArea;
+        }
+        Centroid = Area > 0.0f ? Centroid / Area : Positions[Indices[Clusters[c] * 3]];
+        const float NormalLength = glm::length(Normal);
+        Normal = NormalLength > 0.0f ? Normal / NormalLength : glm::vec3(0.0f);
+        SortKeys[c] = glm::dot(Centroid - MeshCentroid, Normal);
+    }
+
+    std::vector<uint32_t> Order(ClusterCount);
+    std::iota(Order.begin(), Order.end(), 0u);
+    std::stable_sort(Order.begin(), Order.end(), [&SortKeys](uint32_t A, uint32_t B) {
+        return SortKeys[A] > SortKeys[B];
+    });
+
+    std::vector<uint32_t> Result;
+    Result.reserve(Indices.size());
+    for(uint32_t c: Order) {
+        Result.insert(
+            Result.end(), Indices.begin() + Clusters[c] * 3,
+            Indices.begin() + Clusters[c + 1] * 3);
+    }
+    std::copy(Result.begin(), Result.end(), Indices.begin());
+}
+
+uint32_t FMeshOptimizer::OptimizeVertexFetch(FMeshData &Mesh) {
+    std::vector<uint32_t> Remap(Mesh.GetVertexCount(), InvalidIndex);
+    uint32_t NextVertex = 0;
+    for(uint32_t &Index: Mesh.Indices) {
+        if(Remap[Index] == InvalidIndex) { Remap[Index] = NextVertex++; }
+        Index = Remap[Index];
+    }
+
+    RemapStream(Mesh.Positions, Remap, NextVertex);
+    RemapStream(Mesh.Normals, Remap, NextVertex);
+    RemapStream(Mesh.Tangents, Remap, NextVertex);
+    RemapStream(Mesh.TexCoords, Remap, NextVertex);
+    return NextVertex;
+}
+
+FMeshOptimizeStats FMeshOptimizer::Optimize(
+    FMeshData &Mesh, const FMeshOptimizeOptions &Options) {
+    FMeshOptimizeStats Stats;
+    Stats.Before =
+        AnalyzeVertexCache(Mesh.Indices, Mesh.GetVertexCount(), Options.StatsCacheSize);
+
+    if(Options.bVertexCache) { OptimizeVertexCache(Mesh.Indices, Mesh.GetVertexCount()); }
+    if(Options.bOverdraw) {
+        OptimizeOverdraw(Mesh.Indices, Mesh.Positions, Options.OverdrawThreshold);
+    }
+    if(Options.bVertexFetch) { OptimizeVertexFetch(Mesh); }
+
+    Stats.After =
+        AnalyzeVertexCache(Mesh.Indices, Mesh.GetVertexCount(), Options.StatsCacheSize);
+    return Stats;
+}
+
+void FMeshOptimizer::OptimizeMeshes(
+    std::span<FMeshData> Meshes, const FMeshOptimizeOptions &Options,
+    std::vector<FMeshOptimizeStats> *OutStats) {
+    std::vector<FMeshOptimizeStats> Stats(Meshes.size());
+    FTaskSystem::Get().ParallelFor(
+        static_cast<uint32_t>(Meshes.size()), 1, [&](uint32_t Begin, uint32_t End) {
+            for(uint32_t i = Begin; i < End; i++) {
+                Stats[i] = Optimize(Meshes[i], Options);
+            }
+        });
+
+    uint64_t TotalBefore = 0;
+    uint64_t TotalAfter = 0;
+    uint64_t TotalTriangles = 0;
+    for(size_t i = 0; i < Meshes.size(); i++) {
+        RE_LOGD(
+            "Mesh '{}': ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}", Meshes[i].Name,
+            Stats[i].Before.ACMR, Stats[i].After.ACMR, Stats[i].Before.ATVR,
+            Stats[i].After.ATVR);
+        TotalBefore += Stats[i].Before.TransformedVertices;
+        TotalAfter += Stats[i].After.TransformedVertices;
+        TotalTriangles += Meshes[i].GetTriangleCount();
+    }
+    if(TotalTriangles > 0) {
+        RE_LOGI(
+            "Optimized {} meshes: ACMR {:.3f} -> {:.3f}", Meshes.size(),
+            double(TotalBefore) / double(TotalTriangles),
+            double(TotalAfter) / double(TotalTriangles));
+    }
+
+    if(OutStats != nullptr) { *OutStats = std::move(Stats); }
+}
+}
@@ -0,0 +1,417 @@
+﻿#include "Asset/MeshSimplifier.h"
+#include "Asset/MeshOptimizer.h"
+#include "Core/Logging.h"
+#include "Core/TaskSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace RE {
+namespace {
+/* Weight of the planes holding open borders in place, relative to the face planes. */
+constexpr double BorderWeight = 10.0;
+/* Each pass collapses an independent set of edges, this bounds degenerate inputs. */
+constexpr uint32_t MaxPasses = 64;
+
+enum class EVertexKind : uint8_t {
+    Interior,
+    /* On an open border, may only collapse along it. */
+    Border,
+    /* Shares its position with other vertices, typically on an attribute seam. */
+    Locked,
+};
+
+/* Sum of squared distances to a set of weighted planes, as A, b, c of p'Ap + 2b'p + c. */
+struct FQuadric {
+    double A00{0.0}, A11{0.0}, A22{0.0}, A01{0.0}, A02{0.0}, A12{0.0};
+    double B0{0.0}, B1{0.0}, B2{0.0};
+    double C{0.0};
+    double Weight{0.0};
+
+    static FQuadric FromPlane(const glm::dvec3 &Normal, double Distance, double Weight) {
+        FQuadric Q;
+        Q.A00 = Weight * Normal.x * Normal.x;
+        Q.A11 = Weight * Normal.y * Normal.y;
+        Q.A22 = Weight * Normal.z * Normal.z;
+        Q.A01 = Weight * Normal.x * Normal.y;
+        Q.A02 = Weight * Normal.x * Normal.z;
+        Q.A12 = Weight * Normal.y * Normal.z;
+        Q.B0 = Weight * Normal.x * Distance;
+        Q.B1 = Weight * Normal.y * Distance;
+        Q.B2 = Weight * Normal.z * Distance;
+        Q.C = Weight * Distance * Distance;
+        Q.Weight = Weight;
+        return Q;
+    }
+
+    void Add(const FQuadric &Other) {
+        A00 += Other.A00;
+        A11 += Other.A11;
+        A22 += Other.A22;
+        A01 += Other.A01;
+        A02 += Other.A02;
+        A12 += Other.A12;
+        B0 += Other.B0;
+        B1 += Other.B1;
+        B2 += Other.B2;
+        C += Other.C;
+        Weight += Other.Weight;
+    }
+
+    double Evaluate(const glm::dvec3 &P) const {
+        const double X = A00 * P.x + A01 * P.y + A02 * P.z + 2.0 * B0;
+        const double Y = A01 * P.x + A11 * P.y + A12 * P.z + 2.0 * B1;
+        const double Z = A02 * P.x + A12 * P.y + A22 * P.z + 2.0 * B2;
+        return std::max(0.0, P.x * X + P.y * Y + P.z * Z + C);
+    }
+};
+
+struct FCollapse {
+    /* Squared distance, averaged over the plane weights of both quadrics. */
+    double Cost;
+    uint32_t From;
+    /* The vertex From's corners are moved to, taken from a triangle on the edge. */
+    uint32_t To;
+};
+
+uint64_t EdgeKey(uint32_t A, uint32_t B) { return (uint64_t(A) << 32) | B; }
+
+/* Collapses map a vertex onto its neighbour, so positions never move. */
+class FSimplifier {
+public:
+    FSimplifier(
+        std::span<const uint32_t> InIndices, std::span<const glm::vec3> InPositions)
+        : Positions(InPositions), Indices(InIndices.begin(), InIndices.end()) {
+        WeldPositions();
+        ClassifyVertices();
+        ComputeQuadrics();
+    }
+
+    float Run(uint32_t TargetIndexCount, float MaxError);
+    std::vector<uint32_t> &GetIndices() { return Indices; }
+
+private:
+    void WeldPositions();
+    void ClassifyVertices();
+    void ComputeQuadrics();
+    void BuildHalfEdges();
+    bool IsBorderEdge(uint32_t A, uint32_t B) const {
+        return !std::binary_search(HalfEdges.begin(), HalfEdges.end(), EdgeKey(B, A));
+    }
+    void BuildAdjacency();
+    bool TryCollapse(const FCollapse &Collapse, uint32_t &InOutRemoved);
+    void ApplyRemap();
+
+    std::span<const glm::vec3> Positions;
+    std::vector<uint32_t> Indices;
+
+    /* Topology works on the first vertex at each position. */
+    std::vector<uint32_t> Welded;
+    std::vector<EVertexKind> Kinds;
+    std::vector<FQuadric> Quadrics;
+
+    /* Rebuilt every pass. */
+    std::vector<uint64_t> HalfEdges;
+    std::vector<uint32_t> AdjacencyOffsets;
+    std::vector<uint32_t> AdjacentTriangles;
+    std::vector<uint8_t> Touched;
+    std::vector<uint32_t> Remap;
+};
+
+void FSimplifier::WeldPositions() {
+    const uint32_t VertexCount = static_cast<uint32_t>(Positions.size());
+    std::vector<uint32_t> Sorted(VertexCount);
+    std::iota(Sorted.begin(), Sorted.end(), 0u);
+    auto Less = [this](uint32_t A, uint32_t B) {
+        const glm::vec3 &PA = Positions[A];
+        const glm::vec3 &PB = Positions[B];
+        if(PA.x != PB.x) { return PA.x < PB.x; }
+        if(PA.y != PB.y) { return PA.y < PB.y; }
+        return PA.z != PB.z ? PA.z < PB.z : A < B;
+    };
+    std::sort(Sorted.begin(), Sorted.end(), Less);
+
+    Welded.resize(VertexCount);
+    Kinds.assign(VertexCount, EVertexKind::Interior);
+    for(uint32_t i = 0; i < VertexCount;) {
+        uint32_t End = i + 1;
+        while(End < VertexCount && Positions[Sorted[End]] == Positions[Sorted[i]]) {
+            End++;
+        }
+        for(uint32_t j = i; j < End; j++) {
+            Welded[Sorted[j]] = Sorted[i];
+            if(End - i > 1) { Kinds[Sorted[j]] = EVertexKind::Locked; }
+        }
+        i = End;
+    }
+}
+
+void FSimplifier::ClassifyVertices() {
+    BuildHalfEdges();
+    for(size_t i = 0; i < Indices.size(); i += 3) {
+        for(int Corner = 0; Corner < 3; Corner++) {
+            const uint32_t A = Welded[Indices[i + Corner]];
+            const uint32_t B = Welded[Indices[i + (Corner + 1) % 3]];
+            if(!IsBorderEdge(A, B)) { continue; }
+            for(uint32_t Vertex: {A, B}) {
+                if(Kinds[Vertex] == EVertexKind::Interior) {
+                    Kinds[Vertex] = EVertexKind::Border;
+                }
+            }
+        }
+    }
+}
+
+void FSimplifier::ComputeQuadrics() {
+    Quadrics.assign(Positions.size(), FQuadric());
+    for(size_t i = 0; i < Indices.size(); i += 3) {
+        const uint32_t V[3] = {
+            Welded[Indices[i]], Welded[Indices[i + 1]], Welded[Indices[i + 2]]};
+        const glm::dvec3 P0(Positions[V[0]]), P1(Positions[V[1]]), P2(Positions[V[2]]);
+        const glm::dvec3 Cross = glm::cross(P1 - P0, P2 - P0);
+        const double Length = glm::length(Cross);
+        if(Length <= 0.0) { continue; }
+        const glm::dvec3 Normal = Cross / Length;
+        // Weighted by area, so large faces dominate the error of their corners.
+        const FQuadric Face =
+            FQuadric::FromPlane(Normal, -glm::dot(Normal, P0), Length * 0.5);
+        for(uint32_t Vertex: V) {
+            Quadrics[Vertex].Add(Face);
+        }
+
+        // Borders get a plane through the edge perpendicular to the face, which keeps
+        // their vertices from sliding inwards.
+        for(int Corner = 0; Corner < 3; Corner++) {
+            const uint32_t A = V[Corner];
+            const uint32_t B = V[(Corner + 1) % 3];
+            if(!IsBorderEdge(A, B)) { continue; }
+            const glm::dvec3 Edge = glm::dvec3(Positions[B]) - glm::dvec3(Positions[A]);
+            const glm::dvec3 Perpendicular = glm::cross(Edge, Normal);
+            const double PerpendicularLength = glm::length(Perpendicular);
+            if(PerpendicularLength <= 0.0) { continue; }
+            const glm::dvec3 BorderNormal = Perpendicular / PerpendicularLength;
+            const FQuadric Border = FQuadric::FromPlane(
+                BorderNormal, -glm::dot(BorderNormal, glm::dvec3(Positions[A])),
+                BorderWeight * glm::dot(Edge, Edge));
+            Quadrics[A].Add(Border);
+            Quadrics[B].Add(Border);
+        }
+    }
+}
+
+void FSimplifier::BuildHalfEdges() {
+    HalfEdges.clear();
+    HalfEdges.reserve(Indices.size());
+    for(size_t i = 0; i < Indices.size(); i += 3) {
+        for(int Corner = 0; Corner < 3; Corner++) {
+            HalfEdges.push_back(EdgeKey(
+                Welded[Indices[i + Corner]], Welded[Indices[i + (Corner + 1) % 3]]));
+        }
+    }
+    std::sort(HalfEdges.begin(), HalfEdges.end());
+}
+
+void FSimplifier::BuildAdjacency() {
+    const size_t VertexCount = Positions.size();
+    AdjacencyOffsets.assign(VertexCount + 1, 0);
+    for(uint32_t Index: Indices) {
+        AdjacencyOffsets[Welded[Index] + 1]++;
+    }
+    for(size_t i = 0; i < VertexCount; i++) {
+        AdjacencyOffsets[i + 1] += AdjacencyOffsets[i];
+    }
+    AdjacentTriangles.resize(Indices.size());
+    std::vector<uint32_t> Cursor(AdjacencyOffsets.begin(), AdjacencyOffsets.end() - 1);
+    for(size_t i = 0; i < Indices.size(); i++) {
+        AdjacentTriangles[Cursor[Welded[Indices[i]]]++] = static_cast<uint32_t>(i / 3);
+    }
+}
+
+bool FSimplifier::TryCollapse(const FCollapse &Collapse, uint32_t &InOutRemoved) {
+    const uint32_t From = Collapse.From;
+    const uint32_t To = Welded[Collapse.To];
+    if(Touched[From] || Touched[To]) { return false; }
+
+    uint32_t Removed = 0;
+    const glm::vec3 &Target = Positions[To];
+    for(uint32_t i = AdjacencyOffsets[From]; i < AdjacencyOffsets[From + 1]; i++) {
+        const uint32_t *Triangle = Indices.data() + size_t(AdjacentTriangles[i]) * 3;
+        glm::vec3 Old[3], New[3];
+        bool bHasTo = false;
+        for(int Corner = 0; Corner < 3; Corner++) {
+            const uint32_t Vertex = Welded[Triangle[Corner]];
+            if(Vertex == To) {
+                // The triangle collapses; the vertex From lands on must be the same one
+                // on all of them or attributes would tear.
+                if(Triangle[Corner] != Collapse.To) { return false; }
+                bHasTo = true;
+            }
+            Old[Corner] = Positions[Vertex];
+            New[Corner] = Vertex == From ? Target : Old[Corner];
+        }
+        if(bHasTo) {
+            Removed++;
+            continue;
+        }
+        const glm::vec3 OldNormal = glm::cross(Old[1] - Old[0], Old[2] - Old[0]);
+        const glm::vec3 NewNormal = glm::cross(New[1] - New[0], New[2] - New[0]);
+        // Beyond flips, reject turning a face by more than about 75 degrees; slivers
+        // standing up against locked vertices pass a plain sign test.
+        const float Limit = 0.25f * glm::length(OldNormal) * glm::length(NewNormal);
+        if(glm::dot(OldNormal, NewNormal) <= Limit) { return false; }
+    }
+
+    // Nothing around the collapse may change again in this pass, so the adjacency and
+    // flip tests stay valid.
+    for(uint32_t i = AdjacencyOffsets[From]; i < AdjacencyOffsets[From + 1]; i++) {
+        const uint32_t *Triangle = Indices.data() + size_t(AdjacentTriangles[i]) * 3;
+        for(int Corner = 0; Corner < 3; Corner++) {
+            Touched[Welded[Triangle[Corner]]] = 1;
+        }
+    }
+    Remap[From] = Collapse.To;
+    Quadrics[To].Add(Quadrics[From]);
+    InOutRemoved += Removed;
+    return true;
+}
+
+void FSimplifier::ApplyRemap() {
+    size_t Write = 0;
+    for(size_t i = 0; i < Indices.size(); i += 3) {
+        const uint32_t A = Remap[Indices[i]];
+        const uint32_t B = Remap[Indices[i + 1]];
+        const uint32_t C = Remap[Indices[i + 2]];
+        if(Welded[A] == Welded[B] || Welded[B] == Welded[C] || Welded[A] == Welded[C]) {
+            continue;
+        }
+        Indices[Write++] = A;
+        Indices[Write++] = B;
+        Indices[Write++] = C;
+    }
+    Indices.resize(Write);
+}
+
+float FSimplifier::Run(uint32_t TargetIndexCount, float MaxError) {
+    const double MaxCost = double(MaxError) * double(MaxError);
+    const uint32_t TargetTriangles = TargetIndexCount / 3;
+    Remap.resize(Positions.size());
+    std::iota(Remap.begin(), Remap.end(), 0u);
+
+    float Error = 0.0f;
+    std::vector<FCollapse> Collapses;
+    for(uint32_t Pass = 0; Pass < MaxPasses; Pass++) {
+        const uint32_t TriangleCount = static_cast<uint32_t>(Indices.size() / 3);
+        if(TriangleCount <= TargetTriangles) { break; }
+        if(Pass > 0) { BuildHalfEdges(); }
+        BuildAdjacency();
+
+        Collapses.clear();
+        for(size_t i = 0; i < Indices.size(); i += 3) {
+            for(int Corner = 0; Corner < 3; Corner++) {
+                const uint32_t CornerA = Indices[i + Corner];
+                const uint32_t CornerB = Indices[i + (Corner + 1) % 3];
+                const uint32_t A = Welded[CornerA];
+                const uint32_t B = Welded[CornerB];
+                const bool bBorderEdge = IsBorderEdge(A, B);
+                for(int Direction = 0; Direction < 2; Direction++) {
+                    const uint32_t From = Direction == 0 ? A : B;
+                    const uint32_t To = Direction == 0 ? CornerB : CornerA;
+                    const EVertexKind Kind = Kinds[From];
+                    if(Kind == EVertexKind::Locked ||
+                       (Kind == EVertexKind::Border && !bBorderEdge)) {
+                        continue;
+                    }
+                    FQuadric Q = Quadrics[From];
+                    Q.Add(Quadrics[Welded[To]]);
+                    const double Cost = Q.Weight > 0.0
+                        ? Q.Evaluate(glm::dvec3(Positions[To])) / Q.Weight : 0.0;
+                    if(Cost <= MaxCost) { Collapses.push_back({Cost, From, To}); }
+                }
+            }
+        }
+        if(Collapses.empty()) { break; }
+        std::sort(
+            Collapses.begin(), Collapses.end(),
+            [](const FCollapse &A, const FCollapse &B) { return A.Cost < B.Cost; });
+
+        Touched.assign(Positions.size(), 0);
+        const uint32_t ToRemove = TriangleCount - TargetTriangles;
+        uint32_t Removed = 0;
+        uint32_t Collapsed = 0;
+        for(const FCollapse &Collapse: Collapses) {
+            if(Removed >= ToRemove) { break; }
+            if(!TryCollapse(Collapse, Removed)) { continue; }
+            Error = std::max(Error, float(std::sqrt(Collapse.Cost)));
+            Collapsed++;
+        }
+        if(Collapsed == 0) { break; }
+        ApplyRemap();
+        std::iota(Remap.begin(), Remap.end(), 0u);
+    }
+    return Error;
+}
+}
+
+float FMeshSimplifier::Simplify(
+    std::span<const uint32_t> Indices, std::span<const glm::vec3> Positions,
+    uint32_t TargetIndexCount, float MaxError, std::vector<uint32_t> &OutIndices) {
+    FSimplifier Simplifier(Indices, Positions);
+    const float Error = Simplifier.Run(TargetIndexCount, MaxError);
+    OutIndices = std::move(Simplifier.GetIndices());
+    return Error;
+}
+
+void FMeshSimplifier::BuildLods(FMeshData &Mesh, const FMeshLodOptions &Options) {
+    Mesh.Lods.clear();
+    Mesh.Lods.reserve(Options.MaxLods);
+    const float MaxError =
+        Options.MaxError * glm::length(Mesh.BoundsMax - Mesh.BoundsMin);
+
+    std::span<const uint32_t> Source = Mesh.Indices;
+    float Error = 0.0f;
+    for(uint32_t Level = 0; Level < Options.MaxLods; Level++) {
+        const uint32_t SourceTriangles = static_cast<uint32_t>(Source.size() / 3);
+        const uint32_t TargetTriangles =
+            uint32_t(float(SourceTriangles) * Options.TriangleRatio);
+        if(TargetTriangles < Options.MinTriangles || Error >= MaxError) { break; }
+
+        FMeshLod Lod;
+        const float LevelError = Simplify(
+            Source, Mesh.Positions, TargetTriangles * 3, MaxError - Error, Lod.Indices);
+        // Levels that barely shrink, held back by the error budget or locked vertices,
+        // cost memory without saving vertex work.
+        if(Lod.Indices.empty() || Lod.Indices.size() > Source.size() * 9 / 10) { break; }
+
+        FMeshOptimizer::OptimizeVertexCache(Lod.Indices, Mesh.GetVertexCount());
+        // Each level is simplified from the previous one, so their errors add up.
+        Error += LevelError;
+        Lod.Error = Error;
+        Mesh.Lods.push_back(std::move(Lod));
+        Source = Mesh.Lods.back().Indices;
+    }
+}
+
+void FMeshSimplifier::BuildMeshLods(
+    std::span<FMeshData> Meshes, const FMeshLodOptions &Options) {
+    FTaskSystem::Get().ParallelFor(
+        static_cast<uint32_t>(Meshes.size()), 1, [&](uint32_t Begin, uint32_t End) {
+            for(uint32_t i = Begin; i < End; i++) {
+                BuildLods(Meshes[i], Options);
+            }
+        });
+
+    size_t LodCount = 0;
+    for(const FMeshData &Mesh: Meshes) {
+        LodCount += Mesh.Lods.size();
+        for(size_t Level = 0; Level < Mesh.Lods.size(); Level++) {
+            RE_LOGD(
+                "Mesh '{}': LOD {} has {} triangles, error {:.4f}", Mesh.Name, Level + 1,
+                Mesh.Lods[Level].Indices.size() / 3, Mesh.Lods[Level].Error);
+        }
+    }
+    if(LodCount > 0) {
+        RE_LOGI("Generated {} LODs for {} meshes", LodCount, Meshes.size());
+    }
+}
+}
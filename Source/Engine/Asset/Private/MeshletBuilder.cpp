@@ -0,0 +1,231 @@
+#include "Asset/MeshletBuilder.h"
+#include "Core/Logging.h"
+#include "Core/TaskSystem.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace RE {
+namespace {
+constexpr uint8_t NotInMeshlet = 0xFF;
+
+/* Vertex to triangle adjacency in CSR form. */
+struct FTriangleAdjacency {
+    std::vector<uint32_t> Offsets;
+    std::vector<uint32_t> Triangles;
+
+    FTriangleAdjacency(std::span<const uint32_t> Indices, uint32_t VertexCount)
+        : Offsets(VertexCount + 1, 0), Triangles(Indices.size()) {
+        for(uint32_t Index: Indices) {
+            Offsets[Index + 1]++;
+        }
+        for(uint32_t i = 0; i < VertexCount; i++) {
+            Offsets[i + 1] += Offsets[i];
+        }
+        std::vector<uint32_t> Cursor(Offsets.begin(), Offsets.end() - 1);
+        for(size_t i = 0; i < Indices.size(); i++) {
+            Triangles[Cursor[Indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+};
+
+class FMeshletWriter {
+public:
+    FMeshletWriter(FMeshletData &Out, uint32_t VertexCount)
+        : Out(Out), LocalIndex(VertexCount, NotInMeshlet) {}
+
+    uint32_t CountNewVertices(const uint32_t *Triangle) const {
+        return uint32_t(LocalIndex[Triangle[0]] == NotInMeshlet) +
+               uint32_t(LocalIndex[Triangle[1]] == NotInMeshlet) +
+               uint32_t(LocalIndex[Triangle[2]] == NotInMeshlet);
+    }
+
+    void Add(const uint32_t *Triangle) {
+        for(int i = 0; i < 3; i++) {
+            uint8_t &Local = LocalIndex[Triangle[i]];
+            if(Local == NotInMeshlet) {
+                Local = static_cast<uint8_t>(Current.VertexCount++);
+                Out.Vertices.push_back(Triangle[i]);
+            }
+            Out.Triangles.push_back(Local);
+        }
+        Current.TriangleCount++;
+    }
+
+    void Flush() {
+        if(Current.TriangleCount == 0) { return; }
+        for(uint32_t i = 0; i < Current.VertexCount; i++) {
+            LocalIndex[Out.Vertices[Current.VertexOffset + i]] = NotInMeshlet;
+        }
+        // Mesh shaders write primitive indices four at a time.
+        Out.Triangles.resize((Out.Triangles.size() + 3) & ~size_t(3), 0);
+        Out.Meshlets.push_back(Current);
+
+        Current = {};
+        Current.VertexOffset = static_cast<uint32_t>(Out.Vertices.size());
+        Current.TriangleOffset = static_cast<uint32_t>(Out.Triangles.size());
+    }
+
+    const FMeshlet &GetCurrent() const { return Current; }
+    std::span<const uint32_t> GetCurrentVertices() const {
+        return std::span(Out.Vertices).subspan(Current.VertexOffset, Current.VertexCount);
+    }
+
+private:
+    FMeshletData &Out;
+    std::vector<uint8_t> LocalIndex;
+    FMeshlet Current{};
+};
+}
+
+void FMeshletBuilder::Build(
+    std::span<const uint32_t> Indices, std::span<const glm::vec3> Positions,
+    FMeshletData &Out, uint32_t MaxVertices, uint32_t MaxTriangles) {
+    Out = {};
+    MaxVertices = std::clamp(MaxVertices, 3u, uint32_t(NotInMeshlet));
+    MaxTriangles = std::max(MaxTriangles, 1u);
+
+    const uint32_t VertexCount = static_cast<uint32_t>(Positions.size());
+    const uint32_t TriangleCount = static_cast<uint32_t>(Indices.size() / 3);
+    if(TriangleCount == 0) { return; }
+
+    const FTriangleAdjacency Adjacency(Indices.first(TriangleCount * 3), VertexCount);
+    std::vector<bool> Emitted(TriangleCount, false);
+    FMeshletWriter Writer(Out, VertexCount);
+
+    uint32_t NextSeed = 0;
+    for(uint32_t Emit = 0; Emit < TriangleCount; Emit++) {
+        // Prefer the neighbour adding the fewest vertices, ties go to the earlier triangle
+        // which keeps the vertex cache friendly order of the input.
+        uint32_t Best = std::numeric_limits<uint32_t>::max();
+        uint32_t BestNew = 4;
+        for(uint32_t Vertex: Writer.GetCurrentVertices()) {
+            for(uint32_t i = Adjacency.Offsets[Vertex]; i < Adjacency.Offsets[Vertex + 1];
+                i++) {
+                const uint32_t Triangle = Adjacency.Triangles[i];
+                if(Emitted[Triangle]) { continue; }
+                const uint32_t New = Writer.CountNewVertices(&Indices[Triangle * 3]);
+                if(New < BestNew || (New == BestNew && Triangle < Best)) {
+                    Best = Triangle;
+                    BestNew = New;
+                }
+            }
+        }
+
+        if(Best == std::numeric_limits<uint32_t>::max()) {
+            while(Emitted[NextSeed]) {
+                NextSeed++;
+            }
+            Best = NextSeed;
+            BestNew = Writer.CountNewVertices(&Indices[Best * 3]);
+        }
+
+        const FMeshlet &Current = Writer.GetCurrent();
+        if(Current.VertexCount + BestNew > MaxVertices ||
+           Current.TriangleCount + 1 > MaxTriangles) {
+            Writer.Flush();
+            // Restart from the earliest remaining triangle rather than a random neighbour.
+            while(Emitted[NextSeed]) {
+                NextSeed++;
+            }
+            Best = NextSeed;
+        }
+
+        Writer.Add(&Indices[Best * 3]);
+        Emitted[Best] = true;
+    }
+    Writer.Flush();
+
+    Out.Bounds.reserve(Out.Meshlets.size());
+    for(const FMeshlet &Meshlet: Out.Meshlets) {
+        Out.Bounds.push_back(ComputeBounds(Out, Meshlet, Positions));
+    }
+}
+
+FMeshletBounds FMeshletBuilder::ComputeBounds(
+    const FMeshletData &Data, const FMeshlet &Meshlet,
+    std::span<const glm::vec3> Positions) {
+    FMeshletBounds Bounds;
+    if(Meshlet.VertexCount == 0) { return Bounds; }
+
+    const uint32_t *Vertices = &Data.Vertices[Meshlet.VertexOffset];
+    glm::vec3 Min = Positions[Vertices[0]];
+    glm::vec3 Max = Min;
+    for(uint32_t i = 1; i < Meshlet.VertexCount; i++) {
+        Min = glm::min(Min, Positions[Vertices[i]]);
+        Max = glm::max(Max, Positions[Vertices[i]]);
+    }
+    Bounds.Center = (Min + Max) * 0.5f;
+    for(uint32_t i = 0; i < Meshlet.VertexCount; i++) {
+        Bounds.Radius =
+            std::max(Bounds.Radius, glm::distance(Bounds.Center, Positions[Vertices[i]]));
+    }
+
+    // Normal cone from the area weighted average of the triangle normals.
+    std::vector<glm::vec3> Normals;
+    Normals.reserve(Meshlet.TriangleCount);
+    glm::vec3 AxisSum(0.0f);
+    for(uint32_t i = 0; i < Meshlet.TriangleCount; i++) {
+        const uint8_t *Triangle = &Data.Triangles[Meshlet.TriangleOffset + i * 3];
+        const glm::vec3 &A = Positions[Vertices[Triangle[0]]];
+        const glm::vec3 &B = Positions[Vertices[Triangle[1]]];
+        const glm::vec3 &C = Positions[Vertices[Triangle[2]]];
+        const glm::vec3 Cross = glm::cross(B - A, C - A);
+        const float Length = glm::length(Cross);
+        if(Length <= 0.0f) { continue; }
+        AxisSum += Cross;
+        Normals.push_back(Cross / Length);
+    }
+
+    const float AxisLength = glm::length(AxisSum);
+    if(Normals.empty() || AxisLength <= 0.0f) { return Bounds; }
+    Bounds.ConeAxis = AxisSum / AxisLength;
+
+    float MinDot = 1.0f;
+    for(const glm::vec3 &Normal: Normals) {
+        MinDot = std::min(MinDot, glm::dot(Normal, Bounds.ConeAxis));
+    }
+    // Wider than ~84 degrees the cone rejects almost nothing, keep the test disabled.
+    if(MinDot <= 0.1f) {
+        Bounds.ConeApex = Bounds.Center;
+        return Bounds;
+    }
+
+    // Move the apex back along the axis until every triangle plane lies in front of it.
+    float MaxT = 0.0f;
+    for(uint32_t i = 0, n = 0; i < Meshlet.TriangleCount; i++) {
+        const uint8_t *Triangle = &Data.Triangles[Meshlet.TriangleOffset + i * 3];
+        const glm::vec3 &A = Positions[Vertices[Triangle[0]]];
+        const glm::vec3 &B = Positions[Vertices[Triangle[1]]];
+        const glm::vec3 &C = Positions[Vertices[Triangle[2]]];
+        if(glm::length(glm::cross(B - A, C - A)) <= 0.0f) { continue; }
+        const glm::vec3 &Normal = Normals[n++];
+        MaxT = std::max(
+            MaxT, glm::dot(Bounds.Center - A, Normal) / glm::dot(Bounds.ConeAxis, Normal));
+    }
+    Bounds.ConeApex = Bounds.Center - Bounds.ConeAxis * MaxT;
+    Bounds.ConeCutoff = std::sqrt(1.0f - MinDot * MinDot);
+    return Bounds;
+}
+
+void FMeshletBuilder::BuildMeshes(std::span<FMeshData> Meshes) {
+    FTaskSystem::Get().ParallelFor(
+        static_cast<uint32_t>(Meshes.size()), 1, [&](uint32_t Begin, uint32_t End) {
+            for(uint32_t i = Begin; i < End; i++) {
+                Build(Meshes[i].Indices, Meshes[i].Positions, Meshes[i].Meshlets);
+            }
+        });
+
+    size_t MeshletCount = 0;
+    size_t TriangleCount = 0;
+    for(const FMeshData &Mesh: Meshes) {
+        MeshletCount += Mesh.Meshlets.Meshlets.size();
+        TriangleCount += Mesh.GetTriangleCount();
+    }
+    if(MeshletCount > 0) {
+        RE_LOGI(
+            "Built {} meshlets for {} meshes, {:.1f} triangles per meshlet", MeshletCount,
+            Meshes.size(), double(TriangleCount) / double(MeshletCount));
+    }
+}
+}
@@ -0,0 +1,6 @@
+﻿// tiny_gltf.h only includes <fstream> itself when TINYGLTF_NO_FS is not set, but its writer
+// code needs it regardless.
+#include <fstream>
+
+#define TINYGLTF_IMPLEMENTATION
+#include <tiny_gltf.h>
@@ -0,0 +1,245 @@
+﻿#include "Asset/VertexFormat.h"
+#include "Core/Logging.h"
+#include "Core/TaskSystem.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <glm/gtc/packing.hpp>
+
+namespace RE {
+namespace {
+EVertexAttributeFormat GetPositionFormat(EPositionEncoding Encoding) {
+    switch(Encoding) {
+        case EPositionEncoding::Unorm16: return EVertexAttributeFormat::Unorm16x4;
+        default: return EVertexAttributeFormat::Float32x3;
+    }
+}
+
+EVertexAttributeFormat GetDirectionFormat(EDirectionEncoding Encoding, bool bTangent) {
+    switch(Encoding) {
+        case EDirectionEncoding::Octahedral16: return EVertexAttributeFormat::Snorm16x2;
+        case EDirectionEncoding::Octahedral8: return EVertexAttributeFormat::Snorm8x2;
+        default:
+            return bTangent ? EVertexAttributeFormat::Float32x4
+                            : EVertexAttributeFormat::Float32x3;
+    }
+}
+
+EVertexAttributeFormat GetTexCoordFormat(ETexCoordEncoding Encoding) {
+    switch(Encoding) {
+        case ETexCoordEncoding::Half16: return EVertexAttributeFormat::Half16x2;
+        case ETexCoordEncoding::Unorm16: return EVertexAttributeFormat::Unorm16x2;
+        default: return EVertexAttributeFormat::Float32x2;
+    }
+}
+
+uint16_t QuantizeUnorm16(float Value) {
+    return static_cast<uint16_t>(std::clamp(Value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+template<typename T>
+void Store(uint8_t *Dst, const T &Value) {
+    std::memcpy(Dst, &Value, sizeof(T));
+}
+
+/* Octahedral encoding in the requested precision; the sign of the tangent w is stored
+ * with the position so a compact tangent needs no extra component. */
+void StoreDirection(
+    uint8_t *Dst, EVertexAttributeFormat Format, const glm::vec4 &Direction) {
+    switch(Format) {
+        case EVertexAttributeFormat::Snorm16x2:
+            Store(Dst, glm::packSnorm<int16_t>(
+                           FVertexEncoder::EncodeOctahedral(glm::vec3(Direction))));
+            break;
+        case EVertexAttributeFormat::Snorm8x2:
+            Store(Dst, glm::packSnorm<int8_t>(
+                           FVertexEncoder::EncodeOctahedral(glm::vec3(Direction))));
+            break;
+        case EVertexAttributeFormat::Float32x3: Store(Dst, glm::vec3(Direction)); break;
+        case EVertexAttributeFormat::Float32x4: Store(Dst, Direction); break;
+        default: break;
+    }
+}
+}
+
+bool FVertexLayout::IsQuantized() const {
+    for(const FVertexAttribute &Attribute: Attributes) {
+        switch(Attribute.Format) {
+            case EVertexAttributeFormat::None:
+            case EVertexAttributeFormat::Float32x2:
+            case EVertexAttributeFormat::Float32x3:
+            case EVertexAttributeFormat::Float32x4: break;
+            default: return true;
+        }
+    }
+    return false;
+}
+
+FVertexLayout FVertexLayout::Create(
+    const FMeshData &Mesh, const FVertexFormatOptions &Options) {
+    FVertexLayout Layout;
+    auto Add = [&Layout](EVertexSemantic Semantic, EVertexAttributeFormat Format) {
+        Layout.Attributes[size_t(Semantic)] = {Semantic, Format, Layout.Stride};
+        Layout.Stride += FVertexEncoder::GetFormatSize(Format);
+    };
+
+    // Largest attributes first keeps every attribute naturally aligned.
+    Add(EVertexSemantic::Position, GetPositionFormat(Options.Position));
+    if(!Mesh.Tangents.empty()) {
+        // The bitangent sign of an octahedral tangent lives in the quantized position.
+        const EDirectionEncoding TangentEncoding =
+            Options.Position == EPositionEncoding::Unorm16 ? Options.Tangent
+                                                           : EDirectionEncoding::Float32;
+        Add(EVertexSemantic::Tangent, GetDirectionFormat(TangentEncoding, true));
+    }
+    if(!Mesh.Normals.empty()) {
+        Add(EVertexSemantic::Normal, GetDirectionFormat(Options.Normal, false));
+    }
+    if(!Mesh.TexCoords.empty()) {
+        Add(EVertexSemantic::TexCoord, GetTexCoordFormat(Options.TexCoord));
+    }
+
+    // Vertex buffer strides must stay 4 byte aligned for the 8 bit octahedral format.
+    Layout.Stride = (Layout.Stride + 3) & ~3u;
+    return Layout;
+}
+
+uint32_t FVertexEncoder::GetFormatSize(EVertexAttributeFormat Format) {
+    switch(Format) {
+        case EVertexAttributeFormat::Float32x2: return 8;
+        case EVertexAttributeFormat::Float32x3: return 12;
+        case EVertexAttributeFormat::Float32x4: return 16;
+        case EVertexAttributeFormat::Unorm16x4: return 8;
+        case EVertexAttributeFormat::Snorm16x2: return 4;
+        case EVertexAttributeFormat::Snorm8x2: return 2;
+        case EVertexAttributeFormat::Half16x2: return 4;
+        case EVertexAttributeFormat::Unorm16x2: return 4;
+        default: return 0;
+    }
+}
+
+glm::vec2 FVertexEncoder::EncodeOctahedral(const glm::vec3 &Direction) {
+    const float L1 = std::abs(Direction.x) + std::abs(Direction.y) + std::abs(Direction.z);
+    if(L1 <= 0.0f) { return glm::vec2(0.0f); }
+
+    glm::vec2 Result = glm::vec2(Direction) / L1;
+    if(Direction.z < 0.0f) {
+        // Fold the lower hemisphere over the diagonals.
+        const glm::vec2 Sign(
+            Result.x >= 0.0f ? 1.0f : -1.0f, Result.y >= 0.0f ? 1.0f : -1.0f);
+        Result = (1.0f - glm::abs(glm::vec2(Result.y, Result.x))) * Sign;
+    }
+    return Result;
+}
+
+glm::vec3 FVertexEncoder::DecodeOctahedral(const glm::vec2 &Encoded) {
+    glm::vec3 Result(Encoded, 1.0f - std::abs(Encoded.x) - std::abs(Encoded.y));
+    const float T = std::max(-Result.z, 0.0f);
+    Result.x += Result.x >= 0.0f ? -T : T;
+    Result.y += Result.y >= 0.0f ? -T : T;
+    return glm::normalize(Result);
+}
+
+void FVertexEncoder::Encode(
+    const FMeshData &Mesh, const FVertexFormatOptions &Options, FEncodedVertexData &Out) {
+    Out.Layout = FVertexLayout::Create(Mesh, Options);
+    Out.VertexCount = Mesh.GetVertexCount();
+    Out.Vertices.assign(size_t(Out.VertexCount) * Out.Layout.Stride, 0);
+    Out.Quantization = {};
+
+    glm::vec3 BoundsMin = Mesh.BoundsMin;
+    glm::vec3 BoundsMax = Mesh.BoundsMax;
+    if(glm::any(glm::greaterThan(BoundsMin, BoundsMax))) {
+        BoundsMin = BoundsMax = glm::vec3(0.0f);
+    }
+    const glm::vec3 PositionExtent = glm::max(BoundsMax - BoundsMin, glm::vec3(1e-8f));
+    Out.Quantization.PositionOffset = glm::vec4(BoundsMin, 0.0f);
+    Out.Quantization.PositionScale = glm::vec4(PositionExtent, 1.0f);
+
+    glm::vec2 UVMin(0.0f);
+    glm::vec2 UVMax(1.0f);
+    if(!Mesh.TexCoords.empty()) {
+        UVMin = UVMax = Mesh.TexCoords[0];
+        for(const glm::vec2 &UV: Mesh.TexCoords) {
+            UVMin = glm::min(UVMin, UV);
+            UVMax = glm::max(UVMax, UV);
+        }
+    }
+    const glm::vec2 UVExtent = glm::max(UVMax - UVMin, glm::vec2(1e-8f));
+    Out.Quantization.TexCoordOffsetScale = glm::vec4(UVMin, UVExtent);
+
+    const FVertexAttribute &Position = Out.Layout.Get(EVertexSemantic::Position);
+    const FVertexAttribute &Normal = Out.Layout.Get(EVertexSemantic::Normal);
+    const FVertexAttribute &Tangent = Out.Layout.Get(EVertexSemantic::Tangent);
+    const FVertexAttribute &TexCoord = Out.Layout.Get(EVertexSemantic::TexCoord);
+
+    for(uint32_t i = 0; i < Out.VertexCount; i++) {
+        uint8_t *Vertex = Out.Vertices.data() + size_t(i) * Out.Layout.Stride;
+
+        if(Position.Format == EVertexAttributeFormat::Unorm16x4) {
+            const glm::vec3 Normalized = (Mesh.Positions[i] - BoundsMin) / PositionExtent;
+            const bool bNegativeBitangent =
+                !Mesh.Tangents.empty() && Mesh.Tangents[i].w < 0.0f;
+            const std::array<uint16_t, 4> Packed{
+                QuantizeUnorm16(Normalized.x), QuantizeUnorm16(Normalized.y),
+                QuantizeUnorm16(Normalized.z), uint16_t(bNegativeBitangent ? 0 : 65535)};
+            Store(Vertex + Position.Offset, Packed);
+        } else {
+            Store(Vertex + Position.Offset, Mesh.Positions[i]);
+        }
+
+        if(Normal.Format != EVertexAttributeFormat::None) {
+            StoreDirection(
+                Vertex + Normal.Offset, Normal.Format, glm::vec4(Mesh.Normals[i], 0.0f));
+        }
+        if(Tangent.Format != EVertexAttributeFormat::None) {
+            StoreDirection(Vertex + Tangent.Offset, Tangent.Format, Mesh.Tangents[i]);
+        }
+
+        const glm::vec2 UV = Mesh.TexCoords.empty() ? glm::vec2(0.0f) : Mesh.TexCoords[i];
+        switch(TexCoord.Format) {
+            case EVertexAttributeFormat::Half16x2:
+                Store(Vertex + TexCoord.Offset, glm::packHalf2x16(UV));
+                break;
+            case EVertexAttributeFormat::Unorm16x2: {
+                const glm::vec2 Normalized = (UV - UVMin) / UVExtent;
+                const std::array<uint16_t, 2> Packed{
+                    QuantizeUnorm16(Normalized.x), QuantizeUnorm16(Normalized.y)};
+                Store(Vertex + TexCoord.Offset, Packed);
+                break;
+            }
+            case EVertexAttributeFormat::Float32x2:
+                Store(Vertex + TexCoord.Offset, UV);
+                break;
+            default: break;
+        }
+    }
+}
+
+void FVertexEncoder::EncodeMeshes(
+    std::span<const FMeshData> Meshes, const FVertexFormatOptions &Options,
+    std::vector<FEncodedVertexData> &Out) {
+    Out.resize(Meshes.size());
+    FTaskSystem::Get().ParallelFor(
+        static_cast<uint32_t>(Meshes.size()), 1, [&](uint32_t Begin, uint32_t End) {
+            for(uint32_t i = Begin; i < End; i++) {
+                Encode(Meshes[i], Options, Out[i]);
+            }
+        });
+
+    uint64_t FullBytes = 0;
+    uint64_t EncodedBytes = 0;
+    for(size_t i = 0; i < Meshes.size(); i++) {
+        FullBytes += uint64_t(Meshes[i].GetVertexCount()) *
+                     FVertexLayout::Create(Meshes[i], FVertexFormatOptions::Full()).Stride;
+        EncodedBytes += Out[i].Vertices.size();
+    }
+    if(FullBytes > 0) {
+        RE_LOGI(
+            "Encoded {} meshes: vertex data {} KiB -> {} KiB ({:.1f}%)", Meshes.size(),
+            FullBytes / 1024, EncodedBytes / 1024,
+            100.0 * double(EncodedBytes) / double(FullBytes));
+    }
+}
+}
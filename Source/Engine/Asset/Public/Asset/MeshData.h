@@ -0,0 +1,43 @@
+﻿#pragma once
+#include "re-asset_export.h"
+#include "Asset/Meshlet.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace RE {
+/* A simplified index list over the vertices of the full detail mesh. */
+struct FMeshLod {
+    std::vector<uint32_t> Indices;
+    /* Upper bound of the object space distance to the full detail surface. */
+    float Error{0.0f};
+};
+
+/* One triangle list with de-interleaved vertex streams, as produced by the importer. */
+struct FMeshData {
+    std::string Name;
+    uint32_t MaterialIndex{0};
+
+    std::vector<glm::vec3> Positions;
+    std::vector<glm::vec3> Normals;
+    std::vector<glm::vec4> Tangents;
+    std::vector<glm::vec2> TexCoords;
+    std::vector<uint32_t> Indices;
+
+    /* Built from the final index order, empty unless requested at import. */
+    FMeshletData Meshlets;
+    /* Successively coarser levels after Indices, empty unless requested at import. */
+    std::vector<FMeshLod> Lods;
+
+    glm::vec3 BoundsMin{0.0f};
+    glm::vec3 BoundsMax{0.0f};
+
+    uint32_t GetVertexCount() const { return static_cast<uint32_t>(Positions.size()); }
+    uint32_t GetTriangleCount() const { return static_cast<uint32_t>(Indices.size() / 3); }
+
+    void ComputeBounds();
+};
+}
@@ -0,0 +1,27 @@
+﻿#pragma once
+#include "re-asset_export.h"
+#include "Asset/MeshData.h"
+#include "Asset/MeshOptimizer.h"
+#include "Asset/MeshSimplifier.h"
+
+#include <string_view>
+
+namespace RE {
+struct FMeshImportOptions {
+    bool bOptimize{true};
+    FMeshOptimizeOptions Optimize;
+    /* Simplify every mesh into a LOD chain, after optimization and before meshlets. */
+    bool bGenerateLods{true};
+    FMeshLodOptions Lods;
+    /* Split every mesh into meshlets for cluster culling, after optimization. */
+    bool bBuildMeshlets{true};
+};
+
+/* Loads the triangle primitives of a glTF/GLB file from the VFS, one FMeshData each. */
+class RE_ASSET_EXPORT FMeshImporter {
+public:
+    static bool Import(
+        std::string_view Path, const FMeshImportOptions &Options,
+        std::vector<FMeshData> &OutMeshes);
+};
+}
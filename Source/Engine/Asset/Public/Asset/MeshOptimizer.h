@@ -0,0 +1,57 @@
+﻿#pragma once
+#include "re-asset_export.h"
+#include "Asset/MeshData.h"
+
+#include <span>
+
+namespace RE {
+struct FVertexCacheStats {
+    /* Average cache miss ratio: transformed vertices per triangle, 0.5 is the ideal. */
+    float ACMR{0.0f};
+    /* Average transform to vertex ratio: transformed vertices per unique vertex, 1 is ideal. */
+    float ATVR{0.0f};
+    uint32_t TransformedVertices{0};
+};
+
+struct FMeshOptimizeOptions {
+    bool bVertexCache{true};
+    bool bOverdraw{true};
+    bool bVertexFetch{true};
+    /* ACMR the overdraw pass may give up relative to the cache optimized order. */
+    float OverdrawThreshold{1.05f};
+    /* FIFO size used when reporting statistics, typical for current hardware. */
+    uint32_t StatsCacheSize{16};
+};
+
+struct FMeshOptimizeStats {
+    FVertexCacheStats Before;
+    FVertexCacheStats After;
+};
+
+/*
+ * Import time index and vertex reordering. Vertex cache ordering follows Forsyth's linear
+ * speed algorithm, overdraw ordering follows Sander et al. (clusters sorted by how much they
+ * face away from the mesh center) and fetch ordering lays vertices out in first-use order.
+ */
+class RE_ASSET_EXPORT FMeshOptimizer {
+public:
+    static FVertexCacheStats AnalyzeVertexCache(
+        std::span<const uint32_t> Indices, uint32_t VertexCount, uint32_t CacheSize);
+
+    static void OptimizeVertexCache(std::span<uint32_t> Indices, uint32_t VertexCount);
+
+    /* Expects Indices to be vertex cache optimized already. */
+    static void OptimizeOverdraw(
+        std::span<uint32_t> Indices, std::span<const glm::vec3> Positions, float Threshold);
+
+    /* Reorders and compacts every vertex stream of Mesh, returns the new vertex count. */
+    static uint32_t OptimizeVertexFetch(FMeshData &Mesh);
+
+    static FMeshOptimizeStats Optimize(FMeshData &Mesh, const FMeshOptimizeOptions &Options);
+
+    /* Optimizes meshes in parallel on the task system and logs per mesh ACMR/ATVR. */
+    static void OptimizeMeshes(
+        std::span<FMeshData> Meshes, const FMeshOptimizeOptions &Options,
+        std::vector<FMeshOptimizeStats> *OutStats = nullptr);
+};
+}
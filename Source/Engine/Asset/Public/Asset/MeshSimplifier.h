@@ -0,0 +1,43 @@
+﻿#pragma once
+#include "re-asset_export.h"
+#include "Asset/MeshData.h"
+
+#include <span>
+
+namespace RE {
+struct FMeshLodOptions {
+    /* Levels generated after the full detail mesh. */
+    uint32_t MaxLods{4};
+    /* Target triangle count of each level relative to the one before. */
+    float TriangleRatio{0.5f};
+    /* Error budget of the whole chain relative to the diagonal of the mesh bounds. */
+    float MaxError{0.05f};
+    /* No level is generated below this many triangles. */
+    uint32_t MinTriangles{32};
+};
+
+/*
+ * Quadric error edge collapse after Garland and Heckbert. Vertices only collapse onto
+ * their neighbours, so every level indexes the original vertex streams. Open borders may
+ * only collapse along themselves, and vertices split by attribute seams stay in place so
+ * texture coordinates and normals remain valid.
+ */
+class RE_ASSET_EXPORT FMeshSimplifier {
+public:
+    /*
+     * Collapses edges, cheapest first, until at most TargetIndexCount indices remain or
+     * every remaining collapse would move the surface by more than MaxError. Returns the
+     * largest error of the collapses made.
+     */
+    static float Simplify(
+        std::span<const uint32_t> Indices, std::span<const glm::vec3> Positions,
+        uint32_t TargetIndexCount, float MaxError, std::vector<uint32_t> &OutIndices);
+
+    /* Fills Mesh.Lods, each level simplified from the one before and cache optimized. */
+    static void BuildLods(FMeshData &Mesh, const FMeshLodOptions &Options);
+
+    /* Builds the LOD chains of every mesh in parallel on the task system. */
+    static void BuildMeshLods(
+        std::span<FMeshData> Meshes, const FMeshLodOptions &Options);
+};
+}
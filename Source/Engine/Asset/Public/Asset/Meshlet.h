@@ -0,0 +1,45 @@
+#pragma once
+#include "re-asset_export.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace RE {
+/* Limits that fit NVIDIA's recommended mesh shader output sizes. */
+constexpr uint32_t MeshletMaxVertices = 64;
+constexpr uint32_t MeshletMaxTriangles = 124;
+
+struct FMeshlet {
+    /* First entry in FMeshletData::Vertices. */
+    uint32_t VertexOffset{0};
+    /* First byte in FMeshletData::Triangles, always a multiple of 4. */
+    uint32_t TriangleOffset{0};
+    uint32_t VertexCount{0};
+    uint32_t TriangleCount{0};
+};
+
+/*
+ * The cluster is backfacing for every viewer at V when
+ * dot(normalize(ConeApex - V), ConeAxis) >= ConeCutoff; a cutoff of 1 disables the test.
+ */
+struct FMeshletBounds {
+    glm::vec3 Center{0.0f};
+    float Radius{0.0f};
+    glm::vec3 ConeApex{0.0f};
+    float ConeCutoff{1.0f};
+    glm::vec3 ConeAxis{0.0f, 0.0f, 1.0f};
+};
+
+struct FMeshletData {
+    std::vector<FMeshlet> Meshlets;
+    std::vector<FMeshletBounds> Bounds;
+    /* Mesh vertex indices referenced by each meshlet. */
+    std::vector<uint32_t> Vertices;
+    /* Meshlet local vertex indices, three per triangle, padded to 4 bytes per meshlet. */
+    std::vector<uint8_t> Triangles;
+
+    bool IsEmpty() const { return Meshlets.empty(); }
+};
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "re-asset_export.h"
+#include "Asset/MeshData.h"
+
+#include <span>
+
+namespace RE {
+/*
+ * Splits a triangle list into meshlets. Triangles are grown greedily from the seed, always
+ * taking the adjacent triangle that adds the fewest new vertices, so meshlets stay compact
+ * which keeps their bounding spheres and normal cones tight.
+ */
+class RE_ASSET_EXPORT FMeshletBuilder {
+public:
+    static void Build(
+        std::span<const uint32_t> Indices, std::span<const glm::vec3> Positions,
+        FMeshletData &Out, uint32_t MaxVertices = MeshletMaxVertices,
+        uint32_t MaxTriangles = MeshletMaxTriangles);
+
+    static FMeshletBounds ComputeBounds(
+        const FMeshletData &Data, const FMeshlet &Meshlet,
+        std::span<const glm::vec3> Positions);
+
+    /* Builds FMeshData::Meshlets for every mesh in parallel on the task system. */
+    static void BuildMeshes(std::span<FMeshData> Meshes);
+};
+}
@@ -0,0 +1,108 @@
+﻿#pragma once
+#include "re-asset_export.h"
+#include "Asset/MeshData.h"
+
+#include <array>
+#include <span>
+
+namespace RE {
+enum class EVertexSemantic : uint8_t {
+    Position,
+    Normal,
+    Tangent,
+    TexCoord,
+    Count
+};
+
+/* Storage format of one attribute, each maps to exactly one VkFormat. */
+enum class EVertexAttributeFormat : uint8_t {
+    None,
+    Float32x2,
+    Float32x3,
+    Float32x4,
+    /* Position relative to the mesh bounds, w holds the bitangent sign as 0 or 1. */
+    Unorm16x4,
+    /* Octahedral encoded unit vector. */
+    Snorm16x2,
+    /* Octahedral encoded unit vector, for normals where 8 bits per axis are enough. */
+    Snorm8x2,
+    Half16x2,
+    /* Texture coordinate relative to the mesh UV bounds. */
+    Unorm16x2,
+};
+
+enum class EPositionEncoding : uint8_t { Float32, Unorm16 };
+enum class EDirectionEncoding : uint8_t { Float32, Octahedral16, Octahedral8 };
+enum class ETexCoordEncoding : uint8_t { Float32, Half16, Unorm16 };
+
+/* Octahedral tangents need the quantized position to carry their bitangent sign. */
+struct FVertexFormatOptions {
+    EPositionEncoding Position{EPositionEncoding::Unorm16};
+    EDirectionEncoding Normal{EDirectionEncoding::Octahedral16};
+    EDirectionEncoding Tangent{EDirectionEncoding::Octahedral16};
+    ETexCoordEncoding TexCoord{ETexCoordEncoding::Unorm16};
+
+    static FVertexFormatOptions Full() {
+        return {EPositionEncoding::Float32, EDirectionEncoding::Float32,
+                EDirectionEncoding::Float32, ETexCoordEncoding::Float32};
+    }
+};
+
+struct FVertexAttribute {
+    EVertexSemantic Semantic{EVertexSemantic::Position};
+    EVertexAttributeFormat Format{EVertexAttributeFormat::None};
+    uint32_t Offset{0};
+};
+
+/* Interleaved single stream layout; absent attributes have the None format. */
+struct FVertexLayout {
+    std::array<FVertexAttribute, size_t(EVertexSemantic::Count)> Attributes{};
+    uint32_t Stride{0};
+
+    const FVertexAttribute &Get(EVertexSemantic Semantic) const {
+        return Attributes[size_t(Semantic)];
+    }
+    bool Has(EVertexSemantic Semantic) const {
+        return Get(Semantic).Format != EVertexAttributeFormat::None;
+    }
+    bool IsQuantized() const;
+
+    static FVertexLayout Create(
+        const FMeshData &Mesh, const FVertexFormatOptions &Options);
+};
+
+/*
+ * Per mesh decode constants, laid out for direct upload as a std140/std430 block:
+ * position = PositionOffset.xyz + encoded.xyz * PositionScale.xyz and
+ * uv = TexCoordOffsetScale.xy + encoded.xy * TexCoordOffsetScale.zw.
+ */
+struct FVertexQuantization {
+    glm::vec4 PositionOffset{0.0f};
+    glm::vec4 PositionScale{1.0f};
+    glm::vec4 TexCoordOffsetScale{0.0f, 0.0f, 1.0f, 1.0f};
+};
+
+struct FEncodedVertexData {
+    FVertexLayout Layout;
+    FVertexQuantization Quantization;
+    std::vector<uint8_t> Vertices;
+    uint32_t VertexCount{0};
+};
+
+class RE_ASSET_EXPORT FVertexEncoder {
+public:
+    static uint32_t GetFormatSize(EVertexAttributeFormat Format);
+
+    static glm::vec2 EncodeOctahedral(const glm::vec3 &Direction);
+    static glm::vec3 DecodeOctahedral(const glm::vec2 &Encoded);
+
+    static void Encode(
+        const FMeshData &Mesh, const FVertexFormatOptions &Options,
+        FEncodedVertexData &Out);
+
+    /* Encodes meshes in parallel on the task system and logs the vertex memory saved. */
+    static void EncodeMeshes(
+        std::span<const FMeshData> Meshes, const FVertexFormatOptions &Options,
+        std::vector<FEncodedVertexData> &Out);
+};
+}
@@ -0,0 +1,290 @@
+﻿#include "AsyncIOBackend.h"
+#include "Core/Logging.h"
+#include "Core/TaskSystem.h"
+
+#include <thread>
+
+#if defined(WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include "Core/unwindows.h"
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace RE {
+FIOBuffer::FIOBuffer(std::vector<uint8_t> &&Buffer)
+    : Owned(std::move(Buffer)), Data(Owned.data()), Size(Owned.size()) {}
+
+FIOBuffer::FIOBuffer(const uint8_t *Data, size_t Size, std::function<void()> OnRelease)
+    : Data(Data), Size(Size), OnRelease(std::move(OnRelease)) {}
+
+FIOBuffer::FIOBuffer(FIOBuffer &&Other) noexcept
+    : Owned(std::move(Other.Owned)),
+      Data(Other.Data),
+      Size(Other.Size),
+      OnRelease(std::move(Other.OnRelease)) {
+    Other.Data = nullptr;
+    Other.Size = 0;
+    Other.OnRelease = nullptr;
+}
+
+FIOBuffer &FIOBuffer::operator=(FIOBuffer &&Other) noexcept {
+    if(this != &Other) {
+        Reset();
+        Owned = std::move(Other.Owned);
+        Data = Other.Data;
+        Size = Other.Size;
+        OnRelease = std::move(Other.OnRelease);
+        Other.Data = nullptr;
+        Other.Size = 0;
+        Other.OnRelease = nullptr;
+    }
+    return *this;
+}
+
+FIOBuffer::~FIOBuffer() { Reset(); }
+
+void FIOBuffer::Shrink(size_t NewSize) {
+    if(NewSize < Size) { Size = NewSize; }
+}
+
+void FIOBuffer::Reset() {
+    if(OnRelease) { OnRelease(); }
+    OnRelease = nullptr;
+    Owned.clear();
+    Data = nullptr;
+    Size = 0;
+}
+
+FIOHandle::FIOHandle(std::shared_ptr<FIORequestState> State): State(std::move(State)) {}
+
+void FIOHandle::Cancel() {
+    if(!State) { return; }
+    State->bCancelRequested = true;
+    EIOStatus Expected = EIOStatus::Pending;
+    State->Status.compare_exchange_strong(Expected, EIOStatus::Cancelled);
+}
+
+EIOStatus FIOHandle::GetStatus() const {
+    return State ? State->Status.load() : EIOStatus::Cancelled;
+}
+
+bool FIOHandle::IsDone() const { return !State || State->bDone.load(); }
+
+void FIOHandle::Wait() const {
+    if(State) { State->bDone.wait(false); }
+}
+
+void CompleteIORequest(const FIORequestPtr &Request, EIOStatus Status, FIOBuffer &&Buffer) {
+    if(Request->bCancelRequested) {
+        Status = EIOStatus::Cancelled;
+        Buffer = FIOBuffer();
+    }
+    Request->Status = Status;
+
+    // std::function must be copyable, so the move-only buffer rides along in a shared_ptr.
+    auto SharedBuffer = std::make_shared<FIOBuffer>(std::move(Buffer));
+    FTaskSystem::Get().Enqueue([Request, Status, SharedBuffer]() {
+        if(Request->Request.OnComplete) {
+            Request->Request.OnComplete(Status, std::move(*SharedBuffer));
+        }
+        // Release a registered buffer the callback did not keep before signalling waiters.
+        *SharedBuffer = FIOBuffer();
+        Request->bDone = true;
+        Request->bDone.notify_all();
+    });
+}
+
+void FIORequestQueue::Push(FIORequestPtr Request) {
+    {
+        std::lock_guard Lock(Mutex);
+        Heap.push(std::move(Request));
+    }
+    Condition.notify_one();
+}
+
+FIORequestPtr FIORequestQueue::PopWait() {
+    std::unique_lock Lock(Mutex);
+    Condition.wait(Lock, [this]() { return bClosed || !Heap.empty(); });
+    if(Heap.empty()) { return nullptr; }
+    FIORequestPtr Request = Heap.top();
+    Heap.pop();
+    return Request;
+}
+
+FIORequestPtr FIORequestQueue::TryPop() {
+    std::lock_guard Lock(Mutex);
+    if(Heap.empty()) { return nullptr; }
+    FIORequestPtr Request = Heap.top();
+    Heap.pop();
+    return Request;
+}
+
+bool FIORequestQueue::WaitForWork() {
+    std::unique_lock Lock(Mutex);
+    Condition.wait(Lock, [this]() { return bClosed || !Heap.empty(); });
+    return !Heap.empty();
+}
+
+void FIORequestQueue::Close() {
+    {
+        std::lock_guard Lock(Mutex);
+        bClosed = true;
+    }
+    Condition.notify_all();
+}
+
+bool FIORequestQueue::IsClosed() const {
+    std::lock_guard Lock(Mutex);
+    return bClosed;
+}
+
+FIOFileCache::~FIOFileCache() {
+    for(auto &[Path, File]: Files) {
+#if defined(WIN32)
+        CloseHandle(reinterpret_cast<HANDLE>(File));
+#else
+        close(static_cast<int>(File));
+#endif
+    }
+}
+
+intptr_t FIOFileCache::Acquire(const std::filesystem::path &Path) {
+    std::lock_guard Lock(Mutex);
+    auto It = Files.find(Path.native());
+    if(It != Files.end()) { return It->second; }
+
+#if defined(WIN32)
+    HANDLE Handle = CreateFileW(
+        Path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(Handle == INVALID_HANDLE_VALUE) { return -1; }
+    intptr_t File = reinterpret_cast<intptr_t>(Handle);
+#else
+    int Fd = open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(Fd < 0) { return -1; }
+    intptr_t File = Fd;
+#endif
+    Files.emplace(Path.native(), File);
+    return File;
+}
+
+int64_t ReadAt(intptr_t File, void *Buffer, uint64_t Size, uint64_t Offset) {
+    uint64_t Total = 0;
+    while(Total < Size) {
+#if defined(WIN32)
+        OVERLAPPED Overlapped{};
+        Overlapped.Offset = static_cast<DWORD>(Offset + Total);
+        Overlapped.OffsetHigh = static_cast<DWORD>((Offset + Total) >> 32);
+        const DWORD Chunk = static_cast<DWORD>(std::min<uint64_t>(Size - Total, 1u << 30));
+        DWORD BytesRead = 0;
+        if(!ReadFile(
+               reinterpret_cast<HANDLE>(File), static_cast<uint8_t *>(Buffer) + Total, Chunk,
+               &BytesRead, &Overlapped)) {
+            return GetLastError() == ERROR_HANDLE_EOF ? int64_t(Total) : -1;
+        }
+        const int64_t Result = BytesRead;
+#else
+        const int64_t Result = pread(
+            static_cast<int>(File), static_cast<uint8_t *>(Buffer) + Total, Size - Total,
+            static_cast<off_t>(Offset + Total));
+        if(Result < 0) {
+            if(errno == EINTR) { continue; }
+            return -1;
+        }
+#endif
+        if(Result == 0) { break; }
+        Total += static_cast<uint64_t>(Result);
+    }
+    return static_cast<int64_t>(Total);
+}
+
+namespace {
+class FThreadPoolIOBackend: public FAsyncIOBackend {
+public:
+    explicit FThreadPoolIOBackend(uint32_t NumThreads) {
+        for(uint32_t i = 0; i < NumThreads; i++) {
+            Threads.emplace_back([this]() { ThreadLoop(); });
+        }
+    }
+
+    ~FThreadPoolIOBackend() override {
+        Queue.Close();
+        for(auto &Thread: Threads) {
+            Thread.join();
+        }
+    }
+
+    void Submit(FIORequestPtr Request) override { Queue.Push(std::move(Request)); }
+
+    const char *GetName() const override { return "ThreadPool"; }
+
+private:
+    void ThreadLoop() {
+        while(FIORequestPtr Request = Queue.PopWait()) {
+            EIOStatus Expected = EIOStatus::Pending;
+            if(!Request->Status.compare_exchange_strong(Expected, EIOStatus::InFlight)) {
+                CompleteIORequest(Request, EIOStatus::Cancelled, FIOBuffer());
+                continue;
+            }
+
+            const FIOReadRequest &Desc = Request->Request;
+            const intptr_t File = Files.Acquire(Desc.Path);
+            if(File == -1) {
+                RE_LOGE("AsyncIO: failed to open {}", Desc.Path.string());
+                CompleteIORequest(Request, EIOStatus::Failed, FIOBuffer());
+                continue;
+            }
+
+            std::vector<uint8_t> Data(Desc.Size);
+            const int64_t Result = ReadAt(File, Data.data(), Desc.Size, Desc.Offset);
+            if(Result < 0) {
+                CompleteIORequest(Request, EIOStatus::Failed, FIOBuffer());
+                continue;
+            }
+            Data.resize(static_cast<size_t>(Result));
+            CompleteIORequest(Request, EIOStatus::Completed, FIOBuffer(std::move(Data)));
+        }
+    }
+
+    FIORequestQueue Queue;
+    FIOFileCache Files;
+    std::vector<std::thread> Threads;
+};
+}
+
+std::unique_ptr<FAsyncIOBackend> CreateThreadPoolIOBackend() {
+    return std::make_unique<FThreadPoolIOBackend>(
+        std::clamp(std::thread::hardware_concurrency() / 2, 2u, 8u));
+}
+
+FAsyncIO &FAsyncIO::Get() {
+    static FAsyncIO Instance;
+    return Instance;
+}
+
+FAsyncIO::FAsyncIO() {
+    // Completions run on the task system, so it has to outlive the backend threads.
+    FTaskSystem::Get();
+#if defined(__linux__)
+    Backend = CreateIoUringBackend();
+#endif
+    if(!Backend) { Backend = CreateThreadPoolIOBackend(); }
+    RE_LOGI("AsyncIO backend: {}", Backend->GetName());
+}
+
+FAsyncIO::~FAsyncIO() = default;
+
+FIOHandle FAsyncIO::Read(FIOReadRequest &&Request) {
+    auto State = std::make_shared<FIORequestState>();
+    State->Request = std::move(Request);
+    State->Sequence = NextSequence.fetch_add(1);
+    Backend->Submit(State);
+    return FIOHandle(std::move(State));
+}
+
+const char *FAsyncIO::GetBackendName() const { return Backend->GetName(); }
+}
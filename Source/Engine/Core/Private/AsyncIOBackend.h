@@ -0,0 +1,87 @@
+﻿#pragma once
+#include "Core/AsyncIO.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <unordered_map>
+
+namespace RE {
+struct FIORequestState {
+    FIOReadRequest Request;
+    uint64_t Sequence{0};
+    std::atomic<EIOStatus> Status{EIOStatus::Pending};
+    std::atomic<bool> bCancelRequested{false};
+    std::atomic<bool> bDone{false};
+};
+
+using FIORequestPtr = std::shared_ptr<FIORequestState>;
+
+/* Hands the result to the task system and marks the request done afterwards. */
+void CompleteIORequest(const FIORequestPtr &Request, EIOStatus Status, FIOBuffer &&Buffer);
+
+/* Requests ordered by priority, then by submission order. */
+class FIORequestQueue {
+public:
+    void Push(FIORequestPtr Request);
+
+    /* Blocks until a request is available or the queue is closed. */
+    FIORequestPtr PopWait();
+
+    FIORequestPtr TryPop();
+
+    bool WaitForWork();
+
+    void Close();
+
+    bool IsClosed() const;
+
+private:
+    struct FCompare {
+        bool operator()(const FIORequestPtr &A, const FIORequestPtr &B) const {
+            if(A->Request.Priority != B->Request.Priority) {
+                return A->Request.Priority < B->Request.Priority;
+            }
+            return A->Sequence > B->Sequence;
+        }
+    };
+
+    std::priority_queue<FIORequestPtr, std::vector<FIORequestPtr>, FCompare> Heap;
+    mutable std::mutex Mutex;
+    std::condition_variable Condition;
+    bool bClosed{false};
+};
+
+/* Keeps files open across requests so repeated reads from one pack cost no open calls. */
+class FIOFileCache {
+public:
+    ~FIOFileCache();
+
+    /* Returns a native descriptor (fd or HANDLE) or -1. */
+    intptr_t Acquire(const std::filesystem::path &Path);
+
+private:
+    std::mutex Mutex;
+    std::unordered_map<std::filesystem::path::string_type, intptr_t> Files;
+};
+
+/* Blocking positional read, returns the number of bytes read or -1. */
+int64_t ReadAt(intptr_t File, void *Buffer, uint64_t Size, uint64_t Offset);
+
+class FAsyncIOBackend {
+public:
+    virtual ~FAsyncIOBackend() = default;
+
+    virtual void Submit(FIORequestPtr Request) = 0;
+
+    virtual const char *GetName() const = 0;
+};
+
+std::unique_ptr<FAsyncIOBackend> CreateThreadPoolIOBackend();
+
+#if defined(__linux__)
+/* Returns nullptr when io_uring is unavailable (old kernel or disabled by policy). */
+std::unique_ptr<FAsyncIOBackend> CreateIoUringBackend();
+#endif
+}
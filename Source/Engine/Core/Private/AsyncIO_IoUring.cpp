@@ -0,0 +1,318 @@
+﻿#include "AsyncIOBackend.h"
+#include "Core/Logging.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+
+    #include <cstring>
+    #include <thread>
+
+namespace RE {
+namespace {
+int IoUringSetup(uint32_t Entries, io_uring_params *Params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, Entries, Params));
+}
+
+int IoUringEnter(int Fd, uint32_t ToSubmit, uint32_t MinComplete, uint32_t Flags) {
+    return static_cast<int>(
+        syscall(__NR_io_uring_enter, Fd, ToSubmit, MinComplete, Flags, nullptr, 0));
+}
+
+int IoUringRegister(int Fd, uint32_t Opcode, const void *Args, uint32_t NumArgs) {
+    return static_cast<int>(syscall(__NR_io_uring_register, Fd, Opcode, Args, NumArgs));
+}
+
+template<typename T>
+T LoadAcquire(const T *Ptr) {
+    return __atomic_load_n(Ptr, __ATOMIC_ACQUIRE);
+}
+
+template<typename T>
+void StoreRelease(T *Ptr, T Value) {
+    __atomic_store_n(Ptr, Value, __ATOMIC_RELEASE);
+}
+
+/*
+ * Single submission thread driving one ring. Requests small enough for a registered buffer
+ * use READ_FIXED into it, so the kernel skips pinning pages per request; larger ones read
+ * into a heap buffer. Everything gathered between two waits goes out with one
+ * io_uring_enter call.
+ */
+class FIoUringBackend: public FAsyncIOBackend {
+public:
+    static constexpr uint32_t QueueDepth = 64;
+    static constexpr uint32_t NumFixedBuffers = 32;
+    static constexpr size_t FixedBufferSize = 1 << 20;
+
+    ~FIoUringBackend() override {
+        Queue.Close();
+        if(Thread.joinable()) { Thread.join(); }
+
+        if(SqRing != nullptr) { munmap(SqRing, SqRingSize); }
+        if(CqRing != nullptr && CqRing != SqRing) { munmap(CqRing, CqRingSize); }
+        if(Sqes != nullptr) { munmap(Sqes, QueueEntries * sizeof(io_uring_sqe)); }
+        if(RingFd >= 0) { close(RingFd); }
+        if(FixedMemory != nullptr) { munmap(FixedMemory, FixedBufferSize * NumFixedBuffers); }
+    }
+
+    bool Initialize() {
+        io_uring_params Params{};
+        RingFd = IoUringSetup(QueueDepth, &Params);
+        if(RingFd < 0) { return false; }
+        QueueEntries = Params.sq_entries;
+
+        SqRingSize = Params.sq_off.array + Params.sq_entries * sizeof(uint32_t);
+        CqRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(io_uring_cqe);
+        const bool bSingleMmap = (Params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if(bSingleMmap) { SqRingSize = CqRingSize = std::max(SqRingSize, CqRingSize); }
+
+        SqRing = mmap(
+            nullptr, SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd,
+            IORING_OFF_SQ_RING);
+        if(SqRing == MAP_FAILED) {
+            SqRing = nullptr;
+            return false;
+        }
+        if(bSingleMmap) {
+            CqRing = SqRing;
+        } else {
+            CqRing = mmap(
+                nullptr, CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                RingFd, IORING_OFF_CQ_RING);
+            if(CqRing == MAP_FAILED) {
+                CqRing = nullptr;
+                return false;
+            }
+        }
+        void *SqeMemory = mmap(
+            nullptr, QueueEntries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, RingFd, IORING_OFF_SQES);
+        if(SqeMemory == MAP_FAILED) { return false; }
+        Sqes = static_cast<io_uring_sqe *>(SqeMemory);
+
+        auto *Sq = static_cast<uint8_t *>(SqRing);
+        SqHead = reinterpret_cast<uint32_t *>(Sq + Params.sq_off.head);
+        SqTail = reinterpret_cast<uint32_t *>(Sq + Params.sq_off.tail);
+        SqMask = *reinterpret_cast<uint32_t *>(Sq + Params.sq_off.ring_mask);
+        SqArray = reinterpret_cast<uint32_t *>(Sq + Params.sq_off.array);
+
+        auto *Cq = static_cast<uint8_t *>(CqRing);
+        CqHead = reinterpret_cast<uint32_t *>(Cq + Params.cq_off.head);
+        CqTail = reinterpret_cast<uint32_t *>(Cq + Params.cq_off.tail);
+        CqMask = *reinterpret_cast<uint32_t *>(Cq + Params.cq_off.ring_mask);
+        Cqes = reinterpret_cast<io_uring_cqe *>(Cq + Params.cq_off.cqes);
+
+        // Registered buffers are optional: RLIMIT_MEMLOCK may be too small to pin them.
+        void *Memory = mmap(
+            nullptr, FixedBufferSize * NumFixedBuffers, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(Memory != MAP_FAILED) {
+            FixedMemory = static_cast<uint8_t *>(Memory);
+            iovec Vectors[NumFixedBuffers];
+            for(uint32_t i = 0; i < NumFixedBuffers; i++) {
+                Vectors[i].iov_base = FixedMemory + i * FixedBufferSize;
+                Vectors[i].iov_len = FixedBufferSize;
+            }
+            if(IoUringRegister(RingFd, IORING_REGISTER_BUFFERS, Vectors, NumFixedBuffers) ==
+               0) {
+                FreeFixedBuffers.reserve(NumFixedBuffers);
+                for(uint32_t i = 0; i < NumFixedBuffers; i++) {
+                    FreeFixedBuffers.push_back(NumFixedBuffers - 1 - i);
+                }
+            } else {
+                RE_LOGW("AsyncIO: io_uring buffer registration failed, using heap buffers");
+            }
+        }
+
+        Thread = std::thread([this]() { ThreadLoop(); });
+        return true;
+    }
+
+    void Submit(FIORequestPtr Request) override { Queue.Push(std::move(Request)); }
+
+    const char *GetName() const override { return "io_uring"; }
+
+private:
+    struct FInFlight {
+        FIORequestPtr Request;
+        std::vector<uint8_t> HeapBuffer;
+        int32_t FixedIndex{-1};
+    };
+
+    void ThreadLoop() {
+        while(true) {
+            uint32_t Prepared = 0;
+            while(NumInFlight + Prepared < QueueEntries) {
+                FIORequestPtr Request = Queue.TryPop();
+                if(!Request) { break; }
+                if(Prepare(std::move(Request))) { Prepared++; }
+            }
+
+            if(NumInFlight + Prepared == 0) {
+                if(!Queue.WaitForWork()) { return; }
+                continue;
+            }
+
+            const int Result = IoUringEnter(RingFd, Prepared, 1, IORING_ENTER_GETEVENTS);
+            if(Result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                RE_LOGE("AsyncIO: io_uring_enter failed: {}", strerror(errno));
+            }
+            NumInFlight += Prepared;
+            Reap();
+        }
+    }
+
+    bool Prepare(FIORequestPtr Request) {
+        EIOStatus Expected = EIOStatus::Pending;
+        if(!Request->Status.compare_exchange_strong(Expected, EIOStatus::InFlight)) {
+            CompleteIORequest(Request, EIOStatus::Cancelled, FIOBuffer());
+            return false;
+        }
+
+        const FIOReadRequest &Desc = Request->Request;
+        const intptr_t File = Files.Acquire(Desc.Path);
+        if(File == -1) {
+            RE_LOGE("AsyncIO: failed to open {}", Desc.Path.string());
+            CompleteIORequest(Request, EIOStatus::Failed, FIOBuffer());
+            return false;
+        }
+
+        uint32_t Slot = AllocateSlot();
+        FInFlight &Op = Slots[Slot];
+        Op.Request = std::move(Request);
+
+        const uint32_t Tail = *SqTail;
+        const uint32_t Index = Tail & SqMask;
+        io_uring_sqe &Sqe = Sqes[Index];
+        std::memset(&Sqe, 0, sizeof(Sqe));
+        Sqe.fd = static_cast<int>(File);
+        Sqe.off = Desc.Offset;
+        Sqe.len = static_cast<uint32_t>(Desc.Size);
+        Sqe.user_data = Slot;
+
+        int32_t FixedIndex = -1;
+        if(Desc.Size <= FixedBufferSize) {
+            std::lock_guard Lock(FixedMutex);
+            if(!FreeFixedBuffers.empty()) {
+                FixedIndex = static_cast<int32_t>(FreeFixedBuffers.back());
+                FreeFixedBuffers.pop_back();
+            }
+        }
+        if(FixedIndex >= 0) {
+            Op.FixedIndex = FixedIndex;
+            Sqe.opcode = IORING_OP_READ_FIXED;
+            Sqe.addr = reinterpret_cast<uint64_t>(FixedMemory + FixedIndex * FixedBufferSize);
+            Sqe.buf_index = static_cast<uint16_t>(FixedIndex);
+        } else {
+            Op.HeapBuffer.resize(Desc.Size);
+            Sqe.opcode = IORING_OP_READ;
+            Sqe.addr = reinterpret_cast<uint64_t>(Op.HeapBuffer.data());
+        }
+
+        SqArray[Index] = Index;
+        StoreRelease(SqTail, Tail + 1);
+        return true;
+    }
+
+    void Reap() {
+        uint32_t Head = *CqHead;
+        while(Head != LoadAcquire(CqTail)) {
+            const io_uring_cqe &Cqe = Cqes[Head & CqMask];
+            const uint32_t Slot = static_cast<uint32_t>(Cqe.user_data);
+            const int32_t Result = Cqe.res;
+            Head++;
+
+            FInFlight Op = std::move(Slots[Slot]);
+            Slots[Slot] = FInFlight{};
+            FreeSlots.push_back(Slot);
+            NumInFlight--;
+
+            if(Result < 0) {
+                RE_LOGE(
+                    "AsyncIO: read of {} failed: {}", Op.Request->Request.Path.string(),
+                    strerror(-Result));
+                ReleaseFixed(Op.FixedIndex);
+                CompleteIORequest(Op.Request, EIOStatus::Failed, FIOBuffer());
+                continue;
+            }
+
+            // Short reads only happen at end of file for regular files.
+            FIOBuffer Buffer;
+            if(Op.FixedIndex >= 0) {
+                const int32_t FixedIndex = Op.FixedIndex;
+                Buffer = FIOBuffer(
+                    FixedMemory + FixedIndex * FixedBufferSize, static_cast<size_t>(Result),
+                    [this, FixedIndex]() { ReleaseFixed(FixedIndex); });
+            } else {
+                Op.HeapBuffer.resize(static_cast<size_t>(Result));
+                Buffer = FIOBuffer(std::move(Op.HeapBuffer));
+            }
+            CompleteIORequest(Op.Request, EIOStatus::Completed, std::move(Buffer));
+        }
+        StoreRelease(CqHead, Head);
+    }
+
+    uint32_t AllocateSlot() {
+        if(FreeSlots.empty()) {
+            Slots.emplace_back();
+            return static_cast<uint32_t>(Slots.size() - 1);
+        }
+        const uint32_t Slot = FreeSlots.back();
+        FreeSlots.pop_back();
+        return Slot;
+    }
+
+    void ReleaseFixed(int32_t FixedIndex) {
+        if(FixedIndex < 0) { return; }
+        std::lock_guard Lock(FixedMutex);
+        FreeFixedBuffers.push_back(static_cast<uint32_t>(FixedIndex));
+    }
+
+    int RingFd{-1};
+    uint32_t QueueEntries{0};
+    void *SqRing{nullptr};
+    void *CqRing{nullptr};
+    size_t SqRingSize{0};
+    size_t CqRingSize{0};
+    io_uring_sqe *Sqes{nullptr};
+    io_uring_cqe *Cqes{nullptr};
+    uint32_t *SqHead{nullptr};
+    uint32_t *SqTail{nullptr};
+    uint32_t *SqArray{nullptr};
+    uint32_t SqMask{0};
+    uint32_t *CqHead{nullptr};
+    uint32_t *CqTail{nullptr};
+    uint32_t CqMask{0};
+
+    uint8_t *FixedMemory{nullptr};
+    std::vector<uint32_t> FreeFixedBuffers;
+    std::mutex FixedMutex;
+
+    std::vector<FInFlight> Slots;
+    std::vector<uint32_t> FreeSlots;
+    uint32_t NumInFlight{0};
+
+    FIORequestQueue Queue;
+    FIOFileCache Files;
+    std::thread Thread;
+};
+}
+
+std::unique_ptr<FAsyncIOBackend> CreateIoUringBackend() {
+    auto Backend = std::make_unique<FIoUringBackend>();
+    if(!Backend->Initialize()) {
+        RE_LOGW("AsyncIO: io_uring unavailable, falling back to thread pool");
+        return nullptr;
+    }
+    return Backend;
+}
+}
+#elif defined(__linux__)
+namespace RE {
+std::unique_ptr<FAsyncIOBackend> CreateIoUringBackend() { return nullptr; }
+}
+#endif
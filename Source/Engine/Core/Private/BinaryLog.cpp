@@ -0,0 +1,148 @@
+﻿#include "Core/BinaryLog.h"
+#include "Core/Logging.h"
+
+namespace RE {
+namespace {
+thread_local void *CurrentRing = nullptr;
+
+template<typename T>
+void WriteValue(std::ofstream &Stream, const T &Value) {
+    Stream.write(reinterpret_cast<const char *>(&Value), sizeof(Value));
+}
+
+void WriteString(std::ofstream &Stream, std::string_view Text) {
+    const uint16_t Length = uint16_t(std::min<size_t>(Text.size(), UINT16_MAX));
+    WriteValue(Stream, Length);
+    Stream.write(Text.data(), Length);
+}
+}
+
+FBinaryLog &FBinaryLog::Get() {
+    static FBinaryLog Instance;
+    return Instance;
+}
+
+FBinaryLog::FThreadRing &FBinaryLog::GetThreadRing() {
+    if(CurrentRing == nullptr) {
+        std::lock_guard Lock(Mutex);
+        auto Ring = std::make_unique<FThreadRing>();
+        Ring->Index = uint32_t(Rings.size());
+        Ring->Name = fmt::format("Thread {}", Rings.size());
+        Ring->Bytes = std::make_unique<uint8_t[]>(RingCapacity);
+        CurrentRing = Rings.emplace_back(std::move(Ring)).get();
+    }
+    return *static_cast<FThreadRing *>(CurrentRing);
+}
+
+void FBinaryLog::SetThreadName(const char *Name) {
+    FThreadRing &Ring = GetThreadRing();
+    std::lock_guard Lock(Mutex);
+    Ring.Name = Name;
+    Ring.bNameWritten = false;
+}
+
+bool FBinaryLog::Register(
+    uint32_t Id, const char *Format, const char *File, uint32_t Line,
+    std::span<const EArgType> Args) {
+    std::lock_guard Lock(Mutex);
+    for(const FSite &Site: Sites) {
+        if(Site.Id == Id) {
+            RE_LOGW(
+                "Binary log site {}:{} has the ID of {}:{}, it is not logged.", File, Line,
+                Site.File, Site.Line);
+            return false;
+        }
+    }
+    Sites.push_back({Id, Format, File, Line, {Args.begin(), Args.end()}});
+    return true;
+}
+
+bool FBinaryLog::Open(const std::filesystem::path &Path) {
+    Close();
+    std::lock_guard Lock(Mutex);
+    Stream.open(Path, std::ios::binary | std::ios::trunc);
+    if(!Stream) {
+        RE_LOGE("Failed to open {} for writing", Path.string());
+        return false;
+    }
+
+    const FFileHeader Header{Magic, Version, FProfiler::Now()};
+    WriteValue(Stream, Header);
+    // A new file repeats the sites and threads, records from before it are dropped.
+    WrittenSites = 0;
+    for(auto &Ring: Rings) {
+        Ring->Tail.store(
+            Ring->Head.load(std::memory_order_acquire), std::memory_order_release);
+        Ring->Dropped.store(0, std::memory_order_relaxed);
+        Ring->bNameWritten = false;
+    }
+    bOpen.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void FBinaryLog::Close() {
+    std::lock_guard Lock(Mutex);
+    if(!Stream.is_open()) { return; }
+    bOpen.store(false, std::memory_order_relaxed);
+    WriteChunks();
+    Stream.close();
+    if(const uint64_t Dropped = CountDropped(); Dropped > 0) {
+        RE_LOGW("Binary log dropped {} records, flush it more often.", Dropped);
+    }
+}
+
+void FBinaryLog::Flush() {
+    std::lock_guard Lock(Mutex);
+    if(!Stream.is_open()) { return; }
+    WriteChunks();
+    Stream.flush();
+}
+
+void FBinaryLog::WriteChunks() {
+    // Sites go first, a record is only written after its site was registered.
+    for(; WrittenSites < Sites.size(); WrittenSites++) {
+        const FSite &Site = Sites[WrittenSites];
+        WriteValue(Stream, EChunk::Site);
+        WriteValue(Stream, Site.Id);
+        WriteValue(Stream, Site.Line);
+        WriteValue(Stream, uint8_t(Site.Args.size()));
+        Stream.write(reinterpret_cast<const char *>(Site.Args.data()), Site.Args.size());
+        WriteString(Stream, Site.File);
+        WriteString(Stream, Site.Format);
+    }
+    for(auto &Ring: Rings) {
+        if(!Ring->bNameWritten) {
+            WriteValue(Stream, EChunk::Thread);
+            WriteValue(Stream, Ring->Index);
+            WriteString(Stream, Ring->Name);
+            Ring->bNameWritten = true;
+        }
+
+        const uint64_t Tail = Ring->Tail.load(std::memory_order_relaxed);
+        const uint64_t Head = Ring->Head.load(std::memory_order_acquire);
+        if(Head == Tail) { continue; }
+        WriteValue(Stream, EChunk::Records);
+        WriteValue(Stream, Ring->Index);
+        WriteValue(Stream, uint32_t(Head - Tail));
+        // The unread bytes may wrap around the end of the ring.
+        const size_t Begin = Tail & (RingCapacity - 1);
+        const size_t First = std::min<size_t>(Head - Tail, RingCapacity - Begin);
+        Stream.write(reinterpret_cast<const char *>(&Ring->Bytes[Begin]), First);
+        Stream.write(reinterpret_cast<const char *>(&Ring->Bytes[0]), Head - Tail - First);
+        Ring->Tail.store(Head, std::memory_order_release);
+    }
+}
+
+uint64_t FBinaryLog::GetDroppedCount() const {
+    std::lock_guard Lock(Mutex);
+    return CountDropped();
+}
+
+uint64_t FBinaryLog::CountDropped() const {
+    uint64_t Count = 0;
+    for(const auto &Ring: Rings) {
+        Count += Ring->Dropped.load(std::memory_order_relaxed);
+    }
+    return Count;
+}
+}
@@ -0,0 +1,269 @@
+﻿#include "Core/ECS.h"
+#include "Core/Logging.h"
+#include "Core/TaskSystem.h"
+
+#include <algorithm>
+#include <deque>
+#include <string>
+
+namespace RE {
+namespace {
+constexpr size_t ChunkAlignment = 64;
+
+struct FRegistryState {
+    std::mutex Mutex;
+    /* A deque keeps returned references valid while other types register. */
+    std::deque<FComponentInfo> Infos;
+    tsl::robin_map<std::string, FComponentId> Ids;
+};
+
+FRegistryState &GetRegistryState() {
+    static FRegistryState State;
+    return State;
+}
+
+uint32_t AlignUp(uint32_t Value, uint32_t Alignment) {
+    return (Value + Alignment - 1) / Alignment * Alignment;
+}
+}
+
+FComponentId FComponentRegistry::Register(const FComponentInfo &Info) {
+    FRegistryState &State = GetRegistryState();
+    std::lock_guard Lock(State.Mutex);
+    if(auto It = State.Ids.find(Info.Name); It != State.Ids.end()) { return It->second; }
+
+    checkf(State.Infos.size() < MaxComponentTypes, "Too many component types.");
+    checkf(Info.Alignment <= ChunkAlignment, "Component {} is over aligned.", Info.Name);
+    const auto Id = static_cast<FComponentId>(State.Infos.size());
+    State.Infos.push_back(Info);
+    State.Ids.emplace(Info.Name, Id);
+    return Id;
+}
+
+const FComponentInfo &FComponentRegistry::Get(FComponentId Id) {
+    FRegistryState &State = GetRegistryState();
+    std::lock_guard Lock(State.Mutex);
+    return State.Infos[Id];
+}
+
+FArchetype::FArchetype(const FComponentMask &Mask)
+    : Mask(Mask), Offsets(MaxComponentTypes, UINT32_MAX), Sizes(MaxComponentTypes, 0) {
+    uint32_t RowSize = sizeof(FEntity);
+    uint32_t AlignmentSlack = 0;
+    for(FComponentId Id = 0; Id < MaxComponentTypes; Id++) {
+        if(!Mask.test(Id)) { continue; }
+        const FComponentInfo &Info = FComponentRegistry::Get(Id);
+        Components.push_back(Id);
+        Infos.push_back(Info);
+        Sizes[Id] = Info.Size;
+        RowSize += Info.Size;
+        AlignmentSlack += Info.Alignment - 1;
+    }
+    Capacity = std::max<uint32_t>((ChunkSize - AlignmentSlack) / RowSize, 1);
+
+    // Entity handles first, then one array per component.
+    uint32_t Offset = Capacity * sizeof(FEntity);
+    for(size_t i = 0; i < Components.size(); i++) {
+        Offset = AlignUp(Offset, Infos[i].Alignment);
+        Offsets[Components[i]] = Offset;
+        Offset += Capacity * Infos[i].Size;
+    }
+    // Only exceeds the chunk size for components too large to share a chunk.
+    DataSize = std::max(Offset, ChunkSize);
+}
+
+FArchetype::~FArchetype() {
+    for(FChunk &Chunk: Chunks) {
+        for(size_t i = 0; i < Components.size(); i++) {
+            for(uint32_t Row = 0; Row < Chunk.Count; Row++) {
+                Infos[i].Destruct(GetComponent(Chunk, Components[i], Row));
+            }
+        }
+        ::operator delete(Chunk.Data, std::align_val_t(ChunkAlignment));
+    }
+}
+
+void FArchetype::Allocate(uint32_t &OutChunk, uint32_t &OutRow) {
+    if(Chunks.empty() || Chunks.back().Count == Capacity) {
+        FChunk Chunk;
+        Chunk.Data = static_cast<uint8_t *>(
+            ::operator new(DataSize, std::align_val_t(ChunkAlignment)));
+        Chunks.push_back(Chunk);
+    }
+    OutChunk = static_cast<uint32_t>(Chunks.size() - 1);
+    OutRow = Chunks.back().Count++;
+}
+
+FEntity FArchetype::MoveLastInto(uint32_t Chunk, uint32_t Row) {
+    FChunk &Last = Chunks.back();
+    const uint32_t LastRow = Last.Count - 1;
+    FEntity Moved;
+    if(&Chunks[Chunk] != &Last || Row != LastRow) {
+        FChunk &Target = Chunks[Chunk];
+        for(size_t i = 0; i < Components.size(); i++) {
+            void *Source = GetComponent(Last, Components[i], LastRow);
+            Infos[i].MoveConstruct(GetComponent(Target, Components[i], Row), Source);
+            Infos[i].Destruct(Source);
+        }
+        Moved = GetEntities(Last)[LastRow];
+        GetEntities(Target)[Row] = Moved;
+    }
+
+    // Only the last chunk is ever partially filled, so iteration stays dense.
+    if(--Last.Count == 0) {
+        ::operator delete(Last.Data, std::align_val_t(ChunkAlignment));
+        Chunks.pop_back();
+    }
+    return Moved;
+}
+
+FWorld::FWorld() = default;
+
+FWorld::~FWorld() = default;
+
+FArchetype &FWorld::GetOrCreateArchetype(const FComponentMask &Mask) {
+    if(auto It = ArchetypeLookup.find(Mask); It != ArchetypeLookup.end()) {
+        return *It->second;
+    }
+    Archetypes.push_back(std::make_unique<FArchetype>(Mask));
+    ArchetypeLookup.emplace(Mask, Archetypes.back().get());
+    return *Archetypes.back();
+}
+
+FEntity FWorld::CreateInArchetype(
+    FArchetype &Archetype, uint32_t &OutChunk, uint32_t &OutRow) {
+    FEntity Entity;
+    if(!FreeIndices.empty()) {
+        Entity.Index = FreeIndices.back();
+        FreeIndices.pop_back();
+    } else {
+        Entity.Index = static_cast<uint32_t>(Generations.size());
+        Generations.push_back(0);
+    }
+    Entity.Generation = Generations[Entity.Index];
+
+    Archetype.Allocate(OutChunk, OutRow);
+    Archetype.GetEntities(Archetype.GetChunks()[OutChunk])[OutRow] = Entity;
+    Locations[Entity.Index] = {&Archetype, OutChunk, OutRow};
+    return Entity;
+}
+
+bool FWorld::IsAlive(FEntity Entity) const {
+    return Entity.Index < Generations.size() &&
+           Generations[Entity.Index] == Entity.Generation &&
+           Locations.find(Entity.Index) != Locations.end();
+}
+
+void FWorld::Destroy(FEntity Entity) {
+    if(!IsAlive(Entity)) { return; }
+    const FEntityLocation Location = Locations.at(Entity.Index);
+    FArchetype &Archetype = *Location.Archetype;
+    FChunk &Chunk = Archetype.GetChunks()[Location.Chunk];
+    for(size_t i = 0; i < Archetype.GetComponents().size(); i++) {
+        Archetype.GetComponentInfos()[i].Destruct(
+            Archetype.GetComponent(Chunk, Archetype.GetComponents()[i], Location.Row));
+    }
+    RemoveRow(Location);
+
+    Locations.erase(Entity.Index);
+    Generations[Entity.Index]++;
+    FreeIndices.push_back(Entity.Index);
+}
+
+void FWorld::RemoveRow(const FEntityLocation &Location) {
+    const FEntity Moved = Location.Archetype->MoveLastInto(Location.Chunk, Location.Row);
+    if(Moved.IsValid()) { Locations[Moved.Index] = Location; }
+}
+
+void *FWorld::GetComponent(FEntity Entity, FComponentId Id) const {
+    if(!IsAlive(Entity)) { return nullptr; }
+    const FEntityLocation &Location = Locations.at(Entity.Index);
+    if(Location.Archetype->GetOffset(Id) == UINT32_MAX) { return nullptr; }
+    return Location.Archetype->GetComponent(
+        Location.Archetype->GetChunks()[Location.Chunk], Id, Location.Row);
+}
+
+FWorld::FEntityLocation FWorld::MoveToArchetype(FEntity Entity, FArchetype &Target) {
+    const FEntityLocation Source = Locations.at(Entity.Index);
+    FEntityLocation Destination{&Target, 0, 0};
+    Target.Allocate(Destination.Chunk, Destination.Row);
+    Target.GetEntities(Target.GetChunks()[Destination.Chunk])[Destination.Row] = Entity;
+
+    const FArchetype &SourceArchetype = *Source.Archetype;
+    FChunk &SourceChunk = Source.Archetype->GetChunks()[Source.Chunk];
+    FChunk &TargetChunk = Target.GetChunks()[Destination.Chunk];
+    for(size_t i = 0; i < SourceArchetype.GetComponents().size(); i++) {
+        const FComponentId Id = SourceArchetype.GetComponents()[i];
+        const FComponentInfo &Info = SourceArchetype.GetComponentInfos()[i];
+        void *Component = SourceArchetype.GetComponent(SourceChunk, Id, Source.Row);
+        if(Target.GetOffset(Id) != UINT32_MAX) {
+            Info.MoveConstruct(
+                Target.GetComponent(TargetChunk, Id, Destination.Row), Component);
+        }
+        Info.Destruct(Component);
+    }
+    RemoveRow(Source);
+    Locations[Entity.Index] = Destination;
+    return Destination;
+}
+
+void *FWorld::AddUninitialized(FEntity Entity, FComponentId Id) {
+    if(!IsAlive(Entity)) {
+        RE_LOGE("Cannot add a component to a dead entity {}.", Entity.Index);
+        return nullptr;
+    }
+    FComponentMask Mask = Locations.at(Entity.Index).Archetype->GetMask();
+    FArchetype &Target = GetOrCreateArchetype(Mask.set(Id));
+    const FEntityLocation Location = MoveToArchetype(Entity, Target);
+    return Target.GetComponent(Target.GetChunks()[Location.Chunk], Id, Location.Row);
+}
+
+void FWorld::RemoveComponent(FEntity Entity, FComponentId Id) {
+    if(GetComponent(Entity, Id) == nullptr) { return; }
+    FComponentMask Mask = Locations.at(Entity.Index).Archetype->GetMask();
+    MoveToArchetype(Entity, GetOrCreateArchetype(Mask.reset(Id)));
+}
+
+void FWorld::ForEachChunk(
+    const FComponentMask &Mask, const std::function<void(const FChunkView &)> &Func) {
+    for(auto &Archetype: Archetypes) {
+        if((Archetype->GetMask() & Mask) != Mask) { continue; }
+        for(FChunk &Chunk: Archetype->GetChunks()) {
+            Func(FChunkView(Archetype.get(), &Chunk));
+        }
+    }
+}
+
+void FWorld::ParallelForEachChunk(
+    const FComponentMask &Mask, const std::function<void(const FChunkView &)> &Func) {
+    std::vector<FChunkView> Chunks;
+    for(auto &Archetype: Archetypes) {
+        if((Archetype->GetMask() & Mask) != Mask) { continue; }
+        for(FChunk &Chunk: Archetype->GetChunks()) {
+            Chunks.emplace_back(Archetype.get(), &Chunk);
+        }
+    }
+    FTaskSystem::Get().ParallelFor(
+        static_cast<uint32_t>(Chunks.size()), 1, [&](uint32_t Begin, uint32_t End) {
+            for(uint32_t i = Begin; i < End; i++) {
+                Func(Chunks[i]);
+            }
+        });
+}
+
+void FWorld::Defer(std::function<void(FWorld &)> Command) {
+    std::lock_guard Lock(DeferredMutex);
+    Deferred.push_back(std::move(Command));
+}
+
+void FWorld::Flush() {
+    std::vector<std::function<void(FWorld &)>> Commands;
+    {
+        std::lock_guard Lock(DeferredMutex);
+        Commands.swap(Deferred);
+    }
+    for(auto &Command: Commands) {
+        Command(*this);
+    }
+}
+}
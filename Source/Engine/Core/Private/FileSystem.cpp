@@ -0,0 +1,481 @@
+﻿#include "Core/FileSystem.h"
+#include "Core/Logging.h"
+#include "Core/TaskSystem.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include <zstd.h>
+
+#if defined(WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include "Core/unwindows.h"
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace RE {
+namespace {
+uint64_t HashPath(std::string_view Path) {
+    // FNV-1a, stable across platforms since it is baked into pack files.
+    uint64_t Hash = 0xcbf29ce484222325ull;
+    for(char C: Path) {
+        Hash ^= static_cast<uint8_t>(C);
+        Hash *= 0x100000001b3ull;
+    }
+    return Hash;
+}
+
+uint64_t AlignUp(uint64_t Value, uint64_t Alignment) {
+    return (Value + Alignment - 1) & ~(Alignment - 1);
+}
+
+bool EntryLess(
+    const FPackArchive::FEntry &A, std::string_view NameA, uint64_t HashB,
+    std::string_view NameB) {
+    if(A.PathHash != HashB) { return A.PathHash < HashB; }
+    return NameA < NameB;
+}
+}
+
+std::shared_ptr<FMappedFile> FMappedFile::Open(const std::filesystem::path &Path) {
+    std::shared_ptr<FMappedFile> File(new FMappedFile());
+#if defined(WIN32)
+    HANDLE FileHandle = CreateFileW(
+        Path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if(FileHandle == INVALID_HANDLE_VALUE) { return nullptr; }
+    File->FileHandle = FileHandle;
+
+    LARGE_INTEGER FileSize;
+    if(!GetFileSizeEx(FileHandle, &FileSize)) { return nullptr; }
+    File->Size = static_cast<size_t>(FileSize.QuadPart);
+    if(File->Size == 0) { return File; }
+
+    HANDLE MappingHandle =
+        CreateFileMappingW(FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(MappingHandle == nullptr) { return nullptr; }
+    File->MappingHandle = MappingHandle;
+
+    File->Data =
+        static_cast<const uint8_t *>(MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if(File->Data == nullptr) { return nullptr; }
+#else
+    int Fd = open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(Fd < 0) { return nullptr; }
+
+    struct stat Stat {};
+    if(fstat(Fd, &Stat) != 0) {
+        close(Fd);
+        return nullptr;
+    }
+    File->Size = static_cast<size_t>(Stat.st_size);
+    if(File->Size > 0) {
+        void *Mapped = mmap(nullptr, File->Size, PROT_READ, MAP_PRIVATE, Fd, 0);
+        if(Mapped == MAP_FAILED) {
+            close(Fd);
+            return nullptr;
+        }
+        File->Data = static_cast<const uint8_t *>(Mapped);
+    }
+    // The mapping holds its own reference to the file.
+    close(Fd);
+#endif
+    return File;
+}
+
+FMappedFile::~FMappedFile() {
+#if defined(WIN32)
+    if(Data != nullptr) { UnmapViewOfFile(Data); }
+    if(MappingHandle != nullptr) { CloseHandle(MappingHandle); }
+    if(FileHandle != nullptr) { CloseHandle(FileHandle); }
+#else
+    if(Data != nullptr) { munmap(const_cast<uint8_t *>(Data), Size); }
+#endif
+}
+
+FFileData::FFileData(std::shared_ptr<FMappedFile> Mapping, size_t Offset, size_t Size)
+    : Mapping(std::move(Mapping)), Size(Size), bLoaded(true) {
+    if(this->Mapping->GetData() != nullptr) { Data = this->Mapping->GetData() + Offset; }
+}
+
+FFileData::FFileData(std::vector<uint8_t> &&Buffer)
+    : Owned(std::move(Buffer)), Data(Owned.data()), Size(Owned.size()), bLoaded(true) {}
+
+FDirectoryMount::FDirectoryMount(std::filesystem::path Root): Root(std::move(Root)) {}
+
+bool FDirectoryMount::Exists(std::string_view Path) const {
+    std::error_code Error;
+    return std::filesystem::is_regular_file(Root / std::u8string_view(
+        reinterpret_cast<const char8_t *>(Path.data()), Path.size()), Error);
+}
+
+bool FDirectoryMount::Read(std::string_view Path, FFileData &OutData) const {
+    auto Mapping = FMappedFile::Open(Root / std::u8string_view(
+        reinterpret_cast<const char8_t *>(Path.data()), Path.size()));
+    if(!Mapping) { return false; }
+    const size_t Size = Mapping->GetSize();
+    OutData = FFileData(std::move(Mapping), 0, Size);
+    return true;
+}
+
+bool FDirectoryMount::Locate(std::string_view Path, FFileLocation &OutLocation) const {
+    std::error_code Error;
+    auto FullPath =
+        Root / std::u8string_view(reinterpret_cast<const char8_t *>(Path.data()), Path.size());
+    const auto Size = std::filesystem::file_size(FullPath, Error);
+    if(Error) { return false; }
+    OutLocation = FFileLocation{
+        .Path = std::move(FullPath), .Offset = 0, .StoredSize = Size, .Size = Size};
+    return true;
+}
+
+void FDirectoryMount::Enumerate(std::vector<std::string> &OutPaths) const {
+    std::error_code Error;
+    for(const auto &Entry: std::filesystem::recursive_directory_iterator(Root, Error)) {
+        if(!Entry.is_regular_file()) { continue; }
+        auto Relative = std::filesystem::relative(Entry.path(), Root, Error).u8string();
+        OutPaths.push_back(FVirtualFileSystem::NormalizePath(
+            {reinterpret_cast<const char *>(Relative.data()), Relative.size()}));
+    }
+}
+
+std::unique_ptr<FPackArchive> FPackArchive::Open(const std::filesystem::path &Path) {
+    auto Mapping = FMappedFile::Open(Path);
+    if(!Mapping) {
+        RE_LOGE("Failed to map pack file {}", Path.string());
+        return nullptr;
+    }
+
+    const uint8_t *Base = Mapping->GetData();
+    const size_t Size = Mapping->GetSize();
+    if(Size < sizeof(FHeader)) {
+        RE_LOGE("Pack file {} is truncated", Path.string());
+        return nullptr;
+    }
+
+    const auto *Header = reinterpret_cast<const FHeader *>(Base);
+    if(Header->Magic != Magic || Header->Version != Version) {
+        RE_LOGE("Pack file {} has an unsupported header", Path.string());
+        return nullptr;
+    }
+    if(Header->TocOffset + uint64_t(Header->EntryCount) * sizeof(FEntry) > Size ||
+       Header->NamesOffset + Header->NamesSize > Size) {
+        RE_LOGE("Pack file {} has an out of range table of contents", Path.string());
+        return nullptr;
+    }
+
+    std::unique_ptr<FPackArchive> Archive(new FPackArchive());
+    Archive->ArchivePath = Path;
+    Archive->Entries = {
+        reinterpret_cast<const FEntry *>(Base + Header->TocOffset), Header->EntryCount};
+    Archive->Mapping = std::move(Mapping);
+
+    RE_LOGI("Mounted pack {} ({} entries)", Path.string(), Header->EntryCount);
+    return Archive;
+}
+
+std::string_view FPackArchive::GetName(const FEntry &Entry) const {
+    const auto *Header = reinterpret_cast<const FHeader *>(Mapping->GetData());
+    return {
+        reinterpret_cast<const char *>(Mapping->GetData() + Header->NamesOffset) +
+            Entry.NameOffset,
+        Entry.NameLength};
+}
+
+const FPackArchive::FEntry *FPackArchive::Find(std::string_view Path) const {
+    const uint64_t Hash = HashPath(Path);
+    auto It = std::lower_bound(
+        Entries.begin(), Entries.end(), Hash, [&](const FEntry &Entry, uint64_t Value) {
+            return EntryLess(Entry, GetName(Entry), Value, Path);
+        });
+    if(It == Entries.end() || It->PathHash != Hash || GetName(*It) != Path) {
+        return nullptr;
+    }
+    return &*It;
+}
+
+bool FPackArchive::Exists(std::string_view Path) const { return Find(Path) != nullptr; }
+
+bool FPackArchive::Read(std::string_view Path, FFileData &OutData) const {
+    const FEntry *Entry = Find(Path);
+    return Entry != nullptr && ReadEntry(*Entry, OutData);
+}
+
+bool FPackArchive::ReadEntry(const FEntry &Entry, FFileData &OutData) const {
+    if(Entry.DataOffset + Entry.StoredSize > Mapping->GetSize()) {
+        RE_LOGE("Pack entry {} is out of range", GetName(Entry));
+        return false;
+    }
+
+    if((Entry.Flags & Compressed) == 0) {
+        OutData = FFileData(Mapping, Entry.DataOffset, Entry.Size);
+        return true;
+    }
+
+    std::vector<uint8_t> Buffer(Entry.Size);
+    const size_t Result = ZSTD_decompress(
+        Buffer.data(), Buffer.size(), Mapping->GetData() + Entry.DataOffset,
+        Entry.StoredSize);
+    if(ZSTD_isError(Result) || Result != Entry.Size) {
+        RE_LOGE(
+            "Failed to decompress pack entry {}: {}", GetName(Entry),
+            ZSTD_isError(Result) ? ZSTD_getErrorName(Result) : "size mismatch");
+        return false;
+    }
+    OutData = FFileData(std::move(Buffer));
+    return true;
+}
+
+bool FPackArchive::Locate(std::string_view Path, FFileLocation &OutLocation) const {
+    const FEntry *Entry = Find(Path);
+    if(Entry == nullptr) { return false; }
+    OutLocation = FFileLocation{
+        .Path = ArchivePath,
+        .Offset = Entry->DataOffset,
+        .StoredSize = Entry->StoredSize,
+        .Size = Entry->Size,
+        .bCompressed = (Entry->Flags & Compressed) != 0};
+    return true;
+}
+
+void FPackArchive::Enumerate(std::vector<std::string> &OutPaths) const {
+    for(const auto &Entry: Entries) {
+        OutPaths.emplace_back(GetName(Entry));
+    }
+}
+
+void FPackWriter::AddFile(
+    std::string_view Path, std::span<const uint8_t> Data, int CompressionLevel) {
+    FPendingEntry Entry{
+        .Path = FVirtualFileSystem::NormalizePath(Path), .Size = Data.size(),
+        .bCompressed = false};
+
+    if(CompressionLevel > 0 && !Data.empty()) {
+        Entry.Data.resize(ZSTD_compressBound(Data.size()));
+        const size_t Result = ZSTD_compress(
+            Entry.Data.data(), Entry.Data.size(), Data.data(), Data.size(),
+            CompressionLevel);
+        // Only keep the compressed form when it actually saves space.
+        if(!ZSTD_isError(Result) && Result < Data.size()) {
+            Entry.Data.resize(Result);
+            Entry.bCompressed = true;
+        }
+    }
+    if(!Entry.bCompressed) { Entry.Data.assign(Data.begin(), Data.end()); }
+
+    PendingEntries.push_back(std::move(Entry));
+}
+
+void FPackWriter::AddDirectory(const std::filesystem::path &Directory, int CompressionLevel) {
+    std::error_code Error;
+    for(const auto &DirEntry:
+        std::filesystem::recursive_directory_iterator(Directory, Error)) {
+        if(!DirEntry.is_regular_file()) { continue; }
+
+        std::ifstream Stream(DirEntry.path(), std::ios::binary);
+        std::vector<uint8_t> Data(
+            (std::istreambuf_iterator<char>(Stream)), std::istreambuf_iterator<char>());
+
+        auto Relative = std::filesystem::relative(DirEntry.path(), Directory).u8string();
+        AddFile(
+            {reinterpret_cast<const char *>(Relative.data()), Relative.size()}, Data,
+            CompressionLevel);
+    }
+}
+
+bool FPackWriter::Write(const std::filesystem::path &Path) const {
+    std::ofstream Stream(Path, std::ios::binary | std::ios::trunc);
+    if(!Stream) {
+        RE_LOGE("Failed to open {} for writing", Path.string());
+        return false;
+    }
+
+    std::vector<const FPendingEntry *> Sorted;
+    Sorted.reserve(PendingEntries.size());
+    for(const auto &Entry: PendingEntries) {
+        Sorted.push_back(&Entry);
+    }
+    std::sort(Sorted.begin(), Sorted.end(), [](const auto *A, const auto *B) {
+        const uint64_t HashA = HashPath(A->Path);
+        const uint64_t HashB = HashPath(B->Path);
+        return HashA != HashB ? HashA < HashB : A->Path < B->Path;
+    });
+
+    FPackArchive::FHeader Header{};
+    Header.Magic = FPackArchive::Magic;
+    Header.Version = FPackArchive::Version;
+    Header.EntryCount = static_cast<uint32_t>(Sorted.size());
+
+    std::vector<FPackArchive::FEntry> Toc;
+    Toc.reserve(Sorted.size());
+    std::string Names;
+
+    const char Padding[FPackArchive::DataAlignment] = {};
+    uint64_t Offset = sizeof(Header);
+    Stream.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+
+    for(const auto *Entry: Sorted) {
+        const uint64_t Aligned = AlignUp(Offset, FPackArchive::DataAlignment);
+        Stream.write(Padding, static_cast<std::streamsize>(Aligned - Offset));
+        Offset = Aligned;
+
+        FPackArchive::FEntry TocEntry{};
+        TocEntry.PathHash = HashPath(Entry->Path);
+        TocEntry.DataOffset = Offset;
+        TocEntry.StoredSize = Entry->Data.size();
+        TocEntry.Size = Entry->Size;
+        TocEntry.NameOffset = static_cast<uint32_t>(Names.size());
+        TocEntry.NameLength = static_cast<uint32_t>(Entry->Path.size());
+        TocEntry.Flags = Entry->bCompressed ? FPackArchive::Compressed : FPackArchive::None;
+        Toc.push_back(TocEntry);
+        Names += Entry->Path;
+
+        Stream.write(
+            reinterpret_cast<const char *>(Entry->Data.data()),
+            static_cast<std::streamsize>(Entry->Data.size()));
+        Offset += Entry->Data.size();
+    }
+
+    const uint64_t TocOffset = AlignUp(Offset, alignof(FPackArchive::FEntry));
+    Stream.write(Padding, static_cast<std::streamsize>(TocOffset - Offset));
+    Stream.write(
+        reinterpret_cast<const char *>(Toc.data()),
+        static_cast<std::streamsize>(Toc.size() * sizeof(FPackArchive::FEntry)));
+    Stream.write(Names.data(), static_cast<std::streamsize>(Names.size()));
+
+    Header.TocOffset = TocOffset;
+    Header.NamesOffset = TocOffset + Toc.size() * sizeof(FPackArchive::FEntry);
+    Header.NamesSize = Names.size();
+    Stream.seekp(0);
+    Stream.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+
+    return Stream.good();
+}
+
+FVirtualFileSystem &FVirtualFileSystem::Get() {
+    static FVirtualFileSystem Instance;
+    return Instance;
+}
+
+void FVirtualFileSystem::Mount(std::unique_ptr<FMountPoint> MountPoint) {
+    Mounts.push_back(std::move(MountPoint));
+}
+
+bool FVirtualFileSystem::MountDirectory(const std::filesystem::path &Directory) {
+    std::error_code Error;
+    if(!std::filesystem::is_directory(Directory, Error)) {
+        RE_LOGE("Cannot mount {}: not a directory", Directory.string());
+        return false;
+    }
+    Mount(std::make_unique<FDirectoryMount>(Directory));
+    return true;
+}
+
+bool FVirtualFileSystem::MountPack(const std::filesystem::path &Path) {
+    auto Archive = FPackArchive::Open(Path);
+    if(!Archive) { return false; }
+    Mount(std::move(Archive));
+    return true;
+}
+
+void FVirtualFileSystem::UnmountAll() { Mounts.clear(); }
+
+std::string FVirtualFileSystem::NormalizePath(std::string_view Path) {
+    std::string Result;
+    Result.reserve(Path.size());
+    for(char C: Path) {
+        if(C == '\\') { C = '/'; }
+        if(C == '/' && (Result.empty() || Result.back() == '/')) { continue; }
+        Result.push_back(C);
+    }
+    if(Result.starts_with("./")) { Result.erase(0, 2); }
+    return Result;
+}
+
+const FMountPoint *FVirtualFileSystem::FindMount(std::string_view NormalizedPath) const {
+    for(auto It = Mounts.rbegin(); It != Mounts.rend(); ++It) {
+        if((*It)->Exists(NormalizedPath)) { return It->get(); }
+    }
+    return nullptr;
+}
+
+bool FVirtualFileSystem::Exists(std::string_view Path) const {
+    return FindMount(NormalizePath(Path)) != nullptr;
+}
+
+bool FVirtualFileSystem::Read(std::string_view Path, FFileData &OutData) const {
+    const std::string Normalized = NormalizePath(Path);
+    for(auto It = Mounts.rbegin(); It != Mounts.rend(); ++It) {
+        if((*It)->Read(Normalized, OutData)) { return true; }
+    }
+    RE_LOGW("VFS: {} not found", Normalized);
+    return false;
+}
+
+bool FVirtualFileSystem::Locate(std::string_view Path, FFileLocation &OutLocation) const {
+    const std::string Normalized = NormalizePath(Path);
+    for(auto It = Mounts.rbegin(); It != Mounts.rend(); ++It) {
+        if((*It)->Locate(Normalized, OutLocation)) { return true; }
+    }
+    return false;
+}
+
+FIOHandle FVirtualFileSystem::ReadAsync(
+    std::string_view Path, EIOPriority Priority, FIOCompletion OnComplete) const {
+    FFileLocation Location;
+    if(!Locate(Path, Location)) {
+        RE_LOGW("VFS: {} not found", Path);
+        FTaskSystem::Get().Enqueue([OnComplete = std::move(OnComplete)]() {
+            OnComplete(EIOStatus::Failed, FIOBuffer());
+        });
+        return {};
+    }
+
+    FIOReadRequest Request{
+        .Path = Location.Path,
+        .Offset = Location.Offset,
+        .Size = Location.StoredSize,
+        .Priority = Priority};
+    if(!Location.bCompressed) {
+        Request.OnComplete = std::move(OnComplete);
+        return FAsyncIO::Get().Read(std::move(Request));
+    }
+
+    Request.OnComplete = [Size = Location.Size, OnComplete = std::move(OnComplete)](
+                             EIOStatus Status, FIOBuffer &&Buffer) {
+        if(Status != EIOStatus::Completed) {
+            OnComplete(Status, std::move(Buffer));
+            return;
+        }
+        std::vector<uint8_t> Decompressed(Size);
+        const size_t Result = ZSTD_decompress(
+            Decompressed.data(), Decompressed.size(), Buffer.GetData(), Buffer.GetSize());
+        // Hand the staging buffer back to the reader before the consumer runs.
+        Buffer = FIOBuffer();
+        if(ZSTD_isError(Result) || Result != Size) {
+            OnComplete(EIOStatus::Failed, FIOBuffer());
+            return;
+        }
+        OnComplete(EIOStatus::Completed, FIOBuffer(std::move(Decompressed)));
+    };
+    return FAsyncIO::Get().Read(std::move(Request));
+}
+
+std::vector<FFileData> FVirtualFileSystem::ReadBatch(
+    std::span<const std::string_view> Paths) const {
+    std::vector<FFileData> Results(Paths.size());
+    FTaskSystem::Get().ParallelFor(
+        static_cast<uint32_t>(Paths.size()), 1, [&](uint32_t Begin, uint32_t End) {
+            for(uint32_t i = Begin; i < End; i++) {
+                Read(Paths[i], Results[i]);
+            }
+        });
+    return Results;
+}
+}
@@ -1,12 +1,34 @@
 ﻿#include "Core/Logging.h"
+#include "Core/Profiler.h"
+#include <spdlog/async.h>
 #include <spdlog/common.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
+#include <chrono>
+#include <thread>
+
 namespace RE {
-void FLogging::Init() {
+namespace {
+// Longest Flush waits for the queue to drain while other threads keep logging.
+constexpr std::chrono::milliseconds FlushTimeout{500};
+
+std::shared_ptr<spdlog::details::thread_pool> ThreadPool;
+}
+
+void FLogging::Init(ELoggingMode Mode) {
     std::vector<spdlog::sink_ptr> sinks;
     sinks.push_back(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
-    auto logger = std::make_shared<spdlog::logger>("logger", sinks.begin(), sinks.end());
+    std::shared_ptr<spdlog::logger> logger;
+    if(Mode == ELoggingMode::Async) {
+        // One thread keeps the messages in order, the queue's slots are allocated here.
+        ThreadPool = std::make_shared<spdlog::details::thread_pool>(
+            QueueSize, 1, []() { RE_PROFILE_THREAD("Logging"); });
+        logger = std::make_shared<spdlog::async_logger>(
+            "logger", sinks.begin(), sinks.end(), ThreadPool,
+            spdlog::async_overflow_policy::overrun_oldest);
+    } else {
+        logger = std::make_shared<spdlog::logger>("logger", sinks.begin(), sinks.end());
+    }
 
 #if RE_DEVELOPMENT
     logger->set_level(spdlog::level::debug);
@@ -15,8 +37,47 @@ void FLogging::Init() {
 #endif
 
     logger->set_pattern(RE_LOGGER_FORMAT);
+    logger->flush_on(spdlog::level::warn);
     spdlog::set_default_logger(logger);
 
     RE_LOGI("Logger initialized");
 }
-}
\ No newline at end of file
+
+void FLogging::Flush() {
+    auto logger = spdlog::default_logger();
+    logger->flush();
+    if(!ThreadPool) { return; }
+
+    // The async flush only queues a request. The single thread writes messages in order,
+    // so once the queue is empty everything before the request has reached the sinks,
+    // whose flush then waits for a write still in progress.
+    const auto Deadline = std::chrono::steady_clock::now() + FlushTimeout;
+    while(ThreadPool->queue_size() > 0 && std::chrono::steady_clock::now() < Deadline) {
+        std::this_thread::yield();
+    }
+    for(auto &sink: logger->sinks()) {
+        sink->flush();
+    }
+}
+
+void FLogging::Shutdown() {
+    if(!ThreadPool) { return; }
+    if(ThreadPool->overrun_counter() > 0) {
+        RE_LOGW("Logging dropped {} messages.", ThreadPool->overrun_counter());
+    }
+    // Later messages go straight to the same sinks, then releasing the pool joins its
+    // thread once it has written what is still queued.
+    auto logger = spdlog::default_logger();
+    auto sync = std::make_shared<spdlog::logger>(
+        logger->name(), logger->sinks().begin(), logger->sinks().end());
+    sync->set_level(logger->level());
+    sync->flush_on(spdlog::level::warn);
+    spdlog::set_default_logger(sync);
+    logger.reset();
+    ThreadPool.reset();
+}
+
+size_t FLogging::GetDroppedCount() {
+    return ThreadPool ? ThreadPool->overrun_counter() : 0;
+}
+}
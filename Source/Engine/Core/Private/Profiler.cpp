@@ -0,0 +1,253 @@
+﻿#include "Core/Profiler.h"
+#include "Core/Logging.h"
+
+#include <tsl/robin_map.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+namespace RE {
+namespace {
+thread_local void *CurrentRing = nullptr;
+
+void WriteJsonString(std::ofstream &Stream, const char *Text) {
+    Stream << '"';
+    for(const char *c = Text; *c; c++) {
+        if(*c == '"' || *c == '\\') {
+            Stream << '\\' << *c;
+        } else if(static_cast<unsigned char>(*c) < 0x20) {
+            Stream << ' ';
+        } else {
+            Stream << *c;
+        }
+    }
+    Stream << '"';
+}
+}
+
+uint64_t FProfiler::SinceStart(uint64_t Ns) const {
+    return Ns > CaptureStart ? Ns - CaptureStart : 0;
+}
+
+FProfiler &FProfiler::Get() {
+    static FProfiler Instance;
+    return Instance;
+}
+
+uint64_t FProfiler::Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+FProfiler::FThreadRing &FProfiler::CreateRing(std::string Name) {
+    auto Ring = std::make_unique<FThreadRing>();
+    Ring->Name = std::move(Name);
+    Ring->Events = std::make_unique<FProfileEvent[]>(RingCapacity);
+    return *Rings.emplace_back(std::move(Ring));
+}
+
+FProfiler::FThreadRing &FProfiler::GetThreadRing() {
+    if(CurrentRing == nullptr) {
+        std::lock_guard Lock(Mutex);
+        CurrentRing = &CreateRing(fmt::format("Thread {}", Rings.size()));
+    }
+    return *static_cast<FThreadRing *>(CurrentRing);
+}
+
+void FProfiler::Push(FThreadRing &Ring, const FProfileEvent &Event) {
+    const uint64_t Head = Ring.Head.load(std::memory_order_relaxed);
+    if(Head - Ring.Tail.load(std::memory_order_acquire) >= RingCapacity) {
+        Ring.Dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Ring.Events[Head & (RingCapacity - 1)] = Event;
+    Ring.Head.store(Head + 1, std::memory_order_release);
+}
+
+void FProfiler::Record(const char *Name, uint64_t BeginNs, uint64_t EndNs) {
+    Push(GetThreadRing(), {Name, BeginNs, EndNs});
+}
+
+uint32_t FProfiler::CreateTrack(const char *Name) {
+    std::lock_guard Lock(Mutex);
+    CreateRing(Name);
+    return uint32_t(Rings.size() - 1);
+}
+
+void FProfiler::RecordTrack(
+    uint32_t Track, const char *Name, uint64_t BeginNs, uint64_t EndNs) {
+    if(!IsCapturing()) { return; }
+    // Tracks are fed from results read back once per frame, off the hot path, so the
+    // list that other threads may grow is read under the mutex.
+    FThreadRing *Ring;
+    {
+        std::lock_guard Lock(Mutex);
+        if(Track >= Rings.size()) { return; }
+        Ring = Rings[Track].get();
+    }
+    Push(*Ring, {Name, BeginNs, EndNs});
+}
+
+void FProfiler::SetThreadName(const char *Name) {
+    FThreadRing &Ring = GetThreadRing();
+    std::lock_guard Lock(Mutex);
+    Ring.Name = Name;
+}
+
+void FProfiler::Collect() {
+    for(auto &Ring: Rings) {
+        const uint64_t Tail = Ring->Tail.load(std::memory_order_relaxed);
+        const uint64_t Head = Ring->Head.load(std::memory_order_acquire);
+        for(uint64_t i = Tail; i < Head; i++) {
+            Ring->Collected.push_back(Ring->Events[i & (RingCapacity - 1)]);
+        }
+        Ring->Tail.store(Head, std::memory_order_release);
+    }
+}
+
+void FProfiler::BeginCapture() {
+    std::lock_guard Lock(Mutex);
+    Collect();
+    for(auto &Ring: Rings) {
+        Ring->Collected.clear();
+        Ring->Dropped.store(0, std::memory_order_relaxed);
+    }
+    Frames.clear();
+    CaptureStart = Now();
+    bCapturing.store(true, std::memory_order_relaxed);
+}
+
+void FProfiler::EndCapture() {
+    bCapturing.store(false, std::memory_order_relaxed);
+    std::lock_guard Lock(Mutex);
+    Collect();
+    RE_LOGI(
+        "Profiler capture of {} frames, {} events, {} dropped.", Frames.size(),
+        CountEvents(), CountDropped());
+}
+
+void FProfiler::MarkFrame() {
+    if(!IsCapturing()) { return; }
+    std::lock_guard Lock(Mutex);
+    Collect();
+    Frames.push_back(Now());
+}
+
+uint64_t FProfiler::GetEventCount() const {
+    std::lock_guard Lock(Mutex);
+    return CountEvents();
+}
+
+uint64_t FProfiler::GetDroppedCount() const {
+    std::lock_guard Lock(Mutex);
+    return CountDropped();
+}
+
+uint64_t FProfiler::CountEvents() const {
+    uint64_t Count = 0;
+    for(const auto &Ring: Rings) {
+        Count += Ring->Collected.size();
+    }
+    return Count;
+}
+
+uint64_t FProfiler::CountDropped() const {
+    uint64_t Count = 0;
+    for(const auto &Ring: Rings) {
+        Count += Ring->Dropped.load(std::memory_order_relaxed);
+    }
+    return Count;
+}
+
+bool FProfiler::WriteChromeTrace(const std::filesystem::path &Path) {
+    std::lock_guard Lock(Mutex);
+    Collect();
+    std::ofstream Stream(Path, std::ios::trunc);
+    if(!Stream) {
+        RE_LOGE("Failed to open {} for writing", Path.string());
+        return false;
+    }
+
+    Stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool bFirst = true;
+    auto Separate = [&]() {
+        Stream << (bFirst ? "\n" : ",\n");
+        bFirst = false;
+    };
+    // Times are in microseconds, the unit of the trace event format.
+    for(size_t Thread = 0; Thread < Rings.size(); Thread++) {
+        Separate();
+        Stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << Thread
+               << ",\"args\":{\"name\":";
+        WriteJsonString(Stream, Rings[Thread]->Name.c_str());
+        Stream << "}}";
+        for(const FProfileEvent &Event: Rings[Thread]->Collected) {
+            Separate();
+            Stream << "{\"name\":";
+            WriteJsonString(Stream, Event.Name);
+            Stream << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << Thread
+                   << ",\"ts\":" << SinceStart(Event.BeginNs) * 1e-3
+                   << ",\"dur\":" << double(Event.EndNs - Event.BeginNs) * 1e-3 << "}";
+        }
+    }
+    for(uint64_t Frame: Frames) {
+        Separate();
+        Stream << "{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":"
+               << SinceStart(Frame) * 1e-3 << "}";
+    }
+    Stream << "\n]}\n";
+    return bool(Stream);
+}
+
+bool FProfiler::WriteBinary(const std::filesystem::path &Path) {
+    std::lock_guard Lock(Mutex);
+    Collect();
+    std::ofstream Stream(Path, std::ios::binary | std::ios::trunc);
+    if(!Stream) {
+        RE_LOGE("Failed to open {} for writing", Path.string());
+        return false;
+    }
+
+    // Names are keyed by pointer, a literal keeps its address however often it is used.
+    tsl::robin_map<const char *, uint32_t> NameLookup;
+    std::vector<const char *> Names;
+    std::vector<FBinaryEvent> Events;
+    Events.reserve(CountEvents());
+    for(size_t Thread = 0; Thread < Rings.size(); Thread++) {
+        for(const FProfileEvent &Event: Rings[Thread]->Collected) {
+            auto [It, bInserted] =
+                NameLookup.try_emplace(Event.Name, uint32_t(Names.size()));
+            if(bInserted) { Names.push_back(Event.Name); }
+            Events.push_back(
+                {It->second, uint32_t(Thread), SinceStart(Event.BeginNs),
+                 Event.EndNs - Event.BeginNs});
+        }
+    }
+
+    auto WriteString = [&](std::string_view Text) {
+        const uint16_t Length = uint16_t(std::min<size_t>(Text.size(), UINT16_MAX));
+        Stream.write(reinterpret_cast<const char *>(&Length), sizeof(Length));
+        Stream.write(Text.data(), Length);
+    };
+    const FBinaryHeader Header{
+        Magic, Version, uint32_t(Names.size()), uint32_t(Rings.size()), Events.size(),
+        Frames.size()};
+    Stream.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+    for(const char *Name: Names) {
+        WriteString(Name);
+    }
+    for(const auto &Ring: Rings) {
+        WriteString(Ring->Name);
+    }
+    Stream.write(
+        reinterpret_cast<const char *>(Events.data()),
+        Events.size() * sizeof(FBinaryEvent));
+    for(uint64_t Frame: Frames) {
+        const uint64_t Offset = SinceStart(Frame);
+        Stream.write(reinterpret_cast<const char *>(&Offset), sizeof(Offset));
+    }
+    return bool(Stream);
+}
+}
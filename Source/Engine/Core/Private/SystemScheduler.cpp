@@ -0,0 +1,68 @@
+﻿#include "Core/SystemScheduler.h"
+#include "Core/Logging.h"
+#include "Core/TaskSystem.h"
+
+#include <algorithm>
+
+namespace RE {
+bool FSystemAccess::ConflictsWith(const FSystemAccess &Other) const {
+    if(bExclusive || Other.bExclusive) { return true; }
+    return (Writes & (Other.Reads | Other.Writes)).any() || (Other.Writes & Reads).any();
+}
+
+void FSystemScheduler::Add(
+    std::string Name, const FSystemAccess &Access, FSystemFunc Func) {
+    Systems.push_back({std::move(Name), Access, std::move(Func)});
+    bStagesDirty = true;
+}
+
+void FSystemScheduler::BuildStages() {
+    Stages.clear();
+    std::vector<uint32_t> SystemStages(Systems.size(), 0);
+    for(uint32_t i = 0; i < Systems.size(); i++) {
+        uint32_t Stage = 0;
+        for(uint32_t j = 0; j < i; j++) {
+            if(Systems[i].Access.ConflictsWith(Systems[j].Access)) {
+                Stage = std::max(Stage, SystemStages[j] + 1);
+            }
+        }
+        SystemStages[i] = Stage;
+        if(Stage >= Stages.size()) { Stages.resize(Stage + 1); }
+        Stages[Stage].push_back(i);
+    }
+    bStagesDirty = false;
+}
+
+uint32_t FSystemScheduler::GetStageCount() {
+    if(bStagesDirty) { BuildStages(); }
+    return static_cast<uint32_t>(Stages.size());
+}
+
+void FSystemScheduler::LogStages() {
+    if(bStagesDirty) { BuildStages(); }
+    for(size_t Stage = 0; Stage < Stages.size(); Stage++) {
+        std::string Names;
+        for(uint32_t System: Stages[Stage]) {
+            Names += (Names.empty() ? "" : ", ") + Systems[System].Name;
+        }
+        RE_LOGI("System stage {}: {}", Stage, Names);
+    }
+}
+
+void FSystemScheduler::Run(FWorld &World) {
+    if(bStagesDirty) { BuildStages(); }
+    for(const std::vector<uint32_t> &Stage: Stages) {
+        if(Stage.size() == 1) {
+            Systems[Stage[0]].Func(World);
+        } else {
+            const auto Count = static_cast<uint32_t>(Stage.size());
+            FTaskSystem::Get().ParallelFor(Count, 1, [&](uint32_t Begin, uint32_t End) {
+                for(uint32_t i = Begin; i < End; i++) {
+                    Systems[Stage[i]].Func(World);
+                }
+            });
+        }
+        World.Flush();
+    }
+}
+}
@@ -0,0 +1,100 @@
+﻿#include "Core/TaskSystem.h"
+#include "Core/Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace RE {
+FTaskSystem &FTaskSystem::Get() {
+    static FTaskSystem Instance;
+    return Instance;
+}
+
+FTaskSystem::FTaskSystem(uint32_t NumWorkers) {
+    if(NumWorkers == 0) {
+        NumWorkers = std::max(1u, std::thread::hardware_concurrency() - 1);
+    }
+    Workers.reserve(NumWorkers);
+    for(uint32_t i = 0; i < NumWorkers; i++) {
+        Workers.emplace_back([this]() { WorkerLoop(); });
+    }
+}
+
+FTaskSystem::~FTaskSystem() {
+    {
+        std::lock_guard Lock(QueueMutex);
+        bStopping = true;
+    }
+    QueueCondition.notify_all();
+    for(auto &Worker: Workers) {
+        Worker.join();
+    }
+}
+
+void FTaskSystem::Enqueue(FTask Task) {
+    {
+        std::lock_guard Lock(QueueMutex);
+        Queue.push_back(std::move(Task));
+    }
+    QueueCondition.notify_one();
+}
+
+void FTaskSystem::ParallelFor(uint32_t Count, uint32_t BatchSize, const FRangeFunc &Func) {
+    if(Count == 0) { return; }
+    BatchSize = std::max(1u, BatchSize);
+    const uint32_t NumBatches = (Count + BatchSize - 1) / BatchSize;
+    if(NumBatches == 1) {
+        Func(0, Count);
+        return;
+    }
+
+    // Helpers may start after the caller already drained every batch, so the shared state
+    // must outlive this call.
+    struct FState {
+        std::atomic<uint32_t> NextBatch{0};
+        std::atomic<uint32_t> DoneBatches{0};
+        std::mutex DoneMutex;
+        std::condition_variable DoneCondition;
+    };
+    auto State = std::make_shared<FState>();
+
+    auto RunBatches = [State, &Func, Count, BatchSize, NumBatches]() {
+        uint32_t Batch;
+        while((Batch = State->NextBatch.fetch_add(1)) < NumBatches) {
+            const uint32_t Begin = Batch * BatchSize;
+            Func(Begin, std::min(Count, Begin + BatchSize));
+            if(State->DoneBatches.fetch_add(1) + 1 == NumBatches) {
+                std::lock_guard Lock(State->DoneMutex);
+                State->DoneCondition.notify_all();
+            }
+        }
+    };
+
+    const uint32_t NumHelpers = std::min(GetNumWorkers(), NumBatches - 1);
+    for(uint32_t i = 0; i < NumHelpers; i++) {
+        Enqueue(RunBatches);
+    }
+    RunBatches();
+
+    std::unique_lock Lock(State->DoneMutex);
+    State->DoneCondition.wait(
+        Lock, [&State, NumBatches]() { return State->DoneBatches.load() == NumBatches; });
+}
+
+void FTaskSystem::WorkerLoop() {
+    RE_PROFILE_THREAD("Task Worker");
+    while(true) {
+        FTask Task;
+        {
+            std::unique_lock Lock(QueueMutex);
+            QueueCondition.wait(Lock, [this]() { return bStopping || !Queue.empty(); });
+            if(bStopping && Queue.empty()) { return; }
+            Task = std::move(Queue.front());
+            Queue.pop_front();
+        }
+        RE_PROFILE_SCOPE("Task");
+        Task();
+    }
+}
+}
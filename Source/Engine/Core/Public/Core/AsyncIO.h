@@ -0,0 +1,110 @@
+﻿#pragma once
+#include "re-core_export.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace RE {
+enum class EIOPriority : uint8_t { Low, Normal, High, Critical };
+
+enum class EIOStatus : uint8_t { Pending, InFlight, Completed, Cancelled, Failed };
+
+/*
+ * Bytes produced by a read. Backed either by a heap buffer or by one of the backend's
+ * registered buffers, which goes back to the pool when the FIOBuffer is destroyed. Holding on
+ * to buffers for long therefore throttles the reader; copy out what has to be kept.
+ */
+class RE_CORE_EXPORT FIOBuffer {
+public:
+    FIOBuffer() = default;
+    explicit FIOBuffer(std::vector<uint8_t> &&Buffer);
+    FIOBuffer(const uint8_t *Data, size_t Size, std::function<void()> OnRelease);
+
+    FIOBuffer(FIOBuffer &&Other) noexcept;
+    FIOBuffer &operator=(FIOBuffer &&Other) noexcept;
+    FIOBuffer(const FIOBuffer &) = delete;
+    FIOBuffer &operator=(const FIOBuffer &) = delete;
+
+    ~FIOBuffer();
+
+    const uint8_t *GetData() const { return Data; }
+    size_t GetSize() const { return Size; }
+    std::span<const uint8_t> GetBytes() const { return {Data, Size}; }
+
+    void Shrink(size_t NewSize);
+
+private:
+    void Reset();
+
+    std::vector<uint8_t> Owned;
+    const uint8_t *Data{nullptr};
+    size_t Size{0};
+    std::function<void()> OnRelease;
+};
+
+/* Runs on a task system worker, never on the I/O thread. */
+using FIOCompletion = std::function<void(EIOStatus Status, FIOBuffer &&Buffer)>;
+
+struct FIOReadRequest {
+    std::filesystem::path Path;
+    uint64_t Offset{0};
+    uint64_t Size{0};
+    EIOPriority Priority{EIOPriority::Normal};
+    FIOCompletion OnComplete;
+};
+
+struct FIORequestState;
+
+class RE_CORE_EXPORT FIOHandle {
+public:
+    FIOHandle() = default;
+    explicit FIOHandle(std::shared_ptr<FIORequestState> State);
+
+    /*
+     * Requests that have not reached the device are dropped; reads already in flight finish
+     * but report EIOStatus::Cancelled. The completion is invoked either way.
+     */
+    void Cancel();
+
+    EIOStatus GetStatus() const;
+
+    bool IsDone() const;
+
+    /* Blocks until the completion callback has returned. */
+    void Wait() const;
+
+private:
+    std::shared_ptr<FIORequestState> State;
+};
+
+class FAsyncIOBackend;
+
+/*
+ * Asynchronous file reads. Uses io_uring with registered buffers and batched submission on
+ * Linux and falls back to a small pool of threads issuing positional reads elsewhere.
+ */
+class RE_CORE_EXPORT FAsyncIO {
+public:
+    static FAsyncIO &Get();
+
+    FAsyncIO();
+
+    ~FAsyncIO();
+
+    FAsyncIO(const FAsyncIO &) = delete;
+    FAsyncIO &operator=(const FAsyncIO &) = delete;
+
+    FIOHandle Read(FIOReadRequest &&Request);
+
+    const char *GetBackendName() const;
+
+private:
+    std::unique_ptr<FAsyncIOBackend> Backend;
+    std::atomic<uint64_t> NextSequence{0};
+};
+}
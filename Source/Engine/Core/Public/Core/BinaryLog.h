@@ -0,0 +1,252 @@
+﻿#pragma once
+#include "re-core_export.h"
+#include "Core/Profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Logs the raw bytes of the arguments, formatted offline by RE-LogDecoder. Format must
+ * be a literal in fmt syntax; its site is registered once, keyed by an ID hashed from the
+ * format, file and line at compile time. Arguments are numbers, enums, pointers and
+ * strings, which are copied. Without RE_BINARY_LOGGING the macro compiles to nothing.
+ */
+#if RE_BINARY_LOGGING
+    #define RE_BINARY_LOG(Format, ...)                                                    \
+        [&](const auto &...BinaryLogArgs) {                                               \
+            ::RE::FBinaryLog &BinaryLog = ::RE::FBinaryLog::Get();                        \
+            if(!BinaryLog.IsOpen()) { return; }                                           \
+            static constexpr uint32_t Id =                                                \
+                ::RE::FBinaryLog::SiteId(Format, __FILE__, __LINE__);                     \
+            static const bool bRegistered = BinaryLog.Register(                           \
+                Id, Format, __FILE__, __LINE__,                                           \
+                ::RE::FBinaryLog::Signature<std::decay_t<decltype(BinaryLogArgs)>...>()); \
+            if(bRegistered) { BinaryLog.Write(Id, BinaryLogArgs...); }                    \
+        }(__VA_ARGS__)
+#else
+    #define RE_BINARY_LOG(Format, ...) \
+        do {                           \
+        } while(false)
+#endif
+
+namespace RE {
+/*
+ * Per-thread byte rings of log records, the counterpart of FProfiler's event rings: the
+ * owning thread is the only writer and publishes a whole record with a release store of
+ * the head, Flush the only reader, so a log site takes no lock and allocates nothing. A
+ * record that does not fit is dropped and counted. Flush writes the new sites, threads
+ * and records to the file, call it once per frame or so to keep the rings short.
+ *
+ * The file starts with FFileHeader followed by chunks, each an EChunk byte and:
+ *  - Site: the ID, the line, the argument count and types, the file and the format.
+ *  - Thread: the thread index and its name.
+ *  - Records: the thread index, the byte count and the records, each the site ID, the
+ *    time of FProfiler::Now and the arguments.
+ * Strings are a uint16_t length and the characters, everything else native endian.
+ */
+class RE_CORE_EXPORT FBinaryLog {
+public:
+    /* Bytes per ring, a power of two. */
+    static constexpr uint32_t RingCapacity = 1 << 20;
+    /* Longer string arguments are cut. */
+    static constexpr uint32_t MaxStringLength = 1024;
+
+    static constexpr uint32_t Magic = 0x4C425245; // "REBL"
+    static constexpr uint32_t Version = 1;
+    struct FFileHeader {
+        uint32_t Magic;
+        uint32_t Version;
+        uint64_t StartNs;
+    };
+    enum class EChunk : uint8_t { Site, Thread, Records };
+    enum class EArgType : uint8_t {
+        Bool,
+        Int8,
+        UInt8,
+        Int16,
+        UInt16,
+        Int32,
+        UInt32,
+        Int64,
+        UInt64,
+        Float,
+        Double,
+        Pointer,
+        String
+    };
+
+    static FBinaryLog &Get();
+
+    FBinaryLog(const FBinaryLog &) = delete;
+    FBinaryLog &operator=(const FBinaryLog &) = delete;
+
+    /* Starts a new file, dropping whatever the rings still hold. */
+    bool Open(const std::filesystem::path &Path);
+    /* Flushes and closes the file. */
+    void Close();
+    bool IsOpen() const { return bOpen.load(std::memory_order_relaxed); }
+
+    void SetThreadName(const char *Name);
+    void Flush();
+    uint64_t GetDroppedCount() const;
+
+    /* FNV-1a, distinct per site unless two hash alike, which Register reports. */
+    static consteval uint32_t SiteId(const char *Format, const char *File, uint32_t Line) {
+        uint32_t Hash = 2166136261u;
+        auto Mix = [&](uint8_t Byte) { Hash = (Hash ^ Byte) * 16777619u; };
+        for(const char *c = Format; *c; c++) {
+            Mix(uint8_t(*c));
+        }
+        for(const char *c = File; *c; c++) {
+            Mix(uint8_t(*c));
+        }
+        for(uint32_t i = 0; i < 4; i++) {
+            Mix(uint8_t(Line >> (i * 8)));
+        }
+        return Hash;
+    }
+
+    template<typename T>
+    static constexpr EArgType GetArgType() {
+        if constexpr(std::is_same_v<T, bool>) {
+            return EArgType::Bool;
+        } else if constexpr(std::is_enum_v<T>) {
+            return GetArgType<std::underlying_type_t<T>>();
+        } else if constexpr(std::is_integral_v<T>) {
+            constexpr bool bSigned = std::is_signed_v<T>;
+            if constexpr(sizeof(T) == 1) {
+                return bSigned ? EArgType::Int8 : EArgType::UInt8;
+            } else if constexpr(sizeof(T) == 2) {
+                return bSigned ? EArgType::Int16 : EArgType::UInt16;
+            } else if constexpr(sizeof(T) == 4) {
+                return bSigned ? EArgType::Int32 : EArgType::UInt32;
+            } else {
+                static_assert(sizeof(T) == 8);
+                return bSigned ? EArgType::Int64 : EArgType::UInt64;
+            }
+        } else if constexpr(std::is_same_v<T, float>) {
+            return EArgType::Float;
+        } else if constexpr(std::is_same_v<T, double>) {
+            return EArgType::Double;
+        } else if constexpr(
+            std::is_same_v<T, const char *> || std::is_same_v<T, char *> ||
+            std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>) {
+            return EArgType::String;
+        } else {
+            static_assert(std::is_pointer_v<T>, "Unsupported binary log argument.");
+            return EArgType::Pointer;
+        }
+    }
+
+    template<typename... TArgs>
+    static constexpr std::array<EArgType, sizeof...(TArgs)> Signature() {
+        return {GetArgType<TArgs>()...};
+    }
+
+    /* Returns false if another site already took the ID. */
+    bool Register(
+        uint32_t Id, const char *Format, const char *File, uint32_t Line,
+        std::span<const EArgType> Args);
+
+    template<typename... TArgs>
+    void Write(uint32_t Id, const TArgs &...Args) {
+        FThreadRing &Ring = GetThreadRing();
+        const uint64_t Size = sizeof(Id) + sizeof(uint64_t) + (0 + ... + ArgSize(Args));
+        uint64_t Head = Ring.Head.load(std::memory_order_relaxed);
+        if(Head + Size - Ring.Tail.load(std::memory_order_acquire) > RingCapacity) {
+            Ring.Dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        const uint64_t Now = FProfiler::Now();
+        Copy(Ring, Head, &Id, sizeof(Id));
+        Copy(Ring, Head, &Now, sizeof(Now));
+        (Put(Ring, Head, Args), ...);
+        Ring.Head.store(Head, std::memory_order_release);
+    }
+
+private:
+    struct FThreadRing {
+        uint32_t Index;
+        std::string Name;
+        bool bNameWritten{false};
+        std::unique_ptr<uint8_t[]> Bytes;
+        std::atomic<uint64_t> Head{0};
+        std::atomic<uint64_t> Tail{0};
+        std::atomic<uint64_t> Dropped{0};
+    };
+    struct FSite {
+        uint32_t Id;
+        const char *Format;
+        const char *File;
+        uint32_t Line;
+        std::vector<EArgType> Args;
+    };
+
+    FBinaryLog() = default;
+    FThreadRing &GetThreadRing();
+    void WriteChunks();
+    uint64_t CountDropped() const;
+
+    static std::string_view ToString(const char *Text) { return Text ? Text : ""; }
+    static std::string_view ToString(std::string_view Text) { return Text; }
+    static uint16_t StringLength(std::string_view Text) {
+        return uint16_t(std::min<size_t>(Text.size(), MaxStringLength));
+    }
+
+    template<typename T>
+    static uint64_t ArgSize(const T &Arg) {
+        if constexpr(GetArgType<std::decay_t<T>>() == EArgType::String) {
+            return sizeof(uint16_t) + StringLength(ToString(Arg));
+        } else if constexpr(GetArgType<std::decay_t<T>>() == EArgType::Pointer) {
+            return sizeof(uint64_t);
+        } else {
+            return sizeof(T);
+        }
+    }
+
+    static void Copy(FThreadRing &Ring, uint64_t &Offset, const void *Data, size_t Size) {
+        const size_t Begin = Offset & (RingCapacity - 1);
+        const size_t First = std::min<size_t>(Size, RingCapacity - Begin);
+        std::memcpy(&Ring.Bytes[Begin], Data, First);
+        std::memcpy(
+            &Ring.Bytes[0], static_cast<const uint8_t *>(Data) + First, Size - First);
+        Offset += Size;
+    }
+
+    template<typename T>
+    static void Put(FThreadRing &Ring, uint64_t &Offset, const T &Arg) {
+        if constexpr(GetArgType<std::decay_t<T>>() == EArgType::String) {
+            const std::string_view Text = ToString(Arg);
+            const uint16_t Length = StringLength(Text);
+            Copy(Ring, Offset, &Length, sizeof(Length));
+            Copy(Ring, Offset, Text.data(), Length);
+        } else if constexpr(GetArgType<std::decay_t<T>>() == EArgType::Pointer) {
+            const uint64_t Address = reinterpret_cast<uintptr_t>(Arg);
+            Copy(Ring, Offset, &Address, sizeof(Address));
+        } else {
+            Copy(Ring, Offset, &Arg, sizeof(T));
+        }
+    }
+
+    std::atomic<bool> bOpen{false};
+    /* Guards the rings, the sites and the file, taken off the hot path only. */
+    mutable std::mutex Mutex;
+    std::vector<std::unique_ptr<FThreadRing>> Rings;
+    std::vector<FSite> Sites;
+    /* Sites already in the file. */
+    size_t WrittenSites{0};
+    std::ofstream Stream;
+};
+}
@@ -0,0 +1,264 @@
+﻿#pragma once
+#include "re-core_export.h"
+
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+
+#include <tsl/robin_map.h>
+
+namespace RE {
+constexpr uint32_t MaxComponentTypes = 128;
+/* Chunk size in bytes, one chunk of a few components fits comfortably in L2. */
+constexpr uint32_t ChunkSize = 16 * 1024;
+
+using FComponentId = uint32_t;
+using FComponentMask = std::bitset<MaxComponentTypes>;
+
+struct FEntity {
+    uint32_t Index{UINT32_MAX};
+    uint32_t Generation{0};
+
+    bool IsValid() const { return Index != UINT32_MAX; }
+    bool operator==(const FEntity &) const = default;
+};
+
+struct FComponentInfo {
+    const char *Name{nullptr};
+    uint32_t Size{0};
+    uint32_t Alignment{0};
+    void (*MoveConstruct)(void *Destination, void *Source){nullptr};
+    void (*Destruct)(void *Component){nullptr};
+};
+
+class RE_CORE_EXPORT FComponentRegistry {
+public:
+    /* Ids are keyed by type name, so every module resolves a type to the same id. */
+    static FComponentId Register(const FComponentInfo &Info);
+    static const FComponentInfo &Get(FComponentId Id);
+};
+
+template<typename T>
+FComponentId GetComponentId() {
+    using FType = std::remove_cvref_t<T>;
+    static const FComponentId Id = FComponentRegistry::Register(
+        {typeid(FType).name(), sizeof(FType), alignof(FType),
+         [](void *Destination, void *Source) {
+             new(Destination) FType(std::move(*static_cast<FType *>(Source)));
+         },
+         [](void *Component) { static_cast<FType *>(Component)->~FType(); }});
+    return Id;
+}
+
+template<typename... Ts>
+FComponentMask MakeComponentMask() {
+    FComponentMask Mask;
+    (Mask.set(GetComponentId<Ts>()), ...);
+    return Mask;
+}
+
+struct FChunk {
+    uint8_t *Data{nullptr};
+    uint32_t Count{0};
+};
+
+/*
+ * All entities with exactly the same component set. Each chunk stores its entities and
+ * then one tightly packed array per component, so iterating a component touches
+ * contiguous memory only.
+ */
+class RE_CORE_EXPORT FArchetype {
+public:
+    explicit FArchetype(const FComponentMask &Mask);
+    ~FArchetype();
+
+    FArchetype(const FArchetype &) = delete;
+    FArchetype &operator=(const FArchetype &) = delete;
+
+    const FComponentMask &GetMask() const { return Mask; }
+    const std::vector<FComponentId> &GetComponents() const { return Components; }
+    const std::vector<FComponentInfo> &GetComponentInfos() const { return Infos; }
+    uint32_t GetCapacity() const { return Capacity; }
+    std::vector<FChunk> &GetChunks() { return Chunks; }
+
+    /* Byte offset of the component array inside a chunk, or UINT32_MAX if absent. */
+    uint32_t GetOffset(FComponentId Id) const { return Offsets[Id]; }
+    void *GetComponent(const FChunk &Chunk, FComponentId Id, uint32_t Row) const {
+        return Chunk.Data + Offsets[Id] + Row * Sizes[Id];
+    }
+    FEntity *GetEntities(const FChunk &Chunk) const {
+        return reinterpret_cast<FEntity *>(Chunk.Data);
+    }
+
+    /* Reserves a row with uninitialized components at the end of the last chunk. */
+    void Allocate(uint32_t &OutChunk, uint32_t &OutRow);
+    /*
+     * Fills a vacated row, whose contents must already be destructed or moved out, with
+     * the archetype's last row. Returns the entity now stored there, if any.
+     */
+    FEntity MoveLastInto(uint32_t Chunk, uint32_t Row);
+
+private:
+    FComponentMask Mask;
+    std::vector<FComponentId> Components;
+    /* Parallel to Components, copied to keep the registry lock off the hot paths. */
+    std::vector<FComponentInfo> Infos;
+    std::vector<uint32_t> Offsets;
+    std::vector<uint32_t> Sizes;
+    uint32_t Capacity{0};
+    uint32_t DataSize{0};
+    std::vector<FChunk> Chunks;
+};
+
+/* Typed access to the component arrays of one chunk during a query. */
+class FChunkView {
+public:
+    FChunkView(FArchetype *Archetype, FChunk *Chunk)
+        : Archetype(Archetype), Chunk(Chunk) {}
+
+    uint32_t GetCount() const { return Chunk->Count; }
+    const FEntity *GetEntities() const { return Archetype->GetEntities(*Chunk); }
+
+    /* Null if the archetype lacks T; a const T gives read-only access. */
+    template<typename T>
+    T *GetArray() const {
+        const uint32_t Offset = Archetype->GetOffset(GetComponentId<T>());
+        if(Offset == UINT32_MAX) { return nullptr; }
+        return reinterpret_cast<T *>(Chunk->Data + Offset);
+    }
+
+private:
+    FArchetype *Archetype;
+    FChunk *Chunk;
+};
+
+/*
+ * Entity storage. Structural changes (create, destroy, add, remove) invalidate component
+ * pointers and must not happen while a query runs; systems running in parallel queue them
+ * through Defer instead.
+ */
+class RE_CORE_EXPORT FWorld {
+public:
+    FWorld();
+    ~FWorld();
+
+    FWorld(const FWorld &) = delete;
+    FWorld &operator=(const FWorld &) = delete;
+
+    template<typename... Ts>
+    FEntity Create(Ts &&...Components) {
+        uint32_t Chunk, Row;
+        FArchetype &Archetype = GetOrCreateArchetype(MakeComponentMask<Ts...>());
+        const FEntity Entity = CreateInArchetype(Archetype, Chunk, Row);
+        FChunk &Target = Archetype.GetChunks()[Chunk];
+        (new(Archetype.GetComponent(Target, GetComponentId<Ts>(), Row))
+             std::remove_cvref_t<Ts>(std::forward<Ts>(Components)),
+         ...);
+        return Entity;
+    }
+
+    void Destroy(FEntity Entity);
+    bool IsAlive(FEntity Entity) const;
+
+    template<typename T>
+    void Add(FEntity Entity, T &&Component) {
+        using FType = std::remove_cvref_t<T>;
+        if(FType *Existing = Get<FType>(Entity)) {
+            *Existing = std::forward<T>(Component);
+            return;
+        }
+        if(void *Storage = AddUninitialized(Entity, GetComponentId<FType>())) {
+            new(Storage) FType(std::forward<T>(Component));
+        }
+    }
+
+    template<typename T>
+    void Remove(FEntity Entity) {
+        RemoveComponent(Entity, GetComponentId<T>());
+    }
+
+    template<typename T>
+    T *Get(FEntity Entity) {
+        return static_cast<T *>(GetComponent(Entity, GetComponentId<T>()));
+    }
+
+    template<typename T>
+    bool Has(FEntity Entity) const {
+        return GetComponent(Entity, GetComponentId<T>()) != nullptr;
+    }
+
+    /* Calls Func(FEntity, Ts &...) for every entity that has all of Ts. */
+    template<typename... Ts, typename F>
+    void Each(F &&Func) {
+        ForEachChunk(MakeComponentMask<Ts...>(), [&Func](const FChunkView &Chunk) {
+            EachInChunk<Ts...>(Chunk, Func);
+        });
+    }
+
+    /* Like Each, with chunks spread over the task system; Func must be thread safe. */
+    template<typename... Ts, typename F>
+    void ParallelEach(F &&Func) {
+        const FComponentMask Mask = MakeComponentMask<Ts...>();
+        ParallelForEachChunk(Mask, [&Func](const FChunkView &Chunk) {
+            EachInChunk<Ts...>(Chunk, Func);
+        });
+    }
+
+    void ForEachChunk(
+        const FComponentMask &Mask, const std::function<void(const FChunkView &)> &Func);
+    void ParallelForEachChunk(
+        const FComponentMask &Mask, const std::function<void(const FChunkView &)> &Func);
+
+    /* Thread safe, the command runs on the next Flush. */
+    void Defer(std::function<void(FWorld &)> Command);
+    void Flush();
+
+    uint32_t GetEntityCount() const { return static_cast<uint32_t>(Locations.size()); }
+    uint32_t GetArchetypeCount() const {
+        return static_cast<uint32_t>(Archetypes.size());
+    }
+
+private:
+    struct FEntityLocation {
+        FArchetype *Archetype;
+        uint32_t Chunk;
+        uint32_t Row;
+    };
+
+    template<typename... Ts, typename F>
+    static void EachInChunk(const FChunkView &Chunk, F &Func) {
+        const FEntity *Entities = Chunk.GetEntities();
+        auto Arrays = std::make_tuple(Chunk.GetArray<Ts>()...);
+        for(uint32_t i = 0; i < Chunk.GetCount(); i++) {
+            std::apply([&](auto *...Array) { Func(Entities[i], Array[i]...); }, Arrays);
+        }
+    }
+
+    FArchetype &GetOrCreateArchetype(const FComponentMask &Mask);
+    FEntity CreateInArchetype(
+        FArchetype &Archetype, uint32_t &OutChunk, uint32_t &OutRow);
+    void *GetComponent(FEntity Entity, FComponentId Id) const;
+    void *AddUninitialized(FEntity Entity, FComponentId Id);
+    void RemoveComponent(FEntity Entity, FComponentId Id);
+    /* Moves the entity's shared components over and returns its new location. */
+    FEntityLocation MoveToArchetype(FEntity Entity, FArchetype &Target);
+    void RemoveRow(const FEntityLocation &Location);
+
+    tsl::robin_map<uint32_t, FEntityLocation> Locations;
+    std::vector<uint32_t> Generations;
+    std::vector<uint32_t> FreeIndices;
+
+    std::vector<std::unique_ptr<FArchetype>> Archetypes;
+    tsl::robin_map<FComponentMask, FArchetype *> ArchetypeLookup;
+
+    std::mutex DeferredMutex;
+    std::vector<std::function<void(FWorld &)>> Deferred;
+};
+}
@@ -0,0 +1,219 @@
+﻿#pragma once
+#include "re-core_export.h"
+#include "Core/AsyncIO.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace RE {
+/* Read-only memory mapping of a whole file on disk. */
+class RE_CORE_EXPORT FMappedFile {
+public:
+    static std::shared_ptr<FMappedFile> Open(const std::filesystem::path &Path);
+
+    ~FMappedFile();
+
+    FMappedFile(const FMappedFile &) = delete;
+    FMappedFile &operator=(const FMappedFile &) = delete;
+
+    const uint8_t *GetData() const { return Data; }
+    size_t GetSize() const { return Size; }
+
+private:
+    FMappedFile() = default;
+
+    const uint8_t *Data{nullptr};
+    size_t Size{0};
+#if defined(WIN32)
+    void *FileHandle{nullptr};
+    void *MappingHandle{nullptr};
+#endif
+};
+
+/*
+ * Contents of a file returned by the VFS. Either a zero-copy view into a mapping (which the
+ * view keeps alive) or a buffer owned by this object when the entry had to be decompressed.
+ */
+class RE_CORE_EXPORT FFileData {
+public:
+    FFileData() = default;
+    FFileData(std::shared_ptr<FMappedFile> Mapping, size_t Offset, size_t Size);
+    explicit FFileData(std::vector<uint8_t> &&Buffer);
+
+    FFileData(FFileData &&) = default;
+    FFileData &operator=(FFileData &&) = default;
+    FFileData(const FFileData &) = delete;
+    FFileData &operator=(const FFileData &) = delete;
+
+    const uint8_t *GetData() const { return Data; }
+    size_t GetSize() const { return Size; }
+    std::span<const uint8_t> GetBytes() const { return {Data, Size}; }
+    bool IsMapped() const { return Mapping != nullptr; }
+    bool IsValid() const { return bLoaded; }
+
+private:
+    std::shared_ptr<FMappedFile> Mapping;
+    std::vector<uint8_t> Owned;
+    const uint8_t *Data{nullptr};
+    size_t Size{0};
+    bool bLoaded{false};
+};
+
+/* Where the bytes of a VFS entry live on disk, used to issue asynchronous reads. */
+struct FFileLocation {
+    std::filesystem::path Path;
+    uint64_t Offset{0};
+    uint64_t StoredSize{0};
+    uint64_t Size{0};
+    bool bCompressed{false};
+};
+
+class RE_CORE_EXPORT FMountPoint {
+public:
+    virtual ~FMountPoint() = default;
+
+    virtual bool Exists(std::string_view Path) const = 0;
+
+    virtual bool Read(std::string_view Path, FFileData &OutData) const = 0;
+
+    virtual bool Locate(std::string_view Path, FFileLocation &OutLocation) const = 0;
+
+    virtual void Enumerate(std::vector<std::string> &OutPaths) const = 0;
+};
+
+/* Loose files below a host directory. */
+class RE_CORE_EXPORT FDirectoryMount: public FMountPoint {
+public:
+    explicit FDirectoryMount(std::filesystem::path Root);
+
+    bool Exists(std::string_view Path) const override;
+    bool Read(std::string_view Path, FFileData &OutData) const override;
+    bool Locate(std::string_view Path, FFileLocation &OutLocation) const override;
+    void Enumerate(std::vector<std::string> &OutPaths) const override;
+
+private:
+    std::filesystem::path Root;
+};
+
+/*
+ * Pack file layout (little endian):
+ *   FHeader | entry data ... | FEntry[EntryCount] sorted by (PathHash, Path) | path strings
+ * Uncompressed entries are 16 byte aligned and served straight out of the mapping.
+ */
+class RE_CORE_EXPORT FPackArchive: public FMountPoint {
+public:
+    static constexpr uint32_t Magic = 0x4B504552; // "REPK"
+    static constexpr uint32_t Version = 1;
+    static constexpr uint64_t DataAlignment = 16;
+
+    enum EEntryFlags : uint32_t { None = 0, Compressed = 1 << 0 };
+
+    struct FHeader {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t EntryCount;
+        uint32_t Reserved;
+        uint64_t TocOffset;
+        uint64_t NamesOffset;
+        uint64_t NamesSize;
+    };
+
+    struct FEntry {
+        uint64_t PathHash;
+        uint64_t DataOffset;
+        uint64_t StoredSize;
+        uint64_t Size;
+        uint32_t NameOffset;
+        uint32_t NameLength;
+        uint32_t Flags;
+        uint32_t Reserved;
+    };
+
+    static std::unique_ptr<FPackArchive> Open(const std::filesystem::path &Path);
+
+    bool Exists(std::string_view Path) const override;
+    bool Read(std::string_view Path, FFileData &OutData) const override;
+    bool Locate(std::string_view Path, FFileLocation &OutLocation) const override;
+    void Enumerate(std::vector<std::string> &OutPaths) const override;
+
+    const FEntry *Find(std::string_view Path) const;
+    bool ReadEntry(const FEntry &Entry, FFileData &OutData) const;
+
+private:
+    FPackArchive() = default;
+
+    std::string_view GetName(const FEntry &Entry) const;
+
+    std::filesystem::path ArchivePath;
+    std::shared_ptr<FMappedFile> Mapping;
+    std::span<const FEntry> Entries;
+};
+
+/* Offline writer for FPackArchive files. */
+class RE_CORE_EXPORT FPackWriter {
+public:
+    /* Level <= 0 stores the entry uncompressed. */
+    void AddFile(
+        std::string_view Path, std::span<const uint8_t> Data, int CompressionLevel = 3);
+
+    /* Adds every file below Directory, keyed by its path relative to Directory. */
+    void AddDirectory(const std::filesystem::path &Directory, int CompressionLevel = 3);
+
+    bool Write(const std::filesystem::path &Path) const;
+
+private:
+    struct FPendingEntry {
+        std::string Path;
+        std::vector<uint8_t> Data;
+        uint64_t Size;
+        bool bCompressed;
+    };
+    std::vector<FPendingEntry> PendingEntries;
+};
+
+/*
+ * Mounts are searched from the most recently mounted one backwards, so a patch pack or a
+ * loose development directory mounted last overrides the base packs.
+ */
+class RE_CORE_EXPORT FVirtualFileSystem {
+public:
+    static FVirtualFileSystem &Get();
+
+    void Mount(std::unique_ptr<FMountPoint> MountPoint);
+
+    bool MountDirectory(const std::filesystem::path &Directory);
+
+    bool MountPack(const std::filesystem::path &Path);
+
+    void UnmountAll();
+
+    bool Exists(std::string_view Path) const;
+
+    bool Read(std::string_view Path, FFileData &OutData) const;
+
+    bool Locate(std::string_view Path, FFileLocation &OutLocation) const;
+
+    /*
+     * Streams a file through FAsyncIO. Compressed pack entries are decompressed on the task
+     * system before OnComplete runs, so the callback can go straight on to parsing and
+     * uploading the data.
+     */
+    FIOHandle ReadAsync(
+        std::string_view Path, EIOPriority Priority, FIOCompletion OnComplete) const;
+
+    /* Reads several files at once, decompressing packed entries on the task system. */
+    std::vector<FFileData> ReadBatch(std::span<const std::string_view> Paths) const;
+
+    static std::string NormalizePath(std::string_view Path);
+
+private:
+    const FMountPoint *FindMount(std::string_view NormalizedPath) const;
+
+    std::vector<std::unique_ptr<FMountPoint>> Mounts;
+};
+}
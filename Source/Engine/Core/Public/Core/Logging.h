@@ -11,21 +11,33 @@
     #define RE_ROOT_PATH_SIZE 0
 #endif
 
+/*
+ * The file and line are prepended to the format string of RE_LOGE, which must be a
+ * literal, so the message is formatted once. RE_LOGD compiles to nothing outside
+ * development builds, its arguments are not evaluated.
+ */
 #define RE_LOGI(...) spdlog::info(__VA_ARGS__)
 #define RE_LOGW(...) spdlog::warn(__VA_ARGS__)
-#define RE_LOGE(...)                                                             \
-    spdlog::error(                                                               \
-        "[{}:{}] {}", (static_cast<const char *>(__FILE__) + RE_ROOT_PATH_SIZE), \
-        __LINE__, fmt::format(__VA_ARGS__))
-#define RE_LOGD(...) spdlog::debug(__VA_ARGS__)
+#define RE_LOGE(Format, ...)                                                           \
+    spdlog::error(                                                                     \
+        "[{}:{}] " Format,                                                             \
+        (static_cast<const char *>(__FILE__) + RE_ROOT_PATH_SIZE), __LINE__, ##__VA_ARGS__)
+#if RE_DEVELOPMENT
+    #define RE_LOGD(...) spdlog::debug(__VA_ARGS__)
+#else
+    #define RE_LOGD(...) \
+        do {             \
+        } while(false)
+#endif
 
 #if RE_DEVELOPMENT
-    #define checkf(expr, ...)         \
-        do {                          \
-            if(!(expr)) {             \
-                RE_LOGE(__VA_ARGS__); \
-                __debugbreak();       \
-            }                         \
+    #define checkf(expr, ...)                 \
+        do {                                  \
+            if(!(expr)) {                     \
+                RE_LOGE(__VA_ARGS__);         \
+                ::RE::FLogging::Flush();      \
+                __debugbreak();               \
+            }                                 \
         } while(false)
     #define check(expr) checkf(expr, "Check failed")
 #else
@@ -33,8 +45,24 @@
 #endif
 
 namespace RE {
+enum class ELoggingMode : uint8_t { Sync, Async };
+
+/*
+ * In async mode the calling thread only formats the message and queues it, the console
+ * is written by a background thread. The queue is preallocated and a full one overwrites
+ * its oldest message instead of waiting, so logging never stalls a frame on I/O; dropped
+ * messages are counted. Warnings and errors are flushed once the thread writes them.
+ */
 class RE_CORE_EXPORT FLogging {
 public:
-    static void Init();
+    /* Messages the async queue holds. */
+    static constexpr size_t QueueSize = 8192;
+
+    static void Init(ELoggingMode Mode = ELoggingMode::Async);
+    /* Waits until the messages logged so far are written, e.g. before breaking. */
+    static void Flush();
+    /* Writes the queued messages and stops the background thread. */
+    static void Shutdown();
+    static size_t GetDroppedCount();
 };
 } // namespace RE
\ No newline at end of file
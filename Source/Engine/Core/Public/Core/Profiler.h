@@ -0,0 +1,154 @@
+﻿#pragma once
+#include "re-core_export.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define RE_PROFILE_CONCAT_INNER(A, B) A##B
+#define RE_PROFILE_CONCAT(A, B) RE_PROFILE_CONCAT_INNER(A, B)
+
+/*
+ * Hot path instrumentation. Names must be string literals or otherwise live until the
+ * capture is written, only their pointers are recorded. Without RE_PROFILING the macros
+ * compile to nothing.
+ */
+#if RE_PROFILING
+    #define RE_PROFILE_SCOPE(Name) \
+        ::RE::FProfileScope RE_PROFILE_CONCAT(ProfileScope, __LINE__)(Name)
+    #define RE_PROFILE_FUNCTION() RE_PROFILE_SCOPE(__func__)
+    #define RE_PROFILE_THREAD(Name) ::RE::FProfiler::Get().SetThreadName(Name)
+    #define RE_PROFILE_FRAME() ::RE::FProfiler::Get().MarkFrame()
+#else
+    #define RE_PROFILE_SCOPE(Name) \
+        do {                       \
+        } while(false)
+    #define RE_PROFILE_FUNCTION() RE_PROFILE_SCOPE(nullptr)
+    #define RE_PROFILE_THREAD(Name) RE_PROFILE_SCOPE(Name)
+    #define RE_PROFILE_FRAME() RE_PROFILE_SCOPE(nullptr)
+#endif
+
+namespace RE {
+/* A finished scope, times in nanoseconds of FProfiler::Now. */
+struct FProfileEvent {
+    const char *Name;
+    uint64_t BeginNs;
+    uint64_t EndNs;
+};
+
+/*
+ * Collects scopes of every thread into per-thread rings. The owning thread is the only
+ * writer of its ring and publishes each event with a release store of the head, the
+ * collecting thread the only reader advancing the tail, so recording takes no lock and
+ * never waits; a full ring drops the event and counts it. Scopes cost a relaxed load of
+ * the capture flag while no capture runs.
+ *
+ * Tracks are rings that belong to no thread, for timelines recorded after the fact such
+ * as GPU scopes converted to Now's clock, which correlates them with the CPU scopes in
+ * the same trace. A track must only be written from one thread at a time.
+ */
+class RE_CORE_EXPORT FProfiler {
+public:
+    /* Events per ring, a power of two. */
+    static constexpr uint32_t RingCapacity = 1 << 16;
+
+    /*
+     * Layout of the binary capture: the header, the names, the threads, the events and
+     * the frame times. Times are nanoseconds since the capture start.
+     */
+    static constexpr uint32_t Magic = 0x46505245; // "REPF"
+    static constexpr uint32_t Version = 1;
+    struct FBinaryHeader {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t NameCount;
+        uint32_t ThreadCount;
+        uint64_t EventCount;
+        uint64_t FrameCount;
+    };
+    /* Names and threads follow as a uint16_t length and the characters. */
+    struct FBinaryEvent {
+        uint32_t Name;
+        uint32_t Thread;
+        uint64_t BeginNs;
+        uint64_t DurationNs;
+    };
+
+    static FProfiler &Get();
+    /* Nanoseconds of a steady clock shared by all threads. */
+    static uint64_t Now();
+
+    FProfiler(const FProfiler &) = delete;
+    FProfiler &operator=(const FProfiler &) = delete;
+
+    /* Starts recording, dropping whatever an earlier capture collected. */
+    void BeginCapture();
+    /* Stops recording and collects the events still in the rings. */
+    void EndCapture();
+    bool IsCapturing() const { return bCapturing.load(std::memory_order_relaxed); }
+
+    void SetThreadName(const char *Name);
+    /* Collects the rings and marks a frame boundary, once per frame keeps them short. */
+    void MarkFrame();
+
+    void Record(const char *Name, uint64_t BeginNs, uint64_t EndNs);
+    uint32_t CreateTrack(const char *Name);
+    void RecordTrack(uint32_t Track, const char *Name, uint64_t BeginNs, uint64_t EndNs);
+
+    uint64_t GetEventCount() const;
+    uint64_t GetDroppedCount() const;
+
+    /* Chrome trace event JSON, for chrome://tracing or Perfetto. */
+    bool WriteChromeTrace(const std::filesystem::path &Path);
+    bool WriteBinary(const std::filesystem::path &Path);
+
+private:
+    struct FThreadRing {
+        std::string Name;
+        std::unique_ptr<FProfileEvent[]> Events;
+        std::atomic<uint64_t> Head{0};
+        std::atomic<uint64_t> Tail{0};
+        std::atomic<uint64_t> Dropped{0};
+        /* Events already moved out of the ring into the capture. */
+        std::vector<FProfileEvent> Collected;
+    };
+
+    FProfiler() = default;
+    FThreadRing &GetThreadRing();
+    FThreadRing &CreateRing(std::string Name);
+    static void Push(FThreadRing &Ring, const FProfileEvent &Event);
+    void Collect();
+    uint64_t CountEvents() const;
+    uint64_t CountDropped() const;
+    uint64_t SinceStart(uint64_t Ns) const;
+
+    std::atomic<bool> bCapturing{false};
+    /* Guards the ring list and the collected events, taken off the hot path only. */
+    mutable std::mutex Mutex;
+    std::vector<std::unique_ptr<FThreadRing>> Rings;
+    std::vector<uint64_t> Frames;
+    uint64_t CaptureStart{0};
+};
+
+/* Records the time between construction and destruction while capturing. */
+class FProfileScope {
+public:
+    explicit FProfileScope(const char *Name)
+        : Name(FProfiler::Get().IsCapturing() ? Name : nullptr),
+          BeginNs(this->Name ? FProfiler::Now() : 0) {}
+    ~FProfileScope() {
+        if(Name) { FProfiler::Get().Record(Name, BeginNs, FProfiler::Now()); }
+    }
+
+    FProfileScope(const FProfileScope &) = delete;
+    FProfileScope &operator=(const FProfileScope &) = delete;
+
+private:
+    const char *Name;
+    uint64_t BeginNs;
+};
+}
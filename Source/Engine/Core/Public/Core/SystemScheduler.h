@@ -0,0 +1,67 @@
+﻿#pragma once
+#include "re-core_export.h"
+#include "Core/ECS.h"
+
+#include <string>
+
+namespace RE {
+/* Components a system reads and writes; systems with disjoint writes may run together. */
+class RE_CORE_EXPORT FSystemAccess {
+public:
+    template<typename... Ts>
+    FSystemAccess &Read() {
+        Reads |= MakeComponentMask<Ts...>();
+        return *this;
+    }
+
+    template<typename... Ts>
+    FSystemAccess &Write() {
+        Writes |= MakeComponentMask<Ts...>();
+        return *this;
+    }
+
+    /* Also conflicts with everything, for systems making structural changes directly. */
+    FSystemAccess &Exclusive() {
+        bExclusive = true;
+        return *this;
+    }
+
+    bool ConflictsWith(const FSystemAccess &Other) const;
+
+private:
+    FComponentMask Reads;
+    FComponentMask Writes;
+    bool bExclusive{false};
+};
+
+/*
+ * Runs systems in stages. A system is placed in the stage after the last earlier system
+ * it conflicts with, so registration order is kept wherever it matters and everything
+ * else runs in parallel on the task system. Deferred world commands are flushed between
+ * stages.
+ */
+class RE_CORE_EXPORT FSystemScheduler {
+public:
+    using FSystemFunc = std::function<void(FWorld &World)>;
+
+    void Add(std::string Name, const FSystemAccess &Access, FSystemFunc Func);
+
+    void Run(FWorld &World);
+
+    uint32_t GetStageCount();
+    void LogStages();
+
+private:
+    struct FSystem {
+        std::string Name;
+        FSystemAccess Access;
+        FSystemFunc Func;
+    };
+
+    void BuildStages();
+
+    std::vector<FSystem> Systems;
+    std::vector<std::vector<uint32_t>> Stages;
+    bool bStagesDirty{false};
+};
+}
@@ -0,0 +1,49 @@
+﻿#pragma once
+#include "re-core_export.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RE {
+/* Shared worker pool used by the engine modules for data-parallel work. */
+class RE_CORE_EXPORT FTaskSystem {
+public:
+    using FTask = std::function<void()>;
+    using FRangeFunc = std::function<void(uint32_t Begin, uint32_t End)>;
+
+    static FTaskSystem &Get();
+
+    /* NumWorkers of 0 picks hardware_concurrency - 1 (at least one). */
+    explicit FTaskSystem(uint32_t NumWorkers = 0);
+
+    ~FTaskSystem();
+
+    FTaskSystem(const FTaskSystem &) = delete;
+    FTaskSystem &operator=(const FTaskSystem &) = delete;
+
+    void Enqueue(FTask Task);
+
+    /*
+     * Splits [0, Count) into batches of BatchSize and runs them on the workers. The calling
+     * thread takes part in the work and returns once every batch has finished, so nested
+     * calls from inside a task cannot deadlock.
+     */
+    void ParallelFor(uint32_t Count, uint32_t BatchSize, const FRangeFunc &Func);
+
+    uint32_t GetNumWorkers() const { return static_cast<uint32_t>(Workers.size()); }
+
+private:
+    void WorkerLoop();
+
+    std::vector<std::thread> Workers;
+    std::deque<FTask> Queue;
+    std::mutex QueueMutex;
+    std::condition_variable QueueCondition;
+    bool bStopping{false};
+};
+}
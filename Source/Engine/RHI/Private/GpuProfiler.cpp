@@ -0,0 +1,237 @@
+﻿#include "RHI/GpuProfiler.h"
+#include "RHI/RHI.h"
+#include "Core/Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace RE {
+namespace {
+constexpr const char *FrameScopeName = "Frame";
+// Weight of the newest frame in the smoothed times.
+constexpr double Smoothing = 0.1;
+
+uint32_t GetTimestampValidBits(VkPhysicalDevice PhysicalDevice, uint32_t QueueFamily) {
+    uint32_t Count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(PhysicalDevice, &Count, nullptr);
+    std::vector<VkQueueFamilyProperties> Families(Count);
+    vkGetPhysicalDeviceQueueFamilyProperties(PhysicalDevice, &Count, Families.data());
+    return QueueFamily < Count ? Families[QueueFamily].timestampValidBits : 0;
+}
+
+bool CanCalibrateDevice(VkPhysicalDevice PhysicalDevice) {
+    uint32_t Count = 0;
+    vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(PhysicalDevice, &Count, nullptr);
+    std::vector<VkTimeDomainEXT> Domains(Count);
+    vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(PhysicalDevice, &Count, Domains.data());
+    return std::find(Domains.begin(), Domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) !=
+           Domains.end();
+}
+}
+
+FGpuProfiler::FGpuProfiler(FRHI &RHI) : RHI(RHI) {
+    // Scopes may land on either queue, so only the bits both of them keep are compared.
+    const VkPhysicalDevice PhysicalDevice = RHI.GetPhysicalDevice();
+    const uint32_t ValidBits = std::min(
+        GetTimestampValidBits(PhysicalDevice, RHI.GetGraphicsQueueIndex()),
+        GetTimestampValidBits(PhysicalDevice, RHI.GetComputeQueueIndex()));
+    if(ValidBits == 0) {
+        RE_LOGW("The device queues write no timestamps, GPU profiling is unavailable.");
+        return;
+    }
+    TimestampMask = ValidBits >= 64 ? ~0ull : (1ull << ValidBits) - 1;
+    TimestampPeriod = RHI.GetPhysicalDeviceProperties().limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo CreateInfo{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    CreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    CreateInfo.queryCount = 2 * MaxScopes;
+    for(FFrameSlot &Slot: Slots) {
+        vk_check(vkCreateQueryPool(RHI.GetDevice(), &CreateInfo, nullptr, &Slot.QueryPool));
+        Slot.Scopes.reserve(MaxScopes);
+    }
+    Timestamps.resize(2 * MaxScopes);
+    bSupported = true;
+
+    bCalibrated = RHI.GetCapabilities().bCalibratedTimestamps &&
+                  CanCalibrateDevice(PhysicalDevice);
+    if(bCalibrated) { ProfilerTrack = FProfiler::Get().CreateTrack("GPU"); }
+}
+
+FGpuProfiler::~FGpuProfiler() {
+    for(FFrameSlot &Slot: Slots) {
+        if(Slot.QueryPool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(RHI.GetDevice(), Slot.QueryPool, nullptr);
+        }
+    }
+}
+
+void FGpuProfiler::BeginFrame(VkCommandBuffer CommandBuffer, uint32_t Frame) {
+    Current = nullptr;
+    CurrentDepth = 0;
+    if(!bSupported) { return; }
+
+    FFrameSlot &Slot = Slots[Frame % FrameLatency];
+    if(Slot.bPending) { ReadBack(Slot); }
+    Slot.Scopes.clear();
+    Slot.QueryCount = 0;
+    if(!bEnabled) { return; }
+
+    vkCmdResetQueryPool(CommandBuffer, Slot.QueryPool, 0, 2 * MaxScopes);
+    Current = &Slot;
+    bOverflowReported = false;
+    BeginScope(CommandBuffer, FrameScopeName);
+}
+
+void FGpuProfiler::EndFrame(VkCommandBuffer CommandBuffer) {
+    if(Current == nullptr) { return; }
+    EndScope(CommandBuffer, 0);
+    Current->bPending = true;
+    Current = nullptr;
+}
+
+uint32_t FGpuProfiler::BeginScope(
+    VkCommandBuffer CommandBuffer, const char *Name, VkPipelineStageFlagBits Stage) {
+    if(Current == nullptr) { return InvalidScope; }
+    if(Current->QueryCount + 2 > 2 * MaxScopes) {
+        if(!bOverflowReported) {
+            RE_LOGW(
+                "More than {} GPU scopes in a frame, the rest are not timed.", MaxScopes);
+            bOverflowReported = true;
+        }
+        return InvalidScope;
+    }
+
+    const uint32_t Query = Current->QueryCount;
+    Current->QueryCount += 2;
+    Current->Scopes.push_back({Name, CurrentDepth++, Query, InvalidScope});
+    vkCmdWriteTimestamp(CommandBuffer, Stage, Current->QueryPool, Query);
+    return uint32_t(Current->Scopes.size() - 1);
+}
+
+void FGpuProfiler::EndScope(
+    VkCommandBuffer CommandBuffer, uint32_t Scope, VkPipelineStageFlagBits Stage) {
+    if(Current == nullptr || Scope >= Current->Scopes.size()) { return; }
+    FScope &Entry = Current->Scopes[Scope];
+    Entry.EndQuery = Entry.BeginQuery + 1;
+    CurrentDepth = Entry.Depth;
+    vkCmdWriteTimestamp(CommandBuffer, Stage, Current->QueryPool, Entry.EndQuery);
+}
+
+void FGpuProfiler::ReadBack(FFrameSlot &Slot) {
+    Slot.bPending = false;
+    if(Slot.QueryCount == 0) { return; }
+
+    // Without the wait flag this returns VK_NOT_READY instead of blocking. Pairs are read
+    // one scope at a time since an unclosed scope leaves its end query unavailable.
+    LastFrame.clear();
+    for(const FScope &Scope: Slot.Scopes) {
+        if(Scope.EndQuery == InvalidScope) { continue; }
+        uint64_t *Pair = &Timestamps[Scope.BeginQuery];
+        const VkResult Result = vkGetQueryPoolResults(
+            RHI.GetDevice(), Slot.QueryPool, Scope.BeginQuery, 2, 2 * sizeof(uint64_t),
+            Pair, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if(Result != VK_SUCCESS) {
+            LastFrame.clear();
+            return;
+        }
+        // Masked so a counter wrapping within the scope still gives its length.
+        const uint64_t Ticks = (Pair[1] - Pair[0]) & TimestampMask;
+        LastFrame.push_back(
+            {Scope.Name, Scope.Depth, double(Ticks) * TimestampPeriod * 1e-6});
+    }
+    Aggregate();
+    if(bCalibrated && FProfiler::Get().IsCapturing()) { RecordTrack(Slot); }
+}
+
+void FGpuProfiler::RecordTrack(const FFrameSlot &Slot) {
+    // The device clock is sampled between two reads of the CPU clock and taken to sit
+    // halfway, which is off by well under a microsecond.
+    VkCalibratedTimestampInfoEXT Info{VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT};
+    Info.timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    uint64_t DeviceNow = 0;
+    uint64_t Deviation = 0;
+    const uint64_t Before = FProfiler::Now();
+    if(vkGetCalibratedTimestampsEXT(RHI.GetDevice(), 1, &Info, &DeviceNow, &Deviation) !=
+       VK_SUCCESS) {
+        return;
+    }
+    const uint64_t CpuNow = Before + (FProfiler::Now() - Before) / 2;
+
+    auto ToCpu = [&](uint64_t Timestamp) {
+        const uint64_t Ago = uint64_t(
+            double((DeviceNow - Timestamp) & TimestampMask) * TimestampPeriod);
+        return CpuNow > Ago ? CpuNow - Ago : 0;
+    };
+    for(const FScope &Scope: Slot.Scopes) {
+        if(Scope.EndQuery == InvalidScope) { continue; }
+        FProfiler::Get().RecordTrack(
+            ProfilerTrack, Scope.Name, ToCpu(Timestamps[Scope.BeginQuery]),
+            ToCpu(Timestamps[Scope.EndQuery]));
+    }
+}
+
+void FGpuProfiler::Aggregate() {
+    // Scopes repeating a name, e.g. one per shadow cascade, count as one per frame.
+    std::fill(FrameTotals.begin(), FrameTotals.end(), -1.0);
+    for(const FGpuScopeTiming &Timing: LastFrame) {
+        auto It = StatisticLookup.find(Timing.Name);
+        uint32_t Index;
+        if(It == StatisticLookup.end()) {
+            Index = uint32_t(Statistics.size());
+            StatisticLookup.emplace(Timing.Name, Index);
+            FGpuScopeStats &Stats = Statistics.emplace_back();
+            Stats.Name = Timing.Name;
+            Stats.Depth = Timing.Depth;
+            FrameTotals.push_back(-1.0);
+        } else {
+            Index = It->second;
+        }
+        FrameTotals[Index] = std::max(FrameTotals[Index], 0.0) + Timing.Milliseconds;
+    }
+
+    for(size_t i = 0; i < Statistics.size(); i++) {
+        const double Milliseconds = FrameTotals[i];
+        if(Milliseconds < 0.0) { continue; }
+        FGpuScopeStats &Stats = Statistics[i];
+        if(Stats.Samples == 0) {
+            Stats.SmoothedMs = Stats.MinMs = Stats.MaxMs = Milliseconds;
+        }
+        Stats.Samples++;
+        Stats.LastMs = Milliseconds;
+        Stats.SmoothedMs += (Milliseconds - Stats.SmoothedMs) * Smoothing;
+        Stats.MinMs = std::min(Stats.MinMs, Milliseconds);
+        Stats.MaxMs = std::max(Stats.MaxMs, Milliseconds);
+        Stats.TotalMs += Milliseconds;
+    }
+}
+
+void FGpuProfiler::ResetStatistics() {
+    Statistics.clear();
+    StatisticLookup.clear();
+    FrameTotals.clear();
+}
+
+void FGpuProfiler::LogStatistics() const {
+    for(const FGpuScopeStats &Stats: Statistics) {
+        RE_LOGI(
+            "GPU {:>{}}{}: avg {:.3f} ms, min {:.3f} ms, max {:.3f} ms over {} frames.", "",
+            2 * Stats.Depth, Stats.Name, Stats.GetAverageMs(), Stats.MinMs, Stats.MaxMs,
+            Stats.Samples);
+    }
+}
+
+bool FGpuProfiler::WriteStatistics(const std::filesystem::path &Path) const {
+    std::ofstream Stream(Path, std::ios::trunc);
+    if(!Stream) {
+        RE_LOGE("Failed to open {} for writing", Path.string());
+        return false;
+    }
+    Stream << "Name,Depth,Samples,AverageMs,SmoothedMs,MinMs,MaxMs,LastMs\n";
+    for(const FGpuScopeStats &Stats: Statistics) {
+        Stream << Stats.Name << ',' << Stats.Depth << ',' << Stats.Samples << ','
+               << Stats.GetAverageMs() << ',' << Stats.SmoothedMs << ',' << Stats.MinMs
+               << ',' << Stats.MaxMs << ',' << Stats.LastMs << '\n';
+    }
+    return bool(Stream);
+}
+}
@@ -1,4 +1,5 @@
 ﻿#include "RHI/RHI.h"
+#include "RHI/GpuProfiler.h"
 
 #include <algorithm>
 #include <unordered_set>
@@ -11,10 +12,16 @@ FRHI::FRHI(void *nativeWindow) {
 
     CreateDevice();
 
+    CreateAllocator();
+
     CreateSurface(nativeWindow);
+
+    GpuProfiler = std::make_unique<FGpuProfiler>(*this);
 }
 FRHI::~FRHI() {
     if(DeviceInfo.Device != VK_NULL_HANDLE) { vkDeviceWaitIdle(DeviceInfo.Device); }
+    GpuProfiler.reset();
+    SetStatisticsEnabled(false);
 
     if(DebugReportInfo.DebugMessenger != VK_NULL_HANDLE) {
         vkDestroyDebugUtilsMessengerEXT(
@@ -28,6 +35,12 @@ FRHI::~FRHI() {
         vkDestroySurfaceKHR(DeviceInfo.Instance, DeviceInfo.Surface, nullptr);
     }
 
+    if(DeviceInfo.ImmediateCommandPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(DeviceInfo.Device, DeviceInfo.ImmediateCommandPool, nullptr);
+    }
+    if(DeviceInfo.Allocator != VK_NULL_HANDLE) {
+        vmaDestroyAllocator(DeviceInfo.Allocator);
+    }
     if(DeviceInfo.Device != VK_NULL_HANDLE) {
         vkDestroyDevice(DeviceInfo.Device, nullptr);
     }
@@ -262,6 +275,24 @@ uint32_t identifyGraphicsQueueFamilyIndex(VkPhysicalDevice physicalDevice) {
     }
     return graphicsQueueFamilyIndex;
 }
+// A family with compute but no graphics runs beside the graphics queue on its own.
+uint32_t identifyComputeQueueFamilyIndex(VkPhysicalDevice physicalDevice) {
+    uint32_t queueFamilyPropCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        physicalDevice, &queueFamilyPropCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamiliesProperties(queueFamilyPropCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        physicalDevice, &queueFamilyPropCount, queueFamiliesProperties.data());
+
+    for(uint32_t j = 0; j < queueFamiliesProperties.size(); ++j) {
+        VkQueueFamilyProperties props = queueFamiliesProperties[j];
+        if(props.queueCount != 0 && (props.queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+           !(props.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            return j;
+        }
+    }
+    return INVALID_VK_INDEX;
+}
 inline int deviceTypeOrder(VkPhysicalDeviceType deviceType) {
     switch(deviceType) {
         case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 5;
@@ -352,6 +383,9 @@ FExtensionSet getDeviceExtensions(VkPhysicalDevice device) {
         VK_KHR_MAINTENANCE1_EXTENSION_NAME,
         VK_KHR_MAINTENANCE2_EXTENSION_NAME,
         VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+        VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,
+        VK_NV_MESH_SHADER_EXTENSION_NAME,
+        VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME,
     };
     FExtensionSet exts;
     // Identify supported physical device extensions
@@ -380,6 +414,13 @@ void FRHI::CreateDevice() {
         DeviceInfo.PhysicalDevice, &DeviceInfo.PhysicalDeviceFeatures);
     vkGetPhysicalDeviceMemoryProperties(
         DeviceInfo.PhysicalDevice, &DeviceInfo.MemoryProperties);
+    for(uint32_t i = 0; i < DeviceInfo.MemoryProperties.memoryTypeCount; i++) {
+        const VkMemoryPropertyFlags flags =
+            DeviceInfo.MemoryProperties.memoryTypes[i].propertyFlags;
+        if(flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+            Capabilities.bLazilyAllocatedMemory = true;
+        }
+    }
 
     RE_LOGI(
         "Vulkan Physical Device Name: {}",
@@ -398,20 +439,86 @@ void FRHI::CreateDevice() {
 
     float queuePriority = 1.0f;
 
-    // Create one queue
-    VkDeviceQueueCreateInfo queueCreateInfo{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
-    queueCreateInfo.queueFamilyIndex = DeviceInfo.GraphicsQueueIndex;
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.pQueuePriorities = &queuePriority;
+    // One graphics queue, plus an async compute one when the device has such a family.
+    DeviceInfo.ComputeQueueIndex =
+        identifyComputeQueueFamilyIndex(DeviceInfo.PhysicalDevice);
+    Capabilities.bAsyncCompute = DeviceInfo.ComputeQueueIndex != INVALID_VK_INDEX;
+    if(!Capabilities.bAsyncCompute) {
+        DeviceInfo.ComputeQueueIndex = DeviceInfo.GraphicsQueueIndex;
+    }
+
+    VkDeviceQueueCreateInfo queueCreateInfos[2]{};
+    for(uint32_t i = 0; i < 2; i++) {
+        queueCreateInfos[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfos[i].queueCount = 1;
+        queueCreateInfos[i].pQueuePriorities = &queuePriority;
+    }
+    queueCreateInfos[0].queueFamilyIndex = DeviceInfo.GraphicsQueueIndex;
+    queueCreateInfos[1].queueFamilyIndex = DeviceInfo.ComputeQueueIndex;
+
+    // Subgroup operations shorten reductions in compute shaders, core in Vulkan 1.1.
+    VkPhysicalDeviceSubgroupProperties subgroupProperties{
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES};
+    VkPhysicalDeviceProperties2 subgroupProperties2{
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+    subgroupProperties2.pNext = &subgroupProperties;
+    vkGetPhysicalDeviceProperties2(DeviceInfo.PhysicalDevice, &subgroupProperties2);
+    if(subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) {
+        const VkSubgroupFeatureFlags operations = subgroupProperties.supportedOperations;
+        Capabilities.SubgroupSize = subgroupProperties.subgroupSize;
+        Capabilities.bSubgroupBallot = operations & VK_SUBGROUP_FEATURE_BALLOT_BIT;
+        Capabilities.bSubgroupArithmetic = operations & VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+    }
 
     // We could simply enable all supported features, but since that may have performance
     // consequences let's just enable the features we need.
     VkPhysicalDeviceFeatures enabledFeatures{
+        .multiDrawIndirect = DeviceInfo.PhysicalDeviceFeatures.multiDrawIndirect,
+        .drawIndirectFirstInstance =
+            DeviceInfo.PhysicalDeviceFeatures.drawIndirectFirstInstance,
         .samplerAnisotropy = DeviceInfo.PhysicalDeviceFeatures.samplerAnisotropy,
         .textureCompressionETC2 =
             DeviceInfo.PhysicalDeviceFeatures.textureCompressionETC2,
         .textureCompressionBC = DeviceInfo.PhysicalDeviceFeatures.textureCompressionBC,
     };
+    Capabilities.bMultiDrawIndirect = enabledFeatures.multiDrawIndirect == VK_TRUE;
+    Capabilities.bDrawIndirectFirstInstance =
+        enabledFeatures.drawIndirectFirstInstance == VK_TRUE;
+    Capabilities.bDrawIndirectCount =
+        deviceExts.contains(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    Capabilities.bCalibratedTimestamps =
+        deviceExts.contains(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+
+    // Mesh shaders are only used when both task and mesh stages are available.
+    VkPhysicalDeviceMeshShaderFeaturesNV meshShaderFeatures{
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_NV};
+    if(deviceExts.contains(VK_NV_MESH_SHADER_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+        features2.pNext = &meshShaderFeatures;
+        vkGetPhysicalDeviceFeatures2(DeviceInfo.PhysicalDevice, &features2);
+
+        VkPhysicalDeviceMeshShaderPropertiesNV meshShaderProperties{
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_NV};
+        VkPhysicalDeviceProperties2 properties2{
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+        properties2.pNext = &meshShaderProperties;
+        vkGetPhysicalDeviceProperties2(DeviceInfo.PhysicalDevice, &properties2);
+
+        Capabilities.bMeshShader = meshShaderFeatures.taskShader == VK_TRUE &&
+                                   meshShaderFeatures.meshShader == VK_TRUE;
+        Capabilities.MaxMeshOutputVertices = meshShaderProperties.maxMeshOutputVertices;
+        Capabilities.MaxMeshOutputPrimitives =
+            meshShaderProperties.maxMeshOutputPrimitives;
+    }
+    if(!Capabilities.bMeshShader) { deviceExts.erase(VK_NV_MESH_SHADER_EXTENSION_NAME); }
+    RE_LOGI(
+        "Mesh shaders: {}, draw indirect count: {}, multi draw indirect: {}",
+        Capabilities.bMeshShader, Capabilities.bDrawIndirectCount,
+        Capabilities.bMultiDrawIndirect);
+    RE_LOGI(
+        "Async compute: {}, subgroup size: {}, ballot: {}, arithmetic: {}",
+        Capabilities.bAsyncCompute, Capabilities.SubgroupSize,
+        Capabilities.bSubgroupBallot, Capabilities.bSubgroupArithmetic);
 
     std::vector<const char *> requestExtensions;
     requestExtensions.reserve(deviceExts.size() + 1);
@@ -422,11 +529,12 @@ void FRHI::CreateDevice() {
     }
 
     VkDeviceCreateInfo deviceCreateInfo{VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
-    deviceCreateInfo.queueCreateInfoCount = 1;
-    deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+    deviceCreateInfo.queueCreateInfoCount = Capabilities.bAsyncCompute ? 2 : 1;
+    deviceCreateInfo.pQueueCreateInfos = queueCreateInfos;
     deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
     deviceCreateInfo.enabledExtensionCount = requestExtensions.size();
     deviceCreateInfo.ppEnabledExtensionNames = requestExtensions.data();
+    if(Capabilities.bMeshShader) { deviceCreateInfo.pNext = &meshShaderFeatures; }
 
     vk_check(vkCreateDevice(
         DeviceInfo.PhysicalDevice, &deviceCreateInfo, nullptr, &DeviceInfo.Device));
@@ -434,6 +542,9 @@ void FRHI::CreateDevice() {
     vkGetDeviceQueue(
         DeviceInfo.Device, DeviceInfo.GraphicsQueueIndex, 0, &DeviceInfo.GraphicsQueue);
     checkf(DeviceInfo.GraphicsQueue != VK_NULL_HANDLE, "Unable to get graphics queue.");
+    vkGetDeviceQueue(
+        DeviceInfo.Device, DeviceInfo.ComputeQueueIndex, 0, &DeviceInfo.ComputeQueue);
+    checkf(DeviceInfo.ComputeQueue != VK_NULL_HANDLE, "Unable to get compute queue.");
 }
 void FRHI::CreateSurface(void *nativeWindow) {
     VkSurfaceKHR surface;
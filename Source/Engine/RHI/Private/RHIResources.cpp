@@ -0,0 +1,246 @@
+﻿#include "RHI/RHI.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace RE {
+void FRHI::CreateAllocator() {
+    // VMA cannot see the dynamically loaded entry points, hand them over explicitly.
+    VmaVulkanFunctions Functions{};
+    Functions.vkGetPhysicalDeviceProperties = vkGetPhysicalDeviceProperties;
+    Functions.vkGetPhysicalDeviceMemoryProperties = vkGetPhysicalDeviceMemoryProperties;
+    Functions.vkAllocateMemory = vkAllocateMemory;
+    Functions.vkFreeMemory = vkFreeMemory;
+    Functions.vkMapMemory = vkMapMemory;
+    Functions.vkUnmapMemory = vkUnmapMemory;
+    Functions.vkFlushMappedMemoryRanges = vkFlushMappedMemoryRanges;
+    Functions.vkInvalidateMappedMemoryRanges = vkInvalidateMappedMemoryRanges;
+    Functions.vkBindBufferMemory = vkBindBufferMemory;
+    Functions.vkBindImageMemory = vkBindImageMemory;
+    Functions.vkGetBufferMemoryRequirements = vkGetBufferMemoryRequirements;
+    Functions.vkGetImageMemoryRequirements = vkGetImageMemoryRequirements;
+    Functions.vkCreateBuffer = vkCreateBuffer;
+    Functions.vkDestroyBuffer = vkDestroyBuffer;
+    Functions.vkCreateImage = vkCreateImage;
+    Functions.vkDestroyImage = vkDestroyImage;
+    Functions.vkCmdCopyBuffer = vkCmdCopyBuffer;
+    Functions.vkGetBufferMemoryRequirements2KHR = vkGetBufferMemoryRequirements2;
+    Functions.vkGetImageMemoryRequirements2KHR = vkGetImageMemoryRequirements2;
+    Functions.vkBindBufferMemory2KHR = vkBindBufferMemory2;
+    Functions.vkBindImageMemory2KHR = vkBindImageMemory2;
+    Functions.vkGetPhysicalDeviceMemoryProperties2KHR =
+        vkGetPhysicalDeviceMemoryProperties2;
+
+    VmaAllocatorCreateInfo AllocatorCreateInfo{};
+    AllocatorCreateInfo.vulkanApiVersion = VK_MAKE_API_VERSION(
+        0, RE_VK_REQUIRED_VERSION_MAJOR, RE_VK_REQUIRED_VERSION_MINOR, 0);
+    AllocatorCreateInfo.physicalDevice = DeviceInfo.PhysicalDevice;
+    AllocatorCreateInfo.device = DeviceInfo.Device;
+    AllocatorCreateInfo.instance = DeviceInfo.Instance;
+    AllocatorCreateInfo.pVulkanFunctions = &Functions;
+    vk_check(vmaCreateAllocator(&AllocatorCreateInfo, &DeviceInfo.Allocator));
+
+    VkCommandPoolCreateInfo CommandPoolCreateInfo{
+        VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    CommandPoolCreateInfo.queueFamilyIndex = DeviceInfo.GraphicsQueueIndex;
+    CommandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    vk_check(vkCreateCommandPool(
+        DeviceInfo.Device, &CommandPoolCreateInfo, nullptr,
+        &DeviceInfo.ImmediateCommandPool));
+}
+
+FBuffer FRHI::CreateBuffer(
+    VkDeviceSize Size, VkBufferUsageFlags Usage, VmaMemoryUsage MemoryUsage) {
+    VkBufferCreateInfo BufferCreateInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    BufferCreateInfo.size = std::max<VkDeviceSize>(Size, 4);
+    BufferCreateInfo.usage = Usage;
+    BufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo AllocationCreateInfo{};
+    AllocationCreateInfo.usage = MemoryUsage;
+    if(MemoryUsage != VMA_MEMORY_USAGE_GPU_ONLY) {
+        AllocationCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    }
+
+    FBuffer Buffer;
+    VmaAllocationInfo AllocationInfo{};
+    vk_check(vmaCreateBuffer(
+        DeviceInfo.Allocator, &BufferCreateInfo, &AllocationCreateInfo, &Buffer.Buffer,
+        &Buffer.Allocation, &AllocationInfo));
+    Buffer.Size = Size;
+    Buffer.MappedData = AllocationInfo.pMappedData;
+    return Buffer;
+}
+
+void FRHI::DestroyBuffer(FBuffer &Buffer) {
+    if(Buffer.Buffer != VK_NULL_HANDLE) {
+        vmaDestroyBuffer(DeviceInfo.Allocator, Buffer.Buffer, Buffer.Allocation);
+    }
+    Buffer = {};
+}
+
+FImage FRHI::CreateImage(const VkImageCreateInfo &CreateInfo, VmaMemoryUsage MemoryUsage) {
+    VmaAllocationCreateInfo AllocationCreateInfo{};
+    AllocationCreateInfo.usage = MemoryUsage;
+
+    FImage Image;
+    vk_check(vmaCreateImage(
+        DeviceInfo.Allocator, &CreateInfo, &AllocationCreateInfo, &Image.Image,
+        &Image.Allocation, nullptr));
+    Image.Format = CreateInfo.format;
+    Image.Extent = CreateInfo.extent;
+    Image.MipLevels = CreateInfo.mipLevels;
+    Image.ArrayLayers = CreateInfo.arrayLayers;
+    return Image;
+}
+
+FImage FRHI::CreateImage(const VkImageCreateInfo &CreateInfo, const FMemoryPool &Pool) {
+    VmaAllocationCreateInfo AllocationCreateInfo{};
+    AllocationCreateInfo.pool = Pool.Pool;
+
+    FImage Image;
+    vk_check(vmaCreateImage(
+        DeviceInfo.Allocator, &CreateInfo, &AllocationCreateInfo, &Image.Image,
+        &Image.Allocation, nullptr));
+    Image.Format = CreateInfo.format;
+    Image.Extent = CreateInfo.extent;
+    Image.MipLevels = CreateInfo.mipLevels;
+    Image.ArrayLayers = CreateInfo.arrayLayers;
+    return Image;
+}
+
+FMemoryPool FRHI::CreateImagePool(
+    const VkImageCreateInfo &CreateInfo, VmaMemoryUsage MemoryUsage,
+    VkDeviceSize BlockSize, size_t MaxBlockCount) {
+    VmaAllocationCreateInfo AllocationCreateInfo{};
+    AllocationCreateInfo.usage = MemoryUsage;
+
+    VmaPoolCreateInfo PoolCreateInfo{};
+    vk_check(vmaFindMemoryTypeIndexForImageInfo(
+        DeviceInfo.Allocator, &CreateInfo, &AllocationCreateInfo,
+        &PoolCreateInfo.memoryTypeIndex));
+    if(BlockSize == 0) {
+        // VMA's default blocks may be smaller than one large image.
+        VkImage Probe{VK_NULL_HANDLE};
+        vk_check(vkCreateImage(DeviceInfo.Device, &CreateInfo, nullptr, &Probe));
+        VkMemoryRequirements Requirements{};
+        vkGetImageMemoryRequirements(DeviceInfo.Device, Probe, &Requirements);
+        vkDestroyImage(DeviceInfo.Device, Probe, nullptr);
+        BlockSize = Requirements.size;
+    }
+    PoolCreateInfo.blockSize = BlockSize;
+    PoolCreateInfo.maxBlockCount = MaxBlockCount;
+
+    FMemoryPool Pool;
+    vk_check(vmaCreatePool(DeviceInfo.Allocator, &PoolCreateInfo, &Pool.Pool));
+    return Pool;
+}
+
+void FRHI::DestroyMemoryPool(FMemoryPool &Pool) {
+    if(Pool.Pool != VK_NULL_HANDLE) { vmaDestroyPool(DeviceInfo.Allocator, Pool.Pool); }
+    Pool = {};
+}
+
+void FRHI::GetMemoryPoolUsage(
+    const FMemoryPool &Pool, VkDeviceSize &OutSize, VkDeviceSize &OutUsed) const {
+    VmaPoolStats Stats{};
+    vmaGetPoolStats(DeviceInfo.Allocator, Pool.Pool, &Stats);
+    OutSize = Stats.size;
+    OutUsed = Stats.size - Stats.unusedSize;
+}
+
+void FRHI::DestroyImage(FImage &Image) {
+    if(Image.Image != VK_NULL_HANDLE) {
+        vmaDestroyImage(DeviceInfo.Allocator, Image.Image, Image.Allocation);
+    }
+    Image = {};
+}
+
+VkImageView FRHI::CreateImageView(
+    const FImage &Image, VkImageAspectFlags Aspect, uint32_t BaseMip, uint32_t MipCount,
+    uint32_t BaseLayer, uint32_t LayerCount) {
+    VkImageViewCreateInfo CreateInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+    CreateInfo.image = Image.Image;
+    CreateInfo.viewType =
+        LayerCount > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+    CreateInfo.format = Image.Format;
+    CreateInfo.subresourceRange = {Aspect, BaseMip, MipCount, BaseLayer, LayerCount};
+
+    VkImageView View{VK_NULL_HANDLE};
+    vk_check(vkCreateImageView(DeviceInfo.Device, &CreateInfo, nullptr, &View));
+    return View;
+}
+
+void FRHI::UploadBuffer(const FBuffer &Buffer, const void *Data, VkDeviceSize Size) {
+    if(Size == 0) { return; }
+    if(Buffer.MappedData != nullptr) {
+        std::memcpy(Buffer.MappedData, Data, Size);
+        vmaFlushAllocation(DeviceInfo.Allocator, Buffer.Allocation, 0, Size);
+        return;
+    }
+
+    FBuffer Staging =
+        CreateBuffer(Size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+    std::memcpy(Staging.MappedData, Data, Size);
+    ImmediateSubmit([&](VkCommandBuffer CommandBuffer) {
+        VkBufferCopy Region{0, 0, Size};
+        vkCmdCopyBuffer(CommandBuffer, Staging.Buffer, Buffer.Buffer, 1, &Region);
+    });
+    DestroyBuffer(Staging);
+}
+
+void FRHI::ImmediateSubmit(const std::function<void(VkCommandBuffer)> &Record) {
+    VkCommandBufferAllocateInfo AllocateInfo{
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    AllocateInfo.commandPool = DeviceInfo.ImmediateCommandPool;
+    AllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    AllocateInfo.commandBufferCount = 1;
+
+    VkCommandBuffer CommandBuffer;
+    vk_check(vkAllocateCommandBuffers(DeviceInfo.Device, &AllocateInfo, &CommandBuffer));
+
+    VkCommandBufferBeginInfo BeginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vk_check(vkBeginCommandBuffer(CommandBuffer, &BeginInfo));
+    Record(CommandBuffer);
+    vk_check(vkEndCommandBuffer(CommandBuffer));
+
+    VkFenceCreateInfo FenceCreateInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    VkFence Fence;
+    vk_check(vkCreateFence(DeviceInfo.Device, &FenceCreateInfo, nullptr, &Fence));
+
+    VkSubmitInfo SubmitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    SubmitInfo.commandBufferCount = 1;
+    SubmitInfo.pCommandBuffers = &CommandBuffer;
+    vk_check(vkQueueSubmit(DeviceInfo.GraphicsQueue, 1, &SubmitInfo, Fence));
+    vk_check(vkWaitForFences(DeviceInfo.Device, 1, &Fence, VK_TRUE, UINT64_MAX));
+
+    vkDestroyFence(DeviceInfo.Device, Fence, nullptr);
+    vkFreeCommandBuffers(
+        DeviceInfo.Device, DeviceInfo.ImmediateCommandPool, 1, &CommandBuffer);
+}
+
+VkShaderModule FRHI::CreateShaderModule(std::span<const uint32_t> Spirv) {
+    VkShaderModuleCreateInfo CreateInfo{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+    CreateInfo.codeSize = Spirv.size_bytes();
+    CreateInfo.pCode = Spirv.data();
+
+    VkShaderModule Module{VK_NULL_HANDLE};
+    vk_check(vkCreateShaderModule(DeviceInfo.Device, &CreateInfo, nullptr, &Module));
+    return Module;
+}
+
+VkPipeline FRHI::CreateComputePipeline(VkShaderModule Module, VkPipelineLayout Layout) {
+    VkComputePipelineCreateInfo CreateInfo{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+    CreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    CreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    CreateInfo.stage.module = Module;
+    CreateInfo.stage.pName = "main";
+    CreateInfo.layout = Layout;
+
+    VkPipeline Pipeline{VK_NULL_HANDLE};
+    vk_check(vkCreateComputePipelines(
+        DeviceInfo.Device, VK_NULL_HANDLE, 1, &CreateInfo, nullptr, &Pipeline));
+    return Pipeline;
+}
+}
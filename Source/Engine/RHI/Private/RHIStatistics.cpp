@@ -0,0 +1,114 @@
+﻿#include "RHI/RHI.h"
+
+#include <atomic>
+#include <type_traits>
+
+namespace RE {
+namespace {
+std::atomic<uint32_t> Draws{0};
+std::atomic<uint32_t> Dispatches{0};
+std::atomic<uint32_t> PipelineBinds{0};
+std::atomic<uint32_t> DescriptorSets{0};
+
+// The loaded entry points, called by the counting ones standing in for them.
+PFN_vkCmdDraw OriginalCmdDraw{nullptr};
+PFN_vkCmdDrawIndexed OriginalCmdDrawIndexed{nullptr};
+PFN_vkCmdDrawIndirect OriginalCmdDrawIndirect{nullptr};
+PFN_vkCmdDrawIndexedIndirect OriginalCmdDrawIndexedIndirect{nullptr};
+PFN_vkCmdDrawIndirectCountKHR OriginalCmdDrawIndirectCount{nullptr};
+PFN_vkCmdDrawIndexedIndirectCountKHR OriginalCmdDrawIndexedIndirectCount{nullptr};
+PFN_vkCmdDrawMeshTasksNV OriginalCmdDrawMeshTasks{nullptr};
+PFN_vkCmdDrawMeshTasksIndirectNV OriginalCmdDrawMeshTasksIndirect{nullptr};
+PFN_vkCmdDispatch OriginalCmdDispatch{nullptr};
+PFN_vkCmdDispatchIndirect OriginalCmdDispatchIndirect{nullptr};
+PFN_vkCmdBindPipeline OriginalCmdBindPipeline{nullptr};
+PFN_vkAllocateDescriptorSets OriginalAllocateDescriptorSets{nullptr};
+
+template<typename TFunction>
+struct FCounting;
+
+template<typename TResult, typename... TArgs>
+struct FCounting<TResult(VKAPI_PTR *)(TArgs...)> {
+    using FFunction = TResult(VKAPI_PTR *)(TArgs...);
+
+    // Counts one command per call, an indirect draw being one however many it launches.
+    template<FFunction &Original, std::atomic<uint32_t> &Counter>
+    static TResult VKAPI_CALL Call(TArgs... Args) {
+        Counter.fetch_add(1, std::memory_order_relaxed);
+        return Original(Args...);
+    }
+};
+
+VKAPI_ATTR VkResult VKAPI_CALL CountingAllocateDescriptorSets(
+    VkDevice Device, const VkDescriptorSetAllocateInfo *AllocateInfo,
+    VkDescriptorSet *OutSets) {
+    DescriptorSets.fetch_add(AllocateInfo->descriptorSetCount, std::memory_order_relaxed);
+    return OriginalAllocateDescriptorSets(Device, AllocateInfo, OutSets);
+}
+
+// Swaps an entry point with its counting stand-in, entries never loaded stay null.
+template<typename TFunction>
+void Route(TFunction &Entry, TFunction &Original, TFunction Counting, bool bCount) {
+    if(bCount && Entry != nullptr && Entry != Counting) {
+        Original = Entry;
+        Entry = Counting;
+    } else if(!bCount && Entry == Counting) {
+        Entry = Original;
+    }
+}
+
+template<auto &Original, std::atomic<uint32_t> &Counter>
+constexpr auto Counted =
+    &FCounting<std::remove_reference_t<decltype(Original)>>::template Call<
+        Original, Counter>;
+}
+
+void FRHI::SetStatisticsEnabled(bool bEnabled) {
+    Route(vkCmdDraw, OriginalCmdDraw, Counted<OriginalCmdDraw, Draws>, bEnabled);
+    Route(
+        vkCmdDrawIndexed, OriginalCmdDrawIndexed, Counted<OriginalCmdDrawIndexed, Draws>,
+        bEnabled);
+    Route(
+        vkCmdDrawIndirect, OriginalCmdDrawIndirect,
+        Counted<OriginalCmdDrawIndirect, Draws>, bEnabled);
+    Route(
+        vkCmdDrawIndexedIndirect, OriginalCmdDrawIndexedIndirect,
+        Counted<OriginalCmdDrawIndexedIndirect, Draws>, bEnabled);
+    Route(
+        vkCmdDrawIndirectCountKHR, OriginalCmdDrawIndirectCount,
+        Counted<OriginalCmdDrawIndirectCount, Draws>, bEnabled);
+    Route(
+        vkCmdDrawIndexedIndirectCountKHR, OriginalCmdDrawIndexedIndirectCount,
+        Counted<OriginalCmdDrawIndexedIndirectCount, Draws>, bEnabled);
+    Route(
+        vkCmdDrawMeshTasksNV, OriginalCmdDrawMeshTasks,
+        Counted<OriginalCmdDrawMeshTasks, Draws>, bEnabled);
+    Route(
+        vkCmdDrawMeshTasksIndirectNV, OriginalCmdDrawMeshTasksIndirect,
+        Counted<OriginalCmdDrawMeshTasksIndirect, Draws>, bEnabled);
+    Route(
+        vkCmdDispatch, OriginalCmdDispatch, Counted<OriginalCmdDispatch, Dispatches>,
+        bEnabled);
+    Route(
+        vkCmdDispatchIndirect, OriginalCmdDispatchIndirect,
+        Counted<OriginalCmdDispatchIndirect, Dispatches>, bEnabled);
+    Route(
+        vkCmdBindPipeline, OriginalCmdBindPipeline,
+        Counted<OriginalCmdBindPipeline, PipelineBinds>, bEnabled);
+    Route(
+        vkAllocateDescriptorSets, OriginalAllocateDescriptorSets,
+        &CountingAllocateDescriptorSets, bEnabled);
+    bStatisticsEnabled = bEnabled;
+    ConsumeStatistics();
+}
+
+FRHIStatistics FRHI::ConsumeStatistics() {
+    FRHIStatistics Statistics;
+    Statistics.Draws = Draws.exchange(0, std::memory_order_relaxed);
+    Statistics.Dispatches = Dispatches.exchange(0, std::memory_order_relaxed);
+    Statistics.PipelineBinds = PipelineBinds.exchange(0, std::memory_order_relaxed);
+    Statistics.DescriptorSetAllocations =
+        DescriptorSets.exchange(0, std::memory_order_relaxed);
+    return Statistics;
+}
+}
@@ -0,0 +1,384 @@
+﻿#include "RHI/RenderPassBuilder.h"
+#include "RHI/RHI.h"
+
+#include <algorithm>
+
+namespace RE {
+namespace {
+bool IsDepthFormat(VkFormat Format) {
+    switch(Format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT: return true;
+        default: return false;
+    }
+}
+
+bool HasStencil(VkFormat Format) {
+    return Format == VK_FORMAT_D16_UNORM_S8_UINT || Format == VK_FORMAT_D24_UNORM_S8_UINT ||
+           Format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+// Bytes per sample of the usual attachment formats, 4 for anything else.
+uint32_t GetFormatSize(VkFormat Format) {
+    switch(Format) {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_S8_UINT: return 1;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R16_SFLOAT:
+        case VK_FORMAT_D16_UNORM: return 2;
+        case VK_FORMAT_D16_UNORM_S8_UINT: return 3;
+        case VK_FORMAT_D32_SFLOAT_S8_UINT: return 5;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R16G16B16A16_UNORM:
+        case VK_FORMAT_R32G32_SFLOAT: return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT: return 16;
+        default: return 4;
+    }
+}
+
+bool Contains(const std::vector<uint32_t> &Values, uint32_t Value) {
+    return std::find(Values.begin(), Values.end(), Value) != Values.end();
+}
+
+// Attachments a pass touches inside its render pass, sampled reads excluded.
+std::vector<uint32_t> GetAttachmentUses(const FPassDesc &Pass) {
+    std::vector<uint32_t> Uses = Pass.Colors;
+    if(Pass.Depth >= 0) { Uses.push_back(static_cast<uint32_t>(Pass.Depth)); }
+    for(uint32_t Input: Pass.Inputs) {
+        if(!Contains(Uses, Input)) { Uses.push_back(Input); }
+    }
+    return Uses;
+}
+
+std::vector<uint32_t> GetAttachmentWrites(const FPassDesc &Pass) {
+    std::vector<uint32_t> Writes = Pass.Colors;
+    if(Pass.Depth >= 0 && !Pass.bDepthReadOnly) {
+        Writes.push_back(static_cast<uint32_t>(Pass.Depth));
+    }
+    return Writes;
+}
+
+constexpr VkPipelineStageFlags AttachmentStages =
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+constexpr VkAccessFlags AttachmentWrites =
+    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+constexpr VkAccessFlags AttachmentAccesses =
+    AttachmentWrites | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+}
+
+uint32_t FRenderPassBuilder::AddAttachment(const FAttachmentDesc &Desc) {
+    AttachmentDescs.push_back(Desc);
+    return static_cast<uint32_t>(AttachmentDescs.size() - 1);
+}
+
+uint32_t FRenderPassBuilder::AddPass(const FPassDesc &Desc) {
+    PassDescs.push_back(Desc);
+    return static_cast<uint32_t>(PassDescs.size() - 1);
+}
+
+void FRenderPassBuilder::Compile() {
+    const uint32_t AttachmentCount = static_cast<uint32_t>(AttachmentDescs.size());
+    const uint32_t PassCount = static_cast<uint32_t>(PassDescs.size());
+    RenderPasses.clear();
+    PassRenderPass.assign(PassCount, 0);
+    Transient.assign(AttachmentCount, false);
+
+    // A pass joins the current render pass unless it samples what the render pass
+    // wrote, or writes what it sampled; both need the data in memory.
+    std::vector<bool> WrittenInGroup(AttachmentCount);
+    std::vector<bool> SampledInGroup(AttachmentCount);
+    for(uint32_t Pass = 0; Pass < PassCount; Pass++) {
+        const FPassDesc &Desc = PassDescs[Pass];
+        const std::vector<uint32_t> Writes = GetAttachmentWrites(Desc);
+        bool bBreak = RenderPasses.empty() || Desc.bSeparate;
+        for(uint32_t Attachment: Desc.Sampled) {
+            bBreak |= WrittenInGroup[Attachment];
+        }
+        for(uint32_t Attachment: Writes) {
+            bBreak |= SampledInGroup[Attachment];
+        }
+        if(bBreak) {
+            RenderPasses.emplace_back().FirstPass = Pass;
+            std::fill(WrittenInGroup.begin(), WrittenInGroup.end(), false);
+            std::fill(SampledInGroup.begin(), SampledInGroup.end(), false);
+        }
+        for(uint32_t Attachment: Writes) {
+            WrittenInGroup[Attachment] = true;
+        }
+        for(uint32_t Attachment: Desc.Sampled) {
+            SampledInGroup[Attachment] = true;
+        }
+        RenderPasses.back().PassCount++;
+        PassRenderPass[Pass] = static_cast<uint32_t>(RenderPasses.size() - 1);
+    }
+
+    // Whether any pass from the given one on uses an attachment, and samples it.
+    auto IsUsedFrom = [&](uint32_t FirstPass, uint32_t Attachment, bool bSampledOnly) {
+        for(uint32_t Pass = FirstPass; Pass < PassCount; Pass++) {
+            const FPassDesc &Desc = PassDescs[Pass];
+            if(Contains(Desc.Sampled, Attachment)) { return true; }
+            if(!bSampledOnly && Contains(GetAttachmentUses(Desc), Attachment)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::vector<VkImageLayout> Layouts(AttachmentCount);
+    std::vector<bool> bHasContents(AttachmentCount);
+    std::vector<uint32_t> RenderPassUses(AttachmentCount, 0);
+    for(uint32_t Attachment = 0; Attachment < AttachmentCount; Attachment++) {
+        Layouts[Attachment] = AttachmentDescs[Attachment].InitialLayout;
+        bHasContents[Attachment] =
+            AttachmentDescs[Attachment].LoadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+    }
+
+    for(FMergedRenderPass &RenderPass: RenderPasses) {
+        const uint32_t EndPass = RenderPass.FirstPass + RenderPass.PassCount;
+        std::vector<int32_t> Local(AttachmentCount, -1);
+        std::vector<VkImageLayout> LastLayouts(AttachmentCount);
+        std::vector<std::vector<uint32_t>> SubpassUses;
+
+        for(uint32_t Pass = RenderPass.FirstPass; Pass < EndPass; Pass++) {
+            const FPassDesc &Desc = PassDescs[Pass];
+            SubpassUses.push_back(GetAttachmentUses(Desc));
+            for(uint32_t Attachment: SubpassUses.back()) {
+                if(Local[Attachment] >= 0) { continue; }
+                Local[Attachment] = static_cast<int32_t>(RenderPass.Attachments.size());
+                RenderPass.Attachments.push_back(Attachment);
+            }
+
+            // Reading and writing an attachment in the same subpass needs GENERAL.
+            FMergedRenderPass::FSubpass &Subpass = RenderPass.Subpasses.emplace_back();
+            for(uint32_t Color: Desc.Colors) {
+                const VkImageLayout Layout = Contains(Desc.Inputs, Color)
+                                                 ? VK_IMAGE_LAYOUT_GENERAL
+                                                 : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+                Subpass.Colors.push_back({uint32_t(Local[Color]), Layout});
+                LastLayouts[Color] = Layout;
+            }
+            if(Desc.Depth >= 0) {
+                const uint32_t Depth = static_cast<uint32_t>(Desc.Depth);
+                VkImageLayout Layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+                if(Desc.bDepthReadOnly) {
+                    Layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+                } else if(Contains(Desc.Inputs, Depth)) {
+                    Layout = VK_IMAGE_LAYOUT_GENERAL;
+                }
+                Subpass.Depth = {uint32_t(Local[Depth]), Layout};
+                LastLayouts[Depth] = Layout;
+            }
+            for(uint32_t Input: Desc.Inputs) {
+                VkImageLayout Layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                if(Contains(Desc.Colors, Input) ||
+                   (Desc.Depth == int32_t(Input) && !Desc.bDepthReadOnly)) {
+                    Layout = VK_IMAGE_LAYOUT_GENERAL;
+                } else if(IsDepthFormat(AttachmentDescs[Input].Format)) {
+                    Layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+                }
+                Subpass.Inputs.push_back({uint32_t(Local[Input]), Layout});
+                LastLayouts[Input] = Layout;
+            }
+        }
+
+        // Subpasses between two uses of an attachment have to keep its contents.
+        for(uint32_t Attachment: RenderPass.Attachments) {
+            uint32_t First = RenderPass.PassCount;
+            uint32_t Last = 0;
+            for(uint32_t i = 0; i < RenderPass.PassCount; i++) {
+                if(!Contains(SubpassUses[i], Attachment)) { continue; }
+                First = std::min(First, i);
+                Last = i;
+            }
+            for(uint32_t i = First + 1; i < Last; i++) {
+                if(!Contains(SubpassUses[i], Attachment)) {
+                    RenderPass.Subpasses[i].Preserve.push_back(uint32_t(Local[Attachment]));
+                }
+            }
+        }
+
+        for(uint32_t Attachment: RenderPass.Attachments) {
+            const FAttachmentDesc &Desc = AttachmentDescs[Attachment];
+            const bool bUsedLater = IsUsedFrom(EndPass, Attachment, false);
+            const bool bSampledLater = IsUsedFrom(EndPass, Attachment, true);
+
+            VkAttachmentDescription Description{};
+            Description.format = Desc.Format;
+            Description.samples = Desc.Samples;
+            Description.loadOp = bHasContents[Attachment] ? VK_ATTACHMENT_LOAD_OP_LOAD
+                                                          : Desc.LoadOp;
+            Description.storeOp = bUsedLater || Desc.bKeep
+                                      ? VK_ATTACHMENT_STORE_OP_STORE
+                                      : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            Description.stencilLoadOp = HasStencil(Desc.Format)
+                                            ? Description.loadOp
+                                            : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            Description.stencilStoreOp = HasStencil(Desc.Format)
+                                             ? Description.storeOp
+                                             : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            Description.initialLayout = Description.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD
+                                            ? Layouts[Attachment]
+                                            : VK_IMAGE_LAYOUT_UNDEFINED;
+            Description.finalLayout = LastLayouts[Attachment];
+            if(bSampledLater) {
+                Description.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            } else if(!bUsedLater && Desc.FinalLayout != VK_IMAGE_LAYOUT_UNDEFINED) {
+                Description.finalLayout = Desc.FinalLayout;
+            }
+            RenderPass.Descriptions.push_back(Description);
+
+            Layouts[Attachment] = Description.finalLayout;
+            bHasContents[Attachment] =
+                Description.storeOp == VK_ATTACHMENT_STORE_OP_STORE;
+            RenderPassUses[Attachment]++;
+        }
+
+        // Earlier attachment writes and sampled reads, then tile local dependencies
+        // between subpasses sharing attachments, then later passes.
+        RenderPass.Dependencies.push_back(
+            {VK_SUBPASS_EXTERNAL, 0,
+             AttachmentStages | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+             AttachmentStages | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, AttachmentWrites,
+             AttachmentAccesses, 0});
+        for(uint32_t Dst = 1; Dst < RenderPass.PassCount; Dst++) {
+            for(uint32_t Src = 0; Src < Dst; Src++) {
+                const bool bShared = std::any_of(
+                    SubpassUses[Dst].begin(), SubpassUses[Dst].end(),
+                    [&](uint32_t Attachment) {
+                        return Contains(SubpassUses[Src], Attachment);
+                    });
+                if(!bShared) { continue; }
+                RenderPass.Dependencies.push_back(
+                    {Src, Dst, AttachmentStages | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                     AttachmentStages | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                     AttachmentWrites, AttachmentAccesses,
+                     VK_DEPENDENCY_BY_REGION_BIT});
+            }
+        }
+        RenderPass.Dependencies.push_back(
+            {RenderPass.PassCount - 1, VK_SUBPASS_EXTERNAL, AttachmentStages,
+             AttachmentStages | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, AttachmentWrites,
+             AttachmentAccesses | VK_ACCESS_SHADER_READ_BIT, 0});
+    }
+
+    uint32_t TransientCount = 0;
+    for(uint32_t Attachment = 0; Attachment < AttachmentCount; Attachment++) {
+        const FAttachmentDesc &Desc = AttachmentDescs[Attachment];
+        Transient[Attachment] = RenderPassUses[Attachment] == 1 && !Desc.bKeep &&
+                                Desc.LoadOp != VK_ATTACHMENT_LOAD_OP_LOAD &&
+                                !IsUsedFrom(0, Attachment, true);
+        TransientCount += Transient[Attachment] ? 1 : 0;
+    }
+    RE_LOGI(
+        "{} passes merged into {} render passes, {} of {} attachments transient.",
+        PassCount, RenderPasses.size(), TransientCount, AttachmentCount);
+}
+
+uint32_t FRenderPassBuilder::GetSubpassIndex(uint32_t Pass) const {
+    return Pass - RenderPasses[PassRenderPass[Pass]].FirstPass;
+}
+
+void FRenderPassBuilder::CreateRenderPasses(VkDevice Device) {
+    for(FMergedRenderPass &RenderPass: RenderPasses) {
+        std::vector<VkSubpassDescription> Subpasses;
+        for(const FMergedRenderPass::FSubpass &Subpass: RenderPass.Subpasses) {
+            VkSubpassDescription Description{};
+            Description.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            Description.inputAttachmentCount = static_cast<uint32_t>(Subpass.Inputs.size());
+            Description.pInputAttachments = Subpass.Inputs.data();
+            Description.colorAttachmentCount = static_cast<uint32_t>(Subpass.Colors.size());
+            Description.pColorAttachments = Subpass.Colors.data();
+            if(Subpass.Depth.attachment != VK_ATTACHMENT_UNUSED) {
+                Description.pDepthStencilAttachment = &Subpass.Depth;
+            }
+            Description.preserveAttachmentCount =
+                static_cast<uint32_t>(Subpass.Preserve.size());
+            Description.pPreserveAttachments = Subpass.Preserve.data();
+            Subpasses.push_back(Description);
+        }
+
+        VkRenderPassCreateInfo CreateInfo{VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
+        CreateInfo.attachmentCount = static_cast<uint32_t>(RenderPass.Descriptions.size());
+        CreateInfo.pAttachments = RenderPass.Descriptions.data();
+        CreateInfo.subpassCount = static_cast<uint32_t>(Subpasses.size());
+        CreateInfo.pSubpasses = Subpasses.data();
+        CreateInfo.dependencyCount = static_cast<uint32_t>(RenderPass.Dependencies.size());
+        CreateInfo.pDependencies = RenderPass.Dependencies.data();
+        vk_check(vkCreateRenderPass(Device, &CreateInfo, nullptr, &RenderPass.RenderPass));
+    }
+}
+
+void FRenderPassBuilder::DestroyRenderPasses(VkDevice Device) {
+    for(FMergedRenderPass &RenderPass: RenderPasses) {
+        if(RenderPass.RenderPass == VK_NULL_HANDLE) { continue; }
+        vkDestroyRenderPass(Device, RenderPass.RenderPass, nullptr);
+        RenderPass.RenderPass = VK_NULL_HANDLE;
+    }
+}
+
+VkImageUsageFlags FRenderPassBuilder::GetAttachmentUsage(uint32_t Attachment) const {
+    VkImageUsageFlags Usage = 0;
+    for(const FPassDesc &Pass: PassDescs) {
+        if(Contains(Pass.Colors, Attachment)) {
+            Usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        }
+        if(Pass.Depth == int32_t(Attachment)) {
+            Usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        }
+        if(Contains(Pass.Inputs, Attachment)) {
+            Usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+        }
+        if(Contains(Pass.Sampled, Attachment)) { Usage |= VK_IMAGE_USAGE_SAMPLED_BIT; }
+    }
+    if(Attachment < Transient.size() && Transient[Attachment]) {
+        Usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+    return Usage;
+}
+
+FRenderPassBandwidth FRenderPassBuilder::EstimateBandwidth(VkExtent2D Extent) const {
+    const uint64_t Pixels = uint64_t(Extent.width) * Extent.height;
+    auto GetSize = [&](uint32_t Attachment) {
+        const FAttachmentDesc &Desc = AttachmentDescs[Attachment];
+        return Pixels * GetFormatSize(Desc.Format) * uint64_t(Desc.Samples);
+    };
+
+    FRenderPassBandwidth Bandwidth;
+    for(const FMergedRenderPass &RenderPass: RenderPasses) {
+        for(size_t i = 0; i < RenderPass.Attachments.size(); i++) {
+            const VkAttachmentDescription &Description = RenderPass.Descriptions[i];
+            const uint64_t Size = GetSize(RenderPass.Attachments[i]);
+            if(Description.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+                Bandwidth.LoadBytes += Size;
+            }
+            if(Description.storeOp == VK_ATTACHMENT_STORE_OP_STORE) {
+                Bandwidth.StoreBytes += Size;
+            }
+        }
+    }
+
+    // Every pass on its own stores all it touched and loads what has contents.
+    std::vector<bool> bHasContents(AttachmentDescs.size());
+    for(size_t Attachment = 0; Attachment < AttachmentDescs.size(); Attachment++) {
+        bHasContents[Attachment] =
+            AttachmentDescs[Attachment].LoadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+        if(Attachment < Transient.size() && Transient[Attachment]) {
+            Bandwidth.TransientBytes += GetSize(static_cast<uint32_t>(Attachment));
+        }
+    }
+    for(const FPassDesc &Pass: PassDescs) {
+        for(uint32_t Attachment: GetAttachmentUses(Pass)) {
+            const uint64_t Size = GetSize(Attachment);
+            Bandwidth.UnmergedBytes += bHasContents[Attachment] ? 2 * Size : Size;
+            bHasContents[Attachment] = true;
+        }
+    }
+    return Bandwidth;
+}
+}
@@ -0,0 +1,113 @@
+// glslang has members named check(), include it before the logging macros.
+#include <SPIRV/GlslangToSpv.h>
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/Public/ShaderLang.h>
+
+#include "RHI/ShaderCompiler.h"
+#include "Core/FileSystem.h"
+#include "Core/Logging.h"
+
+namespace RE {
+namespace {
+EShLanguage GetLanguage(EShaderStage Stage) {
+    switch(Stage) {
+        case EShaderStage::Vertex: return EShLangVertex;
+        case EShaderStage::Fragment: return EShLangFragment;
+        case EShaderStage::Compute: return EShLangCompute;
+        case EShaderStage::Task: return EShLangTaskNV;
+        case EShaderStage::Mesh: return EShLangMeshNV;
+        default: return EShLangVertex;
+    }
+}
+
+class FVfsIncluder final : public glslang::TShader::Includer {
+public:
+    IncludeResult *includeLocal(
+        const char *HeaderName, const char *IncluderName, size_t Depth) override {
+        const std::string_view Includer(IncluderName);
+        const size_t Slash = Includer.find_last_of('/');
+        if(Slash != std::string_view::npos) {
+            std::string Path(Includer.substr(0, Slash + 1));
+            Path += HeaderName;
+            if(IncludeResult *Result = Open(Path)) { return Result; }
+        }
+        return includeSystem(HeaderName, IncluderName, Depth);
+    }
+
+    IncludeResult *includeSystem(const char *HeaderName, const char *, size_t) override {
+        return Open(HeaderName);
+    }
+
+    void releaseInclude(IncludeResult *Result) override {
+        if(Result == nullptr) { return; }
+        delete static_cast<std::string *>(Result->userData);
+        delete Result;
+    }
+
+private:
+    static IncludeResult *Open(std::string_view Path) {
+        const std::string Normalized = FVirtualFileSystem::NormalizePath(Path);
+        FFileData Data;
+        if(!FVirtualFileSystem::Get().Read(Normalized, Data)) { return nullptr; }
+        auto *Source = new std::string(
+            reinterpret_cast<const char *>(Data.GetData()), Data.GetSize());
+        return new IncludeResult(Normalized, Source->data(), Source->size(), Source);
+    }
+};
+}
+
+FShaderCompiler &FShaderCompiler::Get() {
+    static FShaderCompiler Compiler;
+    return Compiler;
+}
+
+FShaderCompiler::FShaderCompiler() { glslang::InitializeProcess(); }
+
+FShaderCompiler::~FShaderCompiler() { glslang::FinalizeProcess(); }
+
+bool FShaderCompiler::Compile(
+    std::string_view Path, EShaderStage Stage, std::span<const std::string> Defines,
+    std::vector<uint32_t> &OutSpirv) {
+    const std::string Name = FVirtualFileSystem::NormalizePath(Path);
+    FFileData Data;
+    if(!FVirtualFileSystem::Get().Read(Name, Data)) {
+        RE_LOGE("Shader not found: {}", Name);
+        return false;
+    }
+    const std::string Source(
+        reinterpret_cast<const char *>(Data.GetData()), Data.GetSize());
+
+    std::string Preamble;
+    for(const std::string &Define: Defines) {
+        Preamble += "#define " + Define + "\n";
+    }
+
+    const EShLanguage Language = GetLanguage(Stage);
+    glslang::TShader Shader(Language);
+    const char *SourceString = Source.c_str();
+    const char *SourceName = Name.c_str();
+    Shader.setStringsWithLengthsAndNames(&SourceString, nullptr, &SourceName, 1);
+    Shader.setPreamble(Preamble.c_str());
+    Shader.setEnvInput(glslang::EShSourceGlsl, Language, glslang::EShClientVulkan, 100);
+    Shader.setEnvClient(glslang::EShClientVulkan, glslang::EShTargetVulkan_1_1);
+    Shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_3);
+
+    const auto Messages = static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules);
+    FVfsIncluder Includer;
+    if(!Shader.parse(GetDefaultResources(), 450, false, Messages, Includer)) {
+        RE_LOGE("Failed to compile {}:\n{}", Name, Shader.getInfoLog());
+        return false;
+    }
+
+    glslang::TProgram Program;
+    Program.addShader(&Shader);
+    if(!Program.link(Messages)) {
+        RE_LOGE("Failed to link {}:\n{}", Name, Program.getInfoLog());
+        return false;
+    }
+
+    OutSpirv.clear();
+    glslang::GlslangToSpv(*Program.getIntermediate(Language), OutSpirv);
+    return true;
+}
+}
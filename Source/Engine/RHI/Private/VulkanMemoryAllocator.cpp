@@ -0,0 +1,7 @@
+#include "RHI/RHI.h"
+
+// Entry points are passed to vmaCreateAllocator, see FRHI::CreateAllocator.
+#define VMA_STATIC_VULKAN_FUNCTIONS 0
+#define VMA_DYNAMIC_VULKAN_FUNCTIONS 0
+#define VMA_IMPLEMENTATION
+#include <vk_mem_alloc.h>
@@ -0,0 +1,156 @@
+﻿#pragma once
+#include "re-rhi_export.h"
+#include "RHI/VulkanLoader.h"
+
+#include <tsl/robin_map.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace RE {
+class FRHI;
+
+/* One scope of a finished frame, in the order the scopes were opened. */
+struct FGpuScopeTiming {
+    const char *Name{nullptr};
+    /* Nesting level, 0 being the frame itself. */
+    uint32_t Depth{0};
+    double Milliseconds{0.0};
+};
+
+/* Times of all scopes sharing a name, summed per frame before being aggregated. */
+struct FGpuScopeStats {
+    std::string Name;
+    uint32_t Depth{0};
+    uint64_t Samples{0};
+    double LastMs{0.0};
+    /* Exponential moving average, steady enough to display every frame. */
+    double SmoothedMs{0.0};
+    double MinMs{0.0};
+    double MaxMs{0.0};
+    double TotalMs{0.0};
+
+    double GetAverageMs() const { return Samples > 0 ? TotalMs / double(Samples) : 0.0; }
+};
+
+/*
+ * Attributes GPU time to passes with timestamp queries written around scopes. Every frame
+ * slot has a query pool of its own, and a slot is only read back when it comes round
+ * again FrameLatency frames later, by which time the frame fence has long been waited on
+ * so the results are read without ever stalling the CPU. A slot whose results are not
+ * available yet is dropped rather than waited for.
+ *
+ * Scopes nest and may be opened on command buffers of any queue in the frame, since
+ * timestamps of all queues of a device share one time domain. Names are not copied and
+ * must outlive the frame, e.g. string literals.
+ *
+ * With calibrated timestamps, read back scopes also go to a GPU track of the CPU
+ * profiler while it captures, shifted onto FProfiler::Now's clock so both line up in
+ * one trace.
+ */
+class RE_RHI_EXPORT FGpuProfiler {
+public:
+    static constexpr uint32_t MaxFramesInFlight = 2;
+    /* One slot more than the frames in flight, so a slot's frame has completed. */
+    static constexpr uint32_t FrameLatency = MaxFramesInFlight + 1;
+    static constexpr uint32_t MaxScopes = 256;
+    static constexpr uint32_t InvalidScope = 0xFFFFFFFF;
+
+    explicit FGpuProfiler(FRHI &RHI);
+    ~FGpuProfiler();
+
+    FGpuProfiler(const FGpuProfiler &) = delete;
+    FGpuProfiler &operator=(const FGpuProfiler &) = delete;
+
+    bool IsSupported() const { return bSupported; }
+    /* Scopes recorded while disabled cost nothing, the change applies from BeginFrame. */
+    void SetEnabled(bool bInEnabled) { bEnabled = bInEnabled; }
+    bool IsEnabled() const { return bEnabled; }
+
+    /*
+     * Reads back the results this slot held, then resets its pool and opens the frame
+     * scope. Must be recorded outside a render pass, before any other scope of the frame.
+     */
+    void BeginFrame(VkCommandBuffer CommandBuffer, uint32_t Frame);
+    /* Closes the frame scope, any scope still open is left without a time. */
+    void EndFrame(VkCommandBuffer CommandBuffer);
+
+    /* Returns InvalidScope when disabled or out of queries, EndScope ignores it. */
+    uint32_t BeginScope(
+        VkCommandBuffer CommandBuffer, const char *Name,
+        VkPipelineStageFlagBits Stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    void EndScope(
+        VkCommandBuffer CommandBuffer, uint32_t Scope,
+        VkPipelineStageFlagBits Stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+    /* The most recent frame read back, and its total time. */
+    const std::vector<FGpuScopeTiming> &GetLastFrame() const { return LastFrame; }
+    double GetLastFrameTime() const {
+        return LastFrame.empty() ? 0.0 : LastFrame.front().Milliseconds;
+    }
+
+    const std::vector<FGpuScopeStats> &GetStatistics() const { return Statistics; }
+    void ResetStatistics();
+    void LogStatistics() const;
+    /* Writes the statistics as CSV, one scope name per row. */
+    bool WriteStatistics(const std::filesystem::path &Path) const;
+
+private:
+    struct FScope {
+        const char *Name;
+        uint32_t Depth;
+        uint32_t BeginQuery;
+        uint32_t EndQuery;
+    };
+
+    struct FFrameSlot {
+        VkQueryPool QueryPool{VK_NULL_HANDLE};
+        std::vector<FScope> Scopes;
+        uint32_t QueryCount{0};
+        bool bPending{false};
+    };
+
+    void ReadBack(FFrameSlot &Slot);
+    void Aggregate();
+    void RecordTrack(const FFrameSlot &Slot);
+
+    FRHI &RHI;
+    bool bSupported{false};
+    bool bEnabled{true};
+    double TimestampPeriod{1.0};
+    uint64_t TimestampMask{~0ull};
+    bool bCalibrated{false};
+    uint32_t ProfilerTrack{0};
+
+    FFrameSlot Slots[FrameLatency];
+    /* The slot being recorded, null outside BeginFrame and EndFrame. */
+    FFrameSlot *Current{nullptr};
+    uint32_t CurrentDepth{0};
+    bool bOverflowReported{false};
+
+    std::vector<uint64_t> Timestamps;
+    std::vector<FGpuScopeTiming> LastFrame;
+    std::vector<FGpuScopeStats> Statistics;
+    tsl::robin_map<std::string, uint32_t> StatisticLookup;
+    std::vector<double> FrameTotals;
+};
+
+/* Opens a scope for the lifetime of the object. */
+class FGpuScope {
+public:
+    FGpuScope(FGpuProfiler &Profiler, VkCommandBuffer CommandBuffer, const char *Name)
+        : Profiler(Profiler), CommandBuffer(CommandBuffer),
+          Scope(Profiler.BeginScope(CommandBuffer, Name)) {}
+    ~FGpuScope() { Profiler.EndScope(CommandBuffer, Scope); }
+
+    FGpuScope(const FGpuScope &) = delete;
+    FGpuScope &operator=(const FGpuScope &) = delete;
+
+private:
+    FGpuProfiler &Profiler;
+    VkCommandBuffer CommandBuffer;
+    uint32_t Scope;
+};
+}
@@ -2,14 +2,22 @@
 
 #include "Core/Logging.h"
 
-// #include <vk_mem_alloc.h>
 #include "RHI/VulkanLoader.h"
 
+// The device is created for Vulkan 1.1, keep VMA from touching 1.2 entry points.
+#define VMA_VULKAN_VERSION 1001000
+#include <vk_mem_alloc.h>
+
+#include <functional>
+#include <memory>
+#include <span>
+
 #define vk_check(expr)                        \
     do {                                      \
         VkResult res = (expr);                \
         if(res != VK_SUCCESS) {               \
             RE_LOGE("Vulkan error: {}", res); \
+            ::RE::FLogging::Flush();          \
             __debugbreak();                   \
         }                                     \
     } while(false)
@@ -20,6 +28,67 @@ constexpr static const int RE_VK_REQUIRED_VERSION_MINOR = 1;
 extern PFN_vkAllocateCommandBuffers vkAllocateCommandBuffers;
 
 namespace RE {
+class FGpuProfiler;
+
+/* Optional device features, enabled at device creation when supported. */
+struct FRHICapabilities {
+    bool bMultiDrawIndirect{false};
+    bool bDrawIndirectFirstInstance{false};
+    bool bDrawIndirectCount{false};
+    bool bMeshShader{false};
+    uint32_t MaxMeshOutputVertices{0};
+    uint32_t MaxMeshOutputPrimitives{0};
+    /* A compute only queue family separate from the graphics one. */
+    bool bAsyncCompute{false};
+    /* Subgroup size and the ballot and arithmetic operations in compute shaders. */
+    uint32_t SubgroupSize{1};
+    bool bSubgroupBallot{false};
+    bool bSubgroupArithmetic{false};
+    /* Memory for transient attachments that tiled GPUs never back with storage. */
+    bool bLazilyAllocatedMemory{false};
+    /* The device clock can be sampled from the host, placing GPU work on the CPU clock. */
+    bool bCalibratedTimestamps{false};
+};
+
+/* Commands recorded and descriptor sets allocated, see FRHI::SetStatisticsEnabled. */
+struct FRHIStatistics {
+    uint32_t Draws{0};
+    uint32_t Dispatches{0};
+    uint32_t PipelineBinds{0};
+    uint32_t DescriptorSetAllocations{0};
+};
+
+struct FBuffer {
+    VkBuffer Buffer{VK_NULL_HANDLE};
+    VmaAllocation Allocation{VK_NULL_HANDLE};
+    VkDeviceSize Size{0};
+    /* Persistently mapped pointer for host visible buffers, null otherwise. */
+    void *MappedData{nullptr};
+
+    bool IsValid() const { return Buffer != VK_NULL_HANDLE; }
+};
+
+struct FImage {
+    VkImage Image{VK_NULL_HANDLE};
+    VmaAllocation Allocation{VK_NULL_HANDLE};
+    VkFormat Format{VK_FORMAT_UNDEFINED};
+    VkExtent3D Extent{0, 0, 0};
+    uint32_t MipLevels{0};
+    uint32_t ArrayLayers{0};
+
+    bool IsValid() const { return Image != VK_NULL_HANDLE; }
+};
+
+/*
+ * A VMA pool of its own for one kind of resource, e.g. the physical pages of a virtual
+ * texture, so it can be budgeted and measured apart from the default blocks.
+ */
+struct FMemoryPool {
+    VmaPool Pool{VK_NULL_HANDLE};
+
+    bool IsValid() const { return Pool != VK_NULL_HANDLE; }
+};
+
 class RE_RHI_EXPORT FRHI {
     friend class FRenderer;
 
@@ -33,6 +102,61 @@ public:
     VkSurfaceKHR GetSurface() const { return DeviceInfo.Surface; }
     uint32_t GetGraphicsQueueIndex() const { return DeviceInfo.GraphicsQueueIndex; }
     VkInstance GetInstance() const { return DeviceInfo.Instance; }
+    VkQueue GetGraphicsQueue() const { return DeviceInfo.GraphicsQueue; }
+    /* The async compute queue, or the graphics queue when the device has none. */
+    uint32_t GetComputeQueueIndex() const { return DeviceInfo.ComputeQueueIndex; }
+    VkQueue GetComputeQueue() const { return DeviceInfo.ComputeQueue; }
+    VmaAllocator GetAllocator() const { return DeviceInfo.Allocator; }
+    const FRHICapabilities &GetCapabilities() const { return Capabilities; }
+    const VkPhysicalDeviceProperties &GetPhysicalDeviceProperties() const {
+        return DeviceInfo.PhysicalDeviceProperties;
+    }
+    /* Timestamp scopes around passes, see FGpuProfiler. */
+    FGpuProfiler &GetGpuProfiler() { return *GpuProfiler; }
+
+    /*
+     * Counts draws, dispatches, pipeline binds and descriptor set allocations of every
+     * module by routing the loaded entry points through counting ones, so it costs nothing
+     * while disabled. Only toggle it while no thread records commands.
+     */
+    void SetStatisticsEnabled(bool bEnabled);
+    bool IsStatisticsEnabled() const { return bStatisticsEnabled; }
+    /* The counts since the last call, e.g. once per frame. */
+    FRHIStatistics ConsumeStatistics();
+
+    FBuffer CreateBuffer(
+        VkDeviceSize Size, VkBufferUsageFlags Usage, VmaMemoryUsage MemoryUsage);
+    void DestroyBuffer(FBuffer &Buffer);
+    /* Copies Data into a device local buffer through a staging buffer and waits for it. */
+    void UploadBuffer(const FBuffer &Buffer, const void *Data, VkDeviceSize Size);
+
+    FImage CreateImage(const VkImageCreateInfo &CreateInfo, VmaMemoryUsage MemoryUsage);
+    FImage CreateImage(const VkImageCreateInfo &CreateInfo, const FMemoryPool &Pool);
+    void DestroyImage(FImage &Image);
+
+    /*
+     * A pool for images created like CreateInfo. A BlockSize of 0 fits each block to one
+     * such image, a MaxBlockCount of 0 lets the pool grow without limit.
+     */
+    FMemoryPool CreateImagePool(
+        const VkImageCreateInfo &CreateInfo, VmaMemoryUsage MemoryUsage,
+        VkDeviceSize BlockSize = 0, size_t MaxBlockCount = 0);
+    /* Every image allocated from the pool must have been destroyed. */
+    void DestroyMemoryPool(FMemoryPool &Pool);
+    /* Device memory held by the pool and the part of it in use, in bytes. */
+    void GetMemoryPoolUsage(
+        const FMemoryPool &Pool, VkDeviceSize &OutSize, VkDeviceSize &OutUsed) const;
+    /* A 2D view, or a 2D array view when LayerCount is above one. */
+    VkImageView CreateImageView(
+        const FImage &Image, VkImageAspectFlags Aspect, uint32_t BaseMip = 0,
+        uint32_t MipCount = VK_REMAINING_MIP_LEVELS, uint32_t BaseLayer = 0,
+        uint32_t LayerCount = 1);
+
+    /* Records and submits a one-off command buffer on the graphics queue, then waits. */
+    void ImmediateSubmit(const std::function<void(VkCommandBuffer)> &Record);
+
+    VkShaderModule CreateShaderModule(std::span<const uint32_t> Spirv);
+    VkPipeline CreateComputePipeline(VkShaderModule Module, VkPipelineLayout Layout);
 
 protected:
     void CreateInstance();
@@ -41,21 +165,31 @@ protected:
 
     void CreateSurface(void *nativeWindow);
 
+    void CreateAllocator();
+
     struct FDeviceInfo {
         VkInstance Instance{VK_NULL_HANDLE};
         VkPhysicalDevice PhysicalDevice{VK_NULL_HANDLE};
         VkDevice Device{VK_NULL_HANDLE};
         uint32_t GraphicsQueueIndex{0xFFFFFFFF};
+        uint32_t ComputeQueueIndex{0xFFFFFFFF};
 
         VkSurfaceKHR Surface{VK_NULL_HANDLE};
         VkQueue GraphicsQueue{VK_NULL_HANDLE};
+        VkQueue ComputeQueue{VK_NULL_HANDLE};
 
         VkPhysicalDeviceMemoryProperties MemoryProperties = {};
         VkPhysicalDeviceProperties PhysicalDeviceProperties = {};
         VkPhysicalDeviceFeatures PhysicalDeviceFeatures = {};
 
+        VmaAllocator Allocator{VK_NULL_HANDLE};
+        VkCommandPool ImmediateCommandPool{VK_NULL_HANDLE};
     } DeviceInfo{};
 
+    FRHICapabilities Capabilities{};
+    std::unique_ptr<FGpuProfiler> GpuProfiler;
+    bool bStatisticsEnabled{false};
+
     struct FDebugReportInfo {
         VkDebugUtilsMessengerEXT DebugMessenger{VK_NULL_HANDLE};
         VkDebugReportCallbackEXT DebugReportCallback{VK_NULL_HANDLE};
@@ -0,0 +1,112 @@
+﻿#pragma once
+#include "re-rhi_export.h"
+#include "RHI/VulkanLoader.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace RE {
+struct FAttachmentDesc {
+    std::string Name;
+    VkFormat Format{VK_FORMAT_UNDEFINED};
+    VkSampleCountFlagBits Samples{VK_SAMPLE_COUNT_1_BIT};
+    /*
+     * How the first pass using it starts: CLEAR, LOAD for contents from outside or
+     * DONT_CARE when every pixel is overwritten.
+     */
+    VkAttachmentLoadOp LoadOp{VK_ATTACHMENT_LOAD_OP_CLEAR};
+    /* The contents are needed after the last pass, e.g. swapchain images or history. */
+    bool bKeep{false};
+    /* Layout before the first pass when loaded, and after the last pass when kept. */
+    VkImageLayout InitialLayout{VK_IMAGE_LAYOUT_UNDEFINED};
+    VkImageLayout FinalLayout{VK_IMAGE_LAYOUT_UNDEFINED};
+};
+
+struct FPassDesc {
+    std::string Name;
+    std::vector<uint32_t> Colors;
+    /* Depth stencil attachment, or -1 for none. */
+    int32_t Depth{-1};
+    bool bDepthReadOnly{false};
+    /* Attachments read at the same pixel, e.g. a G-buffer by a lighting pass. */
+    std::vector<uint32_t> Inputs;
+    /* Attachments read at other pixels through a sampler, these leave tile memory. */
+    std::vector<uint32_t> Sampled;
+    /* Starts a new render pass, e.g. when compute work runs in between. */
+    bool bSeparate{false};
+};
+
+/* One render pass of the plan, its subpasses being consecutive passes of the builder. */
+struct FMergedRenderPass {
+    VkRenderPass RenderPass{VK_NULL_HANDLE};
+    uint32_t FirstPass{0};
+    uint32_t PassCount{0};
+    /* Builder attachment indices in framebuffer order. */
+    std::vector<uint32_t> Attachments;
+    std::vector<VkAttachmentDescription> Descriptions;
+    std::vector<VkSubpassDependency> Dependencies;
+
+    struct FSubpass {
+        std::vector<VkAttachmentReference> Colors;
+        std::vector<VkAttachmentReference> Inputs;
+        VkAttachmentReference Depth{VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED};
+        std::vector<uint32_t> Preserve;
+    };
+    std::vector<FSubpass> Subpasses;
+};
+
+/* Attachment traffic to and from external memory for one frame, in bytes. */
+struct FRenderPassBandwidth {
+    uint64_t LoadBytes{0};
+    uint64_t StoreBytes{0};
+    /* The same passes as render passes of their own that load and store everything. */
+    uint64_t UnmergedBytes{0};
+    /* Attachments that never need memory on devices with lazily allocated memory. */
+    uint64_t TransientBytes{0};
+};
+
+/*
+ * Plans render passes for tiled GPUs, where every load and store of an attachment is a
+ * trip to external memory. Passes are declared in execution order with the attachments
+ * they write and read; consecutive passes are merged into subpasses of one render pass
+ * unless one samples what another wrote, and reads at the same pixel become input
+ * attachments that never leave tile memory.
+ *
+ * Load and store ops follow from the uses: an attachment is only loaded when an earlier
+ * render pass left contents in it and only stored when a later one or the caller needs
+ * them. Attachments living within a single render pass are transient, and should be
+ * created with GetAttachmentUsage and VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED where the
+ * device has such memory.
+ */
+class RE_RHI_EXPORT FRenderPassBuilder {
+public:
+    uint32_t AddAttachment(const FAttachmentDesc &Desc);
+    uint32_t AddPass(const FPassDesc &Desc);
+
+    /* Merges the passes and picks the ops, the plan is replaced on every call. */
+    void Compile();
+    const std::vector<FMergedRenderPass> &GetRenderPasses() const { return RenderPasses; }
+    /* Render pass and subpass index of a pass after Compile. */
+    uint32_t GetRenderPassIndex(uint32_t Pass) const { return PassRenderPass[Pass]; }
+    uint32_t GetSubpassIndex(uint32_t Pass) const;
+
+    /* Creates the planned render passes, DestroyRenderPasses releases them. */
+    void CreateRenderPasses(VkDevice Device);
+    void DestroyRenderPasses(VkDevice Device);
+
+    bool IsTransient(uint32_t Attachment) const { return Transient[Attachment]; }
+    /* Image usage the attachment needs, with TRANSIENT_ATTACHMENT when it is transient. */
+    VkImageUsageFlags GetAttachmentUsage(uint32_t Attachment) const;
+
+    FRenderPassBandwidth EstimateBandwidth(VkExtent2D Extent) const;
+
+private:
+    std::vector<FAttachmentDesc> AttachmentDescs;
+    std::vector<FPassDesc> PassDescs;
+
+    std::vector<FMergedRenderPass> RenderPasses;
+    std::vector<uint32_t> PassRenderPass;
+    std::vector<bool> Transient;
+};
+}
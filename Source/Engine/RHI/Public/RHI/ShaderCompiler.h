@@ -0,0 +1,30 @@
+#pragma once
+#include "re-rhi_export.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace RE {
+enum class EShaderStage : uint8_t { Vertex, Fragment, Compute, Task, Mesh };
+
+/*
+ * Runtime GLSL to SPIR-V compilation through glslang. Sources and includes are read
+ * from the virtual file system; quoted includes resolve relative to the including file
+ * first and then to the file system root.
+ */
+class RE_RHI_EXPORT FShaderCompiler {
+public:
+    static FShaderCompiler &Get();
+
+    bool Compile(
+        std::string_view Path, EShaderStage Stage, std::span<const std::string> Defines,
+        std::vector<uint32_t> &OutSpirv);
+
+private:
+    FShaderCompiler();
+    ~FShaderCompiler();
+};
+}
@@ -0,0 +1,378 @@
+﻿#include "Render/CascadedShadows.h"
+#include "Core/Logging.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace RE {
+namespace {
+constexpr VkFormat ShadowFormat = VK_FORMAT_D32_SFLOAT;
+
+// Light turns smaller than this keep the cached cascades, about 0.8 degrees.
+constexpr float LightDirectionTolerance = 0.9999f;
+
+VkRenderPass CreateDepthRenderPass(
+    VkDevice Device, VkAttachmentLoadOp LoadOp, VkImageLayout InitialLayout,
+    VkImageLayout FinalLayout, VkPipelineStageFlags DstStage, VkAccessFlags DstAccess) {
+    VkAttachmentDescription Attachment{};
+    Attachment.format = ShadowFormat;
+    Attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    Attachment.loadOp = LoadOp;
+    Attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    Attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    Attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    Attachment.initialLayout = InitialLayout;
+    Attachment.finalLayout = FinalLayout;
+
+    const VkAttachmentReference DepthRef{
+        0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+    VkSubpassDescription Subpass{};
+    Subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    Subpass.pDepthStencilAttachment = &DepthRef;
+
+    // Waits for last frame's sampling and for copies into or out of the layer.
+    VkSubpassDependency Dependencies[2]{};
+    Dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    Dependencies[0].dstSubpass = 0;
+    Dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                   VK_PIPELINE_STAGE_TRANSFER_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    Dependencies[0].srcAccessMask =
+        VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    Dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    Dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    Dependencies[1].srcSubpass = 0;
+    Dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    Dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    Dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    Dependencies[1].dstStageMask = DstStage;
+    Dependencies[1].dstAccessMask = DstAccess;
+
+    VkRenderPassCreateInfo CreateInfo{VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
+    CreateInfo.attachmentCount = 1;
+    CreateInfo.pAttachments = &Attachment;
+    CreateInfo.subpassCount = 1;
+    CreateInfo.pSubpasses = &Subpass;
+    CreateInfo.dependencyCount = 2;
+    CreateInfo.pDependencies = Dependencies;
+
+    VkRenderPass RenderPass{VK_NULL_HANDLE};
+    vk_check(vkCreateRenderPass(Device, &CreateInfo, nullptr, &RenderPass));
+    return RenderPass;
+}
+
+VkFramebuffer CreateLayerFramebuffer(
+    VkDevice Device, VkRenderPass RenderPass, VkImageView View, uint32_t Resolution) {
+    VkFramebufferCreateInfo CreateInfo{VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
+    CreateInfo.renderPass = RenderPass;
+    CreateInfo.attachmentCount = 1;
+    CreateInfo.pAttachments = &View;
+    CreateInfo.width = Resolution;
+    CreateInfo.height = Resolution;
+    CreateInfo.layers = 1;
+
+    VkFramebuffer Framebuffer{VK_NULL_HANDLE};
+    vk_check(vkCreateFramebuffer(Device, &CreateInfo, nullptr, &Framebuffer));
+    return Framebuffer;
+}
+
+VkImageMemoryBarrier MakeLayerBarrier(
+    VkImage Image, uint32_t Layer, VkImageLayout OldLayout, VkImageLayout NewLayout,
+    VkAccessFlags SrcAccess, VkAccessFlags DstAccess) {
+    VkImageMemoryBarrier Barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    Barrier.srcAccessMask = SrcAccess;
+    Barrier.dstAccessMask = DstAccess;
+    Barrier.oldLayout = OldLayout;
+    Barrier.newLayout = NewLayout;
+    Barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    Barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    Barrier.image = Image;
+    Barrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, Layer, 1};
+    return Barrier;
+}
+}
+
+FCascadedShadows::FCascadedShadows(FRHI &RHI, const FCascadedShadowSettings &InSettings)
+    : RHI(RHI), Settings(InSettings) {
+    Settings.CascadeCount =
+        std::clamp(Settings.CascadeCount, 1u, FCascadedShadowSettings::MaxCascades);
+    Settings.FirstCachedCascade =
+        std::min(Settings.FirstCachedCascade, Settings.CascadeCount);
+    const uint32_t CachedCount = Settings.CascadeCount - Settings.FirstCachedCascade;
+    VkDevice Device = RHI.GetDevice();
+
+    ClearRenderPass = CreateDepthRenderPass(
+        Device, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT);
+    LoadRenderPass = CreateDepthRenderPass(
+        Device, VK_ATTACHMENT_LOAD_OP_LOAD,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT);
+    CacheRenderPass = CreateDepthRenderPass(
+        Device, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_TRANSFER_READ_BIT);
+
+    VkImageCreateInfo ImageCreateInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    ImageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    ImageCreateInfo.format = ShadowFormat;
+    ImageCreateInfo.extent = {Settings.Resolution, Settings.Resolution, 1};
+    ImageCreateInfo.mipLevels = 1;
+    ImageCreateInfo.arrayLayers = Settings.CascadeCount;
+    ImageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    ImageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    ImageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    ImageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    ShadowImage = RHI.CreateImage(ImageCreateInfo, VMA_MEMORY_USAGE_GPU_ONLY);
+
+    // Always an array view, CreateImageView makes a plain 2D view of a single layer.
+    VkImageViewCreateInfo ViewCreateInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+    ViewCreateInfo.image = ShadowImage.Image;
+    ViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    ViewCreateInfo.format = ShadowFormat;
+    ViewCreateInfo.subresourceRange = {
+        VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, Settings.CascadeCount};
+    vk_check(vkCreateImageView(Device, &ViewCreateInfo, nullptr, &ShadowView));
+
+    for(uint32_t Cascade = 0; Cascade < Settings.CascadeCount; Cascade++) {
+        VkImageView View =
+            RHI.CreateImageView(ShadowImage, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, Cascade, 1);
+        LayerViews.push_back(View);
+        // The clear and load passes are compatible, either may use these.
+        Framebuffers.push_back(
+            CreateLayerFramebuffer(Device, ClearRenderPass, View, Settings.Resolution));
+    }
+
+    if(CachedCount > 0) {
+        ImageCreateInfo.arrayLayers = CachedCount;
+        ImageCreateInfo.usage =
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        CacheImage = RHI.CreateImage(ImageCreateInfo, VMA_MEMORY_USAGE_GPU_ONLY);
+        for(uint32_t Layer = 0; Layer < CachedCount; Layer++) {
+            VkImageView View =
+                RHI.CreateImageView(CacheImage, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, Layer, 1);
+            CacheLayerViews.push_back(View);
+            CacheFramebuffers.push_back(CreateLayerFramebuffer(
+                Device, CacheRenderPass, View, Settings.Resolution));
+        }
+    }
+
+    VkSamplerCreateInfo SamplerCreateInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    SamplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+    SamplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    SamplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    SamplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    SamplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    SamplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    SamplerCreateInfo.compareEnable = VK_TRUE;
+    SamplerCreateInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    vk_check(vkCreateSampler(Device, &SamplerCreateInfo, nullptr, &Sampler));
+}
+
+FCascadedShadows::~FCascadedShadows() {
+    VkDevice Device = RHI.GetDevice();
+    vkDestroySampler(Device, Sampler, nullptr);
+    for(VkFramebuffer Framebuffer: CacheFramebuffers) {
+        vkDestroyFramebuffer(Device, Framebuffer, nullptr);
+    }
+    for(VkImageView View: CacheLayerViews) {
+        vkDestroyImageView(Device, View, nullptr);
+    }
+    for(VkFramebuffer Framebuffer: Framebuffers) {
+        vkDestroyFramebuffer(Device, Framebuffer, nullptr);
+    }
+    for(VkImageView View: LayerViews) {
+        vkDestroyImageView(Device, View, nullptr);
+    }
+    vkDestroyImageView(Device, ShadowView, nullptr);
+    RHI.DestroyImage(CacheImage);
+    RHI.DestroyImage(ShadowImage);
+    vkDestroyRenderPass(Device, CacheRenderPass, nullptr);
+    vkDestroyRenderPass(Device, LoadRenderPass, nullptr);
+    vkDestroyRenderPass(Device, ClearRenderPass, nullptr);
+}
+
+void FCascadedShadows::Update(const FShadowView &View, const glm::vec3 &InLightDirection) {
+    const glm::vec3 Direction = glm::normalize(InLightDirection);
+    if(!bHasFrame || glm::dot(Direction, LightDirection) < LightDirectionTolerance) {
+        LightDirection = Direction;
+        const glm::vec3 Up = std::abs(Direction.z) > 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f)
+                                                           : glm::vec3(0.0f, 0.0f, 1.0f);
+        WorldToLight = glm::lookAtRH(glm::vec3(0.0f), Direction, Up);
+        InvalidateStaticCache();
+        bHasFrame = true;
+    }
+
+    // Practical split scheme, a blend of logarithmic and uniform splits.
+    const float Near = View.NearPlane;
+    const float Far = std::max(Settings.ShadowDistance, Near * 2.0f);
+    const float Count = static_cast<float>(Settings.CascadeCount);
+    float SliceNear = Near;
+    for(uint32_t Cascade = 0; Cascade < Settings.CascadeCount; Cascade++) {
+        const float t = static_cast<float>(Cascade + 1) / Count;
+        const float Logarithmic = Near * std::pow(Far / Near, t);
+        const float Uniform = Near + (Far - Near) * t;
+        const float SliceFar =
+            Settings.SplitLambda * Logarithmic + (1.0f - Settings.SplitLambda) * Uniform;
+        FitCascade(Cascade, View, SliceNear, SliceFar);
+        SliceNear = SliceFar;
+    }
+}
+
+void FCascadedShadows::FitCascade(
+    uint32_t Cascade, const FShadowView &View, float SliceNear, float SliceFar) {
+    // The smallest sphere around the slice, which does not change as the view turns.
+    // With k the tangent of the corner ray, its center sits on the view axis at c and
+    // reaches the far corners, or just the far plane for wide slices.
+    const float TanX = View.TanHalfFovY * View.AspectRatio;
+    const float KSquared = TanX * TanX + View.TanHalfFovY * View.TanHalfFovY;
+    const float CenterDepth =
+        std::min(0.5f * (SliceNear + SliceFar) * (1.0f + KSquared), SliceFar);
+    const float SliceRadius = std::sqrt(
+        (SliceFar - CenterDepth) * (SliceFar - CenterDepth) +
+        SliceFar * SliceFar * KSquared);
+    const glm::vec3 WorldCenter =
+        View.ViewToWorld * glm::vec4(0.0f, 0.0f, -CenterDepth, 1.0f);
+    const glm::vec3 LightCenter = WorldToLight * glm::vec4(WorldCenter, 1.0f);
+
+    // Rounding keeps float noise in the radius from changing the texel size.
+    const bool bCached = IsCached(Cascade);
+    const float Margin = bCached ? 1.0f + Settings.CacheMargin : 1.0f;
+    const float Radius = std::ceil(SliceRadius * Margin * 16.0f) / 16.0f;
+    const float TexelSize = 2.0f * Radius / static_cast<float>(Settings.Resolution);
+
+    // A cached cascade stays put while it still contains the slice.
+    const bool bContained = Radii[Cascade] == Radius &&
+                            glm::distance(LightCenter, Centers[Cascade]) + SliceRadius <=
+                                Radius;
+    if(!bCached || !bContained || bStaticDirty[Cascade]) {
+        // Whole texel steps in x and y keep the texels from crawling as the view moves.
+        glm::vec3 Center = LightCenter;
+        Center.x = std::floor(Center.x / TexelSize) * TexelSize;
+        Center.y = std::floor(Center.y / TexelSize) * TexelSize;
+        if(bCached && (Center != Centers[Cascade] || Radii[Cascade] != Radius)) {
+            bStaticDirty[Cascade] = true;
+        }
+        Centers[Cascade] = Center;
+        Radii[Cascade] = Radius;
+    }
+
+    // The light looks down -z, near and far are distances along it. Casters up to
+    // CasterDistance in front of the sphere still land in the map.
+    const glm::vec3 &Center = Centers[Cascade];
+    const glm::mat4 LightToClip = glm::orthoRH_ZO(
+        Center.x - Radius, Center.x + Radius, Center.y - Radius, Center.y + Radius,
+        -Center.z - Radius - Settings.CasterDistance, -Center.z + Radius);
+
+    FShadowCascade &Result = Cascades[Cascade];
+    Result.WorldToClip = LightToClip * WorldToLight;
+    Result.SplitDepth = SliceFar;
+    Result.TexelSize = TexelSize;
+    Result.CullFrustum = FFrustum::FromMatrix(Result.WorldToClip);
+}
+
+void FCascadedShadows::InvalidateStaticCache() {
+    for(uint32_t Cascade = Settings.FirstCachedCascade; Cascade < Settings.CascadeCount;
+        Cascade++) {
+        bStaticDirty[Cascade] = true;
+    }
+}
+
+bool FCascadedShadows::NeedsStaticPass(uint32_t Cascade) const {
+    return IsCached(Cascade) && bStaticDirty[Cascade];
+}
+
+void FCascadedShadows::BeginStaticPass(VkCommandBuffer CommandBuffer, uint32_t Cascade) {
+    checkf(IsCached(Cascade), "Cascade {} has no static cache.", Cascade);
+    bStaticDirty[Cascade] = false;
+    BeginPass(
+        CommandBuffer, CacheRenderPass,
+        CacheFramebuffers[Cascade - Settings.FirstCachedCascade], true);
+}
+
+void FCascadedShadows::BeginDynamicPass(VkCommandBuffer CommandBuffer, uint32_t Cascade) {
+    if(!IsCached(Cascade)) {
+        BeginPass(CommandBuffer, ClearRenderPass, Framebuffers[Cascade], true);
+        return;
+    }
+    if(bStaticDirty[Cascade]) {
+        RE_LOGW("Shadow cascade {} is drawn before its static pass.", Cascade);
+    }
+
+    // Start from the static casters, the previous contents of the layer are discarded.
+    VkImageMemoryBarrier Barrier = MakeLayerBarrier(
+        ShadowImage.Image, Cascade, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
+
+    VkImageCopy Region{};
+    Region.srcSubresource = {
+        VK_IMAGE_ASPECT_DEPTH_BIT, 0, Cascade - Settings.FirstCachedCascade, 1};
+    Region.dstSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, Cascade, 1};
+    Region.extent = {Settings.Resolution, Settings.Resolution, 1};
+    vkCmdCopyImage(
+        CommandBuffer, CacheImage.Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        ShadowImage.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &Region);
+
+    Barrier = MakeLayerBarrier(
+        ShadowImage.Image, Cascade, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1,
+        &Barrier);
+
+    BeginPass(CommandBuffer, LoadRenderPass, Framebuffers[Cascade], false);
+}
+
+void FCascadedShadows::BeginPass(
+    VkCommandBuffer CommandBuffer, VkRenderPass RenderPass, VkFramebuffer Framebuffer,
+    bool bClear) {
+    const VkClearValue ClearValue{.depthStencil = {1.0f, 0}};
+    VkRenderPassBeginInfo BeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+    BeginInfo.renderPass = RenderPass;
+    BeginInfo.framebuffer = Framebuffer;
+    BeginInfo.renderArea = {{0, 0}, {Settings.Resolution, Settings.Resolution}};
+    BeginInfo.clearValueCount = bClear ? 1 : 0;
+    BeginInfo.pClearValues = bClear ? &ClearValue : nullptr;
+    vkCmdBeginRenderPass(CommandBuffer, &BeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    const float Size = static_cast<float>(Settings.Resolution);
+    const VkViewport Viewport{0.0f, 0.0f, Size, Size, 0.0f, 1.0f};
+    vkCmdSetViewport(CommandBuffer, 0, 1, &Viewport);
+    vkCmdSetScissor(CommandBuffer, 0, 1, &BeginInfo.renderArea);
+}
+
+void FCascadedShadows::EndPass(VkCommandBuffer CommandBuffer) {
+    vkCmdEndRenderPass(CommandBuffer);
+}
+
+FShadowShaderParams FCascadedShadows::GetShaderParams() const {
+    // Takes clip space x and y to texture coordinates, depth stays as it is.
+    const glm::mat4 ClipToTexture =
+        glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, 0.5f, 0.0f)) *
+        glm::scale(glm::mat4(1.0f), glm::vec3(0.5f, 0.5f, 1.0f));
+
+    FShadowShaderParams Params{};
+    for(uint32_t Cascade = 0; Cascade < Settings.CascadeCount; Cascade++) {
+        Params.WorldToShadow[Cascade] = ClipToTexture * Cascades[Cascade].WorldToClip;
+        Params.SplitDepths[Cascade] = Cascades[Cascade].SplitDepth;
+        Params.TexelSizes[Cascade] = Cascades[Cascade].TexelSize;
+    }
+    Params.LightDirection =
+        glm::vec4(LightDirection, static_cast<float>(Settings.CascadeCount));
+    return Params;
+}
+}
@@ -0,0 +1,638 @@
+﻿#include "Render/ClusterCulling.h"
+#include "Render/VertexInput.h"
+#include "Core/Logging.h"
+
+#include <cstring>
+#include <iterator>
+
+namespace RE {
+namespace {
+// Mirrors FCullView in Shaders/Include/ClusterCommon.glsl, std140.
+struct FGpuCullView {
+    glm::mat4 WorldToClip;
+    glm::mat4 WorldToView;
+    glm::vec4 FrustumPlanes[6];
+    glm::vec4 CameraPosition;
+    glm::vec4 Projection;
+    glm::vec4 PyramidParams;
+    uint32_t ClusterCount;
+    uint32_t Flags;
+    uint32_t Padding[2];
+};
+
+// Mirrors FVertexFetch in Shaders/Cluster.mesh.
+struct FVertexFetch {
+    uint32_t Stride;
+    uint32_t PositionOffset;
+    uint32_t NormalOffset;
+    uint32_t TexCoordOffset;
+};
+
+struct FDrawIndexedIndirectCommand {
+    uint32_t IndexCount;
+    uint32_t InstanceCount;
+    uint32_t FirstIndex;
+    int32_t VertexOffset;
+    uint32_t FirstInstance;
+};
+static_assert(sizeof(FDrawIndexedIndirectCommand) == sizeof(VkDrawIndexedIndirectCommand));
+
+constexpr uint32_t CullGroupSize = 64;
+constexpr uint32_t TaskGroupSize = 32;
+
+enum EClusterBinding : uint32_t {
+    Binding_View,
+    Binding_Clusters,
+    Binding_Instances,
+    Binding_DrawCommands,
+    Binding_DrawCount,
+    Binding_Meshlets,
+    Binding_MeshletVertices,
+    Binding_MeshletTriangles,
+    Binding_Vertices,
+    Binding_DepthPyramid,
+    Binding_Count
+};
+
+bool IsSameLayout(const FVertexLayout &A, const FVertexLayout &B) {
+    if(A.Stride != B.Stride) { return false; }
+    for(size_t i = 0; i < A.Attributes.size(); i++) {
+        if(A.Attributes[i].Format != B.Attributes[i].Format ||
+           A.Attributes[i].Offset != B.Attributes[i].Offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Gribb and Hartmann, planes point inwards and are normalized for sphere tests.
+void ExtractFrustumPlanes(const glm::mat4 &WorldToClip, glm::vec4 OutPlanes[6]) {
+    const glm::mat4 Rows = glm::transpose(WorldToClip);
+    OutPlanes[0] = Rows[3] + Rows[0];
+    OutPlanes[1] = Rows[3] - Rows[0];
+    OutPlanes[2] = Rows[3] + Rows[1];
+    OutPlanes[3] = Rows[3] - Rows[1];
+    // Vulkan clip space depth starts at 0.
+    OutPlanes[4] = Rows[2];
+    OutPlanes[5] = Rows[3] - Rows[2];
+    for(int i = 0; i < 6; i++) {
+        OutPlanes[i] /= glm::length(glm::vec3(OutPlanes[i]));
+    }
+}
+}
+
+FClusterCuller::FClusterCuller(FRHI &RHI): RHI(RHI) {
+    const FRHICapabilities &Capabilities = RHI.GetCapabilities();
+    bMeshShaders = Capabilities.bMeshShader &&
+                   Capabilities.MaxMeshOutputVertices >= MeshletMaxVertices &&
+                   Capabilities.MaxMeshOutputPrimitives >= MeshletMaxTriangles;
+    if(!bMeshShaders && !Capabilities.bDrawIndirectFirstInstance) {
+        RE_LOGW("drawIndirectFirstInstance is unsupported, instances will draw wrong.");
+    }
+}
+
+FClusterCuller::~FClusterCuller() {
+    DestroyPipelines();
+    VkDevice Device = RHI.GetDevice();
+    if(PipelineLayout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
+    }
+    if(DescriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+    }
+    if(DescriptorSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(Device, DescriptorSetLayout, nullptr);
+    }
+    for(FBuffer *Buffer:
+        {&ViewBuffer, &ClusterBuffer, &InstanceBuffer, &DrawCommandBuffer,
+         &DrawCountBuffer, &MeshletBuffer, &MeshletVertexBuffer, &MeshletTriangleBuffer,
+         &VertexBuffer, &IndexBuffer}) {
+        RHI.DestroyBuffer(*Buffer);
+    }
+}
+
+uint32_t FClusterCuller::AddMesh(const FMeshData &Mesh) {
+    if(bBuilt) {
+        RE_LOGE("Cannot add mesh {} after the cluster culler was built.", Mesh.Name);
+        return InvalidId;
+    }
+    if(Mesh.Meshlets.IsEmpty()) {
+        RE_LOGE("Mesh {} has no meshlets, import it with bBuildMeshlets.", Mesh.Name);
+        return InvalidId;
+    }
+
+    FEncodedVertexData Encoded;
+    FVertexEncoder::Encode(Mesh, FVertexFormatOptions{}, Encoded);
+    if(Meshes.empty()) {
+        VertexLayout = Encoded.Layout;
+    } else if(!IsSameLayout(VertexLayout, Encoded.Layout)) {
+        RE_LOGE("Mesh {} does not match the vertex layout of the first mesh.", Mesh.Name);
+        return InvalidId;
+    }
+
+    FMeshRange Range;
+    Range.Quantization = Encoded.Quantization;
+    Range.BaseVertex = VertexCount;
+    Range.FirstMeshlet = static_cast<uint32_t>(Meshlets.size());
+    Range.MeshletCount = static_cast<uint32_t>(Mesh.Meshlets.Meshlets.size());
+
+    Vertices.insert(Vertices.end(), Encoded.Vertices.begin(), Encoded.Vertices.end());
+    VertexCount += Encoded.VertexCount;
+
+    const auto VertexBase = static_cast<uint32_t>(MeshletVertices.size());
+    const auto TriangleBase = static_cast<uint32_t>(MeshletTriangles.size());
+    for(const FMeshlet &Source: Mesh.Meshlets.Meshlets) {
+        FMeshlet Meshlet = Source;
+        Meshlet.VertexOffset += VertexBase;
+        Meshlet.TriangleOffset += TriangleBase;
+        Meshlets.push_back(Meshlet);
+
+        // The indirect path draws the same triangles from a mesh relative index list.
+        const auto FirstIndex = static_cast<uint32_t>(Indices.size());
+        for(uint32_t i = 0; i < Source.TriangleCount * 3; i++) {
+            const uint8_t Local = Mesh.Meshlets.Triangles[Source.TriangleOffset + i];
+            Indices.push_back(Mesh.Meshlets.Vertices[Source.VertexOffset + Local]);
+        }
+        MeshletIndexRanges.emplace_back(FirstIndex, Source.TriangleCount * 3);
+    }
+    MeshletBounds.insert(
+        MeshletBounds.end(), Mesh.Meshlets.Bounds.begin(), Mesh.Meshlets.Bounds.end());
+    MeshletVertices.insert(
+        MeshletVertices.end(), Mesh.Meshlets.Vertices.begin(),
+        Mesh.Meshlets.Vertices.end());
+    MeshletTriangles.insert(
+        MeshletTriangles.end(), Mesh.Meshlets.Triangles.begin(),
+        Mesh.Meshlets.Triangles.end());
+
+    Meshes.push_back(Range);
+    return static_cast<uint32_t>(Meshes.size() - 1);
+}
+
+uint32_t FClusterCuller::AddInstance(uint32_t MeshId, const glm::mat4 &LocalToWorld) {
+    if(bBuilt || MeshId >= Meshes.size()) {
+        RE_LOGE("Cannot add an instance of mesh {} to the cluster culler.", MeshId);
+        return InvalidId;
+    }
+    const FMeshRange &Mesh = Meshes[MeshId];
+    const auto InstanceIndex = static_cast<uint32_t>(Instances.size());
+    Instances.push_back(
+        {LocalToWorld, Mesh.Quantization, glm::uvec4(Mesh.BaseVertex, 0, 0, 0)});
+
+    for(uint32_t i = 0; i < Mesh.MeshletCount; i++) {
+        const uint32_t MeshletIndex = Mesh.FirstMeshlet + i;
+        const FMeshletBounds &Bounds = MeshletBounds[MeshletIndex];
+
+        FGpuCluster Cluster{};
+        Cluster.BoundingSphere = glm::vec4(Bounds.Center, Bounds.Radius);
+        Cluster.ConeApexCutoff = glm::vec4(Bounds.ConeApex, Bounds.ConeCutoff);
+        Cluster.ConeAxis = glm::vec4(Bounds.ConeAxis, 0.0f);
+        Cluster.FirstIndex = MeshletIndexRanges[MeshletIndex].x;
+        Cluster.IndexCount = MeshletIndexRanges[MeshletIndex].y;
+        Cluster.MeshletIndex = MeshletIndex;
+        Cluster.InstanceIndex = InstanceIndex;
+        Clusters.push_back(Cluster);
+    }
+    return InstanceIndex;
+}
+
+bool FClusterCuller::Build(VkRenderPass InRenderPass, uint32_t InSubpass) {
+    if(bBuilt) { return true; }
+    if(Clusters.empty()) {
+        RE_LOGE("Cluster culler has no instances to draw.");
+        return false;
+    }
+    RenderPass = InRenderPass;
+    Subpass = InSubpass;
+
+    auto CreateAndUpload = [this](const void *Data, VkDeviceSize Size,
+                                  VkBufferUsageFlags Usage) {
+        FBuffer Buffer = RHI.CreateBuffer(
+            Size, Usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        RHI.UploadBuffer(Buffer, Data, Size);
+        return Buffer;
+    };
+    constexpr VkBufferUsageFlags Storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    // The mesh shader reads unaligned attributes one word past the last vertex.
+    Vertices.resize(Vertices.size() + sizeof(uint32_t));
+    ClusterBuffer = CreateAndUpload(
+        Clusters.data(), Clusters.size() * sizeof(FGpuCluster), Storage);
+    InstanceBuffer = CreateAndUpload(
+        Instances.data(), Instances.size() * sizeof(FGpuInstance), Storage);
+    VertexBuffer = CreateAndUpload(
+        Vertices.data(), Vertices.size(), Storage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    if(bMeshShaders) {
+        MeshletBuffer = CreateAndUpload(
+            Meshlets.data(), Meshlets.size() * sizeof(FMeshlet), Storage);
+        MeshletVertexBuffer = CreateAndUpload(
+            MeshletVertices.data(), MeshletVertices.size() * sizeof(uint32_t), Storage);
+        MeshletTriangleBuffer =
+            CreateAndUpload(MeshletTriangles.data(), MeshletTriangles.size(), Storage);
+    } else {
+        IndexBuffer = CreateAndUpload(
+            Indices.data(), Indices.size() * sizeof(uint32_t),
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+        DrawCommandBuffer = RHI.CreateBuffer(
+            Clusters.size() * sizeof(FDrawIndexedIndirectCommand),
+            Storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        DrawCountBuffer = RHI.CreateBuffer(
+            sizeof(uint32_t),
+            Storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY);
+    }
+
+    const VkDeviceSize Alignment =
+        RHI.GetPhysicalDeviceProperties().limits.minUniformBufferOffsetAlignment;
+    ViewStride = (sizeof(FGpuCullView) + Alignment - 1) / Alignment * Alignment;
+    ViewBuffer = RHI.CreateBuffer(
+        ViewStride * MaxFramesInFlight, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+    // The CPU copies are only needed to build the GPU buffers.
+    Vertices = {};
+    Indices = {};
+    MeshletVertices = {};
+    MeshletTriangles = {};
+
+    const VkShaderStageFlags DrawStages =
+        bMeshShaders ? VK_SHADER_STAGE_TASK_BIT_NV | VK_SHADER_STAGE_MESH_BIT_NV
+                     : VK_SHADER_STAGE_VERTEX_BIT;
+    const VkShaderStageFlags CullStages =
+        bMeshShaders ? VK_SHADER_STAGE_TASK_BIT_NV : VK_SHADER_STAGE_COMPUTE_BIT;
+
+    std::vector<VkDescriptorSetLayoutBinding> Bindings;
+    auto AddBinding = [&Bindings](uint32_t Binding, VkDescriptorType Type,
+                                  VkShaderStageFlags Stages) {
+        Bindings.push_back({Binding, Type, 1, Stages, nullptr});
+    };
+    AddBinding(
+        Binding_View, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, CullStages | DrawStages);
+    AddBinding(
+        Binding_Clusters, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, CullStages | DrawStages);
+    AddBinding(
+        Binding_Instances, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, CullStages | DrawStages);
+    AddBinding(
+        Binding_DepthPyramid, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, CullStages);
+    if(bMeshShaders) {
+        for(uint32_t Binding = Binding_Meshlets; Binding <= Binding_Vertices; Binding++) {
+            AddBinding(
+                Binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_MESH_BIT_NV);
+        }
+    } else {
+        AddBinding(
+            Binding_DrawCommands, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_COMPUTE_BIT);
+        AddBinding(
+            Binding_DrawCount, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_COMPUTE_BIT);
+    }
+
+    VkDescriptorSetLayoutCreateInfo LayoutCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    LayoutCreateInfo.bindingCount = static_cast<uint32_t>(Bindings.size());
+    LayoutCreateInfo.pBindings = Bindings.data();
+    vk_check(vkCreateDescriptorSetLayout(
+        RHI.GetDevice(), &LayoutCreateInfo, nullptr, &DescriptorSetLayout));
+
+    const VkDescriptorPoolSize PoolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, Binding_Count},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+    };
+    VkDescriptorPoolCreateInfo PoolCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    PoolCreateInfo.maxSets = 1;
+    PoolCreateInfo.poolSizeCount = static_cast<uint32_t>(std::size(PoolSizes));
+    PoolCreateInfo.pPoolSizes = PoolSizes;
+    vk_check(vkCreateDescriptorPool(
+        RHI.GetDevice(), &PoolCreateInfo, nullptr, &DescriptorPool));
+
+    VkDescriptorSetAllocateInfo AllocateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    AllocateInfo.descriptorPool = DescriptorPool;
+    AllocateInfo.descriptorSetCount = 1;
+    AllocateInfo.pSetLayouts = &DescriptorSetLayout;
+    vk_check(vkAllocateDescriptorSets(RHI.GetDevice(), &AllocateInfo, &DescriptorSet));
+    WriteDescriptors();
+
+    const VkPushConstantRange PushConstantRange{
+        VK_SHADER_STAGE_MESH_BIT_NV, 0, sizeof(FVertexFetch)};
+    VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo{
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    PipelineLayoutCreateInfo.setLayoutCount = 1;
+    PipelineLayoutCreateInfo.pSetLayouts = &DescriptorSetLayout;
+    PipelineLayoutCreateInfo.pushConstantRangeCount = bMeshShaders ? 1 : 0;
+    PipelineLayoutCreateInfo.pPushConstantRanges = &PushConstantRange;
+    vk_check(vkCreatePipelineLayout(
+        RHI.GetDevice(), &PipelineLayoutCreateInfo, nullptr, &PipelineLayout));
+
+    bBuilt = true;
+    RE_LOGI(
+        "Cluster culler: {} clusters of {} instances, {} path.", Clusters.size(),
+        Instances.size(), bMeshShaders ? "mesh shader" : "indirect draw");
+    return CreatePipelines();
+}
+
+bool FClusterCuller::SetOcclusionPyramid(
+    VkImageView PyramidView, VkSampler Sampler, VkExtent2D Size) {
+    if(!bBuilt) {
+        RE_LOGE("The cluster culler must be built before setting a depth pyramid.");
+        return false;
+    }
+    Pyramid.View = PyramidView;
+    Pyramid.Sampler = Sampler;
+    Pyramid.Size = Size;
+    WriteDescriptors();
+    DestroyPipelines();
+    return CreatePipelines();
+}
+
+void FClusterCuller::WriteDescriptors() {
+    std::vector<VkDescriptorBufferInfo> BufferInfos;
+    std::vector<VkWriteDescriptorSet> Writes;
+    BufferInfos.reserve(Binding_Count);
+
+    auto WriteBuffer = [&](uint32_t Binding, VkDescriptorType Type, const FBuffer &Buffer,
+                           VkDeviceSize Range) {
+        if(!Buffer.IsValid()) { return; }
+        BufferInfos.push_back({Buffer.Buffer, 0, Range});
+        VkWriteDescriptorSet Write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        Write.dstSet = DescriptorSet;
+        Write.dstBinding = Binding;
+        Write.descriptorCount = 1;
+        Write.descriptorType = Type;
+        Write.pBufferInfo = &BufferInfos.back();
+        Writes.push_back(Write);
+    };
+    WriteBuffer(
+        Binding_View, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, ViewBuffer,
+        sizeof(FGpuCullView));
+    const std::pair<EClusterBinding, const FBuffer *> StorageBuffers[] = {
+        {Binding_Clusters, &ClusterBuffer},
+        {Binding_Instances, &InstanceBuffer},
+        {Binding_DrawCommands, &DrawCommandBuffer},
+        {Binding_DrawCount, &DrawCountBuffer},
+        {Binding_Meshlets, &MeshletBuffer},
+        {Binding_MeshletVertices, &MeshletVertexBuffer},
+        {Binding_MeshletTriangles, &MeshletTriangleBuffer},
+        {Binding_Vertices, &VertexBuffer},
+    };
+    for(const auto &[Binding, Buffer]: StorageBuffers) {
+        // The indirect path reads vertices through the input assembler instead.
+        if(Binding == Binding_Vertices && !bMeshShaders) { continue; }
+        WriteBuffer(Binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, *Buffer, VK_WHOLE_SIZE);
+    }
+
+    VkDescriptorImageInfo ImageInfo{
+        Pyramid.Sampler, Pyramid.View, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    if(Pyramid.View != VK_NULL_HANDLE) {
+        VkWriteDescriptorSet Write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        Write.dstSet = DescriptorSet;
+        Write.dstBinding = Binding_DepthPyramid;
+        Write.descriptorCount = 1;
+        Write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        Write.pImageInfo = &ImageInfo;
+        Writes.push_back(Write);
+    }
+    vkUpdateDescriptorSets(
+        RHI.GetDevice(), static_cast<uint32_t>(Writes.size()), Writes.data(), 0, nullptr);
+}
+
+VkShaderModule FClusterCuller::CompileShader(
+    std::string_view Path, EShaderStage Stage, const std::vector<std::string> &Defines) {
+    std::vector<uint32_t> Spirv;
+    if(!FShaderCompiler::Get().Compile(Path, Stage, Defines, Spirv)) {
+        return VK_NULL_HANDLE;
+    }
+    return RHI.CreateShaderModule(Spirv);
+}
+
+bool FClusterCuller::CreatePipelines() {
+    std::vector<std::string> Defines = FVertexInput::GetShaderDefines(VertexLayout);
+    if(Pyramid.View != VK_NULL_HANDLE) { Defines.emplace_back("RE_CLUSTER_OCCLUSION"); }
+    if(RHI.GetCapabilities().bDrawIndirectCount) {
+        Defines.emplace_back("RE_CLUSTER_COMPACT");
+    }
+
+    std::vector<std::pair<VkShaderStageFlagBits, VkShaderModule>> Stages;
+    if(bMeshShaders) {
+        Stages.emplace_back(
+            VK_SHADER_STAGE_TASK_BIT_NV,
+            CompileShader("Cluster.task", EShaderStage::Task, Defines));
+        Stages.emplace_back(
+            VK_SHADER_STAGE_MESH_BIT_NV,
+            CompileShader("Cluster.mesh", EShaderStage::Mesh, Defines));
+    } else {
+        VkShaderModule CullModule =
+            CompileShader("ClusterCull.comp", EShaderStage::Compute, Defines);
+        if(CullModule == VK_NULL_HANDLE) { return false; }
+        CullPipeline = RHI.CreateComputePipeline(CullModule, PipelineLayout);
+        vkDestroyShaderModule(RHI.GetDevice(), CullModule, nullptr);
+
+        Stages.emplace_back(
+            VK_SHADER_STAGE_VERTEX_BIT,
+            CompileShader("Cluster.vert", EShaderStage::Vertex, Defines));
+    }
+    Stages.emplace_back(
+        VK_SHADER_STAGE_FRAGMENT_BIT,
+        CompileShader("Cluster.frag", EShaderStage::Fragment, Defines));
+
+    bool bCompiled = true;
+    std::vector<VkPipelineShaderStageCreateInfo> StageCreateInfos;
+    for(const auto &[Stage, Module]: Stages) {
+        bCompiled &= Module != VK_NULL_HANDLE;
+        VkPipelineShaderStageCreateInfo StageCreateInfo{
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
+        StageCreateInfo.stage = Stage;
+        StageCreateInfo.module = Module;
+        StageCreateInfo.pName = "main";
+        StageCreateInfos.push_back(StageCreateInfo);
+    }
+
+    if(bCompiled) {
+        const FVertexInputState VertexInput = FVertexInput::CreateState(VertexLayout);
+        const VkPipelineVertexInputStateCreateInfo VertexInputCreateInfo =
+            VertexInput.GetCreateInfo();
+
+        VkPipelineInputAssemblyStateCreateInfo InputAssembly{
+            VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO};
+        InputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+        VkPipelineViewportStateCreateInfo ViewportState{
+            VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO};
+        ViewportState.viewportCount = 1;
+        ViewportState.scissorCount = 1;
+
+        // Cone culling already removes most backfacing clusters, the rest is culled here.
+        VkPipelineRasterizationStateCreateInfo Rasterization{
+            VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO};
+        Rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+        Rasterization.cullMode = VK_CULL_MODE_BACK_BIT;
+        Rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        Rasterization.lineWidth = 1.0f;
+
+        VkPipelineMultisampleStateCreateInfo Multisample{
+            VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO};
+        Multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkPipelineDepthStencilStateCreateInfo DepthStencil{
+            VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO};
+        DepthStencil.depthTestEnable = VK_TRUE;
+        DepthStencil.depthWriteEnable = VK_TRUE;
+        DepthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+        VkPipelineColorBlendAttachmentState BlendAttachment{};
+        BlendAttachment.colorWriteMask =
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+            VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        VkPipelineColorBlendStateCreateInfo ColorBlend{
+            VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO};
+        ColorBlend.attachmentCount = 1;
+        ColorBlend.pAttachments = &BlendAttachment;
+
+        const VkDynamicState DynamicStates[] = {
+            VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo DynamicState{
+            VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO};
+        DynamicState.dynamicStateCount = static_cast<uint32_t>(std::size(DynamicStates));
+        DynamicState.pDynamicStates = DynamicStates;
+
+        VkGraphicsPipelineCreateInfo CreateInfo{
+            VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
+        CreateInfo.stageCount = static_cast<uint32_t>(StageCreateInfos.size());
+        CreateInfo.pStages = StageCreateInfos.data();
+        CreateInfo.pVertexInputState = bMeshShaders ? nullptr : &VertexInputCreateInfo;
+        CreateInfo.pInputAssemblyState = bMeshShaders ? nullptr : &InputAssembly;
+        CreateInfo.pViewportState = &ViewportState;
+        CreateInfo.pRasterizationState = &Rasterization;
+        CreateInfo.pMultisampleState = &Multisample;
+        CreateInfo.pDepthStencilState = &DepthStencil;
+        CreateInfo.pColorBlendState = &ColorBlend;
+        CreateInfo.pDynamicState = &DynamicState;
+        CreateInfo.layout = PipelineLayout;
+        CreateInfo.renderPass = RenderPass;
+        CreateInfo.subpass = Subpass;
+        vk_check(vkCreateGraphicsPipelines(
+            RHI.GetDevice(), VK_NULL_HANDLE, 1, &CreateInfo, nullptr, &DrawPipeline));
+    }
+
+    for(const auto &[Stage, Module]: Stages) {
+        if(Module != VK_NULL_HANDLE) {
+            vkDestroyShaderModule(RHI.GetDevice(), Module, nullptr);
+        }
+    }
+    return bCompiled;
+}
+
+void FClusterCuller::DestroyPipelines() {
+    if(CullPipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(RHI.GetDevice(), CullPipeline, nullptr);
+        CullPipeline = VK_NULL_HANDLE;
+    }
+    if(DrawPipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(RHI.GetDevice(), DrawPipeline, nullptr);
+        DrawPipeline = VK_NULL_HANDLE;
+    }
+}
+
+void FClusterCuller::Cull(
+    VkCommandBuffer CommandBuffer, const FClusterCullView &View, uint32_t Frame) {
+    if(DrawPipeline == VK_NULL_HANDLE) { return; }
+
+    const glm::mat4 &Projection = View.ViewToClip;
+    FGpuCullView GpuView{};
+    GpuView.WorldToClip = Projection * View.WorldToView;
+    GpuView.WorldToView = View.WorldToView;
+    ExtractFrustumPlanes(GpuView.WorldToClip, GpuView.FrustumPlanes);
+    GpuView.CameraPosition = glm::vec4(View.CameraPosition, 1.0f);
+    // The near plane distance of a 0..1 depth perspective projection is P32 / P22.
+    GpuView.Projection = glm::vec4(
+        Projection[0][0], Projection[1][1], Projection[3][2] / Projection[2][2], 0.0f);
+    GpuView.PyramidParams = glm::vec4(
+        Projection[2][2], Projection[3][2], float(Pyramid.Size.width),
+        float(Pyramid.Size.height));
+    GpuView.ClusterCount = GetClusterCount();
+    GpuView.Flags = View.Flags;
+    if(Pyramid.View == VK_NULL_HANDLE) { GpuView.Flags &= ~ClusterCull_Occlusion; }
+
+    const VkDeviceSize ViewOffset = ViewStride * (Frame % MaxFramesInFlight);
+    std::memcpy(
+        static_cast<uint8_t *>(ViewBuffer.MappedData) + ViewOffset, &GpuView,
+        sizeof(GpuView));
+
+    // Task shaders cull while drawing.
+    if(bMeshShaders) { return; }
+
+    if(RHI.GetCapabilities().bDrawIndirectCount) {
+        vkCmdFillBuffer(CommandBuffer, DrawCountBuffer.Buffer, 0, sizeof(uint32_t), 0);
+        VkMemoryBarrier FillBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        FillBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        FillBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &FillBarrier, 0, nullptr, 0,
+            nullptr);
+    }
+
+    const auto DynamicOffset = static_cast<uint32_t>(ViewOffset);
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, CullPipeline);
+    vkCmdBindDescriptorSets(
+        CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, 0, 1,
+        &DescriptorSet, 1, &DynamicOffset);
+    vkCmdDispatch(
+        CommandBuffer, (GetClusterCount() + CullGroupSize - 1) / CullGroupSize, 1, 1);
+
+    VkMemoryBarrier CullBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    CullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    CullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &CullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void FClusterCuller::Draw(VkCommandBuffer CommandBuffer, uint32_t Frame) {
+    if(DrawPipeline == VK_NULL_HANDLE) { return; }
+
+    const auto DynamicOffset =
+        static_cast<uint32_t>(ViewStride * (Frame % MaxFramesInFlight));
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, DrawPipeline);
+    vkCmdBindDescriptorSets(
+        CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, PipelineLayout, 0, 1,
+        &DescriptorSet, 1, &DynamicOffset);
+
+    if(bMeshShaders) {
+        FVertexFetch Fetch{
+            VertexLayout.Stride, VertexLayout.Get(EVertexSemantic::Position).Offset,
+            VertexLayout.Get(EVertexSemantic::Normal).Offset,
+            VertexLayout.Get(EVertexSemantic::TexCoord).Offset};
+        vkCmdPushConstants(
+            CommandBuffer, PipelineLayout, VK_SHADER_STAGE_MESH_BIT_NV, 0, sizeof(Fetch),
+            &Fetch);
+        vkCmdDrawMeshTasksNV(
+            CommandBuffer, (GetClusterCount() + TaskGroupSize - 1) / TaskGroupSize, 0);
+        return;
+    }
+
+    const VkDeviceSize Offset = 0;
+    vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &VertexBuffer.Buffer, &Offset);
+    vkCmdBindIndexBuffer(CommandBuffer, IndexBuffer.Buffer, 0, VK_INDEX_TYPE_UINT32);
+
+    constexpr uint32_t Stride = sizeof(FDrawIndexedIndirectCommand);
+    const FRHICapabilities &Capabilities = RHI.GetCapabilities();
+    if(Capabilities.bDrawIndirectCount) {
+        vkCmdDrawIndexedIndirectCountKHR(
+            CommandBuffer, DrawCommandBuffer.Buffer, 0, DrawCountBuffer.Buffer, 0,
+            GetClusterCount(), Stride);
+    } else if(Capabilities.bMultiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(
+            CommandBuffer, DrawCommandBuffer.Buffer, 0, GetClusterCount(), Stride);
+    } else {
+        for(uint32_t i = 0; i < GetClusterCount(); i++) {
+            vkCmdDrawIndexedIndirect(
+                CommandBuffer, DrawCommandBuffer.Buffer, VkDeviceSize(i) * Stride, 1,
+                Stride);
+        }
+    }
+}
+}
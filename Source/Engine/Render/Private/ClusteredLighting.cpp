@@ -0,0 +1,223 @@
+﻿#include "Render/ClusteredLighting.h"
+#include "RHI/ShaderCompiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+namespace RE {
+namespace {
+// Mirrors FClusterParams in Shaders/Include/ClusteredLighting.glsl, std140.
+struct FClusterParams {
+    glm::mat4 WorldToView;
+    glm::mat4 ClipToView;
+    glm::uvec4 GridSize;
+    glm::vec4 Viewport;
+    glm::vec4 DepthSlicing;
+    glm::uvec4 Limits;
+};
+
+enum EClusterBinding : uint32_t {
+    Binding_Params,
+    Binding_Lights,
+    Binding_Grid,
+    Binding_Indices,
+    Binding_Scratch,
+    Binding_Counter,
+    Binding_Count
+};
+
+constexpr uint32_t CullGroupSize = 64;
+}
+
+FClusteredLighting::FClusteredLighting(
+    FRHI &RHI, const FClusteredLightingSettings &InSettings)
+    : RHI(RHI), Settings(InSettings) {
+    VkDevice Device = RHI.GetDevice();
+    const uint32_t ClusterCount = GetClusterCount();
+    MaxLightIndices = ClusterCount * Settings.AverageLightsPerCluster;
+    Lights.reserve(Settings.MaxLights);
+
+    constexpr VkBufferUsageFlags Storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    for(uint32_t Frame = 0; Frame < MaxFramesInFlight; Frame++) {
+        ParamsBuffers[Frame] = RHI.CreateBuffer(
+            sizeof(FClusterParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VMA_MEMORY_USAGE_CPU_TO_GPU);
+        LightBuffers[Frame] = RHI.CreateBuffer(
+            VkDeviceSize(Settings.MaxLights) * sizeof(FClusterLight), Storage,
+            VMA_MEMORY_USAGE_CPU_TO_GPU);
+    }
+    GridBuffer = RHI.CreateBuffer(
+        VkDeviceSize(ClusterCount) * sizeof(glm::uvec2), Storage,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    IndexBuffer = RHI.CreateBuffer(
+        VkDeviceSize(MaxLightIndices) * sizeof(uint32_t), Storage,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    ScratchBuffer = RHI.CreateBuffer(
+        VkDeviceSize(ClusterCount) * Settings.MaxLightsPerCluster * sizeof(uint32_t),
+        Storage, VMA_MEMORY_USAGE_GPU_ONLY);
+    CounterBuffer = RHI.CreateBuffer(
+        sizeof(uint32_t), Storage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+
+    // Forward shading reads everything but the culling scratch space.
+    constexpr VkShaderStageFlags Compute = VK_SHADER_STAGE_COMPUTE_BIT;
+    constexpr VkShaderStageFlags Shared = Compute | VK_SHADER_STAGE_FRAGMENT_BIT;
+    const VkDescriptorSetLayoutBinding Bindings[] = {
+        {Binding_Params, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, Shared, nullptr},
+        {Binding_Lights, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, Shared, nullptr},
+        {Binding_Grid, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, Shared, nullptr},
+        {Binding_Indices, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, Shared, nullptr},
+        {Binding_Scratch, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, Compute, nullptr},
+        {Binding_Counter, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, Compute, nullptr},
+    };
+    VkDescriptorSetLayoutCreateInfo LayoutCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    LayoutCreateInfo.bindingCount = static_cast<uint32_t>(std::size(Bindings));
+    LayoutCreateInfo.pBindings = Bindings;
+    vk_check(vkCreateDescriptorSetLayout(
+        Device, &LayoutCreateInfo, nullptr, &DescriptorSetLayout));
+
+    const VkDescriptorPoolSize PoolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, MaxFramesInFlight},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, (Binding_Count - 1) * MaxFramesInFlight},
+    };
+    VkDescriptorPoolCreateInfo PoolCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    PoolCreateInfo.maxSets = MaxFramesInFlight;
+    PoolCreateInfo.poolSizeCount = static_cast<uint32_t>(std::size(PoolSizes));
+    PoolCreateInfo.pPoolSizes = PoolSizes;
+    vk_check(vkCreateDescriptorPool(Device, &PoolCreateInfo, nullptr, &DescriptorPool));
+
+    const VkDescriptorSetLayout Layouts[MaxFramesInFlight] = {
+        DescriptorSetLayout, DescriptorSetLayout};
+    VkDescriptorSetAllocateInfo AllocateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    AllocateInfo.descriptorPool = DescriptorPool;
+    AllocateInfo.descriptorSetCount = MaxFramesInFlight;
+    AllocateInfo.pSetLayouts = Layouts;
+    vk_check(vkAllocateDescriptorSets(Device, &AllocateInfo, DescriptorSets));
+
+    for(uint32_t Frame = 0; Frame < MaxFramesInFlight; Frame++) {
+        const FBuffer *Buffers[Binding_Count] = {
+            &ParamsBuffers[Frame], &LightBuffers[Frame], &GridBuffer,
+            &IndexBuffer,          &ScratchBuffer,       &CounterBuffer};
+        VkDescriptorBufferInfo BufferInfos[Binding_Count];
+        VkWriteDescriptorSet Writes[Binding_Count];
+        for(uint32_t Binding = 0; Binding < Binding_Count; Binding++) {
+            BufferInfos[Binding] = {Buffers[Binding]->Buffer, 0, VK_WHOLE_SIZE};
+            Writes[Binding] = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+            Writes[Binding].dstSet = DescriptorSets[Frame];
+            Writes[Binding].dstBinding = Binding;
+            Writes[Binding].descriptorCount = 1;
+            Writes[Binding].descriptorType = Binding == Binding_Params
+                                                 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+                                                 : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            Writes[Binding].pBufferInfo = &BufferInfos[Binding];
+        }
+        vkUpdateDescriptorSets(Device, Binding_Count, Writes, 0, nullptr);
+    }
+
+    VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo{
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    PipelineLayoutCreateInfo.setLayoutCount = 1;
+    PipelineLayoutCreateInfo.pSetLayouts = &DescriptorSetLayout;
+    vk_check(vkCreatePipelineLayout(
+        Device, &PipelineLayoutCreateInfo, nullptr, &PipelineLayout));
+
+    std::vector<uint32_t> Spirv;
+    if(FShaderCompiler::Get().Compile(
+           "LightCull.comp", EShaderStage::Compute, {}, Spirv)) {
+        VkShaderModule Module = RHI.CreateShaderModule(Spirv);
+        Pipeline = RHI.CreateComputePipeline(Module, PipelineLayout);
+        vkDestroyShaderModule(Device, Module, nullptr);
+    } else {
+        RE_LOGE("The light culling shader failed to compile.");
+    }
+}
+
+FClusteredLighting::~FClusteredLighting() {
+    VkDevice Device = RHI.GetDevice();
+    if(Pipeline != VK_NULL_HANDLE) { vkDestroyPipeline(Device, Pipeline, nullptr); }
+    vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
+    vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(Device, DescriptorSetLayout, nullptr);
+    for(FBuffer *Buffer:
+        {&ParamsBuffers[0], &ParamsBuffers[1], &LightBuffers[0], &LightBuffers[1],
+         &GridBuffer, &IndexBuffer, &ScratchBuffer, &CounterBuffer}) {
+        RHI.DestroyBuffer(*Buffer);
+    }
+}
+
+void FClusteredLighting::SetLights(std::span<const FClusterLight> InLights) {
+    if(InLights.size() > Settings.MaxLights) {
+        RE_LOGW("{} lights exceed the limit of {}.", InLights.size(), Settings.MaxLights);
+        InLights = InLights.first(Settings.MaxLights);
+    }
+    Lights.assign(InLights.begin(), InLights.end());
+    // The cone tests rely on unit axes.
+    for(FClusterLight &Light: Lights) {
+        if(Light.Type == ELightType::Spot) {
+            Light.Direction = glm::normalize(Light.Direction);
+        }
+    }
+}
+
+void FClusteredLighting::Update(
+    VkCommandBuffer CommandBuffer, const glm::mat4 &WorldToView,
+    const glm::mat4 &ViewToClip, float NearPlane, float FarPlane, VkExtent2D ViewportSize,
+    uint32_t Frame) {
+    if(Pipeline == VK_NULL_HANDLE) { return; }
+    if(ViewportSize.width == 0 || ViewportSize.height == 0) { return; }
+    const uint32_t FrameIndex = Frame % MaxFramesInFlight;
+
+    // Slice k starts at Near * (Far / Near)^(k / SliceCount).
+    const float SliceScale = float(Settings.SliceCount) / std::log(FarPlane / NearPlane);
+    FClusterParams Params;
+    Params.WorldToView = WorldToView;
+    Params.ClipToView = glm::inverse(ViewToClip);
+    Params.GridSize = {
+        Settings.TileCountX, Settings.TileCountY, Settings.SliceCount, GetLightCount()};
+    Params.Viewport = {
+        float(ViewportSize.width), float(ViewportSize.height),
+        1.0f / float(ViewportSize.width), 1.0f / float(ViewportSize.height)};
+    Params.DepthSlicing = {
+        NearPlane, FarPlane, SliceScale, std::log(NearPlane) * SliceScale};
+    Params.Limits = {Settings.MaxLightsPerCluster, MaxLightIndices, 0, 0};
+    std::memcpy(ParamsBuffers[FrameIndex].MappedData, &Params, sizeof(Params));
+    std::memcpy(
+        LightBuffers[FrameIndex].MappedData, Lights.data(),
+        Lights.size() * sizeof(FClusterLight));
+
+    // The previous frame's shading may still read the grid and indices.
+    vkCmdPipelineBarrier(
+        CommandBuffer,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+        nullptr, 0, nullptr, 0, nullptr);
+    vkCmdFillBuffer(CommandBuffer, CounterBuffer.Buffer, 0, sizeof(uint32_t), 0);
+    VkMemoryBarrier ResetBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    ResetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    ResetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &ResetBarrier, 0, nullptr, 0,
+        nullptr);
+
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipeline);
+    vkCmdBindDescriptorSets(
+        CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, 0, 1,
+        &DescriptorSets[FrameIndex], 0, nullptr);
+    vkCmdDispatch(
+        CommandBuffer, (GetClusterCount() + CullGroupSize - 1) / CullGroupSize, 1, 1);
+
+    VkMemoryBarrier CullBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    CullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    CullBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &CullBarrier, 0, nullptr, 0,
+        nullptr);
+}
+}
@@ -0,0 +1,237 @@
+﻿#include "Render/DepthPyramid.h"
+#include "RHI/ShaderCompiler.h"
+
+#include <algorithm>
+#include <bit>
+#include <iterator>
+
+namespace RE {
+namespace {
+// Mirrors FReduceParams in Shaders/DepthPyramid.comp.
+struct FReduceParams {
+    int32_t SourceWidth;
+    int32_t SourceHeight;
+    int32_t DestinationWidth;
+    int32_t DestinationHeight;
+};
+
+constexpr uint32_t ReduceGroupSize = 8;
+
+uint32_t PreviousPowerOfTwo(uint32_t Value) {
+    return std::bit_floor(std::max(Value, 1u));
+}
+
+VkImageMemoryBarrier MakeBarrier(
+    VkImage Image, uint32_t BaseMip, uint32_t MipCount, VkImageLayout OldLayout,
+    VkImageLayout NewLayout, VkAccessFlags SrcAccess, VkAccessFlags DstAccess) {
+    VkImageMemoryBarrier Barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    Barrier.srcAccessMask = SrcAccess;
+    Barrier.dstAccessMask = DstAccess;
+    Barrier.oldLayout = OldLayout;
+    Barrier.newLayout = NewLayout;
+    Barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    Barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    Barrier.image = Image;
+    Barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, BaseMip, MipCount, 0, 1};
+    return Barrier;
+}
+}
+
+FDepthPyramid::FDepthPyramid(FRHI &RHI): RHI(RHI) {
+    VkDevice Device = RHI.GetDevice();
+
+    VkSamplerCreateInfo SamplerCreateInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    SamplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+    SamplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+    SamplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    SamplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+    vk_check(vkCreateSampler(Device, &SamplerCreateInfo, nullptr, &Sampler));
+
+    const VkDescriptorSetLayoutBinding Bindings[] = {
+        {0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT,
+         nullptr},
+        {1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+    };
+    VkDescriptorSetLayoutCreateInfo LayoutCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    LayoutCreateInfo.bindingCount = static_cast<uint32_t>(std::size(Bindings));
+    LayoutCreateInfo.pBindings = Bindings;
+    vk_check(vkCreateDescriptorSetLayout(
+        Device, &LayoutCreateInfo, nullptr, &DescriptorSetLayout));
+
+    const VkPushConstantRange PushConstantRange{
+        VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FReduceParams)};
+    VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo{
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    PipelineLayoutCreateInfo.setLayoutCount = 1;
+    PipelineLayoutCreateInfo.pSetLayouts = &DescriptorSetLayout;
+    PipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    PipelineLayoutCreateInfo.pPushConstantRanges = &PushConstantRange;
+    vk_check(vkCreatePipelineLayout(
+        Device, &PipelineLayoutCreateInfo, nullptr, &PipelineLayout));
+
+    std::vector<uint32_t> Spirv;
+    if(FShaderCompiler::Get().Compile(
+           "DepthPyramid.comp", EShaderStage::Compute, {}, Spirv)) {
+        VkShaderModule Module = RHI.CreateShaderModule(Spirv);
+        Pipeline = RHI.CreateComputePipeline(Module, PipelineLayout);
+        vkDestroyShaderModule(Device, Module, nullptr);
+    }
+}
+
+FDepthPyramid::~FDepthPyramid() {
+    Destroy();
+    VkDevice Device = RHI.GetDevice();
+    if(Pipeline != VK_NULL_HANDLE) { vkDestroyPipeline(Device, Pipeline, nullptr); }
+    vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Device, DescriptorSetLayout, nullptr);
+    vkDestroySampler(Device, Sampler, nullptr);
+}
+
+void FDepthPyramid::Destroy() {
+    VkDevice Device = RHI.GetDevice();
+    if(DescriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+        DescriptorPool = VK_NULL_HANDLE;
+    }
+    DescriptorSets.clear();
+    for(VkImageView MipView: MipViews) {
+        vkDestroyImageView(Device, MipView, nullptr);
+    }
+    MipViews.clear();
+    if(View != VK_NULL_HANDLE) {
+        vkDestroyImageView(Device, View, nullptr);
+        View = VK_NULL_HANDLE;
+    }
+    RHI.DestroyImage(Image);
+    Size = {0, 0};
+}
+
+bool FDepthPyramid::Resize(VkImageView DepthView, VkExtent2D InDepthSize) {
+    Destroy();
+    if(Pipeline == VK_NULL_HANDLE) {
+        RE_LOGE("The depth pyramid shader failed to compile.");
+        return false;
+    }
+    if(InDepthSize.width == 0 || InDepthSize.height == 0) { return false; }
+
+    DepthSize = InDepthSize;
+    Size = {PreviousPowerOfTwo(DepthSize.width), PreviousPowerOfTwo(DepthSize.height)};
+    const uint32_t MipCount = std::bit_width(std::max(Size.width, Size.height));
+
+    VkImageCreateInfo ImageCreateInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    ImageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    ImageCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+    ImageCreateInfo.extent = {Size.width, Size.height, 1};
+    ImageCreateInfo.mipLevels = MipCount;
+    ImageCreateInfo.arrayLayers = 1;
+    ImageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    ImageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    ImageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+    ImageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    Image = RHI.CreateImage(ImageCreateInfo, VMA_MEMORY_USAGE_GPU_ONLY);
+    View = RHI.CreateImageView(Image, VK_IMAGE_ASPECT_COLOR_BIT);
+    for(uint32_t Mip = 0; Mip < MipCount; Mip++) {
+        MipViews.push_back(RHI.CreateImageView(Image, VK_IMAGE_ASPECT_COLOR_BIT, Mip, 1));
+    }
+
+    const VkDescriptorPoolSize PoolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MipCount},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MipCount},
+    };
+    VkDescriptorPoolCreateInfo PoolCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    PoolCreateInfo.maxSets = MipCount;
+    PoolCreateInfo.poolSizeCount = static_cast<uint32_t>(std::size(PoolSizes));
+    PoolCreateInfo.pPoolSizes = PoolSizes;
+    vk_check(vkCreateDescriptorPool(
+        RHI.GetDevice(), &PoolCreateInfo, nullptr, &DescriptorPool));
+
+    const std::vector<VkDescriptorSetLayout> Layouts(MipCount, DescriptorSetLayout);
+    VkDescriptorSetAllocateInfo AllocateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    AllocateInfo.descriptorPool = DescriptorPool;
+    AllocateInfo.descriptorSetCount = MipCount;
+    AllocateInfo.pSetLayouts = Layouts.data();
+    DescriptorSets.resize(MipCount);
+    vk_check(vkAllocateDescriptorSets(
+        RHI.GetDevice(), &AllocateInfo, DescriptorSets.data()));
+
+    for(uint32_t Mip = 0; Mip < MipCount; Mip++) {
+        // Levels are written and read in GENERAL while building.
+        const VkDescriptorImageInfo SourceInfo{
+            Sampler, Mip == 0 ? DepthView : MipViews[Mip - 1],
+            Mip == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL};
+        const VkDescriptorImageInfo DestinationInfo{
+            VK_NULL_HANDLE, MipViews[Mip], VK_IMAGE_LAYOUT_GENERAL};
+
+        VkWriteDescriptorSet Writes[2]{
+            {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET},
+            {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET}};
+        Writes[0].dstSet = DescriptorSets[Mip];
+        Writes[0].dstBinding = 0;
+        Writes[0].descriptorCount = 1;
+        Writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        Writes[0].pImageInfo = &SourceInfo;
+        Writes[1].dstSet = DescriptorSets[Mip];
+        Writes[1].dstBinding = 1;
+        Writes[1].descriptorCount = 1;
+        Writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        Writes[1].pImageInfo = &DestinationInfo;
+        vkUpdateDescriptorSets(RHI.GetDevice(), 2, Writes, 0, nullptr);
+    }
+    return true;
+}
+
+void FDepthPyramid::Build(VkCommandBuffer CommandBuffer) {
+    if(!IsValid()) { return; }
+    const uint32_t MipCount = Image.MipLevels;
+
+    // The previous contents are fully overwritten, only wait for earlier reads.
+    VkImageMemoryBarrier Barrier = MakeBarrier(
+        Image.Image, 0, MipCount, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0,
+        VK_ACCESS_SHADER_WRITE_BIT);
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
+
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipeline);
+    VkExtent2D SourceSize = DepthSize;
+    for(uint32_t Mip = 0; Mip < MipCount; Mip++) {
+        const VkExtent2D MipSize{
+            std::max(Size.width >> Mip, 1u), std::max(Size.height >> Mip, 1u)};
+        const FReduceParams Params{
+            int32_t(SourceSize.width), int32_t(SourceSize.height), int32_t(MipSize.width),
+            int32_t(MipSize.height)};
+        vkCmdBindDescriptorSets(
+            CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, 0, 1,
+            &DescriptorSets[Mip], 0, nullptr);
+        vkCmdPushConstants(
+            CommandBuffer, PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Params),
+            &Params);
+        vkCmdDispatch(
+            CommandBuffer, (MipSize.width + ReduceGroupSize - 1) / ReduceGroupSize,
+            (MipSize.height + ReduceGroupSize - 1) / ReduceGroupSize, 1);
+
+        Barrier = MakeBarrier(
+            Image.Image, Mip, 1, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+        vkCmdPipelineBarrier(
+            CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
+        SourceSize = MipSize;
+    }
+
+    // Culling may read the pyramid from compute, task or vertex shaders.
+    Barrier = MakeBarrier(
+        Image.Image, 0, MipCount, VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT,
+        VK_ACCESS_SHADER_READ_BIT);
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
+}
+}
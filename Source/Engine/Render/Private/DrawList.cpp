@@ -0,0 +1,181 @@
+﻿#include "Render/DrawList.h"
+#include "Core/Logging.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace RE {
+namespace {
+constexpr uint32_t RadixBits = 8;
+constexpr uint32_t RadixSize = 1u << RadixBits;
+constexpr uint32_t DigitCount = 64 / RadixBits;
+
+constexpr uint64_t FieldMask(uint32_t Bits) { return (uint64_t(1) << Bits) - 1; }
+}
+
+uint64_t FDrawKey::Make(
+    uint32_t Pass, uint32_t Pipeline, uint32_t Material, uint32_t DepthBucket) {
+    checkf(
+        Pass <= FieldMask(PassBits) && Pipeline <= FieldMask(PipelineBits) &&
+            Material <= FieldMask(MaterialBits) && DepthBucket <= FieldMask(DepthBits),
+        "Draw key field out of range.");
+    uint64_t Key = Pass;
+    Key = (Key << PipelineBits) | Pipeline;
+    Key = (Key << MaterialBits) | Material;
+    Key = (Key << DepthBits) | DepthBucket;
+    return Key;
+}
+
+uint32_t FDrawKey::GetDepthBucket(float ViewDepth, bool bBackToFront) {
+    // Non-negative floats order like their bit patterns, so the top bits after the sign
+    // are a bucket index that is finer close to the camera.
+    const uint32_t Bits = std::bit_cast<uint32_t>(std::max(ViewDepth, 0.0f));
+    const uint32_t Bucket = Bits >> (31 - DepthBits);
+    return bBackToFront ? static_cast<uint32_t>(FieldMask(DepthBits)) - Bucket : Bucket;
+}
+
+void FDrawList::Reset() {
+    Commands.clear();
+    Entries.clear();
+    Stats = {};
+}
+
+void FDrawList::Reserve(uint32_t Count) {
+    Commands.reserve(Count);
+    Entries.reserve(Count);
+    SortScratch.reserve(Count);
+}
+
+void FDrawList::Add(uint64_t Key, const FDrawCommand &Command) {
+    Entries.push_back({Key, static_cast<uint32_t>(Commands.size())});
+    Commands.push_back(Command);
+}
+
+void FDrawList::Sort() {
+    const size_t Count = Entries.size();
+    if(Count < 2) { return; }
+
+    // One sweep builds the histograms of every digit.
+    uint32_t Histograms[DigitCount][RadixSize];
+    std::memset(Histograms, 0, sizeof(Histograms));
+    for(const FSortEntry &Entry: Entries) {
+        for(uint32_t Digit = 0; Digit < DigitCount; Digit++) {
+            Histograms[Digit][(Entry.Key >> (Digit * RadixBits)) & (RadixSize - 1)]++;
+        }
+    }
+
+    SortScratch.resize(Count);
+    FSortEntry *Source = Entries.data();
+    FSortEntry *Target = SortScratch.data();
+    for(uint32_t Digit = 0; Digit < DigitCount; Digit++) {
+        uint32_t *Histogram = Histograms[Digit];
+        const uint32_t Shift = Digit * RadixBits;
+        // A digit shared by all keys would move nothing.
+        if(Histogram[(Source[0].Key >> Shift) & (RadixSize - 1)] == Count) { continue; }
+
+        uint32_t Offset = 0;
+        for(uint32_t Bucket = 0; Bucket < RadixSize; Bucket++) {
+            const uint32_t BucketCount = Histogram[Bucket];
+            Histogram[Bucket] = Offset;
+            Offset += BucketCount;
+        }
+        for(size_t i = 0; i < Count; i++) {
+            Target[Histogram[(Source[i].Key >> Shift) & (RadixSize - 1)]++] = Source[i];
+        }
+        std::swap(Source, Target);
+    }
+    if(Source != Entries.data()) { Entries.swap(SortScratch); }
+}
+
+void FDrawList::Record(
+    VkCommandBuffer CommandBuffer, uint32_t FirstPass, uint32_t LastPass) {
+    const auto PassBegin = [&](uint64_t Pass) {
+        if(Pass > FieldMask(FDrawKey::PassBits)) { return Entries.end(); }
+        const uint64_t Key = Pass << (64 - FDrawKey::PassBits);
+        return std::lower_bound(
+            Entries.begin(), Entries.end(), Key,
+            [](const FSortEntry &Entry, uint64_t Value) { return Entry.Key < Value; });
+    };
+    const auto Begin = PassBegin(FirstPass);
+    const auto End = LastPass >= FirstPass ? PassBegin(uint64_t(LastPass) + 1) : Begin;
+
+    VkPipeline Pipeline = VK_NULL_HANDLE;
+    VkPipelineLayout PipelineLayout = VK_NULL_HANDLE;
+    VkDescriptorSet DescriptorSets[FDrawCommand::MaxDescriptorSets]{};
+    VkBuffer VertexBuffer = VK_NULL_HANDLE;
+    VkDeviceSize VertexBufferOffset = 0;
+    VkBuffer InstanceBuffer = VK_NULL_HANDLE;
+    VkBuffer IndexBuffer = VK_NULL_HANDLE;
+
+    for(auto It = Begin; It != End; ++It) {
+        const FDrawCommand &Command = Commands[It->Command];
+
+        if(Command.Pipeline != Pipeline) {
+            vkCmdBindPipeline(
+                CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Command.Pipeline);
+            Pipeline = Command.Pipeline;
+            Stats.PipelineBinds++;
+        } else {
+            Stats.SkippedPipelineBinds++;
+        }
+        // Sets bound with another layout may have been disturbed, so rebind them all.
+        if(Command.PipelineLayout != PipelineLayout) {
+            PipelineLayout = Command.PipelineLayout;
+            std::fill(
+                std::begin(DescriptorSets), std::end(DescriptorSets), VK_NULL_HANDLE);
+        }
+
+        for(uint32_t Set = 0; Set < FDrawCommand::MaxDescriptorSets; Set++) {
+            const VkDescriptorSet DescriptorSet = Command.DescriptorSets[Set];
+            if(DescriptorSet == VK_NULL_HANDLE) { break; }
+            if(DescriptorSet == DescriptorSets[Set]) {
+                Stats.SkippedDescriptorSetBinds++;
+                continue;
+            }
+            vkCmdBindDescriptorSets(
+                CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, PipelineLayout, Set, 1,
+                &DescriptorSet, 0, nullptr);
+            DescriptorSets[Set] = DescriptorSet;
+            Stats.DescriptorSetBinds++;
+        }
+
+        if(Command.VertexBuffer != VertexBuffer ||
+           Command.VertexBufferOffset != VertexBufferOffset) {
+            vkCmdBindVertexBuffers(
+                CommandBuffer, 0, 1, &Command.VertexBuffer, &Command.VertexBufferOffset);
+            VertexBuffer = Command.VertexBuffer;
+            VertexBufferOffset = Command.VertexBufferOffset;
+            Stats.VertexBufferBinds++;
+        } else {
+            Stats.SkippedVertexBufferBinds++;
+        }
+
+        if(Command.InstanceBuffer != VK_NULL_HANDLE) {
+            if(Command.InstanceBuffer != InstanceBuffer) {
+                const VkDeviceSize Offset = 0;
+                vkCmdBindVertexBuffers(
+                    CommandBuffer, 1, 1, &Command.InstanceBuffer, &Offset);
+                InstanceBuffer = Command.InstanceBuffer;
+                Stats.InstanceBufferBinds++;
+            } else {
+                Stats.SkippedInstanceBufferBinds++;
+            }
+        }
+
+        if(Command.IndexBuffer != IndexBuffer) {
+            vkCmdBindIndexBuffer(
+                CommandBuffer, Command.IndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+            IndexBuffer = Command.IndexBuffer;
+            Stats.IndexBufferBinds++;
+        } else {
+            Stats.SkippedIndexBufferBinds++;
+        }
+
+        vkCmdDrawIndexed(
+            CommandBuffer, Command.IndexCount, Command.InstanceCount, Command.FirstIndex,
+            Command.VertexOffset, Command.FirstInstance);
+        Stats.Draws++;
+    }
+}
+}
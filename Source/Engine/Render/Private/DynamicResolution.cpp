@@ -0,0 +1,126 @@
+﻿#include "Render/DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace RE {
+namespace {
+// Smoothing of the measured time, rising times are followed faster than falling ones.
+constexpr float RiseSmoothing = 0.5f;
+constexpr float FallSmoothing = 0.1f;
+// Largest step down and up per adjustment, relative to the current scale.
+constexpr float MaxDecrease = 0.8f;
+constexpr float MaxIncrease = 1.03f;
+// The scale only rises while the smoothed time is this far under the aim.
+constexpr float IncreaseMargin = 0.92f;
+// A single frame this far over the target drops the scale without smoothing.
+constexpr float PanicRatio = 1.3f;
+}
+
+FDynamicResolution::FDynamicResolution(
+    FRHI &RHI, const FDynamicResolutionSettings &InSettings)
+    : RHI(RHI), Settings(InSettings) {
+    Settings.MinScale = std::clamp(Settings.MinScale, 0.1f, 1.0f);
+    Settings.MaxScale = std::clamp(Settings.MaxScale, Settings.MinScale, 1.0f);
+    Settings.Alignment = std::max(Settings.Alignment, 1u);
+    Scale = Settings.MaxScale;
+    SmoothedTime = Settings.TargetFrameTime * Settings.Headroom;
+
+    const VkPhysicalDeviceLimits &Limits = RHI.GetPhysicalDeviceProperties().limits;
+    if(!Limits.timestampComputeAndGraphics) {
+        RE_LOGW("The device has no timestamps, the render scale stays fixed.");
+        return;
+    }
+    TimestampPeriod = Limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo CreateInfo{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    CreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    CreateInfo.queryCount = 2 * MaxFramesInFlight;
+    vk_check(vkCreateQueryPool(RHI.GetDevice(), &CreateInfo, nullptr, &QueryPool));
+}
+
+FDynamicResolution::~FDynamicResolution() {
+    if(QueryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(RHI.GetDevice(), QueryPool, nullptr);
+    }
+}
+
+void FDynamicResolution::BeginFrame(VkCommandBuffer CommandBuffer, uint32_t Frame) {
+    if(QueryPool == VK_NULL_HANDLE) { return; }
+    const uint32_t FrameIndex = Frame % MaxFramesInFlight;
+    const uint32_t FirstQuery = 2 * FrameIndex;
+
+    // The slot's fence has been waited on, so its timestamps are available.
+    if(bQueriesWritten[FrameIndex]) {
+        uint64_t Timestamps[2]{};
+        const VkResult Result = vkGetQueryPoolResults(
+            RHI.GetDevice(), QueryPool, FirstQuery, 2, sizeof(Timestamps), Timestamps,
+            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if(Result == VK_SUCCESS && Timestamps[1] > Timestamps[0]) {
+            const double Nanoseconds =
+                double(Timestamps[1] - Timestamps[0]) * double(TimestampPeriod);
+            ReportGpuTime(static_cast<float>(Nanoseconds * 1e-6));
+        }
+    }
+
+    vkCmdResetQueryPool(CommandBuffer, QueryPool, FirstQuery, 2);
+    vkCmdWriteTimestamp(
+        CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, QueryPool, FirstQuery);
+}
+
+void FDynamicResolution::EndFrame(VkCommandBuffer CommandBuffer, uint32_t Frame) {
+    if(QueryPool == VK_NULL_HANDLE) { return; }
+    const uint32_t FrameIndex = Frame % MaxFramesInFlight;
+    vkCmdWriteTimestamp(
+        CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, QueryPool,
+        2 * FrameIndex + 1);
+    bQueriesWritten[FrameIndex] = true;
+}
+
+void FDynamicResolution::ReportGpuTime(float Milliseconds) {
+    if(Milliseconds <= 0.0f) { return; }
+    const float Aim = Settings.TargetFrameTime * Settings.Headroom;
+
+    // Frames still in flight at the last change measure the old scale.
+    if(SettleFrames > 0) {
+        SettleFrames--;
+        return;
+    }
+    const float Smoothing = Milliseconds > SmoothedTime ? RiseSmoothing : FallSmoothing;
+    SmoothedTime += (Milliseconds - SmoothedTime) * Smoothing;
+
+    // Time is taken to scale with the pixel count, the square of the axis scale.
+    const bool bPanic = Milliseconds > Settings.TargetFrameTime * PanicRatio;
+    const float Measured = bPanic ? Milliseconds : SmoothedTime;
+    float NewScale = Scale;
+    if(Measured > Aim) {
+        NewScale = Scale * std::max(std::sqrt(Aim / Measured), MaxDecrease);
+    } else if(Measured < Aim * IncreaseMargin) {
+        NewScale = Scale * std::min(std::sqrt(Aim / Measured), MaxIncrease);
+    }
+    NewScale = std::clamp(NewScale, Settings.MinScale, Settings.MaxScale);
+    if(NewScale == Scale) { return; }
+
+    Scale = NewScale;
+    if(bPanic) { SmoothedTime = Aim; }
+    SettleFrames = MaxFramesInFlight;
+}
+
+VkExtent2D FDynamicResolution::ScaleExtent(VkExtent2D OutputExtent, float AxisScale) const {
+    const uint32_t Alignment = Settings.Alignment;
+    auto ScaleAxis = [&](uint32_t Size) {
+        const uint32_t Scaled = static_cast<uint32_t>(std::ceil(float(Size) * AxisScale));
+        const uint32_t Aligned = (Scaled + Alignment - 1) / Alignment * Alignment;
+        return std::clamp(Aligned, std::min(Alignment, Size), Size);
+    };
+    return {ScaleAxis(OutputExtent.width), ScaleAxis(OutputExtent.height)};
+}
+
+VkExtent2D FDynamicResolution::GetRenderExtent(VkExtent2D OutputExtent) const {
+    return ScaleExtent(OutputExtent, Scale);
+}
+
+VkExtent2D FDynamicResolution::GetMaxRenderExtent(VkExtent2D OutputExtent) const {
+    return ScaleExtent(OutputExtent, Settings.MaxScale);
+}
+}
@@ -0,0 +1,332 @@
+﻿#include "Render/FrustumCulling.h"
+#include "Core/Logging.h"
+#include "Core/TaskSystem.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+    #define RE_CULL_AVX 1
+#elif defined(__SSE__) || defined(_M_X64) || defined(_M_IX86)
+    #include <xmmintrin.h>
+    #define RE_CULL_SSE 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+    #define RE_CULL_NEON 1
+#endif
+
+namespace RE {
+namespace {
+/* One view's planes split by component, so each can be broadcast straight from memory. */
+struct FViewPlanes {
+    float Nx[6], Ny[6], Nz[6], D[6];
+    float AbsNx[6], AbsNy[6], AbsNz[6];
+};
+
+#if defined(RE_CULL_AVX)
+struct FSimdOps {
+    using FVec = __m256;
+    static constexpr uint32_t Width = 8;
+    static FVec Load(const float *Data) { return _mm256_loadu_ps(Data); }
+    static FVec Set(float Value) { return _mm256_set1_ps(Value); }
+    static FVec Add(FVec A, FVec B) { return _mm256_add_ps(A, B); }
+    static FVec Mul(FVec A, FVec B) { return _mm256_mul_ps(A, B); }
+    static FVec And(FVec A, FVec B) { return _mm256_and_ps(A, B); }
+    static FVec GreaterZero(FVec A) {
+        return _mm256_cmp_ps(A, _mm256_setzero_ps(), _CMP_GT_OQ);
+    }
+    static uint32_t MoveMask(FVec A) {
+        return static_cast<uint32_t>(_mm256_movemask_ps(A));
+    }
+};
+#elif defined(RE_CULL_SSE)
+struct FSimdOps {
+    using FVec = __m128;
+    static constexpr uint32_t Width = 4;
+    static FVec Load(const float *Data) { return _mm_loadu_ps(Data); }
+    static FVec Set(float Value) { return _mm_set1_ps(Value); }
+    static FVec Add(FVec A, FVec B) { return _mm_add_ps(A, B); }
+    static FVec Mul(FVec A, FVec B) { return _mm_mul_ps(A, B); }
+    static FVec And(FVec A, FVec B) { return _mm_and_ps(A, B); }
+    static FVec GreaterZero(FVec A) { return _mm_cmpgt_ps(A, _mm_setzero_ps()); }
+    static uint32_t MoveMask(FVec A) { return static_cast<uint32_t>(_mm_movemask_ps(A)); }
+};
+#elif defined(RE_CULL_NEON)
+struct FSimdOps {
+    using FVec = float32x4_t;
+    static constexpr uint32_t Width = 4;
+    static FVec Load(const float *Data) { return vld1q_f32(Data); }
+    static FVec Set(float Value) { return vdupq_n_f32(Value); }
+    static FVec Add(FVec A, FVec B) { return vaddq_f32(A, B); }
+    static FVec Mul(FVec A, FVec B) { return vmulq_f32(A, B); }
+    static FVec And(FVec A, FVec B) {
+        return vreinterpretq_f32_u32(
+            vandq_u32(vreinterpretq_u32_f32(A), vreinterpretq_u32_f32(B)));
+    }
+    static FVec GreaterZero(FVec A) {
+        return vreinterpretq_f32_u32(vcgtq_f32(A, vdupq_n_f32(0.0f)));
+    }
+    static uint32_t MoveMask(FVec A) {
+        static const uint32_t LaneBits[4] = {1, 2, 4, 8};
+        const uint32x4_t Bits = vandq_u32(vreinterpretq_u32_f32(A), vld1q_u32(LaneBits));
+        return vaddvq_u32(Bits);
+    }
+};
+#endif
+
+#if defined(RE_CULL_AVX) || defined(RE_CULL_SSE) || defined(RE_CULL_NEON)
+    #define RE_CULL_SIMD 1
+
+/*
+ * Culls [Begin, End) against every view, appending visible indices to Out[View] and
+ * bumping Counts[View]. Begin is block aligned, lanes past End read the zero padding and
+ * are masked off.
+ */
+template<ECullShape Shape>
+void CullRangeSimd(
+    const FCullingBounds &Bounds, uint32_t Begin, uint32_t End,
+    const std::vector<FViewPlanes> &Views, uint32_t *const *Out, uint32_t *Counts) {
+    using FOps = FSimdOps;
+    using FVec = FOps::FVec;
+    for(uint32_t Base = Begin; Base < End; Base += FOps::Width) {
+        const FVec Cx = FOps::Load(Bounds.GetCenterX() + Base);
+        const FVec Cy = FOps::Load(Bounds.GetCenterY() + Base);
+        const FVec Cz = FOps::Load(Bounds.GetCenterZ() + Base);
+        FVec Ex, Ey, Ez, R;
+        if constexpr(Shape == ECullShape::Box) {
+            Ex = FOps::Load(Bounds.GetExtentX() + Base);
+            Ey = FOps::Load(Bounds.GetExtentY() + Base);
+            Ez = FOps::Load(Bounds.GetExtentZ() + Base);
+        } else {
+            R = FOps::Load(Bounds.GetRadius() + Base);
+        }
+        const uint32_t Lanes = std::min(End - Base, FOps::Width);
+        const uint32_t LaneMask = (1u << Lanes) - 1;
+
+        for(size_t View = 0; View < Views.size(); View++) {
+            const FViewPlanes &P = Views[View];
+            FVec Inside;
+            for(int i = 0; i < 6; i++) {
+                FVec Distance = FOps::Add(
+                    FOps::Add(
+                        FOps::Mul(Cx, FOps::Set(P.Nx[i])),
+                        FOps::Mul(Cy, FOps::Set(P.Ny[i]))),
+                    FOps::Add(FOps::Mul(Cz, FOps::Set(P.Nz[i])), FOps::Set(P.D[i])));
+                if constexpr(Shape == ECullShape::Box) {
+                    // Projected half size of the box onto the plane normal.
+                    const FVec Reach = FOps::Add(
+                        FOps::Add(
+                            FOps::Mul(Ex, FOps::Set(P.AbsNx[i])),
+                            FOps::Mul(Ey, FOps::Set(P.AbsNy[i]))),
+                        FOps::Mul(Ez, FOps::Set(P.AbsNz[i])));
+                    Distance = FOps::Add(Distance, Reach);
+                } else {
+                    Distance = FOps::Add(Distance, R);
+                }
+                const FVec PlaneInside = FOps::GreaterZero(Distance);
+                Inside = i == 0 ? PlaneInside : FOps::And(Inside, PlaneInside);
+            }
+
+            uint32_t Mask = FOps::MoveMask(Inside) & LaneMask;
+            uint32_t *Visible = Out[View];
+            uint32_t &Count = Counts[View];
+            while(Mask != 0) {
+                Visible[Count++] = Base + std::countr_zero(Mask);
+                Mask &= Mask - 1;
+            }
+        }
+    }
+}
+#endif
+
+void CullRangeScalar(
+    const FCullingBounds &Bounds, ECullShape Shape, uint32_t Begin, uint32_t End,
+    std::span<const FFrustum> Views, uint32_t *const *Out, uint32_t *Counts) {
+    for(uint32_t i = Begin; i < End; i++) {
+        const glm::vec3 Center(
+            Bounds.GetCenterX()[i], Bounds.GetCenterY()[i], Bounds.GetCenterZ()[i]);
+        const glm::vec3 Extent(
+            Bounds.GetExtentX()[i], Bounds.GetExtentY()[i], Bounds.GetExtentZ()[i]);
+        for(size_t View = 0; View < Views.size(); View++) {
+            const FFrustum &Frustum = Views[View];
+            const bool bVisible = Shape == ECullShape::Box
+                                      ? Frustum.TestBox(Center, Extent)
+                                      : Frustum.TestSphere(Center, Bounds.GetRadius()[i]);
+            if(bVisible) { Out[View][Counts[View]++] = i; }
+        }
+    }
+}
+
+uint32_t RoundUpToBlock(uint32_t Value) {
+    return (Value + FCullingBounds::BlockSize - 1) / FCullingBounds::BlockSize *
+           FCullingBounds::BlockSize;
+}
+}
+
+FFrustum FFrustum::FromMatrix(const glm::mat4 &WorldToClip) {
+    const glm::mat4 M = glm::transpose(WorldToClip);
+    FFrustum Frustum;
+    Frustum.Planes[0] = M[3] + M[0];
+    Frustum.Planes[1] = M[3] - M[0];
+    Frustum.Planes[2] = M[3] + M[1];
+    Frustum.Planes[3] = M[3] - M[1];
+    Frustum.Planes[4] = M[2];
+    Frustum.Planes[5] = M[3] - M[2];
+    for(glm::vec4 &Plane: Frustum.Planes) {
+        Plane /= glm::length(glm::vec3(Plane));
+    }
+    return Frustum;
+}
+
+bool FFrustum::TestSphere(const glm::vec3 &Center, float Radius) const {
+    for(const glm::vec4 &Plane: Planes) {
+        const float Distance = glm::dot(glm::vec3(Plane), Center) + Plane.w;
+        if(Distance + Radius <= 0.0f) { return false; }
+    }
+    return true;
+}
+
+bool FFrustum::TestBox(const glm::vec3 &Center, const glm::vec3 &Extent) const {
+    for(const glm::vec4 &Plane: Planes) {
+        const float Reach = glm::dot(glm::abs(glm::vec3(Plane)), Extent);
+        const float Distance = glm::dot(glm::vec3(Plane), Center) + Plane.w;
+        if(Distance + Reach <= 0.0f) { return false; }
+    }
+    return true;
+}
+
+uint32_t FCullingBounds::Append() {
+    const uint32_t Index = Count++;
+    if(Count > CenterX.size()) {
+        // Grow geometrically, the tail past Count stays zero for the SIMD loads.
+        Reserve(std::max<uint32_t>(Count, static_cast<uint32_t>(CenterX.size()) * 2));
+    }
+    return Index;
+}
+
+uint32_t FCullingBounds::AddBox(const glm::vec3 &Center, const glm::vec3 &Extent) {
+    const uint32_t Index = Append();
+    SetBox(Index, Center, Extent);
+    return Index;
+}
+
+uint32_t FCullingBounds::AddSphere(const glm::vec3 &Center, float InRadius) {
+    const uint32_t Index = Append();
+    SetSphere(Index, Center, InRadius);
+    return Index;
+}
+
+void FCullingBounds::SetBox(
+    uint32_t Index, const glm::vec3 &Center, const glm::vec3 &Extent) {
+    CenterX[Index] = Center.x;
+    CenterY[Index] = Center.y;
+    CenterZ[Index] = Center.z;
+    ExtentX[Index] = Extent.x;
+    ExtentY[Index] = Extent.y;
+    ExtentZ[Index] = Extent.z;
+    Radius[Index] = glm::length(Extent);
+}
+
+void FCullingBounds::SetSphere(uint32_t Index, const glm::vec3 &Center, float InRadius) {
+    SetBox(Index, Center, glm::vec3(InRadius));
+    Radius[Index] = InRadius;
+}
+
+void FCullingBounds::Reserve(uint32_t InCount) {
+    const uint32_t Padded = RoundUpToBlock(InCount);
+    if(Padded <= CenterX.size()) { return; }
+    for(std::vector<float> *Array:
+        {&CenterX, &CenterY, &CenterZ, &ExtentX, &ExtentY, &ExtentZ, &Radius}) {
+        Array->resize(Padded, 0.0f);
+    }
+}
+
+void FCullingBounds::Clear() {
+    for(std::vector<float> *Array:
+        {&CenterX, &CenterY, &CenterZ, &ExtentX, &ExtentY, &ExtentZ, &Radius}) {
+        std::fill(Array->begin(), Array->begin() + RoundUpToBlock(Count), 0.0f);
+    }
+    Count = 0;
+}
+
+void FFrustumCuller::Cull(
+    const FCullingBounds &Bounds, std::span<const FFrustum> Views,
+    std::span<std::vector<uint32_t>> OutVisible) {
+    checkf(OutVisible.size() >= Views.size(), "Need one visible list per view.");
+    const uint32_t Count = Bounds.GetCount();
+    const uint32_t ViewCount = static_cast<uint32_t>(Views.size());
+    const uint32_t BatchCount = (Count + BatchSize - 1) / BatchSize;
+
+    std::vector<FViewPlanes> Planes(ViewCount);
+    for(uint32_t View = 0; View < ViewCount; View++) {
+        for(int i = 0; i < 6; i++) {
+            const glm::vec4 &Plane = Views[View].Planes[i];
+            Planes[View].Nx[i] = Plane.x;
+            Planes[View].Ny[i] = Plane.y;
+            Planes[View].Nz[i] = Plane.z;
+            Planes[View].D[i] = Plane.w;
+            Planes[View].AbsNx[i] = std::abs(Plane.x);
+            Planes[View].AbsNy[i] = std::abs(Plane.y);
+            Planes[View].AbsNz[i] = std::abs(Plane.z);
+        }
+    }
+
+    // Every batch writes into its own slice of a per view scratch list, so the workers
+    // never share an output cursor; the slices are concatenated afterwards.
+    Scratch.resize(std::max(Scratch.size(), size_t(Count) * ViewCount));
+    BatchCounts.assign(size_t(BatchCount) * ViewCount, 0);
+    FTaskSystem::Get().ParallelFor(BatchCount, 1, [&](uint32_t First, uint32_t Last) {
+        std::vector<uint32_t *> Out(ViewCount);
+        for(uint32_t Batch = First; Batch < Last; Batch++) {
+            const uint32_t Begin = Batch * BatchSize;
+            const uint32_t End = std::min(Begin + BatchSize, Count);
+            for(uint32_t View = 0; View < ViewCount; View++) {
+                Out[View] = Scratch.data() + size_t(View) * Count + Begin;
+            }
+            uint32_t *Counts = BatchCounts.data() + size_t(Batch) * ViewCount;
+#if defined(RE_CULL_SIMD)
+            if(!bForceScalar) {
+                if(Shape == ECullShape::Box) {
+                    CullRangeSimd<ECullShape::Box>(
+                        Bounds, Begin, End, Planes, Out.data(), Counts);
+                } else {
+                    CullRangeSimd<ECullShape::Sphere>(
+                        Bounds, Begin, End, Planes, Out.data(), Counts);
+                }
+                continue;
+            }
+#endif
+            CullRangeScalar(Bounds, Shape, Begin, End, Views, Out.data(), Counts);
+        }
+    });
+
+    for(uint32_t View = 0; View < ViewCount; View++) {
+        std::vector<uint32_t> &Visible = OutVisible[View];
+        uint32_t Total = 0;
+        for(uint32_t Batch = 0; Batch < BatchCount; Batch++) {
+            Total += BatchCounts[size_t(Batch) * ViewCount + View];
+        }
+        Visible.clear();
+        Visible.reserve(Total);
+        for(uint32_t Batch = 0; Batch < BatchCount; Batch++) {
+            const uint32_t *Slice =
+                Scratch.data() + size_t(View) * Count + size_t(Batch) * BatchSize;
+            const uint32_t SliceCount = BatchCounts[size_t(Batch) * ViewCount + View];
+            Visible.insert(Visible.end(), Slice, Slice + SliceCount);
+        }
+    }
+}
+
+const char *FFrustumCuller::GetSimdName() {
+#if defined(RE_CULL_AVX)
+    return "AVX";
+#elif defined(RE_CULL_SSE)
+    return "SSE";
+#elif defined(RE_CULL_NEON)
+    return "NEON";
+#else
+    return "Scalar";
+#endif
+}
+}
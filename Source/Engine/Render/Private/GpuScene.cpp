@@ -0,0 +1,469 @@
+﻿#include "Render/GpuScene.h"
+#include "RHI/ShaderCompiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace RE {
+namespace {
+// Mirrors FCullParams in Shaders/GpuSceneCull.comp.
+struct FCullParams {
+    glm::vec4 FrustumPlanes[6];
+    uint32_t InstanceCount;
+};
+
+enum EGpuSceneBinding : uint32_t {
+    Binding_Instances,
+    Binding_Visible,
+    Binding_DrawSlots,
+    Binding_SlotMaterials,
+    Binding_CompactDraws,
+    Binding_MaterialCounts,
+    Binding_Count
+};
+
+constexpr uint32_t CullGroupSize = 64;
+constexpr uint32_t InvalidSlot = UINT32_MAX;
+constexpr VkDeviceSize CommandStride = sizeof(VkDrawIndexedIndirectCommand);
+
+// Gribb and Hartmann, planes point inwards and are normalized for sphere tests.
+void ExtractFrustumPlanes(const glm::mat4 &WorldToClip, glm::vec4 OutPlanes[6]) {
+    const glm::mat4 Rows = glm::transpose(WorldToClip);
+    OutPlanes[0] = Rows[3] + Rows[0];
+    OutPlanes[1] = Rows[3] - Rows[0];
+    OutPlanes[2] = Rows[3] + Rows[1];
+    OutPlanes[3] = Rows[3] - Rows[1];
+    OutPlanes[4] = Rows[2];
+    OutPlanes[5] = Rows[3] - Rows[2];
+    for(int i = 0; i < 6; i++) {
+        OutPlanes[i] /= glm::length(glm::vec3(OutPlanes[i]));
+    }
+}
+
+glm::vec4 TransformSphere(const glm::mat4 &LocalToWorld, const glm::vec4 &Sphere) {
+    const float Scale = std::max(
+        glm::length(glm::vec3(LocalToWorld[0])),
+        std::max(
+            glm::length(glm::vec3(LocalToWorld[1])),
+            glm::length(glm::vec3(LocalToWorld[2]))));
+    return glm::vec4(glm::vec3(LocalToWorld * glm::vec4(glm::vec3(Sphere), 1.0f)),
+                     Sphere.w * Scale);
+}
+}
+
+FGpuScene::FGpuScene(FRHI &RHI, uint32_t MaxInstances, uint32_t MaxMaterials)
+    : RHI(RHI), MaxInstances(MaxInstances), MaxMaterials(MaxMaterials),
+      MaterialRanges(MaxMaterials) {
+    if(!RHI.GetCapabilities().bDrawIndirectFirstInstance) {
+        RE_LOGW("drawIndirectFirstInstance is unsupported, instances will draw wrong.");
+    }
+    Instances.reserve(MaxInstances);
+    DirtyFlags.reserve(MaxInstances);
+
+    constexpr VkBufferUsageFlags Storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    constexpr VkBufferUsageFlags TransferDst = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    constexpr VkBufferUsageFlags Indirect = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    const VkDeviceSize InstanceSize =
+        VkDeviceSize(MaxInstances) * sizeof(FGpuSceneInstance);
+    // Never more slots than instances.
+    const VkDeviceSize SlotSize = VkDeviceSize(MaxInstances) * CommandStride;
+    const VkDeviceSize SlotMaterialSize = VkDeviceSize(MaxInstances) * sizeof(glm::uvec2);
+
+    InstanceBuffer =
+        RHI.CreateBuffer(InstanceSize, Storage | TransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
+    VisibleBuffer = RHI.CreateBuffer(
+        VkDeviceSize(MaxInstances) * sizeof(uint32_t), Storage, VMA_MEMORY_USAGE_GPU_ONLY);
+    DrawSlotBuffer = RHI.CreateBuffer(
+        SlotSize, Storage | TransferDst | Indirect, VMA_MEMORY_USAGE_GPU_ONLY);
+    SlotTemplateBuffer = RHI.CreateBuffer(
+        SlotSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | TransferDst,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    if(RHI.GetCapabilities().bDrawIndirectCount) {
+        SlotMaterialBuffer = RHI.CreateBuffer(
+            SlotMaterialSize, Storage | TransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
+        CompactDrawBuffer =
+            RHI.CreateBuffer(SlotSize, Storage | Indirect, VMA_MEMORY_USAGE_GPU_ONLY);
+        MaterialCountBuffer = RHI.CreateBuffer(
+            VkDeviceSize(MaxMaterials) * sizeof(uint32_t),
+            Storage | TransferDst | Indirect, VMA_MEMORY_USAGE_GPU_ONLY);
+    }
+    for(FBuffer &Staging: StagingBuffers) {
+        Staging = RHI.CreateBuffer(
+            InstanceSize + SlotSize + SlotMaterialSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VMA_MEMORY_USAGE_CPU_ONLY);
+    }
+
+    auto CreateLayout = [this](VkShaderStageFlags Stages, uint32_t BindingCount) {
+        std::vector<VkDescriptorSetLayoutBinding> Bindings;
+        for(uint32_t Binding = 0; Binding < BindingCount; Binding++) {
+            Bindings.push_back(
+                {Binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, Stages, nullptr});
+        }
+        VkDescriptorSetLayoutCreateInfo CreateInfo{
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+        CreateInfo.bindingCount = BindingCount;
+        CreateInfo.pBindings = Bindings.data();
+        VkDescriptorSetLayout Layout{VK_NULL_HANDLE};
+        vk_check(vkCreateDescriptorSetLayout(
+            this->RHI.GetDevice(), &CreateInfo, nullptr, &Layout));
+        return Layout;
+    };
+    DescriptorSetLayout = CreateLayout(VK_SHADER_STAGE_VERTEX_BIT, Binding_DrawSlots);
+    CullSetLayout = CreateLayout(VK_SHADER_STAGE_COMPUTE_BIT, Binding_Count);
+
+    const VkDescriptorPoolSize PoolSize{
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, Binding_DrawSlots + Binding_Count};
+    VkDescriptorPoolCreateInfo PoolCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    PoolCreateInfo.maxSets = 2;
+    PoolCreateInfo.poolSizeCount = 1;
+    PoolCreateInfo.pPoolSizes = &PoolSize;
+    vk_check(vkCreateDescriptorPool(
+        RHI.GetDevice(), &PoolCreateInfo, nullptr, &DescriptorPool));
+
+    const VkDescriptorSetLayout Layouts[] = {DescriptorSetLayout, CullSetLayout};
+    VkDescriptorSet Sets[2];
+    VkDescriptorSetAllocateInfo AllocateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    AllocateInfo.descriptorPool = DescriptorPool;
+    AllocateInfo.descriptorSetCount = 2;
+    AllocateInfo.pSetLayouts = Layouts;
+    vk_check(vkAllocateDescriptorSets(RHI.GetDevice(), &AllocateInfo, Sets));
+    DescriptorSet = Sets[0];
+    CullSet = Sets[1];
+
+    const FBuffer *Buffers[Binding_Count] = {
+        &InstanceBuffer,     &VisibleBuffer,     &DrawSlotBuffer,
+        &SlotMaterialBuffer, &CompactDrawBuffer, &MaterialCountBuffer};
+    VkDescriptorBufferInfo BufferInfos[Binding_Count];
+    std::vector<VkWriteDescriptorSet> Writes;
+    for(uint32_t Binding = 0; Binding < Binding_Count; Binding++) {
+        // The compaction buffers only exist with draw count support.
+        if(!Buffers[Binding]->IsValid()) { continue; }
+        BufferInfos[Binding] = {Buffers[Binding]->Buffer, 0, VK_WHOLE_SIZE};
+        for(VkDescriptorSet Set: {DescriptorSet, CullSet}) {
+            if(Set == DescriptorSet && Binding >= Binding_DrawSlots) { continue; }
+            VkWriteDescriptorSet Write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+            Write.dstSet = Set;
+            Write.dstBinding = Binding;
+            Write.descriptorCount = 1;
+            Write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            Write.pBufferInfo = &BufferInfos[Binding];
+            Writes.push_back(Write);
+        }
+    }
+    vkUpdateDescriptorSets(
+        RHI.GetDevice(), static_cast<uint32_t>(Writes.size()), Writes.data(), 0, nullptr);
+
+    CreatePipelines();
+}
+
+FGpuScene::~FGpuScene() {
+    VkDevice Device = RHI.GetDevice();
+    for(VkPipeline Pipeline: {CullPipeline, CompactPipeline}) {
+        if(Pipeline != VK_NULL_HANDLE) { vkDestroyPipeline(Device, Pipeline, nullptr); }
+    }
+    vkDestroyPipelineLayout(Device, CullPipelineLayout, nullptr);
+    vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(Device, DescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Device, CullSetLayout, nullptr);
+    for(FBuffer *Buffer:
+        {&InstanceBuffer, &VisibleBuffer, &DrawSlotBuffer, &SlotTemplateBuffer,
+         &SlotMaterialBuffer, &CompactDrawBuffer, &MaterialCountBuffer,
+         &StagingBuffers[0], &StagingBuffers[1]}) {
+        RHI.DestroyBuffer(*Buffer);
+    }
+}
+
+bool FGpuScene::CreatePipelines() {
+    // Both passes push at most the cull parameters.
+    const VkPushConstantRange PushConstantRange{
+        VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FCullParams)};
+    VkPipelineLayoutCreateInfo LayoutCreateInfo{
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    LayoutCreateInfo.setLayoutCount = 1;
+    LayoutCreateInfo.pSetLayouts = &CullSetLayout;
+    LayoutCreateInfo.pushConstantRangeCount = 1;
+    LayoutCreateInfo.pPushConstantRanges = &PushConstantRange;
+    vk_check(vkCreatePipelineLayout(
+        RHI.GetDevice(), &LayoutCreateInfo, nullptr, &CullPipelineLayout));
+
+    auto CreatePipeline = [this](std::string_view Path) -> VkPipeline {
+        std::vector<uint32_t> Spirv;
+        if(!FShaderCompiler::Get().Compile(Path, EShaderStage::Compute, {}, Spirv)) {
+            return VK_NULL_HANDLE;
+        }
+        VkShaderModule Module = RHI.CreateShaderModule(Spirv);
+        VkPipeline Pipeline = RHI.CreateComputePipeline(Module, CullPipelineLayout);
+        vkDestroyShaderModule(RHI.GetDevice(), Module, nullptr);
+        return Pipeline;
+    };
+    CullPipeline = CreatePipeline("GpuSceneCull.comp");
+    if(RHI.GetCapabilities().bDrawIndirectCount) {
+        CompactPipeline = CreatePipeline("GpuSceneCompact.comp");
+        return CullPipeline != VK_NULL_HANDLE && CompactPipeline != VK_NULL_HANDLE;
+    }
+    return CullPipeline != VK_NULL_HANDLE;
+}
+
+uint32_t FGpuScene::AddMesh(const FGpuSceneMesh &Mesh) {
+    Meshes.push_back(Mesh);
+    return static_cast<uint32_t>(Meshes.size() - 1);
+}
+
+uint32_t FGpuScene::AddInstance(
+    uint32_t MeshId, uint32_t MaterialId, const glm::mat4 &LocalToWorld) {
+    if(MeshId >= Meshes.size() || MaterialId >= MaxMaterials) {
+        RE_LOGE("Cannot add an instance of mesh {} with material {}.", MeshId, MaterialId);
+        return InvalidId;
+    }
+
+    uint32_t InstanceId;
+    if(!FreeInstances.empty()) {
+        InstanceId = FreeInstances.back();
+        FreeInstances.pop_back();
+    } else if(Instances.size() < MaxInstances) {
+        InstanceId = static_cast<uint32_t>(Instances.size());
+        Instances.emplace_back();
+        DirtyFlags.push_back(0);
+    } else {
+        RE_LOGE("The GPU scene is full at {} instances.", MaxInstances);
+        return InvalidId;
+    }
+
+    FGpuSceneInstance &Instance = Instances[InstanceId];
+    Instance.LocalToWorld = LocalToWorld;
+    Instance.BoundingSphere = TransformSphere(LocalToWorld, Meshes[MeshId].BoundingSphere);
+    Instance.DrawSlot = InvalidSlot;
+    Instance.MeshId = MeshId;
+    Instance.MaterialId = MaterialId;
+    InstanceCount++;
+    bSlotsDirty = true;
+    return InstanceId;
+}
+
+void FGpuScene::RemoveInstance(uint32_t InstanceId) {
+    if(InstanceId >= Instances.size() || Instances[InstanceId].MeshId == InvalidId) {
+        return;
+    }
+    Instances[InstanceId].MeshId = InvalidId;
+    Instances[InstanceId].DrawSlot = InvalidSlot;
+    FreeInstances.push_back(InstanceId);
+    InstanceCount--;
+    bSlotsDirty = true;
+}
+
+void FGpuScene::SetTransform(uint32_t InstanceId, const glm::mat4 &LocalToWorld) {
+    if(InstanceId >= Instances.size() || Instances[InstanceId].MeshId == InvalidId) {
+        return;
+    }
+    FGpuSceneInstance &Instance = Instances[InstanceId];
+    Instance.LocalToWorld = LocalToWorld;
+    Instance.BoundingSphere =
+        TransformSphere(LocalToWorld, Meshes[Instance.MeshId].BoundingSphere);
+    if(!DirtyFlags[InstanceId]) {
+        DirtyFlags[InstanceId] = 1;
+        DirtyInstances.push_back(InstanceId);
+    }
+}
+
+void FGpuScene::RebuildSlots() {
+    // Group live instances by material, then mesh.
+    std::vector<std::pair<uint64_t, uint32_t>> Keys;
+    Keys.reserve(InstanceCount);
+    for(uint32_t i = 0; i < Instances.size(); i++) {
+        const FGpuSceneInstance &Instance = Instances[i];
+        if(Instance.MeshId == InvalidId) { continue; }
+        Keys.emplace_back(uint64_t(Instance.MaterialId) << 32 | Instance.MeshId, i);
+    }
+    std::sort(Keys.begin(), Keys.end());
+
+    Slots.clear();
+    std::fill(MaterialRanges.begin(), MaterialRanges.end(), FMaterialRange{});
+    uint32_t FirstInstance = 0;
+    for(size_t i = 0; i < Keys.size(); i++) {
+        const FGpuSceneInstance &Instance = Instances[Keys[i].second];
+        if(i == 0 || Keys[i].first != Keys[i - 1].first) {
+            FMaterialRange &Range = MaterialRanges[Instance.MaterialId];
+            if(Range.SlotCount == 0) {
+                Range.FirstSlot = static_cast<uint32_t>(Slots.size());
+            }
+            Range.SlotCount++;
+            Slots.push_back({Instance.MeshId, Instance.MaterialId, FirstInstance, 0});
+        }
+        Slots.back().InstanceCapacity++;
+        FirstInstance++;
+        Instances[Keys[i].second].DrawSlot = static_cast<uint32_t>(Slots.size() - 1);
+    }
+
+    // Every instance may have a new slot, and freed ones must be marked invalid.
+    DirtyInstances.resize(Instances.size());
+    for(uint32_t i = 0; i < Instances.size(); i++) {
+        DirtyInstances[i] = i;
+        DirtyFlags[i] = 1;
+    }
+    bSlotsDirty = false;
+    bUploadSlots = true;
+}
+
+void FGpuScene::RecordUploads(VkCommandBuffer CommandBuffer, uint32_t Frame) {
+    if(DirtyInstances.empty() && !bUploadSlots) { return; }
+    const FBuffer &Staging = StagingBuffers[Frame % MaxFramesInFlight];
+    auto *StagingData = static_cast<uint8_t *>(Staging.MappedData);
+    const VkDeviceSize TemplateOffset =
+        VkDeviceSize(MaxInstances) * sizeof(FGpuSceneInstance);
+    const VkDeviceSize SlotMaterialOffset =
+        TemplateOffset + VkDeviceSize(MaxInstances) * CommandStride;
+
+    // The previous frame may still read the buffers about to be overwritten.
+    vkCmdPipelineBarrier(
+        CommandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+    // Staging mirrors the instance buffer layout, runs of consecutive ids copy at once.
+    std::sort(DirtyInstances.begin(), DirtyInstances.end());
+    std::vector<VkBufferCopy> Regions;
+    for(uint32_t InstanceId: DirtyInstances) {
+        const VkDeviceSize Offset = VkDeviceSize(InstanceId) * sizeof(FGpuSceneInstance);
+        std::memcpy(
+            StagingData + Offset, &Instances[InstanceId], sizeof(FGpuSceneInstance));
+        DirtyFlags[InstanceId] = 0;
+        if(!Regions.empty() && Regions.back().srcOffset + Regions.back().size == Offset) {
+            Regions.back().size += sizeof(FGpuSceneInstance);
+        } else {
+            Regions.push_back({Offset, Offset, sizeof(FGpuSceneInstance)});
+        }
+    }
+    DirtyInstances.clear();
+    if(!Regions.empty()) {
+        vkCmdCopyBuffer(
+            CommandBuffer, Staging.Buffer, InstanceBuffer.Buffer,
+            static_cast<uint32_t>(Regions.size()), Regions.data());
+    }
+
+    if(bUploadSlots && !Slots.empty()) {
+        auto *Templates =
+            reinterpret_cast<VkDrawIndexedIndirectCommand *>(StagingData + TemplateOffset);
+        auto *SlotMaterials =
+            reinterpret_cast<glm::uvec2 *>(StagingData + SlotMaterialOffset);
+        for(size_t i = 0; i < Slots.size(); i++) {
+            const FDrawSlot &Slot = Slots[i];
+            const FGpuSceneMesh &Mesh = Meshes[Slot.MeshId];
+            Templates[i] = {
+                Mesh.IndexCount, 0, Mesh.FirstIndex, Mesh.VertexOffset, Slot.FirstInstance};
+            SlotMaterials[i] =
+                glm::uvec2(Slot.MaterialId, MaterialRanges[Slot.MaterialId].FirstSlot);
+        }
+        const VkBufferCopy TemplateRegion{TemplateOffset, 0, Slots.size() * CommandStride};
+        vkCmdCopyBuffer(
+            CommandBuffer, Staging.Buffer, SlotTemplateBuffer.Buffer, 1, &TemplateRegion);
+        if(SlotMaterialBuffer.IsValid()) {
+            const VkBufferCopy MaterialRegion{
+                SlotMaterialOffset, 0, Slots.size() * sizeof(glm::uvec2)};
+            vkCmdCopyBuffer(
+                CommandBuffer, Staging.Buffer, SlotMaterialBuffer.Buffer, 1,
+                &MaterialRegion);
+        }
+    }
+    bUploadSlots = false;
+
+    VkMemoryBarrier UploadBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    UploadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    UploadBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+        0, 1, &UploadBarrier, 0, nullptr, 0, nullptr);
+}
+
+void FGpuScene::Update(
+    VkCommandBuffer CommandBuffer, const glm::mat4 &WorldToClip, uint32_t Frame) {
+    if(CullPipeline == VK_NULL_HANDLE) { return; }
+    if(bSlotsDirty) { RebuildSlots(); }
+    RecordUploads(CommandBuffer, Frame);
+    if(Slots.empty()) { return; }
+    const auto SlotCount = static_cast<uint32_t>(Slots.size());
+
+    // Reset the instance counts, waiting for the previous frame's draws to read them.
+    vkCmdPipelineBarrier(
+        CommandBuffer,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+        nullptr, 0, nullptr, 0, nullptr);
+    const VkBufferCopy ResetRegion{0, 0, SlotCount * CommandStride};
+    vkCmdCopyBuffer(
+        CommandBuffer, SlotTemplateBuffer.Buffer, DrawSlotBuffer.Buffer, 1, &ResetRegion);
+    if(CompactPipeline != VK_NULL_HANDLE) {
+        vkCmdFillBuffer(
+            CommandBuffer, MaterialCountBuffer.Buffer, 0,
+            VkDeviceSize(MaxMaterials) * sizeof(uint32_t), 0);
+    }
+    VkMemoryBarrier ResetBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    ResetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    ResetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &ResetBarrier, 0, nullptr, 0,
+        nullptr);
+
+    FCullParams Params{};
+    ExtractFrustumPlanes(WorldToClip, Params.FrustumPlanes);
+    Params.InstanceCount = static_cast<uint32_t>(Instances.size());
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, CullPipeline);
+    vkCmdBindDescriptorSets(
+        CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, CullPipelineLayout, 0, 1, &CullSet,
+        0, nullptr);
+    vkCmdPushConstants(
+        CommandBuffer, CullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Params),
+        &Params);
+    vkCmdDispatch(
+        CommandBuffer, (Params.InstanceCount + CullGroupSize - 1) / CullGroupSize, 1, 1);
+
+    VkMemoryBarrier CullBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    CullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    CullBarrier.dstAccessMask =
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    if(CompactPipeline != VK_NULL_HANDLE) {
+        vkCmdPipelineBarrier(
+            CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &CullBarrier, 0, nullptr, 0,
+            nullptr);
+        vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, CompactPipeline);
+        vkCmdPushConstants(
+            CommandBuffer, CullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+            sizeof(uint32_t), &SlotCount);
+        vkCmdDispatch(CommandBuffer, (SlotCount + CullGroupSize - 1) / CullGroupSize, 1, 1);
+    }
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1,
+        &CullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void FGpuScene::DrawMaterial(VkCommandBuffer CommandBuffer, uint32_t MaterialId) const {
+    if(MaterialId >= MaxMaterials || MaterialRanges[MaterialId].SlotCount == 0) { return; }
+    const FMaterialRange &Range = MaterialRanges[MaterialId];
+    const VkDeviceSize Offset = Range.FirstSlot * CommandStride;
+    constexpr auto Stride = static_cast<uint32_t>(CommandStride);
+
+    const FRHICapabilities &Capabilities = RHI.GetCapabilities();
+    if(CompactPipeline != VK_NULL_HANDLE) {
+        vkCmdDrawIndexedIndirectCountKHR(
+            CommandBuffer, CompactDrawBuffer.Buffer, Offset, MaterialCountBuffer.Buffer,
+            MaterialId * sizeof(uint32_t), Range.SlotCount, Stride);
+    } else if(Capabilities.bMultiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(
+            CommandBuffer, DrawSlotBuffer.Buffer, Offset, Range.SlotCount, Stride);
+    } else {
+        for(uint32_t i = 0; i < Range.SlotCount; i++) {
+            vkCmdDrawIndexedIndirect(
+                CommandBuffer, DrawSlotBuffer.Buffer, Offset + i * CommandStride, 1,
+                Stride);
+        }
+    }
+}
+}
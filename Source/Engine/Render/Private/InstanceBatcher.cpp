@@ -0,0 +1,216 @@
+﻿#include "Render/InstanceBatcher.h"
+#include "Core/Logging.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace RE {
+namespace {
+// Batches start with room to grow before their first move.
+constexpr uint32_t MinBatchCapacity = 16;
+}
+
+bool FInstanceBatcher::FBatchKey::operator==(const FBatchKey &Other) const {
+    return std::memcmp(this, &Other, sizeof(FBatchKey)) == 0;
+}
+
+size_t FInstanceBatcher::FBatchKeyHash::operator()(const FBatchKey &Key) const {
+    // FNV-1a over the whole key, which is free of padding.
+    uint64_t Hash = 0xcbf29ce484222325ull;
+    const auto *Bytes = reinterpret_cast<const uint8_t *>(&Key);
+    for(size_t i = 0; i < sizeof(FBatchKey); i++) {
+        Hash ^= Bytes[i];
+        Hash *= 0x100000001b3ull;
+    }
+    return static_cast<size_t>(Hash);
+}
+
+FInstanceBatcher::FInstanceBatcher(FRHI &RHI, uint32_t MaxInstances)
+    : RHI(RHI), MaxInstances(MaxInstances) {
+    Instances.reserve(MaxInstances);
+    for(FBuffer &Buffer: InstanceBuffers) {
+        Buffer = RHI.CreateBuffer(
+            VkDeviceSize(MaxInstances) * sizeof(glm::mat4),
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    }
+}
+
+FInstanceBatcher::~FInstanceBatcher() {
+    for(FBuffer &Buffer: InstanceBuffers) {
+        RHI.DestroyBuffer(Buffer);
+    }
+}
+
+uint32_t FInstanceBatcher::AddInstance(
+    uint64_t Key, const FDrawCommand &Command, const glm::mat4 &LocalToWorld) {
+    if(InstanceCount == MaxInstances) {
+        RE_LOGE("The instance batcher is full at {} instances.", MaxInstances);
+        return InvalidId;
+    }
+
+    FBatchKey BatchKey{};
+    BatchKey.SortKey = Key;
+    BatchKey.Pipeline = Command.Pipeline;
+    BatchKey.PipelineLayout = Command.PipelineLayout;
+    std::copy(
+        std::begin(Command.DescriptorSets), std::end(Command.DescriptorSets),
+        BatchKey.DescriptorSets);
+    BatchKey.VertexBuffer = Command.VertexBuffer;
+    BatchKey.VertexBufferOffset = Command.VertexBufferOffset;
+    BatchKey.IndexBuffer = Command.IndexBuffer;
+    BatchKey.IndexCount = Command.IndexCount;
+    BatchKey.FirstIndex = Command.FirstIndex;
+    BatchKey.VertexOffset = Command.VertexOffset;
+
+    auto [It, bInserted] =
+        BatchLookup.try_emplace(BatchKey, static_cast<uint32_t>(Batches.size()));
+    if(bInserted) {
+        FBatch &NewBatch = Batches.emplace_back();
+        NewBatch.Command = Command;
+        NewBatch.SortKey = Key;
+    }
+    const uint32_t BatchIndex = It->second;
+    FBatch &Batch = Batches[BatchIndex];
+    if(Batch.Instances.size() == Batch.Capacity) {
+        AllocateSlots(Batch, std::max(Batch.Capacity * 2, MinBatchCapacity));
+    }
+
+    uint32_t InstanceId;
+    if(!FreeInstances.empty()) {
+        InstanceId = FreeInstances.back();
+        FreeInstances.pop_back();
+    } else {
+        InstanceId = static_cast<uint32_t>(Instances.size());
+        Instances.emplace_back();
+    }
+    if(Batch.Instances.empty()) { BatchCount++; }
+
+    FInstance &Instance = Instances[InstanceId];
+    Instance.LocalToWorld = LocalToWorld;
+    Instance.Batch = BatchIndex;
+    Instance.IndexInBatch = static_cast<uint32_t>(Batch.Instances.size());
+    Batch.Instances.push_back(InstanceId);
+    InstanceCount++;
+    MarkDirty(InstanceId);
+    return InstanceId;
+}
+
+void FInstanceBatcher::RemoveInstance(uint32_t InstanceId) {
+    if(InstanceId >= Instances.size() || Instances[InstanceId].Batch == InvalidId) {
+        return;
+    }
+    FInstance &Instance = Instances[InstanceId];
+    FBatch &Batch = Batches[Instance.Batch];
+
+    // The last instance of the batch fills the hole, so only its slot is rewritten.
+    const uint32_t Last = Batch.Instances.back();
+    Batch.Instances[Instance.IndexInBatch] = Last;
+    Batch.Instances.pop_back();
+    if(Last != InstanceId) {
+        Instances[Last].IndexInBatch = Instance.IndexInBatch;
+        MarkDirty(Last);
+    }
+    // An empty batch gives up its range, compaction reclaims it.
+    if(Batch.Instances.empty()) {
+        Batch.Capacity = 0;
+        BatchCount--;
+    }
+
+    Instance.Batch = InvalidId;
+    FreeInstances.push_back(InstanceId);
+    InstanceCount--;
+}
+
+void FInstanceBatcher::SetTransform(uint32_t InstanceId, const glm::mat4 &LocalToWorld) {
+    if(InstanceId >= Instances.size() || Instances[InstanceId].Batch == InvalidId) {
+        return;
+    }
+    Instances[InstanceId].LocalToWorld = LocalToWorld;
+    MarkDirty(InstanceId);
+}
+
+void FInstanceBatcher::MarkDirty(uint32_t InstanceId) {
+    FInstance &Instance = Instances[InstanceId];
+    for(uint32_t Frame = 0; Frame < MaxFramesInFlight; Frame++) {
+        if(Instance.DirtyFrames & (1u << Frame)) { continue; }
+        Instance.DirtyFrames |= 1u << Frame;
+        DirtyInstances[Frame].push_back(InstanceId);
+    }
+}
+
+void FInstanceBatcher::AllocateSlots(FBatch &Batch, uint32_t Capacity) {
+    // The last range grows in place and keeps its slots.
+    if(Batch.Capacity > 0 && Batch.FirstSlot + Batch.Capacity == SlotEnd &&
+       Batch.FirstSlot + Capacity <= MaxInstances) {
+        SlotEnd = Batch.FirstSlot + Capacity;
+        Batch.Capacity = Capacity;
+        return;
+    }
+    if(SlotEnd + Capacity > MaxInstances) {
+        // Leave the batch out of compaction, its instances move to the end below.
+        Batch.Capacity = 0;
+        CompactSlots();
+        // Fewer instances than MaxInstances are live, so there is room for one more.
+        Capacity = std::min(Capacity, MaxInstances - SlotEnd);
+        checkf(Capacity > Batch.Instances.size(), "Instance slots leaked.");
+    }
+    Batch.FirstSlot = SlotEnd;
+    Batch.Capacity = Capacity;
+    SlotEnd += Capacity;
+    for(uint32_t InstanceId: Batch.Instances) {
+        MarkDirty(InstanceId);
+    }
+}
+
+void FInstanceBatcher::CompactSlots() {
+    // Ranges keep their order, so each one moves down or stays.
+    std::vector<uint32_t> Order;
+    for(uint32_t i = 0; i < Batches.size(); i++) {
+        if(Batches[i].Capacity > 0) { Order.push_back(i); }
+    }
+    std::sort(Order.begin(), Order.end(), [this](uint32_t A, uint32_t B) {
+        return Batches[A].FirstSlot < Batches[B].FirstSlot;
+    });
+
+    SlotEnd = 0;
+    for(uint32_t BatchIndex: Order) {
+        FBatch &Batch = Batches[BatchIndex];
+        const bool bMoved = Batch.FirstSlot != SlotEnd;
+        Batch.FirstSlot = SlotEnd;
+        Batch.Capacity = static_cast<uint32_t>(Batch.Instances.size());
+        SlotEnd += Batch.Capacity;
+        if(!bMoved) { continue; }
+        for(uint32_t InstanceId: Batch.Instances) {
+            MarkDirty(InstanceId);
+        }
+    }
+    RE_LOGD("Compacted instance batches to {} of {} slots.", SlotEnd, MaxInstances);
+}
+
+void FInstanceBatcher::AddDraws(FDrawList &DrawList, uint32_t Frame) {
+    const uint32_t FrameIndex = Frame % MaxFramesInFlight;
+    const FBuffer &Buffer = InstanceBuffers[FrameIndex];
+    auto *Transforms = static_cast<glm::mat4 *>(Buffer.MappedData);
+
+    std::vector<uint32_t> &Dirty = DirtyInstances[FrameIndex];
+    LastWriteCount = 0;
+    for(uint32_t InstanceId: Dirty) {
+        FInstance &Instance = Instances[InstanceId];
+        Instance.DirtyFrames &= ~(1u << FrameIndex);
+        if(Instance.Batch == InvalidId) { continue; }
+        const FBatch &Batch = Batches[Instance.Batch];
+        Transforms[Batch.FirstSlot + Instance.IndexInBatch] = Instance.LocalToWorld;
+        LastWriteCount++;
+    }
+    Dirty.clear();
+
+    for(const FBatch &Batch: Batches) {
+        if(Batch.Instances.empty()) { continue; }
+        FDrawCommand Command = Batch.Command;
+        Command.InstanceBuffer = Buffer.Buffer;
+        Command.InstanceCount = static_cast<uint32_t>(Batch.Instances.size());
+        Command.FirstInstance = Batch.FirstSlot;
+        DrawList.Add(Batch.SortKey, Command);
+    }
+}
+}
@@ -0,0 +1,90 @@
+﻿#include "Render/LodSelection.h"
+#include "Core/Logging.h"
+#include "Core/TaskSystem.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace RE {
+FLodView FLodView::FromPerspective(
+    const glm::vec3 &Position, const glm::mat4 &ViewToClip, float ViewportHeight) {
+    // P[1][1] is the cotangent of half the vertical field of view.
+    return {Position, std::abs(ViewToClip[1][1]) * ViewportHeight * 0.5f};
+}
+
+uint32_t FLodSelector::AddMesh(std::span<const float> LodErrors) {
+    checkf(!LodErrors.empty() && LodErrors.size() <= MaxLods, "Invalid LOD count {}",
+           LodErrors.size());
+    const uint32_t Index = static_cast<uint32_t>(Meshes.size());
+    Meshes.push_back(
+        {static_cast<uint32_t>(Errors.size()), static_cast<uint32_t>(LodErrors.size())});
+    Errors.insert(Errors.end(), LodErrors.begin(), LodErrors.end());
+    return Index;
+}
+
+uint32_t FLodSelector::AddInstance(
+    uint32_t Mesh, const glm::vec3 &Center, float Radius, float Scale) {
+    checkf(Mesh < Meshes.size(), "Invalid mesh {}", Mesh);
+    const uint32_t Index = static_cast<uint32_t>(Instances.size());
+    Instances.push_back({Center, Radius, Scale, Mesh});
+    States.emplace_back();
+    return Index;
+}
+
+void FLodSelector::SetInstance(
+    uint32_t Instance, const glm::vec3 &Center, float Radius, float Scale) {
+    FInstance &Target = Instances[Instance];
+    Target.Center = Center;
+    Target.Radius = Radius;
+    Target.Scale = Scale;
+}
+
+void FLodSelector::Clear() {
+    Meshes.clear();
+    Errors.clear();
+    Instances.clear();
+    States.clear();
+}
+
+uint32_t FLodSelector::SelectLod(
+    const FInstance &Instance, const FLodView &View, uint32_t Current) const {
+    const FMesh &Mesh = Meshes[Instance.Mesh];
+    // Inside the sphere any error may fill the screen.
+    const float Distance = glm::length(Instance.Center - View.Position) - Instance.Radius;
+    if(Distance <= 0.0f) { return 0; }
+
+    const float PixelsPerUnit = Instance.Scale * View.ProjectionScale / Distance;
+    const float Threshold = Settings.PixelErrorThreshold / PixelsPerUnit;
+    const float CoarseThreshold = Threshold * (1.0f - Settings.Hysteresis);
+    const float *LodErrors = Errors.data() + Mesh.ErrorOffset;
+
+    // Errors grow along the chain, so both searches stop at the first level over.
+    uint32_t Fine = 0;
+    uint32_t Coarse = 0;
+    for(uint32_t Lod = 1; Lod < Mesh.LodCount && LodErrors[Lod] <= Threshold; Lod++) {
+        Fine = Lod;
+        if(LodErrors[Lod] <= CoarseThreshold) { Coarse = Lod; }
+    }
+    if(Current > Fine) { return Fine; }
+    return std::max(Current, Coarse);
+}
+
+void FLodSelector::Update(const FLodView &View, float DeltaTime) {
+    const float FadeStep =
+        Settings.FadeDuration > 0.0f ? DeltaTime / Settings.FadeDuration : 1.0f;
+    const uint32_t Count = GetInstanceCount();
+    FTaskSystem::Get().ParallelFor(Count, BatchSize, [&](uint32_t First, uint32_t Last) {
+        for(uint32_t i = First; i < Last; i++) {
+            FLodState &State = States[i];
+            const uint32_t Lod = SelectLod(Instances[i], View, State.Lod);
+            if(Lod != State.Lod) {
+                // A change in the middle of a fade restarts it from the level on screen.
+                State.PreviousLod = State.Lod;
+                State.Lod = static_cast<uint8_t>(Lod);
+                State.Fade = 0.0f;
+            }
+            State.Fade = std::min(State.Fade + FadeStep, 1.0f);
+        }
+    });
+}
+}
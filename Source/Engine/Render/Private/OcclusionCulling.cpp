@@ -0,0 +1,351 @@
+﻿#include "Render/OcclusionCulling.h"
+#include "Render/DepthPyramid.h"
+#include "RHI/ShaderCompiler.h"
+
+#include <cstring>
+#include <iterator>
+#include <string>
+
+namespace RE {
+namespace {
+// Mirrors FOcclusionView in Shaders/OcclusionCull.comp, std140.
+struct FGpuOcclusionView {
+    glm::vec4 FrustumPlanes[6];
+    glm::mat4 PyramidWorldToView;
+    glm::vec4 Projection;
+    glm::vec4 PyramidParams;
+    uint32_t InstanceCount;
+    uint32_t Flags;
+    uint32_t CommandBase;
+    uint32_t Phase;
+};
+
+enum EOcclusionFlags : uint32_t {
+    OcclusionFlag_Frustum = 1 << 0,
+    OcclusionFlag_Occlusion = 1 << 1,
+};
+
+enum EOcclusionBinding : uint32_t {
+    Binding_View,
+    Binding_Instances,
+    Binding_Visibility,
+    Binding_DrawCommands,
+    Binding_DrawCount,
+    Binding_DepthPyramid,
+    Binding_Count
+};
+
+constexpr uint32_t CullGroupSize = 64;
+constexpr uint32_t PhaseCount = 2;
+
+// Gribb and Hartmann, planes point inwards and are normalized for sphere tests.
+void ExtractFrustumPlanes(const glm::mat4 &WorldToClip, glm::vec4 OutPlanes[6]) {
+    const glm::mat4 Rows = glm::transpose(WorldToClip);
+    OutPlanes[0] = Rows[3] + Rows[0];
+    OutPlanes[1] = Rows[3] - Rows[0];
+    OutPlanes[2] = Rows[3] + Rows[1];
+    OutPlanes[3] = Rows[3] - Rows[1];
+    OutPlanes[4] = Rows[2];
+    OutPlanes[5] = Rows[3] - Rows[2];
+    for(int i = 0; i < 6; i++) {
+        OutPlanes[i] /= glm::length(glm::vec3(OutPlanes[i]));
+    }
+}
+}
+
+FOcclusionCuller::FOcclusionCuller(FRHI &RHI): RHI(RHI) {
+    if(!RHI.GetCapabilities().bDrawIndirectFirstInstance) {
+        RE_LOGW("drawIndirectFirstInstance is unsupported, instances will draw wrong.");
+    }
+}
+
+FOcclusionCuller::~FOcclusionCuller() {
+    VkDevice Device = RHI.GetDevice();
+    for(VkPipeline Pipeline: {EarlyPipeline, LatePipeline}) {
+        if(Pipeline != VK_NULL_HANDLE) { vkDestroyPipeline(Device, Pipeline, nullptr); }
+    }
+    if(PipelineLayout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
+    }
+    if(DescriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+    }
+    if(DescriptorSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(Device, DescriptorSetLayout, nullptr);
+    }
+    for(FBuffer *Buffer:
+        {&ViewBuffer, &InstanceBuffer, &VisibilityBuffer, &DrawCommandBuffer,
+         &DrawCountBuffer}) {
+        RHI.DestroyBuffer(*Buffer);
+    }
+}
+
+uint32_t FOcclusionCuller::AddInstance(const FOcclusionInstance &Instance) {
+    if(bBuilt) {
+        RE_LOGE("Cannot add instances after the occlusion culler was built.");
+        return InvalidId;
+    }
+    Instances.push_back(
+        {Instance.BoundingSphere, Instance.FirstIndex, Instance.IndexCount,
+         Instance.VertexOffset, 0});
+    return static_cast<uint32_t>(Instances.size() - 1);
+}
+
+bool FOcclusionCuller::Build() {
+    if(bBuilt) { return true; }
+    if(Instances.empty()) {
+        RE_LOGE("Occlusion culler has no instances to draw.");
+        return false;
+    }
+
+    constexpr VkBufferUsageFlags Storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    const VkDeviceSize InstanceSize = Instances.size() * sizeof(FGpuOcclusionInstance);
+    InstanceBuffer = RHI.CreateBuffer(
+        InstanceSize, Storage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    RHI.UploadBuffer(InstanceBuffer, Instances.data(), InstanceSize);
+
+    VisibilityBuffer = RHI.CreateBuffer(
+        Instances.size() * sizeof(uint32_t), Storage, VMA_MEMORY_USAGE_GPU_ONLY);
+    DrawCommandBuffer = RHI.CreateBuffer(
+        PhaseCount * Instances.size() * sizeof(VkDrawIndexedIndirectCommand),
+        Storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    DrawCountBuffer = RHI.CreateBuffer(
+        PhaseCount * sizeof(uint32_t),
+        Storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+
+    const VkDeviceSize Alignment =
+        RHI.GetPhysicalDeviceProperties().limits.minUniformBufferOffsetAlignment;
+    ViewStride = (sizeof(FGpuOcclusionView) + Alignment - 1) / Alignment * Alignment;
+    ViewBuffer = RHI.CreateBuffer(
+        ViewStride * MaxFramesInFlight * PhaseCount, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+    const VkDescriptorSetLayoutBinding Bindings[] = {
+        {Binding_View, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1,
+         VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+        {Binding_Instances, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+         VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+        {Binding_Visibility, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+         VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+        {Binding_DrawCommands, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+         VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+        {Binding_DrawCount, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+         VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+        {Binding_DepthPyramid, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+         VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+    };
+    VkDescriptorSetLayoutCreateInfo LayoutCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    LayoutCreateInfo.bindingCount = static_cast<uint32_t>(std::size(Bindings));
+    LayoutCreateInfo.pBindings = Bindings;
+    vk_check(vkCreateDescriptorSetLayout(
+        RHI.GetDevice(), &LayoutCreateInfo, nullptr, &DescriptorSetLayout));
+
+    const VkDescriptorPoolSize PoolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+    };
+    VkDescriptorPoolCreateInfo PoolCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    PoolCreateInfo.maxSets = 1;
+    PoolCreateInfo.poolSizeCount = static_cast<uint32_t>(std::size(PoolSizes));
+    PoolCreateInfo.pPoolSizes = PoolSizes;
+    vk_check(vkCreateDescriptorPool(
+        RHI.GetDevice(), &PoolCreateInfo, nullptr, &DescriptorPool));
+
+    VkDescriptorSetAllocateInfo AllocateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    AllocateInfo.descriptorPool = DescriptorPool;
+    AllocateInfo.descriptorSetCount = 1;
+    AllocateInfo.pSetLayouts = &DescriptorSetLayout;
+    vk_check(vkAllocateDescriptorSets(RHI.GetDevice(), &AllocateInfo, &DescriptorSet));
+
+    VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo{
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    PipelineLayoutCreateInfo.setLayoutCount = 1;
+    PipelineLayoutCreateInfo.pSetLayouts = &DescriptorSetLayout;
+    vk_check(vkCreatePipelineLayout(
+        RHI.GetDevice(), &PipelineLayoutCreateInfo, nullptr, &PipelineLayout));
+
+    bBuilt = true;
+    RE_LOGI("Occlusion culler: {} instances.", Instances.size());
+    SetDepthPyramid(Pyramid);
+    return EarlyPipeline != VK_NULL_HANDLE && LatePipeline != VK_NULL_HANDLE;
+}
+
+void FOcclusionCuller::SetDepthPyramid(const FDepthPyramid *InPyramid) {
+    Pyramid = InPyramid && InPyramid->IsValid() ? InPyramid : nullptr;
+    bHasHistory = false;
+    if(!bBuilt) { return; }
+    WriteDescriptors();
+
+    VkDevice Device = RHI.GetDevice();
+    std::vector<std::string> Defines;
+    if(RHI.GetCapabilities().bDrawIndirectCount) {
+        Defines.emplace_back("RE_OCCLUSION_COMPACT");
+    }
+    if(Pyramid) { Defines.emplace_back("RE_OCCLUSION_PYRAMID"); }
+    for(VkPipeline *Pipeline: {&EarlyPipeline, &LatePipeline}) {
+        if(*Pipeline != VK_NULL_HANDLE) { vkDestroyPipeline(Device, *Pipeline, nullptr); }
+        *Pipeline = VK_NULL_HANDLE;
+
+        std::vector<uint32_t> Spirv;
+        if(!FShaderCompiler::Get().Compile(
+               "OcclusionCull.comp", EShaderStage::Compute, Defines, Spirv)) {
+            return;
+        }
+        VkShaderModule Module = RHI.CreateShaderModule(Spirv);
+        *Pipeline = RHI.CreateComputePipeline(Module, PipelineLayout);
+        vkDestroyShaderModule(Device, Module, nullptr);
+        // The late variant only differs by its define.
+        Defines.emplace_back("RE_OCCLUSION_LATE");
+    }
+}
+
+void FOcclusionCuller::WriteDescriptors() {
+    const VkDescriptorBufferInfo BufferInfos[] = {
+        {ViewBuffer.Buffer, 0, sizeof(FGpuOcclusionView)},
+        {InstanceBuffer.Buffer, 0, VK_WHOLE_SIZE},
+        {VisibilityBuffer.Buffer, 0, VK_WHOLE_SIZE},
+        {DrawCommandBuffer.Buffer, 0, VK_WHOLE_SIZE},
+        {DrawCountBuffer.Buffer, 0, VK_WHOLE_SIZE},
+    };
+    std::vector<VkWriteDescriptorSet> Writes;
+    for(uint32_t Binding = Binding_View; Binding < Binding_DepthPyramid; Binding++) {
+        VkWriteDescriptorSet Write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        Write.dstSet = DescriptorSet;
+        Write.dstBinding = Binding;
+        Write.descriptorCount = 1;
+        Write.descriptorType = Binding == Binding_View
+                                   ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+                                   : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        Write.pBufferInfo = &BufferInfos[Binding];
+        Writes.push_back(Write);
+    }
+
+    VkDescriptorImageInfo ImageInfo{};
+    if(Pyramid) {
+        ImageInfo = {
+            Pyramid->GetSampler(), Pyramid->GetView(),
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        VkWriteDescriptorSet Write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        Write.dstSet = DescriptorSet;
+        Write.dstBinding = Binding_DepthPyramid;
+        Write.descriptorCount = 1;
+        Write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        Write.pImageInfo = &ImageInfo;
+        Writes.push_back(Write);
+    }
+    vkUpdateDescriptorSets(
+        RHI.GetDevice(), static_cast<uint32_t>(Writes.size()), Writes.data(), 0, nullptr);
+}
+
+void FOcclusionCuller::Cull(
+    VkCommandBuffer CommandBuffer, const FOcclusionView &View, EOcclusionPhase Phase,
+    uint32_t Frame) {
+    VkPipeline Pipeline = Phase == EOcclusionPhase::Early ? EarlyPipeline : LatePipeline;
+    if(Pipeline == VK_NULL_HANDLE) { return; }
+    const auto PhaseIndex = static_cast<uint32_t>(Phase);
+
+    // The early phase sees the previous frame's depth, seen from the previous camera.
+    const FOcclusionView &PyramidView =
+        Phase == EOcclusionPhase::Early ? HistoryView : View;
+    const glm::mat4 &Projection = PyramidView.ViewToClip;
+    FGpuOcclusionView GpuView{};
+    ExtractFrustumPlanes(View.ViewToClip * View.WorldToView, GpuView.FrustumPlanes);
+    GpuView.PyramidWorldToView = PyramidView.WorldToView;
+    // The near plane distance of a 0..1 depth perspective projection is P32 / P22.
+    GpuView.Projection = glm::vec4(
+        Projection[0][0], Projection[1][1], Projection[3][2] / Projection[2][2], 0.0f);
+    if(Pyramid) {
+        GpuView.PyramidParams = glm::vec4(
+            Projection[2][2], Projection[3][2], float(Pyramid->GetSize().width),
+            float(Pyramid->GetSize().height));
+    }
+    GpuView.InstanceCount = GetInstanceCount();
+    GpuView.Flags = View.bFrustumCulling ? uint32_t(OcclusionFlag_Frustum) : 0u;
+    if(Pyramid && (Phase == EOcclusionPhase::Late || bHasHistory)) {
+        GpuView.Flags |= OcclusionFlag_Occlusion;
+    }
+    GpuView.CommandBase = PhaseIndex * GetInstanceCount();
+    GpuView.Phase = PhaseIndex;
+
+    const VkDeviceSize ViewOffset =
+        ViewStride * ((Frame % MaxFramesInFlight) * PhaseCount + PhaseIndex);
+    std::memcpy(
+        static_cast<uint8_t *>(ViewBuffer.MappedData) + ViewOffset, &GpuView,
+        sizeof(GpuView));
+    if(Phase == EOcclusionPhase::Late) {
+        HistoryView = View;
+        bHasHistory = Pyramid != nullptr;
+    }
+
+    // Commands and counts are rewritten while the previous frame may still draw them, and
+    // the late phase reads the visibility the early phase wrote.
+    VkMemoryBarrier ReuseBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    ReuseBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    ReuseBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(
+        CommandBuffer,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+        &ReuseBarrier, 0, nullptr, 0, nullptr);
+
+    if(RHI.GetCapabilities().bDrawIndirectCount) {
+        vkCmdFillBuffer(
+            CommandBuffer, DrawCountBuffer.Buffer, PhaseIndex * sizeof(uint32_t),
+            sizeof(uint32_t), 0);
+        VkMemoryBarrier FillBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        FillBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        FillBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &FillBarrier, 0, nullptr, 0,
+            nullptr);
+    }
+
+    const auto DynamicOffset = static_cast<uint32_t>(ViewOffset);
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipeline);
+    vkCmdBindDescriptorSets(
+        CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, 0, 1,
+        &DescriptorSet, 1, &DynamicOffset);
+    vkCmdDispatch(
+        CommandBuffer, (GetInstanceCount() + CullGroupSize - 1) / CullGroupSize, 1, 1);
+
+    VkMemoryBarrier CullBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    CullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    CullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &CullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void FOcclusionCuller::Draw(VkCommandBuffer CommandBuffer, EOcclusionPhase Phase) {
+    if(!bBuilt) { return; }
+    constexpr uint32_t Stride = sizeof(VkDrawIndexedIndirectCommand);
+    const auto PhaseIndex = static_cast<uint32_t>(Phase);
+    const VkDeviceSize CommandOffset =
+        VkDeviceSize(PhaseIndex) * GetInstanceCount() * Stride;
+
+    const FRHICapabilities &Capabilities = RHI.GetCapabilities();
+    if(Capabilities.bDrawIndirectCount) {
+        vkCmdDrawIndexedIndirectCountKHR(
+            CommandBuffer, DrawCommandBuffer.Buffer, CommandOffset,
+            DrawCountBuffer.Buffer, PhaseIndex * sizeof(uint32_t), GetInstanceCount(),
+            Stride);
+    } else if(Capabilities.bMultiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(
+            CommandBuffer, DrawCommandBuffer.Buffer, CommandOffset, GetInstanceCount(),
+            Stride);
+    } else {
+        for(uint32_t i = 0; i < GetInstanceCount(); i++) {
+            vkCmdDrawIndexedIndirect(
+                CommandBuffer, DrawCommandBuffer.Buffer,
+                CommandOffset + VkDeviceSize(i) * Stride, 1, Stride);
+        }
+    }
+}
+}
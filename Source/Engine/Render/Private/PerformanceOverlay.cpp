@@ -0,0 +1,495 @@
+﻿#include "Render/PerformanceOverlay.h"
+#include "Core/Profiler.h"
+#include "RHI/GpuProfiler.h"
+#include "RHI/ShaderCompiler.h"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <span>
+
+namespace RE {
+namespace {
+// Mirrors FOverlayConstants in Shaders/Overlay.vert.
+struct FOverlayConstants {
+    float Scale[2];
+    float Translate[2];
+};
+
+constexpr float MiB = 1.0f / float(1 << 20);
+// The time graphs never scale below a 30 Hz frame.
+constexpr float MinGraphScale = 33.3f;
+
+bool IsSrgbFormat(VkFormat Format) {
+    switch(Format) {
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_A8B8G8R8_SRGB_PACK32:
+        return true;
+    default:
+        return false;
+    }
+}
+
+VkShaderModule CompileShader(FRHI &RHI, const char *Path, EShaderStage Stage, bool bSrgb) {
+    std::vector<std::string> Defines;
+    if(bSrgb) { Defines.emplace_back("RE_OVERLAY_SRGB_TARGET"); }
+    std::vector<uint32_t> Spirv;
+    if(!FShaderCompiler::Get().Compile(Path, Stage, Defines, Spirv)) {
+        RE_LOGE("The overlay shader {} failed to compile.", Path);
+        return VK_NULL_HANDLE;
+    }
+    return RHI.CreateShaderModule(Spirv);
+}
+
+void AverageAndMax(std::span<const float> Times, float &OutAverage, float &OutMax) {
+    float Sum = 0.0f;
+    OutMax = 0.0f;
+    for(float Time: Times) {
+        Sum += Time;
+        OutMax = std::max(OutMax, Time);
+    }
+    OutAverage = Sum / float(Times.size());
+}
+}
+
+FPerformanceOverlay::FPerformanceOverlay(
+    FRHI &RHI, VkRenderPass RenderPass, uint32_t Subpass, VkFormat TargetFormat)
+    : RHI(RHI) {
+    ImGuiContext *PreviousContext = ImGui::GetCurrentContext();
+    Context = ImGui::CreateContext();
+    ImGuiIO &IO = ImGui::GetIO();
+    IO.IniFilename = nullptr;
+    IO.BackendRendererName = "RelightEngine";
+
+    CreateFontAtlas();
+    CreatePipeline(RenderPass, Subpass, IsSrgbFormat(TargetFormat));
+    ImGui::SetCurrentContext(PreviousContext);
+}
+
+FPerformanceOverlay::~FPerformanceOverlay() {
+    SetVisible(false);
+    VkDevice Device = RHI.GetDevice();
+    for(uint32_t i = 0; i < MaxFramesInFlight; i++) {
+        RHI.DestroyBuffer(VertexBuffers[i]);
+        RHI.DestroyBuffer(IndexBuffers[i]);
+    }
+    if(Pipeline != VK_NULL_HANDLE) { vkDestroyPipeline(Device, Pipeline, nullptr); }
+    vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
+    vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(Device, DescriptorSetLayout, nullptr);
+    vkDestroySampler(Device, FontSampler, nullptr);
+    vkDestroyImageView(Device, FontView, nullptr);
+    RHI.DestroyImage(FontImage);
+    ImGui::DestroyContext(Context);
+}
+
+void FPerformanceOverlay::CreateFontAtlas() {
+    VkDevice Device = RHI.GetDevice();
+    ImGuiIO &IO = ImGui::GetIO();
+    unsigned char *Pixels = nullptr;
+    int Width = 0;
+    int Height = 0;
+    IO.Fonts->GetTexDataAsAlpha8(&Pixels, &Width, &Height);
+    const VkDeviceSize Size = VkDeviceSize(Width) * VkDeviceSize(Height);
+
+    VkImageCreateInfo ImageCreateInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    ImageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    ImageCreateInfo.format = VK_FORMAT_R8_UNORM;
+    ImageCreateInfo.extent = {uint32_t(Width), uint32_t(Height), 1};
+    ImageCreateInfo.mipLevels = 1;
+    ImageCreateInfo.arrayLayers = 1;
+    ImageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    ImageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    ImageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    ImageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    FontImage = RHI.CreateImage(ImageCreateInfo, VMA_MEMORY_USAGE_GPU_ONLY);
+    FontView = RHI.CreateImageView(FontImage, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    FBuffer Staging =
+        RHI.CreateBuffer(Size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+    std::memcpy(Staging.MappedData, Pixels, Size);
+    RHI.ImmediateSubmit([&](VkCommandBuffer CommandBuffer) {
+        VkImageMemoryBarrier Barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+        Barrier.srcAccessMask = 0;
+        Barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        Barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        Barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        Barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        Barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        Barrier.image = FontImage.Image;
+        Barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(
+            CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
+
+        VkBufferImageCopy Region{};
+        Region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        Region.imageExtent = ImageCreateInfo.extent;
+        vkCmdCopyBufferToImage(
+            CommandBuffer, Staging.Buffer, FontImage.Image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &Region);
+
+        Barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        Barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        Barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        Barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(
+            CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
+    });
+    RHI.DestroyBuffer(Staging);
+    // The pixels are on the GPU, only the glyph metrics stay in the atlas.
+    IO.Fonts->ClearTexData();
+
+    VkSamplerCreateInfo SamplerCreateInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    SamplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+    SamplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    SamplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    SamplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    vk_check(vkCreateSampler(Device, &SamplerCreateInfo, nullptr, &FontSampler));
+
+    const VkDescriptorSetLayoutBinding Binding{
+        0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT,
+        nullptr};
+    VkDescriptorSetLayoutCreateInfo LayoutCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    LayoutCreateInfo.bindingCount = 1;
+    LayoutCreateInfo.pBindings = &Binding;
+    vk_check(vkCreateDescriptorSetLayout(
+        Device, &LayoutCreateInfo, nullptr, &DescriptorSetLayout));
+
+    const VkDescriptorPoolSize PoolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1};
+    VkDescriptorPoolCreateInfo PoolCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    PoolCreateInfo.maxSets = 1;
+    PoolCreateInfo.poolSizeCount = 1;
+    PoolCreateInfo.pPoolSizes = &PoolSize;
+    vk_check(vkCreateDescriptorPool(Device, &PoolCreateInfo, nullptr, &DescriptorPool));
+
+    VkDescriptorSetAllocateInfo AllocateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    AllocateInfo.descriptorPool = DescriptorPool;
+    AllocateInfo.descriptorSetCount = 1;
+    AllocateInfo.pSetLayouts = &DescriptorSetLayout;
+    vk_check(vkAllocateDescriptorSets(Device, &AllocateInfo, &FontSet));
+
+    const VkDescriptorImageInfo ImageInfo{
+        FontSampler, FontView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkWriteDescriptorSet Write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    Write.dstSet = FontSet;
+    Write.dstBinding = 0;
+    Write.descriptorCount = 1;
+    Write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    Write.pImageInfo = &ImageInfo;
+    vkUpdateDescriptorSets(Device, 1, &Write, 0, nullptr);
+}
+
+void FPerformanceOverlay::CreatePipeline(
+    VkRenderPass RenderPass, uint32_t Subpass, bool bSrgbTarget) {
+    VkDevice Device = RHI.GetDevice();
+    const VkPushConstantRange PushConstantRange{
+        VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(FOverlayConstants)};
+    VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo{
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    PipelineLayoutCreateInfo.setLayoutCount = 1;
+    PipelineLayoutCreateInfo.pSetLayouts = &DescriptorSetLayout;
+    PipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    PipelineLayoutCreateInfo.pPushConstantRanges = &PushConstantRange;
+    vk_check(vkCreatePipelineLayout(
+        Device, &PipelineLayoutCreateInfo, nullptr, &PipelineLayout));
+
+    VkShaderModule VertexModule =
+        CompileShader(RHI, "Overlay.vert", EShaderStage::Vertex, bSrgbTarget);
+    VkShaderModule FragmentModule =
+        CompileShader(RHI, "Overlay.frag", EShaderStage::Fragment, bSrgbTarget);
+    if(VertexModule != VK_NULL_HANDLE && FragmentModule != VK_NULL_HANDLE) {
+        VkPipelineShaderStageCreateInfo Stages[2]{};
+        for(VkPipelineShaderStageCreateInfo &Stage: Stages) {
+            Stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            Stage.pName = "main";
+        }
+        Stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        Stages[0].module = VertexModule;
+        Stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        Stages[1].module = FragmentModule;
+
+        const VkVertexInputBindingDescription VertexBinding{
+            0, sizeof(ImDrawVert), VK_VERTEX_INPUT_RATE_VERTEX};
+        const VkVertexInputAttributeDescription VertexAttributes[] = {
+            {0, 0, VK_FORMAT_R32G32_SFLOAT, uint32_t(offsetof(ImDrawVert, pos))},
+            {1, 0, VK_FORMAT_R32G32_SFLOAT, uint32_t(offsetof(ImDrawVert, uv))},
+            {2, 0, VK_FORMAT_R8G8B8A8_UNORM, uint32_t(offsetof(ImDrawVert, col))},
+        };
+        VkPipelineVertexInputStateCreateInfo VertexInput{
+            VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
+        VertexInput.vertexBindingDescriptionCount = 1;
+        VertexInput.pVertexBindingDescriptions = &VertexBinding;
+        VertexInput.vertexAttributeDescriptionCount =
+            static_cast<uint32_t>(std::size(VertexAttributes));
+        VertexInput.pVertexAttributeDescriptions = VertexAttributes;
+
+        VkPipelineInputAssemblyStateCreateInfo InputAssembly{
+            VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO};
+        InputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+        VkPipelineViewportStateCreateInfo ViewportState{
+            VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO};
+        ViewportState.viewportCount = 1;
+        ViewportState.scissorCount = 1;
+
+        VkPipelineRasterizationStateCreateInfo Rasterization{
+            VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO};
+        Rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+        Rasterization.cullMode = VK_CULL_MODE_NONE;
+        Rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        Rasterization.lineWidth = 1.0f;
+
+        VkPipelineMultisampleStateCreateInfo Multisample{
+            VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO};
+        Multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        // Drawn over the finished image, whatever depth the pass has is ignored.
+        VkPipelineDepthStencilStateCreateInfo DepthStencil{
+            VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO};
+
+        VkPipelineColorBlendAttachmentState BlendAttachment{};
+        BlendAttachment.blendEnable = VK_TRUE;
+        BlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        BlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        BlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+        BlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        BlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        BlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+        BlendAttachment.colorWriteMask =
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+            VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        VkPipelineColorBlendStateCreateInfo ColorBlend{
+            VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO};
+        ColorBlend.attachmentCount = 1;
+        ColorBlend.pAttachments = &BlendAttachment;
+
+        const VkDynamicState DynamicStates[] = {
+            VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo DynamicState{
+            VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO};
+        DynamicState.dynamicStateCount = static_cast<uint32_t>(std::size(DynamicStates));
+        DynamicState.pDynamicStates = DynamicStates;
+
+        VkGraphicsPipelineCreateInfo CreateInfo{
+            VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
+        CreateInfo.stageCount = static_cast<uint32_t>(std::size(Stages));
+        CreateInfo.pStages = Stages;
+        CreateInfo.pVertexInputState = &VertexInput;
+        CreateInfo.pInputAssemblyState = &InputAssembly;
+        CreateInfo.pViewportState = &ViewportState;
+        CreateInfo.pRasterizationState = &Rasterization;
+        CreateInfo.pMultisampleState = &Multisample;
+        CreateInfo.pDepthStencilState = &DepthStencil;
+        CreateInfo.pColorBlendState = &ColorBlend;
+        CreateInfo.pDynamicState = &DynamicState;
+        CreateInfo.layout = PipelineLayout;
+        CreateInfo.renderPass = RenderPass;
+        CreateInfo.subpass = Subpass;
+        vk_check(vkCreateGraphicsPipelines(
+            Device, VK_NULL_HANDLE, 1, &CreateInfo, nullptr, &Pipeline));
+    }
+    if(VertexModule != VK_NULL_HANDLE) {
+        vkDestroyShaderModule(Device, VertexModule, nullptr);
+    }
+    if(FragmentModule != VK_NULL_HANDLE) {
+        vkDestroyShaderModule(Device, FragmentModule, nullptr);
+    }
+}
+
+void FPerformanceOverlay::SetVisible(bool bInVisible) {
+    if(bVisible == bInVisible) { return; }
+    bVisible = bInVisible;
+    bBuilt = false;
+    RHI.SetStatisticsEnabled(bVisible);
+}
+
+void FPerformanceOverlay::Update(float DeltaSeconds, VkExtent2D Extent) {
+    if(!bVisible) { return; }
+    RE_PROFILE_SCOPE("Performance Overlay");
+    const uint64_t Start = FProfiler::Now();
+
+    Statistics = RHI.ConsumeStatistics();
+    CpuTimes[HistoryOffset] = DeltaSeconds * 1000.0f;
+    GpuTimes[HistoryOffset] = float(RHI.GetGpuProfiler().GetLastFrameTime());
+    HistoryOffset = (HistoryOffset + 1) % HistoryLength;
+
+    ImGuiContext *PreviousContext = ImGui::GetCurrentContext();
+    ImGui::SetCurrentContext(Context);
+    ImGuiIO &IO = ImGui::GetIO();
+    IO.DisplaySize = ImVec2(float(Extent.width), float(Extent.height));
+    IO.DeltaTime = std::max(DeltaSeconds, 1e-4f);
+    ImGui::NewFrame();
+    BuildWindow();
+    ImGui::Render();
+    ImGui::SetCurrentContext(PreviousContext);
+    bBuilt = true;
+    UpdateNs = FProfiler::Now() - Start;
+}
+
+void FPerformanceOverlay::BuildWindow() {
+    ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_Always);
+    ImGui::SetNextWindowBgAlpha(0.75f);
+    ImGui::Begin(
+        "Performance", nullptr,
+        ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+            ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing |
+            ImGuiWindowFlags_NoInputs);
+
+    float CpuAverage;
+    float CpuMax;
+    float GpuAverage;
+    float GpuMax;
+    AverageAndMax(CpuTimes, CpuAverage, CpuMax);
+    AverageAndMax(GpuTimes, GpuAverage, GpuMax);
+    const float GraphScale = std::max({CpuMax, GpuMax, MinGraphScale});
+    const ImVec2 GraphSize(HistoryLength * 2.0f, 40.0f);
+    ImGui::Text("CPU %.2f ms, max %.2f ms", CpuAverage, CpuMax);
+    ImGui::PlotHistogram(
+        "##Cpu", CpuTimes, HistoryLength, HistoryOffset, nullptr, 0.0f, GraphScale,
+        GraphSize);
+    ImGui::Text("GPU %.2f ms, max %.2f ms", GpuAverage, GpuMax);
+    ImGui::PlotHistogram(
+        "##Gpu", GpuTimes, HistoryLength, HistoryOffset, nullptr, 0.0f, GraphScale,
+        GraphSize);
+
+    const std::vector<FGpuScopeStats> &Passes = RHI.GetGpuProfiler().GetStatistics();
+    if(!Passes.empty()) {
+        ImGui::Separator();
+        for(const FGpuScopeStats &Pass: Passes) {
+            ImGui::Text("%*s%s", int(2 * Pass.Depth), "", Pass.Name.c_str());
+            ImGui::SameLine(180.0f);
+            ImGui::Text("%6.3f ms", Pass.SmoothedMs);
+        }
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Draws %u, dispatches %u", Statistics.Draws, Statistics.Dispatches);
+    ImGui::Text(
+        "Pipeline binds %u, descriptor sets %u", Statistics.PipelineBinds,
+        Statistics.DescriptorSetAllocations);
+
+    ImGui::Separator();
+    const VkPhysicalDeviceMemoryProperties *MemoryProperties = nullptr;
+    vmaGetMemoryProperties(RHI.GetAllocator(), &MemoryProperties);
+    VmaBudget Budgets[VK_MAX_MEMORY_HEAPS]{};
+    vmaGetBudget(RHI.GetAllocator(), Budgets);
+    for(uint32_t Heap = 0; Heap < MemoryProperties->memoryHeapCount; Heap++) {
+        const bool bDeviceLocal =
+            MemoryProperties->memoryHeaps[Heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        ImGui::Text(
+            "Heap %u %s: %.1f / %.1f MiB, %.1f MiB allocated", Heap,
+            bDeviceLocal ? "device" : "host", float(Budgets[Heap].usage) * MiB,
+            float(Budgets[Heap].budget) * MiB, float(Budgets[Heap].allocationBytes) * MiB);
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Overlay %.3f ms CPU", OverlayTime);
+    ImGui::End();
+}
+
+void FPerformanceOverlay::Draw(VkCommandBuffer CommandBuffer, uint32_t Frame) {
+    if(!bBuilt || Pipeline == VK_NULL_HANDLE) { return; }
+    RE_PROFILE_SCOPE("Performance Overlay Draw");
+    const uint64_t Start = FProfiler::Now();
+
+    ImGuiContext *PreviousContext = ImGui::GetCurrentContext();
+    ImGui::SetCurrentContext(Context);
+    const ImDrawData *DrawData = ImGui::GetDrawData();
+    ImGui::SetCurrentContext(PreviousContext);
+    if(DrawData == nullptr || DrawData->TotalVtxCount == 0) { return; }
+    FGpuScope Scope(RHI.GetGpuProfiler(), CommandBuffer, "Performance Overlay");
+
+    // The slot's previous frame has completed, so its buffers can be replaced.
+    const uint32_t FrameIndex = Frame % MaxFramesInFlight;
+    FBuffer &VertexBuffer = VertexBuffers[FrameIndex];
+    FBuffer &IndexBuffer = IndexBuffers[FrameIndex];
+    const VkDeviceSize VertexSize = DrawData->TotalVtxCount * sizeof(ImDrawVert);
+    const VkDeviceSize IndexSize = DrawData->TotalIdxCount * sizeof(ImDrawIdx);
+    if(VertexBuffer.Size < VertexSize) {
+        RHI.DestroyBuffer(VertexBuffer);
+        VertexBuffer = RHI.CreateBuffer(
+            VertexSize * 2, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    }
+    if(IndexBuffer.Size < IndexSize) {
+        RHI.DestroyBuffer(IndexBuffer);
+        IndexBuffer = RHI.CreateBuffer(
+            IndexSize * 2, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    }
+
+    auto *Vertices = static_cast<ImDrawVert *>(VertexBuffer.MappedData);
+    auto *Indices = static_cast<ImDrawIdx *>(IndexBuffer.MappedData);
+    for(int List = 0; List < DrawData->CmdListsCount; List++) {
+        const ImDrawList *DrawList = DrawData->CmdLists[List];
+        const ImVector<ImDrawVert> &ListVertices = DrawList->VtxBuffer;
+        const ImVector<ImDrawIdx> &ListIndices = DrawList->IdxBuffer;
+        std::memcpy(Vertices, ListVertices.Data, ListVertices.Size * sizeof(ImDrawVert));
+        std::memcpy(Indices, ListIndices.Data, ListIndices.Size * sizeof(ImDrawIdx));
+        Vertices += ListVertices.Size;
+        Indices += ListIndices.Size;
+    }
+    vmaFlushAllocation(RHI.GetAllocator(), VertexBuffer.Allocation, 0, VertexSize);
+    vmaFlushAllocation(RHI.GetAllocator(), IndexBuffer.Allocation, 0, IndexSize);
+
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Pipeline);
+    vkCmdBindDescriptorSets(
+        CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, PipelineLayout, 0, 1, &FontSet, 0,
+        nullptr);
+    const VkDeviceSize Offset = 0;
+    vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &VertexBuffer.Buffer, &Offset);
+    vkCmdBindIndexBuffer(
+        CommandBuffer, IndexBuffer.Buffer, 0,
+        sizeof(ImDrawIdx) == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+
+    const ImVec2 DisplayPos = DrawData->DisplayPos;
+    const ImVec2 DisplaySize = DrawData->DisplaySize;
+    const VkViewport Viewport{0.0f, 0.0f, DisplaySize.x, DisplaySize.y, 0.0f, 1.0f};
+    vkCmdSetViewport(CommandBuffer, 0, 1, &Viewport);
+    FOverlayConstants Constants;
+    Constants.Scale[0] = 2.0f / DisplaySize.x;
+    Constants.Scale[1] = 2.0f / DisplaySize.y;
+    Constants.Translate[0] = -1.0f - DisplayPos.x * Constants.Scale[0];
+    Constants.Translate[1] = -1.0f - DisplayPos.y * Constants.Scale[1];
+    vkCmdPushConstants(
+        CommandBuffer, PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Constants),
+        &Constants);
+
+    uint32_t IndexOffset = 0;
+    int32_t VertexOffset = 0;
+    for(int List = 0; List < DrawData->CmdListsCount; List++) {
+        const ImDrawList *DrawList = DrawData->CmdLists[List];
+        for(const ImDrawCmd &Command: DrawList->CmdBuffer) {
+            if(Command.UserCallback != nullptr) {
+                Command.UserCallback(DrawList, &Command);
+            } else {
+                const ImVec4 &Clip = Command.ClipRect;
+                const float MinX = std::max(Clip.x - DisplayPos.x, 0.0f);
+                const float MinY = std::max(Clip.y - DisplayPos.y, 0.0f);
+                const float MaxX = std::min(Clip.z - DisplayPos.x, DisplaySize.x);
+                const float MaxY = std::min(Clip.w - DisplayPos.y, DisplaySize.y);
+                if(MaxX > MinX && MaxY > MinY) {
+                    const VkRect2D Scissor{
+                        {int32_t(MinX), int32_t(MinY)},
+                        {uint32_t(MaxX - MinX), uint32_t(MaxY - MinY)}};
+                    vkCmdSetScissor(CommandBuffer, 0, 1, &Scissor);
+                    vkCmdDrawIndexed(
+                        CommandBuffer, Command.ElemCount, 1, IndexOffset, VertexOffset, 0);
+                }
+            }
+            IndexOffset += Command.ElemCount;
+        }
+        VertexOffset += DrawList->VtxBuffer.Size;
+    }
+
+    OverlayTime = float(UpdateNs + (FProfiler::Now() - Start)) * 1e-6f;
+}
+}
@@ -0,0 +1,405 @@
+﻿#include "Render/PostProcess.h"
+#include "RHI/ShaderCompiler.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iterator>
+#include <string>
+#include <utility>
+
+#include <glm/glm.hpp>
+
+namespace RE {
+namespace {
+// Mirrors FPostConstants in Shaders/Include/PostProcess.glsl.
+struct FPostConstants {
+    glm::vec4 Params;
+    glm::uvec4 Size;
+};
+
+enum EPostBinding : uint32_t {
+    Binding_Source,
+    Binding_Bloom,
+    Binding_Target,
+    Binding_Luminance,
+    Binding_Count
+};
+
+constexpr uint32_t HistogramBins = 256;
+constexpr uint32_t HistogramGroupSize = 16;
+constexpr uint32_t PostGroupSize = 8;
+// Luminance the average is exposed to, before the bias.
+constexpr float MiddleGrey = 0.18f;
+
+VkImageMemoryBarrier MakeBarrier(
+    VkImage Image, uint32_t MipCount, VkImageLayout OldLayout, VkAccessFlags SrcAccess,
+    VkAccessFlags DstAccess) {
+    VkImageMemoryBarrier Barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    Barrier.srcAccessMask = SrcAccess;
+    Barrier.dstAccessMask = DstAccess;
+    Barrier.oldLayout = OldLayout;
+    Barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    Barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    Barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    Barrier.image = Image;
+    Barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, MipCount, 0, 1};
+    return Barrier;
+}
+
+// Makes the previous pass's image and buffer writes visible to the next one.
+void ComputeBarrier(VkCommandBuffer CommandBuffer) {
+    VkMemoryBarrier Barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    Barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    Barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &Barrier, 0, nullptr, 0, nullptr);
+}
+
+VkExtent2D GetBloomLevelSize(VkExtent2D Extent, uint32_t Level) {
+    return {std::max(Extent.width >> (Level + 1), 1u),
+            std::max(Extent.height >> (Level + 1), 1u)};
+}
+}
+
+FPostProcess::FPostProcess(
+    FRHI &RHI, VkExtent2D InExtent, const FPostProcessSettings &InSettings)
+    : RHI(RHI), Settings(InSettings), Extent(InExtent) {
+    VkDevice Device = RHI.GetDevice();
+
+    VkSamplerCreateInfo SamplerCreateInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    SamplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+    SamplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    SamplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    SamplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    vk_check(vkCreateSampler(Device, &SamplerCreateInfo, nullptr, &LinearSampler));
+
+    // Every pass uses the same layout and picks the bindings it needs.
+    constexpr VkShaderStageFlags Compute = VK_SHADER_STAGE_COMPUTE_BIT;
+    const VkDescriptorSetLayoutBinding Bindings[] = {
+        {Binding_Source, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, Compute, nullptr},
+        {Binding_Bloom, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, Compute, nullptr},
+        {Binding_Target, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, Compute, nullptr},
+        {Binding_Luminance, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, Compute, nullptr},
+    };
+    VkDescriptorSetLayoutCreateInfo LayoutCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    LayoutCreateInfo.bindingCount = static_cast<uint32_t>(std::size(Bindings));
+    LayoutCreateInfo.pBindings = Bindings;
+    vk_check(vkCreateDescriptorSetLayout(
+        Device, &LayoutCreateInfo, nullptr, &DescriptorSetLayout));
+
+    const VkPushConstantRange PushConstantRange{
+        VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FPostConstants)};
+    VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo{
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    PipelineLayoutCreateInfo.setLayoutCount = 1;
+    PipelineLayoutCreateInfo.pSetLayouts = &DescriptorSetLayout;
+    PipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    PipelineLayoutCreateInfo.pPushConstantRanges = &PushConstantRange;
+    vk_check(vkCreatePipelineLayout(
+        Device, &PipelineLayoutCreateInfo, nullptr, &PipelineLayout));
+
+    std::vector<std::string> Defines;
+    const FRHICapabilities &Capabilities = RHI.GetCapabilities();
+    if(Capabilities.bSubgroupBallot && Capabilities.bSubgroupArithmetic) {
+        Defines.emplace_back("RE_POST_SUBGROUP");
+    }
+    const std::pair<const char *, VkPipeline *> Pipelines[] = {
+        {"PostHistogram.comp", &HistogramPipeline},
+        {"PostExposure.comp", &ExposurePipeline},
+        {"PostBloomDown.comp", &BloomDownPipeline},
+        {"PostBloomUp.comp", &BloomUpPipeline},
+        {"PostTonemap.comp", &TonemapPipeline},
+    };
+    for(const auto &[Path, Pipeline]: Pipelines) {
+        std::vector<uint32_t> Spirv;
+        if(!FShaderCompiler::Get().Compile(Path, EShaderStage::Compute, Defines, Spirv)) {
+            RE_LOGE("The post processing shader {} failed to compile.", Path);
+            continue;
+        }
+        VkShaderModule Module = RHI.CreateShaderModule(Spirv);
+        *Pipeline = RHI.CreateComputePipeline(Module, PipelineLayout);
+        vkDestroyShaderModule(Device, Module, nullptr);
+    }
+
+    LuminanceBuffer = RHI.CreateBuffer(
+        (HistogramBins + 1) * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+
+    CreateTargets();
+}
+
+FPostProcess::~FPostProcess() {
+    DestroyTargets();
+    VkDevice Device = RHI.GetDevice();
+    RHI.DestroyBuffer(LuminanceBuffer);
+    for(VkPipeline Pipeline: {HistogramPipeline, ExposurePipeline, BloomDownPipeline,
+                              BloomUpPipeline, TonemapPipeline}) {
+        if(Pipeline != VK_NULL_HANDLE) { vkDestroyPipeline(Device, Pipeline, nullptr); }
+    }
+    vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Device, DescriptorSetLayout, nullptr);
+    vkDestroySampler(Device, LinearSampler, nullptr);
+}
+
+void FPostProcess::Resize(VkExtent2D InExtent) {
+    if(InExtent.width == Extent.width && InExtent.height == Extent.height) { return; }
+    DestroyTargets();
+    Extent = InExtent;
+    CreateTargets();
+}
+
+void FPostProcess::CreateTargets() {
+    VkDevice Device = RHI.GetDevice();
+
+    // The outputs are read on the graphics queue while the compute queue writes the next.
+    const uint32_t QueueFamilies[2] = {
+        RHI.GetGraphicsQueueIndex(), RHI.GetComputeQueueIndex()};
+    VkImageCreateInfo ImageCreateInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    ImageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    ImageCreateInfo.format = OutputFormat;
+    ImageCreateInfo.extent = {Extent.width, Extent.height, 1};
+    ImageCreateInfo.mipLevels = 1;
+    ImageCreateInfo.arrayLayers = 1;
+    ImageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    ImageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    ImageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+                            VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    ImageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if(RHI.GetCapabilities().bAsyncCompute) {
+        ImageCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        ImageCreateInfo.queueFamilyIndexCount = 2;
+        ImageCreateInfo.pQueueFamilyIndices = QueueFamilies;
+    }
+    for(uint32_t i = 0; i < MaxFramesInFlight; i++) {
+        Outputs[i] = RHI.CreateImage(ImageCreateInfo, VMA_MEMORY_USAGE_GPU_ONLY);
+        OutputViews[i] = RHI.CreateImageView(Outputs[i], VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+
+    const VkExtent2D BloomSize = GetBloomLevelSize(Extent, 0);
+    const uint32_t LevelCount = std::clamp(
+        Settings.BloomLevels, 1u,
+        static_cast<uint32_t>(std::bit_width(std::min(BloomSize.width, BloomSize.height))));
+    ImageCreateInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    ImageCreateInfo.extent = {BloomSize.width, BloomSize.height, 1};
+    ImageCreateInfo.mipLevels = LevelCount;
+    ImageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    ImageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    ImageCreateInfo.queueFamilyIndexCount = 0;
+    ImageCreateInfo.pQueueFamilyIndices = nullptr;
+    BloomImage = RHI.CreateImage(ImageCreateInfo, VMA_MEMORY_USAGE_GPU_ONLY);
+    for(uint32_t Level = 0; Level < LevelCount; Level++) {
+        BloomViews.push_back(
+            RHI.CreateImageView(BloomImage, VK_IMAGE_ASPECT_COLOR_BIT, Level, 1));
+    }
+
+    const uint32_t SetCount = 2 * MaxFramesInFlight + 2 * (LevelCount - 1);
+    const VkDescriptorPoolSize PoolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * SetCount},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, SetCount},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, SetCount},
+    };
+    VkDescriptorPoolCreateInfo PoolCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    PoolCreateInfo.maxSets = SetCount;
+    PoolCreateInfo.poolSizeCount = static_cast<uint32_t>(std::size(PoolSizes));
+    PoolCreateInfo.pPoolSizes = PoolSizes;
+    vk_check(vkCreateDescriptorPool(Device, &PoolCreateInfo, nullptr, &DescriptorPool));
+
+    const std::vector<VkDescriptorSetLayout> Layouts(SetCount, DescriptorSetLayout);
+    VkDescriptorSetAllocateInfo AllocateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    AllocateInfo.descriptorPool = DescriptorPool;
+    AllocateInfo.descriptorSetCount = SetCount;
+    AllocateInfo.pSetLayouts = Layouts.data();
+    std::vector<VkDescriptorSet> Sets(SetCount);
+    vk_check(vkAllocateDescriptorSets(Device, &AllocateInfo, Sets.data()));
+
+    // The sets reading the source are written once it is known.
+    auto Next = Sets.begin();
+    for(uint32_t i = 0; i < MaxFramesInFlight; i++) {
+        FrameSets[i] = *Next++;
+        PrefilterSets[i] = *Next++;
+        FrameSources[i] = VK_NULL_HANDLE;
+    }
+    DownSets.assign(Next, Next + (LevelCount - 1));
+    UpSets.assign(Next + (LevelCount - 1), Sets.end());
+    for(uint32_t Level = 0; Level + 1 < LevelCount; Level++) {
+        WriteSet(
+            DownSets[Level], BloomViews[Level], VK_IMAGE_LAYOUT_GENERAL,
+            BloomViews[Level + 1]);
+        WriteSet(
+            UpSets[Level], BloomViews[Level + 1], VK_IMAGE_LAYOUT_GENERAL,
+            BloomViews[Level]);
+    }
+}
+
+void FPostProcess::DestroyTargets() {
+    VkDevice Device = RHI.GetDevice();
+    if(DescriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+        DescriptorPool = VK_NULL_HANDLE;
+    }
+    DownSets.clear();
+    UpSets.clear();
+    for(VkImageView BloomView: BloomViews) {
+        vkDestroyImageView(Device, BloomView, nullptr);
+    }
+    BloomViews.clear();
+    RHI.DestroyImage(BloomImage);
+    for(uint32_t i = 0; i < MaxFramesInFlight; i++) {
+        if(OutputViews[i] != VK_NULL_HANDLE) {
+            vkDestroyImageView(Device, OutputViews[i], nullptr);
+            OutputViews[i] = VK_NULL_HANDLE;
+        }
+        RHI.DestroyImage(Outputs[i]);
+    }
+}
+
+void FPostProcess::WriteSet(
+    VkDescriptorSet Set, VkImageView Source, VkImageLayout SourceLayout,
+    VkImageView Target) {
+    const VkDescriptorImageInfo ImageInfos[3] = {
+        {LinearSampler, Source, SourceLayout},
+        {LinearSampler, BloomViews[0], VK_IMAGE_LAYOUT_GENERAL},
+        {VK_NULL_HANDLE, Target, VK_IMAGE_LAYOUT_GENERAL},
+    };
+    const VkDescriptorBufferInfo BufferInfo{LuminanceBuffer.Buffer, 0, VK_WHOLE_SIZE};
+    const VkDescriptorType Types[Binding_Count] = {
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
+
+    VkWriteDescriptorSet Writes[Binding_Count];
+    for(uint32_t Binding = 0; Binding < Binding_Count; Binding++) {
+        Writes[Binding] = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        Writes[Binding].dstSet = Set;
+        Writes[Binding].dstBinding = Binding;
+        Writes[Binding].descriptorCount = 1;
+        Writes[Binding].descriptorType = Types[Binding];
+        if(Binding == Binding_Luminance) {
+            Writes[Binding].pBufferInfo = &BufferInfo;
+        } else {
+            Writes[Binding].pImageInfo = &ImageInfos[Binding];
+        }
+    }
+    vkUpdateDescriptorSets(RHI.GetDevice(), Binding_Count, Writes, 0, nullptr);
+}
+
+void FPostProcess::Record(
+    VkCommandBuffer CommandBuffer, uint32_t Frame, VkImageView Source,
+    float DeltaSeconds) {
+    for(VkPipeline Pipeline: {HistogramPipeline, ExposurePipeline, BloomDownPipeline,
+                              BloomUpPipeline, TonemapPipeline}) {
+        if(Pipeline == VK_NULL_HANDLE) { return; }
+    }
+    const uint32_t FrameIndex = Frame % MaxFramesInFlight;
+    const uint32_t LevelCount = BloomImage.MipLevels;
+
+    // The frame slot's previous submission has completed, so its sets can be rewritten.
+    if(FrameSources[FrameIndex] != Source) {
+        WriteSet(
+            FrameSets[FrameIndex], Source, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            OutputViews[FrameIndex]);
+        WriteSet(
+            PrefilterSets[FrameIndex], Source, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            BloomViews[0]);
+        FrameSources[FrameIndex] = Source;
+    }
+
+    // The histogram starts empty and the exposure at 1, then the first frame adapts fully.
+    float Adaptation = 1.0f - std::exp(-DeltaSeconds * Settings.ExposureSpeed);
+    if(!bLuminanceInitialized) {
+        vkCmdFillBuffer(
+            CommandBuffer, LuminanceBuffer.Buffer, 0, HistogramBins * sizeof(uint32_t), 0);
+        vkCmdFillBuffer(
+            CommandBuffer, LuminanceBuffer.Buffer, HistogramBins * sizeof(uint32_t),
+            sizeof(float), std::bit_cast<uint32_t>(1.0f));
+        VkMemoryBarrier Barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        Barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        Barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &Barrier, 0, nullptr, 0, nullptr);
+        bLuminanceInitialized = true;
+        Adaptation = 1.0f;
+    }
+
+    // The bloom chain and the frame's output are fully overwritten.
+    const VkImageMemoryBarrier Barriers[2] = {
+        MakeBarrier(
+            BloomImage.Image, LevelCount, VK_IMAGE_LAYOUT_UNDEFINED, 0,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT),
+        MakeBarrier(
+            Outputs[FrameIndex].Image, 1, VK_IMAGE_LAYOUT_UNDEFINED, 0,
+            VK_ACCESS_SHADER_WRITE_BIT),
+    };
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, Barriers);
+
+    auto Dispatch = [&](VkPipeline Pipeline, VkDescriptorSet Set, const glm::vec4 &Params,
+                        VkExtent2D Size, uint32_t GroupSize) {
+        const FPostConstants Constants{Params, {Size.width, Size.height, 0, 0}};
+        vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipeline);
+        vkCmdBindDescriptorSets(
+            CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, 0, 1, &Set, 0,
+            nullptr);
+        vkCmdPushConstants(
+            CommandBuffer, PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+            sizeof(Constants), &Constants);
+        vkCmdDispatch(
+            CommandBuffer, (Size.width + GroupSize - 1) / GroupSize,
+            (Size.height + GroupSize - 1) / GroupSize, 1);
+    };
+
+    // The histogram and the first bloom level only read the source and run together.
+    const float LogRange = std::max(
+        Settings.MaxLogLuminance - Settings.MinLogLuminance, 1e-3f);
+    Dispatch(
+        HistogramPipeline, FrameSets[FrameIndex],
+        {Settings.MinLogLuminance, 1.0f / LogRange, 0.0f, 0.0f}, Extent,
+        HistogramGroupSize);
+    Dispatch(
+        BloomDownPipeline, PrefilterSets[FrameIndex],
+        {Settings.BloomThreshold, Settings.BloomKnee, 1.0f, 0.0f},
+        GetBloomLevelSize(Extent, 0), PostGroupSize);
+    for(uint32_t Level = 1; Level < LevelCount; Level++) {
+        ComputeBarrier(CommandBuffer);
+        Dispatch(
+            BloomDownPipeline, DownSets[Level - 1], glm::vec4(0.0f),
+            GetBloomLevelSize(Extent, Level), PostGroupSize);
+    }
+    ComputeBarrier(CommandBuffer);
+
+    Dispatch(
+        ExposurePipeline, FrameSets[FrameIndex],
+        {Settings.MinLogLuminance, LogRange, Adaptation,
+         MiddleGrey * std::exp2(Settings.ExposureBias)},
+        {1, 1}, 1);
+    ComputeBarrier(CommandBuffer);
+
+    for(uint32_t Level = LevelCount - 1; Level > 0; Level--) {
+        Dispatch(
+            BloomUpPipeline, UpSets[Level - 1], glm::vec4(1.0f, 0.0f, 0.0f, 0.0f),
+            GetBloomLevelSize(Extent, Level - 1), PostGroupSize);
+        ComputeBarrier(CommandBuffer);
+    }
+    Dispatch(
+        TonemapPipeline, FrameSets[FrameIndex],
+        {Settings.BloomIntensity, 0.0f, 0.0f, 0.0f}, Extent, PostGroupSize);
+
+    // Any later pass on this queue may read the output.
+    const VkImageMemoryBarrier OutputBarrier = MakeBarrier(
+        Outputs[FrameIndex].Image, 1, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &OutputBarrier);
+}
+}
@@ -1,15 +1,32 @@
 ﻿#include "Render/Renderer.h"
+#include "Core/FileSystem.h"
+#include "RHI/RenderPassBuilder.h"
 
 namespace RE {
 FRenderer::FRenderer(void *nativeWindow): RHI(nativeWindow) {
+    // Loose shader sources, packs mounted later can override them.
+    FVirtualFileSystem::Get().MountDirectory(RE_SHADER_DIR);
     CreateSwapchain();
     createRenderPass();
     createFramebuffers();
     createCommandBuffer();
     createSyncObjects();
+
+    const VkExtent2D OutputExtent = SwapchainInfo.SwapchainExtent;
+    DynamicResolution = std::make_unique<FDynamicResolution>(RHI);
+    Upscaler = std::make_unique<FTemporalUpscaler>(
+        RHI, OutputExtent, DynamicResolution->GetMaxRenderExtent(OutputExtent));
+    Upscaler->SetAsyncCompute(true);
+    PostProcess = std::make_unique<FPostProcess>(RHI, OutputExtent);
+    Overlay = std::make_unique<FPerformanceOverlay>(
+        RHI, renderPassInfo.vkRenderPass, 0, SwapchainInfo.SurfaceFormat);
 }
 FRenderer::~FRenderer() {
     if(RHI.GetDevice() != VK_NULL_HANDLE) { vkDeviceWaitIdle(RHI.GetDevice()); }
+    Overlay.reset();
+    PostProcess.reset();
+    Upscaler.reset();
+    DynamicResolution.reset();
     for(const auto &fence: renderPassInfo.vkInFlightFences) {
         vkDestroyFence(RHI.GetDevice(), fence, nullptr);
     }
@@ -141,44 +158,21 @@ void FRenderer::CreateSwapchain() {
 }
 
 void FRenderer::createRenderPass() {
-    VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = SwapchainInfo.SurfaceFormat;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    VkAttachmentReference colorAttachmentRef{};
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpass{};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
-
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    VkRenderPassCreateInfo renderPassCreateInfo{
-        VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
-    renderPassCreateInfo.attachmentCount = 1;
-    renderPassCreateInfo.pAttachments = &colorAttachment;
-    renderPassCreateInfo.subpassCount = 1;
-    renderPassCreateInfo.pSubpasses = &subpass;
-    renderPassCreateInfo.dependencyCount = 1;
-    renderPassCreateInfo.pDependencies = &dependency;
-
-    vk_check(vkCreateRenderPass(
-        RHI.GetDevice(), &renderPassCreateInfo, nullptr, &renderPassInfo.vkRenderPass));
+    FAttachmentDesc swapchainAttachment;
+    swapchainAttachment.Name = "Swapchain";
+    swapchainAttachment.Format = SwapchainInfo.SurfaceFormat;
+    swapchainAttachment.LoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    swapchainAttachment.bKeep = true;
+    swapchainAttachment.FinalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    FRenderPassBuilder builder;
+    FPassDesc presentPass;
+    presentPass.Name = "Present";
+    presentPass.Colors = {builder.AddAttachment(swapchainAttachment)};
+    builder.AddPass(presentPass);
+    builder.Compile();
+    builder.CreateRenderPasses(RHI.GetDevice());
+    renderPassInfo.vkRenderPass = builder.GetRenderPasses()[0].RenderPass;
 }
 
 void FRenderer::createFramebuffers() {
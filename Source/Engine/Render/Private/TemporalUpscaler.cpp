@@ -0,0 +1,445 @@
+﻿#include "Render/TemporalUpscaler.h"
+#include "RHI/ShaderCompiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace RE {
+namespace {
+// Mirrors FUpscaleConstants in Shaders/TemporalUpscale.comp.
+struct FUpscaleConstants {
+    glm::mat4 ClipToPrevClip;
+    /* Jitter in render pixels, then 1 when the history is valid. */
+    glm::vec4 Jitter;
+    /* Render width and height, then output width and height. */
+    glm::uvec4 Extents;
+};
+
+enum EUpscaleBinding : uint32_t {
+    Binding_SceneColor,
+    Binding_SceneDepth,
+    Binding_HistoryRead,
+    Binding_HistoryWrite,
+    Binding_Count
+};
+
+constexpr uint32_t UpscaleGroupSize = 8;
+
+float Halton(uint32_t Index, uint32_t Base) {
+    float Result = 0.0f;
+    float Fraction = 1.0f;
+    while(Index > 0) {
+        Fraction /= float(Base);
+        Result += Fraction * float(Index % Base);
+        Index /= Base;
+    }
+    return Result;
+}
+
+VkImageMemoryBarrier MakeBarrier(
+    VkImage Image, VkImageLayout OldLayout, VkImageLayout NewLayout,
+    VkAccessFlags SrcAccess, VkAccessFlags DstAccess) {
+    VkImageMemoryBarrier Barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    Barrier.srcAccessMask = SrcAccess;
+    Barrier.dstAccessMask = DstAccess;
+    Barrier.oldLayout = OldLayout;
+    Barrier.newLayout = NewLayout;
+    Barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    Barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    Barrier.image = Image;
+    Barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    return Barrier;
+}
+
+// Hands the scene targets between queue families, both halves of the pair use the same
+// families and layouts.
+void TransferSceneTargets(
+    VkCommandBuffer CommandBuffer, VkImage Color, VkImage Depth, uint32_t SrcFamily,
+    uint32_t DstFamily, bool bRelease) {
+    VkImageMemoryBarrier Barriers[2];
+    const VkImage Images[2] = {Color, Depth};
+    for(uint32_t i = 0; i < 2; i++) {
+        Barriers[i] = MakeBarrier(
+            Images[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, 0);
+        Barriers[i].srcQueueFamilyIndex = SrcFamily;
+        Barriers[i].dstQueueFamilyIndex = DstFamily;
+    }
+    Barriers[1].subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if(bRelease) {
+        Barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        Barriers[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            CommandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                               VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 2, Barriers);
+    } else {
+        Barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        Barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(
+            CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, Barriers);
+    }
+}
+}
+
+FTemporalUpscaler::FTemporalUpscaler(
+    FRHI &RHI, VkExtent2D InOutputExtent, VkExtent2D InMaxRenderExtent)
+    : RHI(RHI), OutputExtent(InOutputExtent), MaxRenderExtent(InMaxRenderExtent) {
+    VkDevice Device = RHI.GetDevice();
+
+    // Both attachments are sampled by the upscale pass afterwards.
+    VkAttachmentDescription Attachments[2]{};
+    Attachments[0].format = ColorFormat;
+    Attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+    Attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    Attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    Attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    Attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    Attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    Attachments[0].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    Attachments[1] = Attachments[0];
+    Attachments[1].format = DepthFormat;
+
+    const VkAttachmentReference ColorRef{0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    const VkAttachmentReference DepthRef{
+        1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+    VkSubpassDescription Subpass{};
+    Subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    Subpass.colorAttachmentCount = 1;
+    Subpass.pColorAttachments = &ColorRef;
+    Subpass.pDepthStencilAttachment = &DepthRef;
+
+    // Waits for last frame's upscale reads, and makes the results visible to this one.
+    VkSubpassDependency Dependencies[2]{};
+    Dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    Dependencies[0].dstSubpass = 0;
+    Dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    Dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                   VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    Dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    Dependencies[1].srcSubpass = 0;
+    Dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    Dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    Dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    Dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    Dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    VkRenderPassCreateInfo RenderPassCreateInfo{VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
+    RenderPassCreateInfo.attachmentCount = 2;
+    RenderPassCreateInfo.pAttachments = Attachments;
+    RenderPassCreateInfo.subpassCount = 1;
+    RenderPassCreateInfo.pSubpasses = &Subpass;
+    RenderPassCreateInfo.dependencyCount = 2;
+    RenderPassCreateInfo.pDependencies = Dependencies;
+    vk_check(vkCreateRenderPass(Device, &RenderPassCreateInfo, nullptr, &SceneRenderPass));
+
+    VkSamplerCreateInfo SamplerCreateInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    SamplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+    SamplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+    SamplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    SamplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    vk_check(vkCreateSampler(Device, &SamplerCreateInfo, nullptr, &PointSampler));
+    SamplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+    SamplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    vk_check(vkCreateSampler(Device, &SamplerCreateInfo, nullptr, &LinearSampler));
+
+    constexpr VkShaderStageFlags Compute = VK_SHADER_STAGE_COMPUTE_BIT;
+    const VkDescriptorSetLayoutBinding Bindings[] = {
+        {Binding_SceneColor, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, Compute,
+         nullptr},
+        {Binding_SceneDepth, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, Compute,
+         nullptr},
+        {Binding_HistoryRead, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, Compute,
+         nullptr},
+        {Binding_HistoryWrite, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, Compute, nullptr},
+    };
+    VkDescriptorSetLayoutCreateInfo LayoutCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    LayoutCreateInfo.bindingCount = static_cast<uint32_t>(std::size(Bindings));
+    LayoutCreateInfo.pBindings = Bindings;
+    vk_check(vkCreateDescriptorSetLayout(
+        Device, &LayoutCreateInfo, nullptr, &DescriptorSetLayout));
+
+    const VkDescriptorPoolSize PoolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 * 2},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2},
+    };
+    VkDescriptorPoolCreateInfo PoolCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    PoolCreateInfo.maxSets = 2;
+    PoolCreateInfo.poolSizeCount = static_cast<uint32_t>(std::size(PoolSizes));
+    PoolCreateInfo.pPoolSizes = PoolSizes;
+    vk_check(vkCreateDescriptorPool(Device, &PoolCreateInfo, nullptr, &DescriptorPool));
+
+    const VkDescriptorSetLayout Layouts[2] = {DescriptorSetLayout, DescriptorSetLayout};
+    VkDescriptorSetAllocateInfo AllocateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    AllocateInfo.descriptorPool = DescriptorPool;
+    AllocateInfo.descriptorSetCount = 2;
+    AllocateInfo.pSetLayouts = Layouts;
+    vk_check(vkAllocateDescriptorSets(Device, &AllocateInfo, DescriptorSets));
+
+    const VkPushConstantRange PushConstantRange{
+        VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FUpscaleConstants)};
+    VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo{
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    PipelineLayoutCreateInfo.setLayoutCount = 1;
+    PipelineLayoutCreateInfo.pSetLayouts = &DescriptorSetLayout;
+    PipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    PipelineLayoutCreateInfo.pPushConstantRanges = &PushConstantRange;
+    vk_check(vkCreatePipelineLayout(
+        Device, &PipelineLayoutCreateInfo, nullptr, &PipelineLayout));
+
+    std::vector<uint32_t> Spirv;
+    if(FShaderCompiler::Get().Compile(
+           "TemporalUpscale.comp", EShaderStage::Compute, {}, Spirv)) {
+        VkShaderModule Module = RHI.CreateShaderModule(Spirv);
+        Pipeline = RHI.CreateComputePipeline(Module, PipelineLayout);
+        vkDestroyShaderModule(Device, Module, nullptr);
+    } else {
+        RE_LOGE("The temporal upscaling shader failed to compile.");
+    }
+
+    CreateTargets();
+}
+
+FTemporalUpscaler::~FTemporalUpscaler() {
+    DestroyTargets();
+    VkDevice Device = RHI.GetDevice();
+    if(Pipeline != VK_NULL_HANDLE) { vkDestroyPipeline(Device, Pipeline, nullptr); }
+    vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
+    vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(Device, DescriptorSetLayout, nullptr);
+    vkDestroySampler(Device, LinearSampler, nullptr);
+    vkDestroySampler(Device, PointSampler, nullptr);
+    vkDestroyRenderPass(Device, SceneRenderPass, nullptr);
+}
+
+void FTemporalUpscaler::Resize(VkExtent2D InOutputExtent, VkExtent2D InMaxRenderExtent) {
+    if(InOutputExtent.width == OutputExtent.width &&
+       InOutputExtent.height == OutputExtent.height &&
+       InMaxRenderExtent.width == MaxRenderExtent.width &&
+       InMaxRenderExtent.height == MaxRenderExtent.height) {
+        return;
+    }
+    DestroyTargets();
+    OutputExtent = InOutputExtent;
+    MaxRenderExtent = InMaxRenderExtent;
+    CreateTargets();
+}
+
+void FTemporalUpscaler::CreateTargets() {
+    VkDevice Device = RHI.GetDevice();
+    RE_LOGI(
+        "Temporal upscaler targets for {}x{} from up to {}x{}.", OutputExtent.width,
+        OutputExtent.height, MaxRenderExtent.width, MaxRenderExtent.height);
+
+    VkImageCreateInfo ImageCreateInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    ImageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    ImageCreateInfo.format = ColorFormat;
+    ImageCreateInfo.extent = {MaxRenderExtent.width, MaxRenderExtent.height, 1};
+    ImageCreateInfo.mipLevels = 1;
+    ImageCreateInfo.arrayLayers = 1;
+    ImageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    ImageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    ImageCreateInfo.usage =
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    ImageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    SceneColor = RHI.CreateImage(ImageCreateInfo, VMA_MEMORY_USAGE_GPU_ONLY);
+    SceneColorView = RHI.CreateImageView(SceneColor, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    ImageCreateInfo.format = DepthFormat;
+    ImageCreateInfo.usage =
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    SceneDepth = RHI.CreateImage(ImageCreateInfo, VMA_MEMORY_USAGE_GPU_ONLY);
+    SceneDepthView = RHI.CreateImageView(SceneDepth, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+    ImageCreateInfo.format = ColorFormat;
+    ImageCreateInfo.extent = {OutputExtent.width, OutputExtent.height, 1};
+    ImageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+                            VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    for(uint32_t i = 0; i < 2; i++) {
+        History[i] = RHI.CreateImage(ImageCreateInfo, VMA_MEMORY_USAGE_GPU_ONLY);
+        HistoryViews[i] = RHI.CreateImageView(History[i], VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+
+    const VkImageView Attachments[] = {SceneColorView, SceneDepthView};
+    VkFramebufferCreateInfo FramebufferCreateInfo{
+        VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
+    FramebufferCreateInfo.renderPass = SceneRenderPass;
+    FramebufferCreateInfo.attachmentCount = 2;
+    FramebufferCreateInfo.pAttachments = Attachments;
+    FramebufferCreateInfo.width = MaxRenderExtent.width;
+    FramebufferCreateInfo.height = MaxRenderExtent.height;
+    FramebufferCreateInfo.layers = 1;
+    vk_check(
+        vkCreateFramebuffer(Device, &FramebufferCreateInfo, nullptr, &SceneFramebuffer));
+
+    // The history read by the first frame's descriptors must be in a valid layout even
+    // though the shader ignores it.
+    RHI.ImmediateSubmit([this](VkCommandBuffer CommandBuffer) {
+        VkImageMemoryBarrier Barriers[2];
+        for(uint32_t i = 0; i < 2; i++) {
+            Barriers[i] = MakeBarrier(
+                History[i].Image, VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, VK_ACCESS_SHADER_READ_BIT);
+        }
+        vkCmdPipelineBarrier(
+            CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, Barriers);
+    });
+
+    // Set i writes history i and reads the other one.
+    for(uint32_t i = 0; i < 2; i++) {
+        const VkDescriptorImageInfo ImageInfos[Binding_Count] = {
+            {PointSampler, SceneColorView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+            {PointSampler, SceneDepthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+            {LinearSampler, HistoryViews[1 - i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+            {VK_NULL_HANDLE, HistoryViews[i], VK_IMAGE_LAYOUT_GENERAL},
+        };
+        VkWriteDescriptorSet Writes[Binding_Count];
+        for(uint32_t Binding = 0; Binding < Binding_Count; Binding++) {
+            Writes[Binding] = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+            Writes[Binding].dstSet = DescriptorSets[i];
+            Writes[Binding].dstBinding = Binding;
+            Writes[Binding].descriptorCount = 1;
+            Writes[Binding].descriptorType =
+                Binding == Binding_HistoryWrite ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+                                                : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            Writes[Binding].pImageInfo = &ImageInfos[Binding];
+        }
+        vkUpdateDescriptorSets(Device, Binding_Count, Writes, 0, nullptr);
+    }
+    bHistoryValid = false;
+}
+
+void FTemporalUpscaler::DestroyTargets() {
+    VkDevice Device = RHI.GetDevice();
+    if(SceneFramebuffer != VK_NULL_HANDLE) {
+        vkDestroyFramebuffer(Device, SceneFramebuffer, nullptr);
+        SceneFramebuffer = VK_NULL_HANDLE;
+    }
+    for(VkImageView *View: {&SceneColorView, &SceneDepthView, &HistoryViews[0],
+                            &HistoryViews[1]}) {
+        if(*View != VK_NULL_HANDLE) { vkDestroyImageView(Device, *View, nullptr); }
+        *View = VK_NULL_HANDLE;
+    }
+    for(FImage *Image: {&SceneColor, &SceneDepth, &History[0], &History[1]}) {
+        RHI.DestroyImage(*Image);
+    }
+}
+
+glm::vec2 FTemporalUpscaler::GetJitter(
+    uint64_t FrameNumber, VkExtent2D RenderExtent) const {
+    // 8 phases per output pixel covered by a render pixel.
+    const float Ratio = float(OutputExtent.width) / float(std::max(RenderExtent.width, 1u));
+    const uint32_t PhaseCount =
+        std::clamp(static_cast<uint32_t>(std::ceil(8.0f * Ratio * Ratio)), 8u, 64u);
+    // The sequence starts at 1, index 0 would always give the origin.
+    const uint32_t Index = static_cast<uint32_t>(FrameNumber % PhaseCount) + 1;
+    return {Halton(Index, 2) - 0.5f, Halton(Index, 3) - 0.5f};
+}
+
+glm::mat4 FTemporalUpscaler::ApplyJitter(
+    const glm::mat4 &ViewToClip, glm::vec2 Jitter, VkExtent2D RenderExtent) {
+    // Moves the image by Jitter pixels, x right and y down with clip space y up.
+    const glm::vec3 Offset(
+        2.0f * Jitter.x / float(RenderExtent.width),
+        -2.0f * Jitter.y / float(RenderExtent.height), 0.0f);
+    return glm::translate(glm::mat4(1.0f), Offset) * ViewToClip;
+}
+
+void FTemporalUpscaler::BeginScenePass(
+    VkCommandBuffer CommandBuffer, VkExtent2D RenderExtent,
+    const glm::vec4 &ClearColor) {
+    RenderExtent.width = std::min(RenderExtent.width, MaxRenderExtent.width);
+    RenderExtent.height = std::min(RenderExtent.height, MaxRenderExtent.height);
+
+    VkClearValue ClearValues[2]{};
+    ClearValues[0].color = {{ClearColor.r, ClearColor.g, ClearColor.b, ClearColor.a}};
+    ClearValues[1].depthStencil = {1.0f, 0};
+    VkRenderPassBeginInfo BeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+    BeginInfo.renderPass = SceneRenderPass;
+    BeginInfo.framebuffer = SceneFramebuffer;
+    BeginInfo.renderArea = {{0, 0}, RenderExtent};
+    BeginInfo.clearValueCount = 2;
+    BeginInfo.pClearValues = ClearValues;
+    vkCmdBeginRenderPass(CommandBuffer, &BeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    const VkViewport Viewport{
+        0.0f, 0.0f, float(RenderExtent.width), float(RenderExtent.height), 0.0f, 1.0f};
+    vkCmdSetViewport(CommandBuffer, 0, 1, &Viewport);
+    vkCmdSetScissor(CommandBuffer, 0, 1, &BeginInfo.renderArea);
+}
+
+void FTemporalUpscaler::EndScenePass(VkCommandBuffer CommandBuffer) {
+    vkCmdEndRenderPass(CommandBuffer);
+    if(bAsyncCompute) {
+        TransferSceneTargets(
+            CommandBuffer, SceneColor.Image, SceneDepth.Image, RHI.GetGraphicsQueueIndex(),
+            RHI.GetComputeQueueIndex(), true);
+    }
+}
+
+void FTemporalUpscaler::SetAsyncCompute(bool bEnable) {
+    bAsyncCompute = bEnable && RHI.GetCapabilities().bAsyncCompute;
+}
+
+void FTemporalUpscaler::Upscale(
+    VkCommandBuffer CommandBuffer, VkExtent2D RenderExtent, glm::vec2 Jitter,
+    const glm::mat4 &ClipToPrevClip) {
+    if(Pipeline == VK_NULL_HANDLE) { return; }
+    RenderExtent.width = std::min(RenderExtent.width, MaxRenderExtent.width);
+    RenderExtent.height = std::min(RenderExtent.height, MaxRenderExtent.height);
+
+    if(bAsyncCompute) {
+        TransferSceneTargets(
+            CommandBuffer, SceneColor.Image, SceneDepth.Image, RHI.GetGraphicsQueueIndex(),
+            RHI.GetComputeQueueIndex(), false);
+    }
+
+    // The other history becomes the one read, its old contents are overwritten.
+    HistoryIndex = 1 - HistoryIndex;
+    const VkImage Target = History[HistoryIndex].Image;
+    VkImageMemoryBarrier Barrier = MakeBarrier(
+        Target, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0,
+        VK_ACCESS_SHADER_WRITE_BIT);
+    vkCmdPipelineBarrier(
+        CommandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
+
+    const FUpscaleConstants Constants{
+        ClipToPrevClip,
+        {Jitter, bHistoryValid ? 1.0f : 0.0f, 0.0f},
+        {RenderExtent.width, RenderExtent.height, OutputExtent.width,
+         OutputExtent.height}};
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipeline);
+    vkCmdBindDescriptorSets(
+        CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, PipelineLayout, 0, 1,
+        &DescriptorSets[HistoryIndex], 0, nullptr);
+    vkCmdPushConstants(
+        CommandBuffer, PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Constants),
+        &Constants);
+    vkCmdDispatch(
+        CommandBuffer, (OutputExtent.width + UpscaleGroupSize - 1) / UpscaleGroupSize,
+        (OutputExtent.height + UpscaleGroupSize - 1) / UpscaleGroupSize, 1);
+
+    Barrier = MakeBarrier(
+        Target, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
+    bHistoryValid = true;
+}
+}
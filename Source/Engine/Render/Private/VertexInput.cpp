@@ -0,0 +1,91 @@
+﻿#include "Render/VertexInput.h"
+
+namespace RE {
+VkPipelineVertexInputStateCreateInfo FVertexInputState::GetCreateInfo() const {
+    VkPipelineVertexInputStateCreateInfo CreateInfo{
+        VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
+    CreateInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(Bindings.size());
+    CreateInfo.pVertexBindingDescriptions = Bindings.data();
+    CreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(Attributes.size());
+    CreateInfo.pVertexAttributeDescriptions = Attributes.data();
+    return CreateInfo;
+}
+
+VkFormat FVertexInput::GetFormat(EVertexAttributeFormat Format) {
+    switch(Format) {
+        case EVertexAttributeFormat::Float32x2: return VK_FORMAT_R32G32_SFLOAT;
+        case EVertexAttributeFormat::Float32x3: return VK_FORMAT_R32G32B32_SFLOAT;
+        case EVertexAttributeFormat::Float32x4: return VK_FORMAT_R32G32B32A32_SFLOAT;
+        case EVertexAttributeFormat::Unorm16x4: return VK_FORMAT_R16G16B16A16_UNORM;
+        case EVertexAttributeFormat::Snorm16x2: return VK_FORMAT_R16G16_SNORM;
+        case EVertexAttributeFormat::Snorm8x2: return VK_FORMAT_R8G8_SNORM;
+        case EVertexAttributeFormat::Half16x2: return VK_FORMAT_R16G16_SFLOAT;
+        case EVertexAttributeFormat::Unorm16x2: return VK_FORMAT_R16G16_UNORM;
+        default: return VK_FORMAT_UNDEFINED;
+    }
+}
+
+FVertexInputState FVertexInput::CreateState(const FVertexLayout &Layout, uint32_t Binding) {
+    FVertexInputState State;
+    State.Bindings.push_back({Binding, Layout.Stride, VK_VERTEX_INPUT_RATE_VERTEX});
+
+    for(const FVertexAttribute &Attribute: Layout.Attributes) {
+        if(Attribute.Format == EVertexAttributeFormat::None) { continue; }
+        VkVertexInputAttributeDescription Description{};
+        Description.location = GetVertexInputLocation(Attribute.Semantic);
+        Description.binding = Binding;
+        Description.format = GetFormat(Attribute.Format);
+        Description.offset = Attribute.Offset;
+        State.Attributes.push_back(Description);
+    }
+    return State;
+}
+
+void FVertexInput::AddInstanceTransform(FVertexInputState &State, uint32_t Binding) {
+    State.Bindings.push_back({Binding, sizeof(glm::mat4), VK_VERTEX_INPUT_RATE_INSTANCE});
+    for(uint32_t Column = 0; Column < 4; Column++) {
+        State.Attributes.push_back(
+            {InstanceTransformLocation + Column, Binding, VK_FORMAT_R32G32B32A32_SFLOAT,
+             Column * uint32_t(sizeof(glm::vec4))});
+    }
+}
+
+std::vector<std::string> FVertexInput::GetShaderDefines(const FVertexLayout &Layout) {
+    std::vector<std::string> Defines;
+    auto IsOctahedral = [&Layout](EVertexSemantic Semantic) {
+        const EVertexAttributeFormat Format = Layout.Get(Semantic).Format;
+        return Format == EVertexAttributeFormat::Snorm16x2 ||
+               Format == EVertexAttributeFormat::Snorm8x2;
+    };
+
+    if(Layout.Get(EVertexSemantic::Position).Format == EVertexAttributeFormat::Unorm16x4) {
+        Defines.emplace_back("RE_VERTEX_POSITION_QUANTIZED");
+    }
+    if(Layout.Has(EVertexSemantic::Normal)) {
+        Defines.emplace_back("RE_VERTEX_HAS_NORMAL");
+        if(IsOctahedral(EVertexSemantic::Normal)) {
+            Defines.emplace_back("RE_VERTEX_NORMAL_OCTAHEDRAL");
+        }
+        // Shaders fetching from a storage buffer need to know the packed width.
+        if(Layout.Get(EVertexSemantic::Normal).Format == EVertexAttributeFormat::Snorm8x2) {
+            Defines.emplace_back("RE_VERTEX_NORMAL_OCTAHEDRAL8");
+        }
+    }
+    if(Layout.Has(EVertexSemantic::Tangent)) {
+        Defines.emplace_back("RE_VERTEX_HAS_TANGENT");
+        if(IsOctahedral(EVertexSemantic::Tangent)) {
+            Defines.emplace_back("RE_VERTEX_TANGENT_OCTAHEDRAL");
+        }
+    }
+    if(Layout.Has(EVertexSemantic::TexCoord)) {
+        Defines.emplace_back("RE_VERTEX_HAS_TEXCOORD");
+        if(Layout.Get(EVertexSemantic::TexCoord).Format == EVertexAttributeFormat::Unorm16x2) {
+            Defines.emplace_back("RE_VERTEX_TEXCOORD_QUANTIZED");
+        }
+        if(Layout.Get(EVertexSemantic::TexCoord).Format == EVertexAttributeFormat::Half16x2) {
+            Defines.emplace_back("RE_VERTEX_TEXCOORD_HALF");
+        }
+    }
+    return Defines;
+}
+}
@@ -0,0 +1,636 @@
+﻿#include "Render/VirtualShadowMap.h"
+#include "RHI/ShaderCompiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace RE {
+namespace {
+// Mirrors FVirtualShadowParams in Shaders/Include/VirtualShadowMap.glsl, std140.
+struct FVirtualShadowParams {
+    glm::mat4 WorldToVirtual;
+    glm::ivec4 Window;
+    glm::vec4 Atlas;
+    glm::vec4 LightDirection;
+};
+
+// Mirrors FMarkConstants in Shaders/VirtualShadowMark.comp.
+struct FMarkConstants {
+    glm::mat4 ClipToWorld;
+    glm::uvec4 DepthSize;
+};
+
+enum EShadingBinding : uint32_t { Binding_Params, Binding_PageTable, Binding_Shadow };
+enum EMarkBinding : uint32_t {
+    MarkBinding_Params,
+    MarkBinding_Depth,
+    MarkBinding_Requests
+};
+
+constexpr VkFormat PhysicalFormat = VK_FORMAT_D32_SFLOAT;
+constexpr uint32_t MarkGroupSize = 8;
+constexpr uint32_t InvalidPage = UINT32_MAX;
+// Set in page table entries of mapped pages, the low bits hold the physical page.
+constexpr uint32_t PageValidBit = 1u << 31;
+// Light turns smaller than this keep the pages, about 0.8 degrees.
+constexpr float LightDirectionTolerance = 0.9999f;
+}
+
+FVirtualShadowMap::FVirtualShadowMap(FRHI &RHI, const FVirtualShadowSettings &InSettings)
+    : RHI(RHI), Settings(InSettings) {
+    checkf(
+        Settings.VirtualResolution % Settings.PageSize == 0 &&
+            Settings.PhysicalResolution % Settings.PageSize == 0,
+        "Shadow map resolutions must be multiples of the page size {}.", Settings.PageSize);
+    VkDevice Device = RHI.GetDevice();
+    PagesPerSide = Settings.VirtualResolution / Settings.PageSize;
+    PhysicalPagesPerRow = Settings.PhysicalResolution / Settings.PageSize;
+    PageWorldSize = Settings.WorldSize / static_cast<float>(PagesPerSide);
+
+    PhysicalPages.resize(GetPhysicalPageCount());
+    for(uint32_t Page = GetPhysicalPageCount(); Page > 0; Page--) {
+        FreePages.push_back(Page - 1);
+    }
+    PageLookup.reserve(GetPhysicalPageCount());
+
+    // The pool holds exactly the atlas, its size is what the virtual map costs.
+    VkImageCreateInfo ImageCreateInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    ImageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    ImageCreateInfo.format = PhysicalFormat;
+    ImageCreateInfo.extent = {Settings.PhysicalResolution, Settings.PhysicalResolution, 1};
+    ImageCreateInfo.mipLevels = 1;
+    ImageCreateInfo.arrayLayers = 1;
+    ImageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    ImageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    ImageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    ImageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    PhysicalMemory = RHI.CreateImagePool(ImageCreateInfo, VMA_MEMORY_USAGE_GPU_ONLY, 0, 1);
+    PhysicalImage = RHI.CreateImage(ImageCreateInfo, PhysicalMemory);
+    PhysicalView = RHI.CreateImageView(PhysicalImage, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+    // Pages keep their contents between frames, the pass only loads and stores.
+    VkAttachmentDescription Attachment{};
+    Attachment.format = PhysicalFormat;
+    Attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    Attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    Attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    Attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    Attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    Attachment.initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    Attachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    const VkAttachmentReference DepthRef{
+        0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+    VkSubpassDescription Subpass{};
+    Subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    Subpass.pDepthStencilAttachment = &DepthRef;
+
+    VkSubpassDependency Dependencies[2]{};
+    Dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    Dependencies[0].dstSubpass = 0;
+    Dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    Dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    Dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    Dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    Dependencies[1].srcSubpass = 0;
+    Dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    Dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    Dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    Dependencies[1].dstStageMask =
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    Dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    VkRenderPassCreateInfo RenderPassCreateInfo{VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
+    RenderPassCreateInfo.attachmentCount = 1;
+    RenderPassCreateInfo.pAttachments = &Attachment;
+    RenderPassCreateInfo.subpassCount = 1;
+    RenderPassCreateInfo.pSubpasses = &Subpass;
+    RenderPassCreateInfo.dependencyCount = 2;
+    RenderPassCreateInfo.pDependencies = Dependencies;
+    vk_check(vkCreateRenderPass(Device, &RenderPassCreateInfo, nullptr, &RenderPass));
+
+    VkFramebufferCreateInfo FramebufferCreateInfo{
+        VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
+    FramebufferCreateInfo.renderPass = RenderPass;
+    FramebufferCreateInfo.attachmentCount = 1;
+    FramebufferCreateInfo.pAttachments = &PhysicalView;
+    FramebufferCreateInfo.width = Settings.PhysicalResolution;
+    FramebufferCreateInfo.height = Settings.PhysicalResolution;
+    FramebufferCreateInfo.layers = 1;
+    vk_check(vkCreateFramebuffer(Device, &FramebufferCreateInfo, nullptr, &Framebuffer));
+
+    // The render pass expects the atlas readable from the start.
+    RHI.ImmediateSubmit([this](VkCommandBuffer CommandBuffer) {
+        const VkImageSubresourceRange Range{VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+        VkImageMemoryBarrier Barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+        Barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        Barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        Barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        Barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        Barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        Barrier.image = PhysicalImage.Image;
+        Barrier.subresourceRange = Range;
+        vkCmdPipelineBarrier(
+            CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
+        const VkClearDepthStencilValue ClearValue{1.0f, 0};
+        vkCmdClearDepthStencilImage(
+            CommandBuffer, PhysicalImage.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            &ClearValue, 1, &Range);
+        Barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        Barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        Barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        Barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(
+            CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
+    });
+
+    // Linear comparisons for the shading lookup, which keeps to the inside of a page.
+    VkSamplerCreateInfo SamplerCreateInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    SamplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+    SamplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    SamplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    SamplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    SamplerCreateInfo.compareEnable = VK_TRUE;
+    SamplerCreateInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    vk_check(vkCreateSampler(Device, &SamplerCreateInfo, nullptr, &ShadowSampler));
+    SamplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+    SamplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+    SamplerCreateInfo.compareEnable = VK_FALSE;
+    vk_check(vkCreateSampler(Device, &SamplerCreateInfo, nullptr, &DepthSampler));
+
+    const VkDeviceSize TableSize =
+        VkDeviceSize(PagesPerSide) * PagesPerSide * sizeof(uint32_t);
+    for(uint32_t Frame = 0; Frame < MaxFramesInFlight; Frame++) {
+        ParamsBuffers[Frame] = RHI.CreateBuffer(
+            sizeof(FVirtualShadowParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VMA_MEMORY_USAGE_CPU_TO_GPU);
+        PageTableBuffers[Frame] = RHI.CreateBuffer(
+            TableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+        RequestBuffers[Frame] = RHI.CreateBuffer(
+            TableSize,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_GPU_TO_CPU);
+    }
+
+    constexpr VkShaderStageFlags Shared =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    const VkDescriptorSetLayoutBinding Bindings[] = {
+        {Binding_Params, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, Shared, nullptr},
+        {Binding_PageTable, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, Shared, nullptr},
+        {Binding_Shadow, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, Shared, nullptr},
+    };
+    VkDescriptorSetLayoutCreateInfo LayoutCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    LayoutCreateInfo.bindingCount = static_cast<uint32_t>(std::size(Bindings));
+    LayoutCreateInfo.pBindings = Bindings;
+    vk_check(vkCreateDescriptorSetLayout(
+        Device, &LayoutCreateInfo, nullptr, &DescriptorSetLayout));
+
+    constexpr VkShaderStageFlags Compute = VK_SHADER_STAGE_COMPUTE_BIT;
+    const VkDescriptorSetLayoutBinding MarkBindings[] = {
+        {MarkBinding_Params, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, Compute, nullptr},
+        {MarkBinding_Depth, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, Compute,
+         nullptr},
+        {MarkBinding_Requests, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, Compute, nullptr},
+    };
+    LayoutCreateInfo.bindingCount = static_cast<uint32_t>(std::size(MarkBindings));
+    LayoutCreateInfo.pBindings = MarkBindings;
+    vk_check(
+        vkCreateDescriptorSetLayout(Device, &LayoutCreateInfo, nullptr, &MarkSetLayout));
+
+    const VkDescriptorPoolSize PoolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 * MaxFramesInFlight},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * MaxFramesInFlight},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * MaxFramesInFlight},
+    };
+    VkDescriptorPoolCreateInfo PoolCreateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    PoolCreateInfo.maxSets = 2 * MaxFramesInFlight;
+    PoolCreateInfo.poolSizeCount = static_cast<uint32_t>(std::size(PoolSizes));
+    PoolCreateInfo.pPoolSizes = PoolSizes;
+    vk_check(vkCreateDescriptorPool(Device, &PoolCreateInfo, nullptr, &DescriptorPool));
+
+    const VkDescriptorSetLayout Layouts[2 * MaxFramesInFlight] = {
+        DescriptorSetLayout, DescriptorSetLayout, MarkSetLayout, MarkSetLayout};
+    VkDescriptorSet Sets[2 * MaxFramesInFlight];
+    VkDescriptorSetAllocateInfo AllocateInfo{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    AllocateInfo.descriptorPool = DescriptorPool;
+    AllocateInfo.descriptorSetCount = 2 * MaxFramesInFlight;
+    AllocateInfo.pSetLayouts = Layouts;
+    vk_check(vkAllocateDescriptorSets(Device, &AllocateInfo, Sets));
+
+    for(uint32_t Frame = 0; Frame < MaxFramesInFlight; Frame++) {
+        DescriptorSets[Frame] = Sets[Frame];
+        MarkSets[Frame] = Sets[MaxFramesInFlight + Frame];
+
+        // The depth binding of the mark set is written once MarkPages sees a depth view.
+        const VkDescriptorBufferInfo ParamsInfo{
+            ParamsBuffers[Frame].Buffer, 0, VK_WHOLE_SIZE};
+        const VkDescriptorBufferInfo TableInfo{
+            PageTableBuffers[Frame].Buffer, 0, VK_WHOLE_SIZE};
+        const VkDescriptorBufferInfo RequestInfo{
+            RequestBuffers[Frame].Buffer, 0, VK_WHOLE_SIZE};
+        const VkDescriptorImageInfo ShadowInfo{
+            ShadowSampler, PhysicalView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+        VkWriteDescriptorSet Writes[5];
+        for(VkWriteDescriptorSet &Write: Writes) {
+            Write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+            Write.descriptorCount = 1;
+        }
+        Writes[0].dstSet = DescriptorSets[Frame];
+        Writes[0].dstBinding = Binding_Params;
+        Writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        Writes[0].pBufferInfo = &ParamsInfo;
+        Writes[1].dstSet = DescriptorSets[Frame];
+        Writes[1].dstBinding = Binding_PageTable;
+        Writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        Writes[1].pBufferInfo = &TableInfo;
+        Writes[2].dstSet = DescriptorSets[Frame];
+        Writes[2].dstBinding = Binding_Shadow;
+        Writes[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        Writes[2].pImageInfo = &ShadowInfo;
+        Writes[3].dstSet = MarkSets[Frame];
+        Writes[3].dstBinding = MarkBinding_Params;
+        Writes[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        Writes[3].pBufferInfo = &ParamsInfo;
+        Writes[4].dstSet = MarkSets[Frame];
+        Writes[4].dstBinding = MarkBinding_Requests;
+        Writes[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        Writes[4].pBufferInfo = &RequestInfo;
+        vkUpdateDescriptorSets(Device, 5, Writes, 0, nullptr);
+    }
+
+    const VkPushConstantRange PushConstantRange{
+        VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FMarkConstants)};
+    VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo{
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    PipelineLayoutCreateInfo.setLayoutCount = 1;
+    PipelineLayoutCreateInfo.pSetLayouts = &MarkSetLayout;
+    PipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    PipelineLayoutCreateInfo.pPushConstantRanges = &PushConstantRange;
+    vk_check(vkCreatePipelineLayout(
+        Device, &PipelineLayoutCreateInfo, nullptr, &MarkPipelineLayout));
+
+    std::vector<uint32_t> Spirv;
+    if(FShaderCompiler::Get().Compile(
+           "VirtualShadowMark.comp", EShaderStage::Compute, {}, Spirv)) {
+        VkShaderModule Module = RHI.CreateShaderModule(Spirv);
+        MarkPipeline = RHI.CreateComputePipeline(Module, MarkPipelineLayout);
+        vkDestroyShaderModule(Device, Module, nullptr);
+    } else {
+        RE_LOGE("The virtual shadow map marking shader failed to compile.");
+    }
+
+    VkDeviceSize PoolSize, PoolUsed;
+    RHI.GetMemoryPoolUsage(PhysicalMemory, PoolSize, PoolUsed);
+    RE_LOGI(
+        "Virtual shadow map of {}^2 texels backed by {} pages in {} MiB.",
+        Settings.VirtualResolution, GetPhysicalPageCount(), PoolSize >> 20);
+}
+
+FVirtualShadowMap::~FVirtualShadowMap() {
+    VkDevice Device = RHI.GetDevice();
+    if(MarkPipeline != VK_NULL_HANDLE) { vkDestroyPipeline(Device, MarkPipeline, nullptr); }
+    vkDestroyPipelineLayout(Device, MarkPipelineLayout, nullptr);
+    vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(Device, MarkSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Device, DescriptorSetLayout, nullptr);
+    for(uint32_t Frame = 0; Frame < MaxFramesInFlight; Frame++) {
+        RHI.DestroyBuffer(ParamsBuffers[Frame]);
+        RHI.DestroyBuffer(PageTableBuffers[Frame]);
+        RHI.DestroyBuffer(RequestBuffers[Frame]);
+    }
+    vkDestroySampler(Device, DepthSampler, nullptr);
+    vkDestroySampler(Device, ShadowSampler, nullptr);
+    vkDestroyFramebuffer(Device, Framebuffer, nullptr);
+    vkDestroyRenderPass(Device, RenderPass, nullptr);
+    vkDestroyImageView(Device, PhysicalView, nullptr);
+    RHI.DestroyImage(PhysicalImage);
+    RHI.DestroyMemoryPool(PhysicalMemory);
+}
+
+uint64_t FVirtualShadowMap::GetPageKey(glm::ivec2 VirtualPage) {
+    return (uint64_t(uint32_t(VirtualPage.y)) << 32) | uint32_t(VirtualPage.x);
+}
+
+VkDeviceSize FVirtualShadowMap::GetPhysicalMemorySize() const {
+    VkDeviceSize Size, Used;
+    RHI.GetMemoryPoolUsage(PhysicalMemory, Size, Used);
+    return Size;
+}
+
+void FVirtualShadowMap::Update(
+    const glm::vec3 &CameraPosition, const glm::vec3 &InLightDirection, uint32_t Frame) {
+    const uint32_t FrameIndex = Frame % MaxFramesInFlight;
+    FrameCounter++;
+
+    // Pages are fixed in light space, so turning the light invalidates all of them and
+    // the requests marked in the old space.
+    const glm::vec3 Direction = glm::normalize(InLightDirection);
+    if(!bHasLight || glm::dot(Direction, LightDirection) < LightDirectionTolerance) {
+        LightDirection = Direction;
+        const glm::vec3 Up = std::abs(Direction.z) > 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f)
+                                                           : glm::vec3(0.0f, 0.0f, 1.0f);
+        WorldToLight = glm::lookAtRH(glm::vec3(0.0f), Direction, Up);
+        UnmapAll();
+        std::fill(std::begin(bMarked), std::end(bMarked), false);
+        bHasLight = true;
+    }
+
+    // The depth range follows the camera in quarter steps, each step changes the depth
+    // of every page.
+    const glm::vec3 LightCamera = WorldToLight * glm::vec4(CameraPosition, 1.0f);
+    const float DepthStep = Settings.DepthRange * 0.25f;
+    const float NewDepthCenter = std::round(LightCamera.z / DepthStep) * DepthStep;
+    if(NewDepthCenter != DepthCenter) {
+        DepthCenter = NewDepthCenter;
+        InvalidateAll();
+    }
+    WindowOrigin = glm::ivec2(glm::floor(glm::vec2(LightCamera) / PageWorldSize)) -
+                   glm::ivec2(int32_t(PagesPerSide / 2));
+
+    EvictionQueue.clear();
+    PageIndicesToRender.clear();
+    if(bMarked[FrameIndex]) {
+        const FBuffer &Requests = RequestBuffers[FrameIndex];
+        vmaInvalidateAllocation(RHI.GetAllocator(), Requests.Allocation, 0, VK_WHOLE_SIZE);
+        const auto *Flags = static_cast<const uint32_t *>(Requests.MappedData);
+        const glm::ivec2 Origin = MarkedOrigins[FrameIndex];
+
+        // Requested pages that are mapped are touched first, so they are not evicted.
+        std::vector<glm::ivec2> Missing;
+        std::vector<uint32_t> Dirty;
+        for(uint32_t i = 0; i < PagesPerSide * PagesPerSide; i++) {
+            if(Flags[i] == 0) { continue; }
+            const glm::ivec2 Page =
+                Origin + glm::ivec2(int32_t(i % PagesPerSide), int32_t(i / PagesPerSide));
+            auto It = PageLookup.find(GetPageKey(Page));
+            if(It == PageLookup.end()) {
+                Missing.push_back(Page);
+                continue;
+            }
+            FPhysicalPage &Physical = PhysicalPages[It->second];
+            Physical.LastUsedFrame = FrameCounter;
+            if(Physical.bDirty) { Dirty.push_back(It->second); }
+        }
+
+        // Empty pages come before stale ones, the rest wait for the next frames.
+        const uint32_t MaxRenders = Settings.MaxPageRendersPerFrame;
+        for(const glm::ivec2 &Page: Missing) {
+            if(PageIndicesToRender.size() == MaxRenders) { break; }
+            const uint32_t Index = MapPage(Page);
+            if(Index == InvalidPage) {
+                RE_LOGW(
+                    "The virtual shadow page pool is full, {} pages are missing.",
+                    Missing.size() - PageIndicesToRender.size());
+                break;
+            }
+            PageIndicesToRender.push_back(Index);
+        }
+        for(uint32_t Index: Dirty) {
+            if(PageIndicesToRender.size() == MaxRenders) { break; }
+            PhysicalPages[Index].bDirty = false;
+            PageIndicesToRender.push_back(Index);
+        }
+    }
+
+    // The light looks down -z, near and far are distances along it.
+    const float HalfDepth = Settings.DepthRange * 0.5f;
+    const float Near = -DepthCenter - HalfDepth;
+    const float Far = -DepthCenter + HalfDepth;
+    PagesToRender.clear();
+    for(uint32_t Index: PageIndicesToRender) {
+        const glm::vec2 Min = glm::vec2(PhysicalPages[Index].VirtualPage) * PageWorldSize;
+        const glm::vec2 Max = Min + PageWorldSize;
+        FVirtualShadowPage &Page = PagesToRender.emplace_back();
+        Page.WorldToClip =
+            glm::orthoRH_ZO(Min.x, Max.x, Min.y, Max.y, Near, Far) * WorldToLight;
+        Page.CullFrustum = FFrustum::FromMatrix(Page.WorldToClip);
+        Page.PhysicalRect = {
+            {int32_t(Index % PhysicalPagesPerRow * Settings.PageSize),
+             int32_t(Index / PhysicalPagesPerRow * Settings.PageSize)},
+            {Settings.PageSize, Settings.PageSize}};
+    }
+
+    // Light space xy in pages and the depth the pages were rendered with.
+    FVirtualShadowParams Params;
+    Params.WorldToVirtual =
+        glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -Near / (Far - Near))) *
+        glm::scale(
+            glm::mat4(1.0f),
+            glm::vec3(1.0f / PageWorldSize, 1.0f / PageWorldSize, -1.0f / (Far - Near))) *
+        WorldToLight;
+    Params.Window = {WindowOrigin, int32_t(PagesPerSide), int32_t(PhysicalPagesPerRow)};
+    const float PhysicalSize = static_cast<float>(Settings.PhysicalResolution);
+    Params.Atlas = {
+        float(Settings.PageSize) / PhysicalSize, 1.0f / PhysicalSize,
+        PageWorldSize / float(Settings.PageSize), 0.0f};
+    Params.LightDirection = glm::vec4(LightDirection, 0.0f);
+    std::memcpy(ParamsBuffers[FrameIndex].MappedData, &Params, sizeof(Params));
+    WritePageTable(FrameIndex);
+}
+
+uint32_t FVirtualShadowMap::MapPage(glm::ivec2 VirtualPage) {
+    uint32_t Index;
+    if(!FreePages.empty()) {
+        Index = FreePages.back();
+        FreePages.pop_back();
+    } else {
+        if(EvictionQueue.empty()) {
+            for(uint32_t i = 0; i < PhysicalPages.size(); i++) {
+                if(PhysicalPages[i].LastUsedFrame < FrameCounter) {
+                    EvictionQueue.push_back(i);
+                }
+            }
+            std::sort(
+                EvictionQueue.begin(), EvictionQueue.end(), [this](uint32_t A, uint32_t B) {
+                    return PhysicalPages[A].LastUsedFrame > PhysicalPages[B].LastUsedFrame;
+                });
+        }
+        // Everything is in use this frame.
+        if(EvictionQueue.empty()) { return InvalidPage; }
+        Index = EvictionQueue.back();
+        EvictionQueue.pop_back();
+        PageLookup.erase(GetPageKey(PhysicalPages[Index].VirtualPage));
+    }
+
+    FPhysicalPage &Page = PhysicalPages[Index];
+    Page.VirtualPage = VirtualPage;
+    Page.LastUsedFrame = FrameCounter;
+    Page.bMapped = true;
+    Page.bDirty = false;
+    PageLookup[GetPageKey(VirtualPage)] = Index;
+    return Index;
+}
+
+void FVirtualShadowMap::UnmapAll() {
+    PageLookup.clear();
+    FreePages.clear();
+    for(uint32_t Page = GetPhysicalPageCount(); Page > 0; Page--) {
+        PhysicalPages[Page - 1] = {};
+        FreePages.push_back(Page - 1);
+    }
+}
+
+void FVirtualShadowMap::InvalidateAll() {
+    for(FPhysicalPage &Page: PhysicalPages) {
+        if(Page.bMapped) { Page.bDirty = true; }
+    }
+}
+
+void FVirtualShadowMap::InvalidateBounds(const glm::vec3 &Center, const glm::vec3 &Extent) {
+    if(PageLookup.empty()) { return; }
+
+    // Depth along the light does not matter, a caster shadows every page under it.
+    glm::vec2 Min(std::numeric_limits<float>::max());
+    glm::vec2 Max(std::numeric_limits<float>::lowest());
+    for(uint32_t Corner = 0; Corner < 8; Corner++) {
+        const glm::vec3 Sign(
+            Corner & 1 ? 1.0f : -1.0f, Corner & 2 ? 1.0f : -1.0f,
+            Corner & 4 ? 1.0f : -1.0f);
+        const glm::vec2 Point = WorldToLight * glm::vec4(Center + Sign * Extent, 1.0f);
+        Min = glm::min(Min, Point);
+        Max = glm::max(Max, Point);
+    }
+    const glm::ivec2 First(glm::floor(Min / PageWorldSize));
+    const glm::ivec2 Last(glm::floor(Max / PageWorldSize));
+
+    // Walk whichever is smaller, the covered pages or the mapped ones.
+    const int64_t Covered = int64_t(Last.x - First.x + 1) * (Last.y - First.y + 1);
+    if(Covered <= int64_t(PageLookup.size())) {
+        for(int32_t y = First.y; y <= Last.y; y++) {
+            for(int32_t x = First.x; x <= Last.x; x++) {
+                auto It = PageLookup.find(GetPageKey({x, y}));
+                if(It != PageLookup.end()) { PhysicalPages[It->second].bDirty = true; }
+            }
+        }
+        return;
+    }
+    for(FPhysicalPage &Page: PhysicalPages) {
+        if(Page.bMapped && glm::all(glm::greaterThanEqual(Page.VirtualPage, First)) &&
+           glm::all(glm::lessThanEqual(Page.VirtualPage, Last))) {
+            Page.bDirty = true;
+        }
+    }
+}
+
+void FVirtualShadowMap::WritePageTable(uint32_t FrameIndex) {
+    auto *Table = static_cast<uint32_t *>(PageTableBuffers[FrameIndex].MappedData);
+    for(uint32_t y = 0; y < PagesPerSide; y++) {
+        for(uint32_t x = 0; x < PagesPerSide; x++) {
+            const glm::ivec2 Page = WindowOrigin + glm::ivec2(int32_t(x), int32_t(y));
+            auto It = PageLookup.find(GetPageKey(Page));
+            Table[y * PagesPerSide + x] =
+                It != PageLookup.end() ? It->second | PageValidBit : 0;
+        }
+    }
+}
+
+bool FVirtualShadowMap::BeginPagePass(VkCommandBuffer CommandBuffer) {
+    if(PagesToRender.empty()) { return false; }
+
+    VkRenderPassBeginInfo BeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+    BeginInfo.renderPass = RenderPass;
+    BeginInfo.framebuffer = Framebuffer;
+    BeginInfo.renderArea = {
+        {0, 0}, {Settings.PhysicalResolution, Settings.PhysicalResolution}};
+    vkCmdBeginRenderPass(CommandBuffer, &BeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    // Only the pages about to be drawn are cleared, the others stay cached.
+    std::vector<VkClearRect> Rects;
+    Rects.reserve(PagesToRender.size());
+    for(const FVirtualShadowPage &Page: PagesToRender) {
+        Rects.push_back({Page.PhysicalRect, 0, 1});
+    }
+    VkClearAttachment Clear{};
+    Clear.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    Clear.clearValue.depthStencil = {1.0f, 0};
+    vkCmdClearAttachments(
+        CommandBuffer, 1, &Clear, static_cast<uint32_t>(Rects.size()), Rects.data());
+    return true;
+}
+
+void FVirtualShadowMap::SetPage(VkCommandBuffer CommandBuffer, uint32_t Page) {
+    const VkRect2D &Rect = PagesToRender[Page].PhysicalRect;
+    const VkViewport Viewport{
+        float(Rect.offset.x), float(Rect.offset.y), float(Rect.extent.width),
+        float(Rect.extent.height), 0.0f, 1.0f};
+    vkCmdSetViewport(CommandBuffer, 0, 1, &Viewport);
+    vkCmdSetScissor(CommandBuffer, 0, 1, &Rect);
+}
+
+void FVirtualShadowMap::EndPagePass(VkCommandBuffer CommandBuffer) {
+    vkCmdEndRenderPass(CommandBuffer);
+}
+
+void FVirtualShadowMap::MarkPages(
+    VkCommandBuffer CommandBuffer, VkImageView DepthView, VkExtent2D DepthSize,
+    const glm::mat4 &WorldToClip, uint32_t Frame) {
+    if(MarkPipeline == VK_NULL_HANDLE) { return; }
+    if(DepthSize.width == 0 || DepthSize.height == 0) { return; }
+    const uint32_t FrameIndex = Frame % MaxFramesInFlight;
+
+    // The frame slot is idle, its set can be pointed at a new depth buffer.
+    if(MarkedDepthViews[FrameIndex] != DepthView) {
+        const VkDescriptorImageInfo DepthInfo{
+            DepthSampler, DepthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        VkWriteDescriptorSet Write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        Write.dstSet = MarkSets[FrameIndex];
+        Write.dstBinding = MarkBinding_Depth;
+        Write.descriptorCount = 1;
+        Write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        Write.pImageInfo = &DepthInfo;
+        vkUpdateDescriptorSets(RHI.GetDevice(), 1, &Write, 0, nullptr);
+        MarkedDepthViews[FrameIndex] = DepthView;
+    }
+
+    vkCmdFillBuffer(
+        CommandBuffer, RequestBuffers[FrameIndex].Buffer, 0, VK_WHOLE_SIZE, 0);
+    VkMemoryBarrier ResetBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    ResetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    ResetBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &ResetBarrier, 0, nullptr, 0,
+        nullptr);
+
+    const FMarkConstants Constants{
+        glm::inverse(WorldToClip), {DepthSize.width, DepthSize.height, 0, 0}};
+    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, MarkPipeline);
+    vkCmdBindDescriptorSets(
+        CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, MarkPipelineLayout, 0, 1,
+        &MarkSets[FrameIndex], 0, nullptr);
+    vkCmdPushConstants(
+        CommandBuffer, MarkPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+        sizeof(Constants), &Constants);
+    vkCmdDispatch(
+        CommandBuffer, (DepthSize.width + MarkGroupSize - 1) / MarkGroupSize,
+        (DepthSize.height + MarkGroupSize - 1) / MarkGroupSize, 1);
+
+    // Read back by Update once the frame slot comes round again.
+    VkMemoryBarrier MarkBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    MarkBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    MarkBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(
+        CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+        0, 1, &MarkBarrier, 0, nullptr, 0, nullptr);
+
+    MarkedOrigins[FrameIndex] = WindowOrigin;
+    bMarked[FrameIndex] = true;
+}
+}
@@ -0,0 +1,142 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+#include "Render/FrustumCulling.h"
+
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace RE {
+struct FCascadedShadowSettings {
+    static constexpr uint32_t MaxCascades = 4;
+
+    uint32_t CascadeCount{4};
+    uint32_t Resolution{2048};
+    /* Distance from the camera covered by the last cascade. */
+    float ShadowDistance{150.0f};
+    /* Blend of logarithmic (1) and uniform (0) split distances. */
+    float SplitLambda{0.75f};
+    /* Casters this far towards the light beyond a cascade still cast into it. */
+    float CasterDistance{200.0f};
+    /* Cascades from this index on cache their static casters, CascadeCount disables. */
+    uint32_t FirstCachedCascade{2};
+    /*
+     * Extra coverage of cached cascades relative to their slice, so the camera can move
+     * this far before the cascade has to move and its static casters be redrawn.
+     */
+    float CacheMargin{0.25f};
+};
+
+/* The camera a shadow frame is fitted to, with a symmetric perspective projection. */
+struct FShadowView {
+    glm::mat4 ViewToWorld{1.0f};
+    float TanHalfFovY{1.0f};
+    float AspectRatio{1.0f};
+    float NearPlane{0.1f};
+};
+
+struct FShadowCascade {
+    glm::mat4 WorldToClip{1.0f};
+    /* View depth where this cascade ends and the next one takes over. */
+    float SplitDepth{0.0f};
+    /* World space size of a shadow map texel, for scaling filter radii and biases. */
+    float TexelSize{0.0f};
+    /* Includes the caster extension towards the light. */
+    FFrustum CullFrustum{};
+};
+
+/* Mirrors FShadowParams in Shaders/Include/CascadedShadows.glsl, std140. */
+struct FShadowShaderParams {
+    glm::mat4 WorldToShadow[FCascadedShadowSettings::MaxCascades];
+    glm::vec4 SplitDepths;
+    glm::vec4 TexelSizes;
+    /* Towards the scene in xyz, the cascade count in w. */
+    glm::vec4 LightDirection;
+};
+
+/*
+ * Cascaded shadow maps for one directional light. Cascades are fitted to the bounding
+ * sphere of their slice of the view frustum, so their size does not change as the camera
+ * turns, and their origin snaps to whole texels of a light space grid, so the texels do
+ * not crawl as it moves.
+ *
+ * Far cascades hold their static casters in a cache layer that is only redrawn when the
+ * cascade has to move, the light turns or InvalidateStaticCache is called. Every frame
+ * the cache is copied into the shadow map and just the dynamic casters are drawn on top.
+ *
+ * A frame goes: Update, then for each cascade BeginStaticPass/EndPass if
+ * NeedsStaticPass, then BeginDynamicPass/EndPass, then the map is ready for sampling.
+ * Casters are culled per cascade against GetCascade(i).CullFrustum, e.g. all cascades in
+ * one FFrustumCuller pass. Caster pipelines use GetRenderPass with a dynamic viewport
+ * and scissor, and should carry a depth bias scaled by the texel size. Shaders include
+ * Shaders/Include/CascadedShadows.glsl.
+ */
+class RE_RENDER_EXPORT FCascadedShadows {
+public:
+    FCascadedShadows(FRHI &RHI, const FCascadedShadowSettings &Settings = {});
+    ~FCascadedShadows();
+
+    FCascadedShadows(const FCascadedShadows &) = delete;
+    FCascadedShadows &operator=(const FCascadedShadows &) = delete;
+
+    /* Fits the cascades, LightDirection points from the light into the scene. */
+    void Update(const FShadowView &View, const glm::vec3 &LightDirection);
+    /* Static casters were added, removed or moved. */
+    void InvalidateStaticCache();
+
+    bool IsCached(uint32_t Cascade) const { return Cascade >= Settings.FirstCachedCascade; }
+    bool NeedsStaticPass(uint32_t Cascade) const;
+
+    /* Begins drawing static casters into the cache of a cached cascade. */
+    void BeginStaticPass(VkCommandBuffer CommandBuffer, uint32_t Cascade);
+    /* Begins drawing dynamic casters, or all casters for an uncached cascade. */
+    void BeginDynamicPass(VkCommandBuffer CommandBuffer, uint32_t Cascade);
+    /* After the dynamic pass the layer is in SHADER_READ_ONLY_OPTIMAL. */
+    void EndPass(VkCommandBuffer CommandBuffer);
+
+    uint32_t GetCascadeCount() const { return Settings.CascadeCount; }
+    const FShadowCascade &GetCascade(uint32_t Cascade) const { return Cascades[Cascade]; }
+    FShadowShaderParams GetShaderParams() const;
+
+    VkRenderPass GetRenderPass() const { return ClearRenderPass; }
+    /* A 2D array view with one layer per cascade. */
+    VkImageView GetView() const { return ShadowView; }
+    /* Linear depth comparison sampler for sampler2DArrayShadow. */
+    VkSampler GetSampler() const { return Sampler; }
+
+private:
+    void FitCascade(
+        uint32_t Cascade, const FShadowView &View, float SliceNear, float SliceFar);
+    void BeginPass(
+        VkCommandBuffer CommandBuffer, VkRenderPass RenderPass, VkFramebuffer Framebuffer,
+        bool bClear);
+
+    FRHI &RHI;
+    FCascadedShadowSettings Settings;
+    FShadowCascade Cascades[FCascadedShadowSettings::MaxCascades];
+
+    glm::mat4 WorldToLight{1.0f};
+    glm::vec3 LightDirection{0.0f, 0.0f, -1.0f};
+    /* Light space bounds of each cascade, cached cascades keep theirs while they can. */
+    glm::vec3 Centers[FCascadedShadowSettings::MaxCascades]{};
+    float Radii[FCascadedShadowSettings::MaxCascades]{};
+    bool bStaticDirty[FCascadedShadowSettings::MaxCascades]{};
+    bool bHasFrame{false};
+
+    FImage ShadowImage;
+    FImage CacheImage;
+    VkImageView ShadowView{VK_NULL_HANDLE};
+    std::vector<VkImageView> LayerViews;
+    std::vector<VkImageView> CacheLayerViews;
+    std::vector<VkFramebuffer> Framebuffers;
+    std::vector<VkFramebuffer> CacheFramebuffers;
+    VkSampler Sampler{VK_NULL_HANDLE};
+    /* Clears into SHADER_READ_ONLY, or into TRANSFER_SRC for cache layers. */
+    VkRenderPass ClearRenderPass{VK_NULL_HANDLE};
+    VkRenderPass CacheRenderPass{VK_NULL_HANDLE};
+    /* Keeps the copied static depth and draws dynamic casters on top. */
+    VkRenderPass LoadRenderPass{VK_NULL_HANDLE};
+};
+}
@@ -0,0 +1,145 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+#include "RHI/ShaderCompiler.h"
+#include "Asset/MeshData.h"
+#include "Asset/VertexFormat.h"
+
+#include <glm/glm.hpp>
+
+namespace RE {
+enum EClusterCullFlags : uint32_t {
+    ClusterCull_Frustum = 1 << 0,
+    ClusterCull_Cone = 1 << 1,
+    /* Only effective once a depth pyramid has been set. */
+    ClusterCull_Occlusion = 1 << 2,
+    ClusterCull_All = ClusterCull_Frustum | ClusterCull_Cone | ClusterCull_Occlusion,
+};
+
+struct FClusterCullView {
+    glm::mat4 WorldToView{1.0f};
+    /* Vulkan clip space with 0..1 depth and a finite far plane. */
+    glm::mat4 ViewToClip{1.0f};
+    glm::vec3 CameraPosition{0.0f};
+    uint32_t Flags{ClusterCull_All};
+};
+
+/*
+ * Draws meshlet clusters of many mesh instances with per cluster culling on the GPU.
+ *
+ * With NV mesh shaders the task shader culls and emits visible meshlets directly.
+ * Otherwise a compute pass writes one indexed indirect draw per cluster, consumed by
+ * vkCmdDrawIndexedIndirectCount when available and by vkCmdDrawIndexedIndirect with
+ * zero instance counts for culled clusters when not.
+ */
+class RE_RENDER_EXPORT FClusterCuller {
+public:
+    static constexpr uint32_t MaxFramesInFlight = 2;
+    static constexpr uint32_t InvalidId = UINT32_MAX;
+
+    explicit FClusterCuller(FRHI &RHI);
+    ~FClusterCuller();
+
+    FClusterCuller(const FClusterCuller &) = delete;
+    FClusterCuller &operator=(const FClusterCuller &) = delete;
+
+    /* All meshes must encode to the same vertex layout and carry meshlets. */
+    uint32_t AddMesh(const FMeshData &Mesh);
+    uint32_t AddInstance(uint32_t MeshId, const glm::mat4 &LocalToWorld);
+
+    /* Uploads the geometry and creates the pipelines for the given subpass. */
+    bool Build(VkRenderPass RenderPass, uint32_t Subpass = 0);
+
+    /*
+     * Enables occlusion culling against a farthest depth pyramid of the previous frame.
+     * Recreates the pipelines, so no frame using the culler may be in flight.
+     */
+    bool SetOcclusionPyramid(VkImageView PyramidView, VkSampler Sampler, VkExtent2D Size);
+
+    /* Records the culling pass, must be outside of a render pass. */
+    void Cull(
+        VkCommandBuffer CommandBuffer, const FClusterCullView &View, uint32_t Frame);
+    /* Records the cluster draws inside the render pass given to Build. */
+    void Draw(VkCommandBuffer CommandBuffer, uint32_t Frame);
+
+    bool UsesMeshShaders() const { return bMeshShaders; }
+    uint32_t GetClusterCount() const { return static_cast<uint32_t>(Clusters.size()); }
+    const FVertexLayout &GetVertexLayout() const { return VertexLayout; }
+
+private:
+    struct FGpuCluster {
+        glm::vec4 BoundingSphere;
+        glm::vec4 ConeApexCutoff;
+        glm::vec4 ConeAxis;
+        uint32_t FirstIndex;
+        uint32_t IndexCount;
+        uint32_t MeshletIndex;
+        uint32_t InstanceIndex;
+    };
+
+    struct FGpuInstance {
+        glm::mat4 LocalToWorld;
+        FVertexQuantization Quantization;
+        glm::uvec4 VertexBase;
+    };
+
+    struct FMeshRange {
+        FVertexQuantization Quantization;
+        uint32_t BaseVertex{0};
+        uint32_t FirstMeshlet{0};
+        uint32_t MeshletCount{0};
+    };
+
+    bool CreatePipelines();
+    void DestroyPipelines();
+    VkShaderModule CompileShader(
+        std::string_view Path, EShaderStage Stage,
+        const std::vector<std::string> &Defines);
+    void WriteDescriptors();
+
+    FRHI &RHI;
+    bool bMeshShaders{false};
+    bool bBuilt{false};
+
+    FVertexLayout VertexLayout;
+    std::vector<uint8_t> Vertices;
+    uint32_t VertexCount{0};
+    std::vector<uint32_t> Indices;
+    std::vector<FMeshlet> Meshlets;
+    std::vector<FMeshletBounds> MeshletBounds;
+    /* Index range of every meshlet in Indices. */
+    std::vector<glm::uvec2> MeshletIndexRanges;
+    std::vector<uint32_t> MeshletVertices;
+    std::vector<uint8_t> MeshletTriangles;
+    std::vector<FMeshRange> Meshes;
+    std::vector<FGpuInstance> Instances;
+    std::vector<FGpuCluster> Clusters;
+
+    FBuffer ViewBuffer;
+    VkDeviceSize ViewStride{0};
+    FBuffer ClusterBuffer;
+    FBuffer InstanceBuffer;
+    FBuffer DrawCommandBuffer;
+    FBuffer DrawCountBuffer;
+    FBuffer MeshletBuffer;
+    FBuffer MeshletVertexBuffer;
+    FBuffer MeshletTriangleBuffer;
+    FBuffer VertexBuffer;
+    FBuffer IndexBuffer;
+
+    VkRenderPass RenderPass{VK_NULL_HANDLE};
+    uint32_t Subpass{0};
+    struct {
+        VkImageView View{VK_NULL_HANDLE};
+        VkSampler Sampler{VK_NULL_HANDLE};
+        VkExtent2D Size{0, 0};
+    } Pyramid;
+
+    VkDescriptorSetLayout DescriptorSetLayout{VK_NULL_HANDLE};
+    VkDescriptorPool DescriptorPool{VK_NULL_HANDLE};
+    VkDescriptorSet DescriptorSet{VK_NULL_HANDLE};
+    VkPipelineLayout PipelineLayout{VK_NULL_HANDLE};
+    VkPipeline CullPipeline{VK_NULL_HANDLE};
+    VkPipeline DrawPipeline{VK_NULL_HANDLE};
+};
+}
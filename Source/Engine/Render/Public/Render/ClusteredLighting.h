@@ -0,0 +1,105 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace RE {
+enum class ELightType : uint32_t { Point, Spot };
+
+/* Mirrors FClusterLight in Shaders/Include/ClusteredLighting.glsl, std430. */
+struct FClusterLight {
+    glm::vec3 Position{0.0f};
+    /* Distance at which the light has faded out completely. */
+    float Radius{1.0f};
+    /* Linear color premultiplied by intensity. */
+    glm::vec3 Color{1.0f};
+    ELightType Type{ELightType::Point};
+    /* Spot lights only, the direction the cone opens towards in world space. */
+    glm::vec3 Direction{0.0f, 0.0f, -1.0f};
+    float SpotCosOuter{0.0f};
+    float SpotCosInner{0.0f};
+    uint32_t Padding[3]{};
+};
+static_assert(sizeof(FClusterLight) == 64, "FClusterLight must match the shader layout.");
+
+struct FClusteredLightingSettings {
+    uint32_t TileCountX{16};
+    uint32_t TileCountY{9};
+    /* Depth slices, spaced exponentially between the near and far plane. */
+    uint32_t SliceCount{24};
+    uint32_t MaxLights{16384};
+    /* Lights beyond this many in one cluster are dropped. */
+    uint32_t MaxLightsPerCluster{256};
+    /* Sizes the shared index list, clusters past its end get no lights. */
+    uint32_t AverageLightsPerCluster{48};
+};
+
+/*
+ * Clustered forward shading after Olsson et al. The view frustum is split into a grid of
+ * screen tiles and exponential depth slices. Each frame a compute pass tests every light
+ * against the view space box of every cluster, a thread per cluster walking the lights
+ * in chunks shared by its work group, and writes an offset and count per cluster into a
+ * compact list of light indices. Forward passes bind the set from GetDescriptorSet,
+ * include Shaders/Include/ClusteredLighting.glsl with RE_CLUSTERED_LIGHTING_SET defined
+ * and loop over just the lights of their fragment's cluster.
+ */
+class RE_RENDER_EXPORT FClusteredLighting {
+public:
+    static constexpr uint32_t MaxFramesInFlight = 2;
+
+    FClusteredLighting(FRHI &RHI, const FClusteredLightingSettings &Settings = {});
+    ~FClusteredLighting();
+
+    FClusteredLighting(const FClusteredLighting &) = delete;
+    FClusteredLighting &operator=(const FClusteredLighting &) = delete;
+
+    /* Replaces the lights of the next Update, at most MaxLights are kept. */
+    void SetLights(std::span<const FClusterLight> InLights);
+
+    /*
+     * Records the light upload and culling outside of a render pass, for a y-up
+     * perspective projection with 0..1 depth. Fragment shaders may read the result
+     * afterwards.
+     */
+    void Update(
+        VkCommandBuffer CommandBuffer, const glm::mat4 &WorldToView,
+        const glm::mat4 &ViewToClip, float NearPlane, float FarPlane,
+        VkExtent2D ViewportSize, uint32_t Frame);
+
+    /* Uniform buffer 0, storage buffers 1 (lights), 2 (cluster grid) and 3 (indices). */
+    VkDescriptorSetLayout GetDescriptorSetLayout() const { return DescriptorSetLayout; }
+    VkDescriptorSet GetDescriptorSet(uint32_t Frame) const {
+        return DescriptorSets[Frame % MaxFramesInFlight];
+    }
+
+    uint32_t GetClusterCount() const {
+        return Settings.TileCountX * Settings.TileCountY * Settings.SliceCount;
+    }
+    uint32_t GetLightCount() const { return static_cast<uint32_t>(Lights.size()); }
+
+private:
+    FRHI &RHI;
+    FClusteredLightingSettings Settings;
+    uint32_t MaxLightIndices{0};
+    std::vector<FClusterLight> Lights;
+
+    /* Per frame in flight, written by the CPU. */
+    FBuffer ParamsBuffers[MaxFramesInFlight];
+    FBuffer LightBuffers[MaxFramesInFlight];
+    FBuffer GridBuffer;
+    FBuffer IndexBuffer;
+    /* A fixed run of MaxLightsPerCluster per cluster, gathered before compaction. */
+    FBuffer ScratchBuffer;
+    FBuffer CounterBuffer;
+
+    VkDescriptorSetLayout DescriptorSetLayout{VK_NULL_HANDLE};
+    VkDescriptorPool DescriptorPool{VK_NULL_HANDLE};
+    VkDescriptorSet DescriptorSets[MaxFramesInFlight]{};
+    VkPipelineLayout PipelineLayout{VK_NULL_HANDLE};
+    VkPipeline Pipeline{VK_NULL_HANDLE};
+};
+}
@@ -0,0 +1,60 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+
+#include <vector>
+
+namespace RE {
+/*
+ * Hierarchical Z buffer built from a depth attachment with a compute shader. Level 0 is
+ * the largest power of two not above the depth size, every texel keeps the farthest depth
+ * of its footprint, so a bound behind a texel is behind everything the texel covers.
+ */
+class RE_RENDER_EXPORT FDepthPyramid {
+public:
+    explicit FDepthPyramid(FRHI &RHI);
+    ~FDepthPyramid();
+
+    FDepthPyramid(const FDepthPyramid &) = delete;
+    FDepthPyramid &operator=(const FDepthPyramid &) = delete;
+
+    /*
+     * (Re)creates the pyramid for a depth view of the given size. The view is sampled by
+     * every Build, so it must outlive the pyramid or the next Resize. No frame using the
+     * pyramid may be in flight.
+     */
+    bool Resize(VkImageView DepthView, VkExtent2D DepthSize);
+
+    /*
+     * Records the reduction. The depth image must be in SHADER_READ_ONLY_OPTIMAL with its
+     * writes made visible to compute shaders; afterwards every level is in
+     * SHADER_READ_ONLY_OPTIMAL too.
+     */
+    void Build(VkCommandBuffer CommandBuffer);
+
+    bool IsValid() const { return Image.IsValid(); }
+    VkImageView GetView() const { return View; }
+    /* Nearest filtering with clamped edges, reads must pick their level explicitly. */
+    VkSampler GetSampler() const { return Sampler; }
+    VkExtent2D GetSize() const { return Size; }
+    uint32_t GetMipCount() const { return Image.MipLevels; }
+
+private:
+    void Destroy();
+
+    FRHI &RHI;
+    FImage Image;
+    VkExtent2D Size{0, 0};
+    VkImageView View{VK_NULL_HANDLE};
+    std::vector<VkImageView> MipViews;
+    VkSampler Sampler{VK_NULL_HANDLE};
+
+    VkDescriptorSetLayout DescriptorSetLayout{VK_NULL_HANDLE};
+    VkDescriptorPool DescriptorPool{VK_NULL_HANDLE};
+    /* One per level, reading the level above or the depth view for level 0. */
+    std::vector<VkDescriptorSet> DescriptorSets;
+    VkPipelineLayout PipelineLayout{VK_NULL_HANDLE};
+    VkPipeline Pipeline{VK_NULL_HANDLE};
+    VkExtent2D DepthSize{0, 0};
+};
+}
@@ -0,0 +1,114 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+
+#include <vector>
+
+namespace RE {
+/*
+ * Sort key of a draw, most significant first: pass, pipeline, material and depth bucket.
+ * Pipeline and material ids are small dense numbers chosen by the caller, so that draws
+ * sharing state end up next to each other.
+ */
+struct RE_RENDER_EXPORT FDrawKey {
+    static constexpr uint32_t PassBits = 6;
+    static constexpr uint32_t PipelineBits = 14;
+    static constexpr uint32_t MaterialBits = 20;
+    static constexpr uint32_t DepthBits = 24;
+
+    static uint64_t Make(
+        uint32_t Pass, uint32_t Pipeline, uint32_t Material, uint32_t DepthBucket);
+    /*
+     * Quantizes a view space distance keeping its order, front to back unless
+     * bBackToFront is set for blended passes.
+     */
+    static uint32_t GetDepthBucket(float ViewDepth, bool bBackToFront = false);
+
+    static uint32_t GetPass(uint64_t Key) {
+        return static_cast<uint32_t>(Key >> (PipelineBits + MaterialBits + DepthBits));
+    }
+};
+
+static_assert(
+    FDrawKey::PassBits + FDrawKey::PipelineBits + FDrawKey::MaterialBits +
+        FDrawKey::DepthBits == 64,
+    "Draw key fields should fill the key.");
+
+/* The state of one indexed draw, bound by FDrawList only where it changes. */
+struct FDrawCommand {
+    static constexpr uint32_t MaxDescriptorSets = 2;
+
+    VkPipeline Pipeline{VK_NULL_HANDLE};
+    VkPipelineLayout PipelineLayout{VK_NULL_HANDLE};
+    /* Bound from set 0, the first null handle ends the list. */
+    VkDescriptorSet DescriptorSets[MaxDescriptorSets]{};
+    VkBuffer VertexBuffer{VK_NULL_HANDLE};
+    VkDeviceSize VertexBufferOffset{0};
+    /* Per instance data at binding 1, left unbound when null. */
+    VkBuffer InstanceBuffer{VK_NULL_HANDLE};
+    VkBuffer IndexBuffer{VK_NULL_HANDLE};
+    uint32_t IndexCount{0};
+    uint32_t InstanceCount{1};
+    uint32_t FirstIndex{0};
+    int32_t VertexOffset{0};
+    uint32_t FirstInstance{0};
+};
+
+struct FDrawListStats {
+    uint32_t Draws{0};
+    uint32_t PipelineBinds{0};
+    uint32_t DescriptorSetBinds{0};
+    uint32_t VertexBufferBinds{0};
+    uint32_t InstanceBufferBinds{0};
+    uint32_t IndexBufferBinds{0};
+    /* Binds that matched the state already set and were left out. */
+    uint32_t SkippedPipelineBinds{0};
+    uint32_t SkippedDescriptorSetBinds{0};
+    uint32_t SkippedVertexBufferBinds{0};
+    uint32_t SkippedInstanceBufferBinds{0};
+    uint32_t SkippedIndexBufferBinds{0};
+
+    uint32_t GetSkippedBinds() const {
+        return SkippedPipelineBinds + SkippedDescriptorSetBinds +
+               SkippedVertexBufferBinds + SkippedInstanceBufferBinds +
+               SkippedIndexBufferBinds;
+    }
+};
+
+/*
+ * Collects the draws of a frame, sorts them by key with an LSD radix sort, which stays
+ * linear in the draw count and skips digits all keys share, and records them while
+ * leaving out every bind of state that is already current.
+ */
+class RE_RENDER_EXPORT FDrawList {
+public:
+    void Reset();
+    void Reserve(uint32_t Count);
+    void Add(uint64_t Key, const FDrawCommand &Command);
+
+    void Sort();
+    /*
+     * Records the sorted draws with keys in [FirstPass, LastPass] into a command buffer
+     * inside a render pass, all of them by default. Nothing is assumed to be bound
+     * beforehand.
+     */
+    void Record(
+        VkCommandBuffer CommandBuffer, uint32_t FirstPass = 0,
+        uint32_t LastPass = UINT32_MAX);
+
+    uint32_t GetCount() const { return static_cast<uint32_t>(Commands.size()); }
+    /* Bind counts summed over the Record calls since the last Reset. */
+    const FDrawListStats &GetStats() const { return Stats; }
+
+private:
+    struct FSortEntry {
+        uint64_t Key;
+        uint32_t Command;
+    };
+
+    std::vector<FDrawCommand> Commands;
+    std::vector<FSortEntry> Entries;
+    std::vector<FSortEntry> SortScratch;
+    FDrawListStats Stats;
+};
+}
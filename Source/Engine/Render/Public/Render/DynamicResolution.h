@@ -0,0 +1,66 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+
+namespace RE {
+struct FDynamicResolutionSettings {
+    /* GPU time per frame to hold, in milliseconds. */
+    float TargetFrameTime{16.6f};
+    /* Fraction of the target aimed for, leaving room for spikes. */
+    float Headroom{0.9f};
+    /* Bounds of the scale applied to each axis of the output size. */
+    float MinScale{0.5f};
+    float MaxScale{1.0f};
+    /* Render sizes are rounded to multiples of this many pixels. */
+    uint32_t Alignment{8};
+};
+
+/*
+ * Picks the internal render resolution from measured GPU frame times. GPU cost is taken
+ * to grow with the pixel count, so the axis scale moves by the square root of the ratio
+ * between target and measured time. Overruns are answered at once, while the scale only
+ * creeps back up once the smoothed time stays clearly under the target, so fluctuating
+ * load does not make the resolution oscillate.
+ *
+ * Frame times come from a pair of timestamps per frame in flight written around the
+ * frame by BeginFrame and EndFrame, read back when the frame slot comes round again.
+ * ReportGpuTime takes times measured elsewhere instead.
+ */
+class RE_RENDER_EXPORT FDynamicResolution {
+public:
+    static constexpr uint32_t MaxFramesInFlight = 2;
+
+    FDynamicResolution(FRHI &RHI, const FDynamicResolutionSettings &Settings = {});
+    ~FDynamicResolution();
+
+    FDynamicResolution(const FDynamicResolution &) = delete;
+    FDynamicResolution &operator=(const FDynamicResolution &) = delete;
+
+    /* Feeds back the time of this slot's previous frame, then starts timing this one. */
+    void BeginFrame(VkCommandBuffer CommandBuffer, uint32_t Frame);
+    void EndFrame(VkCommandBuffer CommandBuffer, uint32_t Frame);
+
+    void ReportGpuTime(float Milliseconds);
+
+    float GetScale() const { return Scale; }
+    float GetSmoothedGpuTime() const { return SmoothedTime; }
+    /* The output size scaled and aligned, never above the output size. */
+    VkExtent2D GetRenderExtent(VkExtent2D OutputExtent) const;
+    /* The largest render size for an output size, to allocate targets once. */
+    VkExtent2D GetMaxRenderExtent(VkExtent2D OutputExtent) const;
+
+private:
+    VkExtent2D ScaleExtent(VkExtent2D OutputExtent, float AxisScale) const;
+
+    FRHI &RHI;
+    FDynamicResolutionSettings Settings;
+    float Scale{1.0f};
+    float SmoothedTime{0.0f};
+    /* Reports still timing a scale from before the last change, which are skipped. */
+    uint32_t SettleFrames{0};
+
+    VkQueryPool QueryPool{VK_NULL_HANDLE};
+    bool bQueriesWritten[MaxFramesInFlight]{};
+    float TimestampPeriod{1.0f};
+};
+}
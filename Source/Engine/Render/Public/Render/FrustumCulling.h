@@ -0,0 +1,96 @@
+﻿#pragma once
+#include "re-render_export.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace RE {
+enum class ECullShape : uint8_t { Sphere, Box };
+
+struct RE_RENDER_EXPORT FFrustum {
+    /* Left, right, bottom, top, near, far; xyz points inwards and is normalized. */
+    glm::vec4 Planes[6];
+
+    /* Vulkan clip space with 0..1 depth. */
+    static FFrustum FromMatrix(const glm::mat4 &WorldToClip);
+
+    bool TestSphere(const glm::vec3 &Center, float Radius) const;
+    bool TestBox(const glm::vec3 &Center, const glm::vec3 &Extent) const;
+};
+
+/*
+ * Bounding volumes in structure of arrays form, padded to whole SIMD blocks so the
+ * culling loops never need a scalar tail.
+ */
+class RE_RENDER_EXPORT FCullingBounds {
+public:
+    static constexpr uint32_t BlockSize = 8;
+
+    /* Returns the index of the new bounds; the box radius encloses its corners. */
+    uint32_t AddBox(const glm::vec3 &Center, const glm::vec3 &Extent);
+    uint32_t AddSphere(const glm::vec3 &Center, float Radius);
+    void SetBox(uint32_t Index, const glm::vec3 &Center, const glm::vec3 &Extent);
+    void SetSphere(uint32_t Index, const glm::vec3 &Center, float Radius);
+
+    void Reserve(uint32_t Count);
+    void Clear();
+    uint32_t GetCount() const { return Count; }
+
+    const float *GetCenterX() const { return CenterX.data(); }
+    const float *GetCenterY() const { return CenterY.data(); }
+    const float *GetCenterZ() const { return CenterZ.data(); }
+    const float *GetExtentX() const { return ExtentX.data(); }
+    const float *GetExtentY() const { return ExtentY.data(); }
+    const float *GetExtentZ() const { return ExtentZ.data(); }
+    const float *GetRadius() const { return Radius.data(); }
+
+private:
+    uint32_t Append();
+
+    uint32_t Count{0};
+    std::vector<float> CenterX;
+    std::vector<float> CenterY;
+    std::vector<float> CenterZ;
+    std::vector<float> ExtentX;
+    std::vector<float> ExtentY;
+    std::vector<float> ExtentZ;
+    std::vector<float> Radius;
+};
+
+/*
+ * Tests bounds against any number of frusta in a single pass over the arrays, eight
+ * bounds per instruction with AVX, four with SSE or NEON, and writes one compacted list
+ * of visible indices per view. Large sets are split into batches on the task system.
+ */
+class RE_RENDER_EXPORT FFrustumCuller {
+public:
+    /* Bounds per task, the SIMD loop takes a few microseconds per batch. */
+    static constexpr uint32_t BatchSize = 16 * 1024;
+
+    /*
+     * OutVisible must hold one list per view, each is overwritten in ascending order.
+     * Not reentrant, use one culler per thread issuing culls.
+     */
+    void Cull(
+        const FCullingBounds &Bounds, std::span<const FFrustum> Views,
+        std::span<std::vector<uint32_t>> OutVisible);
+
+    void SetShape(ECullShape InShape) { Shape = InShape; }
+    ECullShape GetShape() const { return Shape; }
+    /* Uses the plain C++ loop, mainly to compare against the SIMD path. */
+    void SetForceScalar(bool bInForceScalar) { bForceScalar = bInForceScalar; }
+
+    /* The instruction set selected at compile time: "AVX", "SSE", "NEON" or "Scalar". */
+    static const char *GetSimdName();
+
+private:
+    ECullShape Shape{ECullShape::Sphere};
+    bool bForceScalar{false};
+    /* Per batch output slices, kept between calls to avoid touching fresh pages. */
+    std::vector<uint32_t> Scratch;
+    std::vector<uint32_t> BatchCounts;
+};
+}
@@ -0,0 +1,135 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace RE {
+/* Index range of one mesh in the vertex and index buffers bound for drawing. */
+struct FGpuSceneMesh {
+    uint32_t FirstIndex{0};
+    uint32_t IndexCount{0};
+    int32_t VertexOffset{0};
+    /* Local space bounding sphere. */
+    glm::vec4 BoundingSphere{0.0f};
+};
+
+/* Mirrors FGpuSceneInstance in Shaders/Include/GpuScene.glsl, std430. */
+struct FGpuSceneInstance {
+    glm::mat4 LocalToWorld;
+    glm::vec4 BoundingSphere;
+    uint32_t DrawSlot;
+    uint32_t MeshId;
+    uint32_t MaterialId;
+    uint32_t Padding;
+};
+
+/*
+ * Instance data kept in GPU buffers and drawn without any per object CPU work.
+ *
+ * Instances sharing a mesh and material form a draw slot, an indexed indirect command
+ * whose FirstInstance marks the slot's run in a visible instance buffer. Each frame a
+ * compute pass frustum culls all instances and appends the visible ones to their slot,
+ * then every material draws all of its slots with a single vkCmdDrawIndexedIndirect, or
+ * with vkCmdDrawIndexedIndirectCount over just the non-empty slots where supported.
+ * Material vertex shaders define RE_GPU_SCENE_DRAW, include GpuScene.glsl and fetch their
+ * instance with GetSceneInstance().
+ *
+ * Capacities are fixed at construction so no buffer is ever reallocated under a frame in
+ * flight.
+ */
+class RE_RENDER_EXPORT FGpuScene {
+public:
+    static constexpr uint32_t MaxFramesInFlight = 2;
+    static constexpr uint32_t InvalidId = UINT32_MAX;
+
+    FGpuScene(FRHI &RHI, uint32_t MaxInstances, uint32_t MaxMaterials);
+    ~FGpuScene();
+
+    FGpuScene(const FGpuScene &) = delete;
+    FGpuScene &operator=(const FGpuScene &) = delete;
+
+    uint32_t AddMesh(const FGpuSceneMesh &Mesh);
+    /* MaterialId is a dense index below MaxMaterials chosen by the caller. */
+    uint32_t AddInstance(
+        uint32_t MeshId, uint32_t MaterialId, const glm::mat4 &LocalToWorld);
+    void RemoveInstance(uint32_t InstanceId);
+    void SetTransform(uint32_t InstanceId, const glm::mat4 &LocalToWorld);
+
+    /*
+     * Records the upload of changed instances and the culling pass, outside of a render
+     * pass. Adding or removing instances rebuilds the draw slots here.
+     */
+    void Update(
+        VkCommandBuffer CommandBuffer, const glm::mat4 &WorldToClip, uint32_t Frame);
+    /*
+     * Records the draws of every visible instance of a material. The caller binds the
+     * material pipeline, the scene descriptor set and the vertex and index buffers.
+     */
+    void DrawMaterial(VkCommandBuffer CommandBuffer, uint32_t MaterialId) const;
+
+    /* Storage buffers 0 (instances) and 1 (visible ids), visible to vertex shaders. */
+    VkDescriptorSetLayout GetDescriptorSetLayout() const { return DescriptorSetLayout; }
+    VkDescriptorSet GetDescriptorSet() const { return DescriptorSet; }
+
+    uint32_t GetInstanceCount() const { return InstanceCount; }
+    uint32_t GetDrawSlotCount() const { return static_cast<uint32_t>(Slots.size()); }
+
+private:
+    struct FDrawSlot {
+        uint32_t MeshId;
+        uint32_t MaterialId;
+        uint32_t FirstInstance;
+        uint32_t InstanceCapacity;
+    };
+
+    struct FMaterialRange {
+        uint32_t FirstSlot{0};
+        uint32_t SlotCount{0};
+    };
+
+    bool CreatePipelines();
+    void RebuildSlots();
+    void RecordUploads(VkCommandBuffer CommandBuffer, uint32_t Frame);
+
+    FRHI &RHI;
+    uint32_t MaxInstances;
+    uint32_t MaxMaterials;
+
+    std::vector<FGpuSceneMesh> Meshes;
+    std::vector<FGpuSceneInstance> Instances;
+    std::vector<uint32_t> FreeInstances;
+    uint32_t InstanceCount{0};
+    std::vector<uint32_t> DirtyInstances;
+    std::vector<uint8_t> DirtyFlags;
+    bool bSlotsDirty{false};
+    /* Set on a slot rebuild, the templates go out with the next frame's uploads. */
+    bool bUploadSlots{false};
+
+    /* Sorted by material, then mesh. */
+    std::vector<FDrawSlot> Slots;
+    std::vector<FMaterialRange> MaterialRanges;
+
+    FBuffer InstanceBuffer;
+    FBuffer VisibleBuffer;
+    /* Live draw commands, reset from the templates before every cull. */
+    FBuffer DrawSlotBuffer;
+    FBuffer SlotTemplateBuffer;
+    FBuffer SlotMaterialBuffer;
+    FBuffer CompactDrawBuffer;
+    FBuffer MaterialCountBuffer;
+    /* Per frame in flight, holds instance and slot data for the transfer. */
+    FBuffer StagingBuffers[MaxFramesInFlight];
+
+    VkDescriptorSetLayout DescriptorSetLayout{VK_NULL_HANDLE};
+    VkDescriptorSetLayout CullSetLayout{VK_NULL_HANDLE};
+    VkDescriptorPool DescriptorPool{VK_NULL_HANDLE};
+    VkDescriptorSet DescriptorSet{VK_NULL_HANDLE};
+    VkDescriptorSet CullSet{VK_NULL_HANDLE};
+    VkPipelineLayout CullPipelineLayout{VK_NULL_HANDLE};
+    VkPipeline CullPipeline{VK_NULL_HANDLE};
+    VkPipeline CompactPipeline{VK_NULL_HANDLE};
+};
+}
@@ -0,0 +1,106 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "Render/DrawList.h"
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <tsl/robin_map.h>
+
+namespace RE {
+/*
+ * Merges draws of the same mesh and material into instanced draws on the CPU side, for
+ * objects drawn through FDrawList rather than the GPU scene.
+ *
+ * Instances whose draw command and sort key are identical form a batch, which owns a
+ * range of slots in the instance buffer holding their transforms, bound at binding 1 as
+ * set up by FVertexInput::AddInstanceTransform. Batches persist across frames: adding,
+ * removing or moving an instance only rewrites the slots it touches, and each frame in
+ * flight has its own copy of the buffer that catches up on those slots when its frame
+ * comes round. A batch outgrowing its range moves to the end with twice the capacity,
+ * and the ranges are compacted once the end of the buffer is reached.
+ */
+class RE_RENDER_EXPORT FInstanceBatcher {
+public:
+    static constexpr uint32_t MaxFramesInFlight = 2;
+    static constexpr uint32_t InvalidId = UINT32_MAX;
+
+    FInstanceBatcher(FRHI &RHI, uint32_t MaxInstances);
+    ~FInstanceBatcher();
+
+    FInstanceBatcher(const FInstanceBatcher &) = delete;
+    FInstanceBatcher &operator=(const FInstanceBatcher &) = delete;
+
+    /* Command draws a single instance, its instance buffer and range are set per batch. */
+    uint32_t AddInstance(
+        uint64_t Key, const FDrawCommand &Command, const glm::mat4 &LocalToWorld);
+    void RemoveInstance(uint32_t InstanceId);
+    void SetTransform(uint32_t InstanceId, const glm::mat4 &LocalToWorld);
+
+    /* Writes the slots this frame's buffer is missing and adds one draw per batch. */
+    void AddDraws(FDrawList &DrawList, uint32_t Frame);
+
+    uint32_t GetInstanceCount() const { return InstanceCount; }
+    uint32_t GetBatchCount() const { return BatchCount; }
+    /* Slots written by the last AddDraws, for checking that static batches stay put. */
+    uint32_t GetLastWriteCount() const { return LastWriteCount; }
+
+private:
+    /* Everything that must match for two draws to merge, free of padding for hashing. */
+    struct FBatchKey {
+        uint64_t SortKey;
+        VkPipeline Pipeline;
+        VkPipelineLayout PipelineLayout;
+        VkDescriptorSet DescriptorSets[FDrawCommand::MaxDescriptorSets];
+        VkBuffer VertexBuffer;
+        VkDeviceSize VertexBufferOffset;
+        VkBuffer IndexBuffer;
+        uint32_t IndexCount;
+        uint32_t FirstIndex;
+        int32_t VertexOffset;
+        uint32_t Padding;
+
+        bool operator==(const FBatchKey &Other) const;
+    };
+    struct FBatchKeyHash {
+        size_t operator()(const FBatchKey &Key) const;
+    };
+
+    struct FBatch {
+        FDrawCommand Command;
+        uint64_t SortKey;
+        uint32_t FirstSlot{0};
+        uint32_t Capacity{0};
+        std::vector<uint32_t> Instances;
+    };
+
+    struct FInstance {
+        glm::mat4 LocalToWorld;
+        uint32_t Batch{InvalidId};
+        uint32_t IndexInBatch{0};
+        /* One bit per frame in flight whose buffer still holds an old slot. */
+        uint8_t DirtyFrames{0};
+    };
+
+    void MarkDirty(uint32_t InstanceId);
+    /* Moves the batch to a new range at the end, compacting first if it is full. */
+    void AllocateSlots(FBatch &Batch, uint32_t Capacity);
+    void CompactSlots();
+
+    FRHI &RHI;
+    uint32_t MaxInstances;
+
+    std::vector<FBatch> Batches;
+    tsl::robin_map<FBatchKey, uint32_t, FBatchKeyHash> BatchLookup;
+    uint32_t BatchCount{0};
+    std::vector<FInstance> Instances;
+    std::vector<uint32_t> FreeInstances;
+    uint32_t InstanceCount{0};
+    /* End of the allocated slot ranges, freed ranges are only reclaimed by compaction. */
+    uint32_t SlotEnd{0};
+
+    std::vector<uint32_t> DirtyInstances[MaxFramesInFlight];
+    FBuffer InstanceBuffers[MaxFramesInFlight];
+    uint32_t LastWriteCount{0};
+};
+}
@@ -0,0 +1,96 @@
+﻿#pragma once
+#include "re-render_export.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace RE {
+struct FLodSelectionSettings {
+    /* Largest error in pixels a level may show on screen. */
+    float PixelErrorThreshold{1.0f};
+    /*
+     * Fraction the error must fall below the threshold before a coarser level is taken,
+     * so instances resting near a boundary do not flip between two levels.
+     */
+    float Hysteresis{0.25f};
+    /* Seconds a cross-fade between two levels takes, zero switches at once. */
+    float FadeDuration{0.25f};
+};
+
+struct RE_RENDER_EXPORT FLodView {
+    glm::vec3 Position{0.0f};
+    /* Pixels covered by one unit at a distance of one unit. */
+    float ProjectionScale{1.0f};
+
+    static FLodView FromPerspective(
+        const glm::vec3 &Position, const glm::mat4 &ViewToClip, float ViewportHeight);
+};
+
+/*
+ * While Fade is below one both levels are drawn with complementary dither patterns, Lod
+ * with GetIncomingFade and PreviousLod with GetOutgoingFade, see LodFade.glsl.
+ */
+struct FLodState {
+    uint8_t Lod{0};
+    uint8_t PreviousLod{0};
+    float Fade{1.0f};
+
+    bool IsFading() const { return Fade < 1.0f; }
+    float GetIncomingFade() const { return Fade; }
+    float GetOutgoingFade() const { return Fade - 1.0f; }
+};
+
+/*
+ * Picks a level of every instance from the error of its LOD chain projected to the
+ * screen at the distance of its bounding sphere. Finer levels are taken as soon as the
+ * current one exceeds the threshold, coarser ones only past the hysteresis margin.
+ */
+class RE_RENDER_EXPORT FLodSelector {
+public:
+    static constexpr uint32_t MaxLods = 16;
+    /* Instances per task. */
+    static constexpr uint32_t BatchSize = 4096;
+
+    /* Errors start with the full detail level and grow, as in FMeshLod::Error. */
+    uint32_t AddMesh(std::span<const float> LodErrors);
+    /* Scale converts the object space errors of the mesh into world space. */
+    uint32_t AddInstance(
+        uint32_t Mesh, const glm::vec3 &Center, float Radius, float Scale);
+    void SetInstance(
+        uint32_t Instance, const glm::vec3 &Center, float Radius, float Scale);
+    void Clear();
+
+    /* Selects the levels for this frame and advances the cross-fades by DeltaTime. */
+    void Update(const FLodView &View, float DeltaTime);
+
+    std::span<const FLodState> GetStates() const { return States; }
+    uint32_t GetInstanceCount() const { return static_cast<uint32_t>(Instances.size()); }
+
+    void SetSettings(const FLodSelectionSettings &InSettings) { Settings = InSettings; }
+    const FLodSelectionSettings &GetSettings() const { return Settings; }
+
+private:
+    struct FMesh {
+        uint32_t ErrorOffset;
+        uint32_t LodCount;
+    };
+    struct FInstance {
+        glm::vec3 Center;
+        float Radius;
+        float Scale;
+        uint32_t Mesh;
+    };
+
+    uint32_t SelectLod(
+        const FInstance &Instance, const FLodView &View, uint32_t Current) const;
+
+    FLodSelectionSettings Settings;
+    std::vector<FMesh> Meshes;
+    std::vector<float> Errors;
+    std::vector<FInstance> Instances;
+    std::vector<FLodState> States;
+};
+}
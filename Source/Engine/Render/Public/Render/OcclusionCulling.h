@@ -0,0 +1,112 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace RE {
+class FDepthPyramid;
+
+enum class EOcclusionPhase : uint8_t { Early, Late };
+
+struct FOcclusionInstance {
+    /* World space bounding sphere. */
+    glm::vec4 BoundingSphere{0.0f};
+    uint32_t FirstIndex{0};
+    uint32_t IndexCount{0};
+    int32_t VertexOffset{0};
+};
+
+struct FOcclusionView {
+    glm::mat4 WorldToView{1.0f};
+    /* Vulkan clip space with 0..1 depth and a finite far plane. */
+    glm::mat4 ViewToClip{1.0f};
+    bool bFrustumCulling{true};
+};
+
+/*
+ * Two phase GPU occlusion culling of whole instances against a hierarchical Z buffer.
+ *
+ * A frame records
+ *   Cull(Early), Draw(Early), build the pyramid from the depth so far,
+ *   Cull(Late), Draw(Late), build the pyramid again for the next frame.
+ * The early phase tests against the previous frame's pyramid, projecting bounds with the
+ * camera that pyramid was rendered from, and draws what passes. The late phase re-tests
+ * everything the early phase rejected against the current depth, so objects disoccluded
+ * by camera or occluder movement appear in the same frame.
+ *
+ * Culling writes one indexed indirect draw per visible instance with FirstInstance set to
+ * the instance id, compacted for vkCmdDrawIndexedIndirectCount when available.
+ */
+class RE_RENDER_EXPORT FOcclusionCuller {
+public:
+    static constexpr uint32_t MaxFramesInFlight = 2;
+    static constexpr uint32_t InvalidId = UINT32_MAX;
+
+    explicit FOcclusionCuller(FRHI &RHI);
+    ~FOcclusionCuller();
+
+    FOcclusionCuller(const FOcclusionCuller &) = delete;
+    FOcclusionCuller &operator=(const FOcclusionCuller &) = delete;
+
+    uint32_t AddInstance(const FOcclusionInstance &Instance);
+    bool Build();
+
+    /*
+     * Null disables occlusion culling. Every change, including a pyramid resize, drops the
+     * history, so the next early phase only frustum culls. No frame may be in flight.
+     */
+    void SetDepthPyramid(const FDepthPyramid *InPyramid);
+
+    /* Records the culling pass of a phase, must be outside of a render pass. */
+    void Cull(
+        VkCommandBuffer CommandBuffer, const FOcclusionView &View, EOcclusionPhase Phase,
+        uint32_t Frame);
+    /*
+     * Records the phase's draws inside a render pass. The caller binds the pipeline and
+     * the vertex and index buffers the instance ranges refer to.
+     */
+    void Draw(VkCommandBuffer CommandBuffer, EOcclusionPhase Phase);
+
+    uint32_t GetInstanceCount() const { return static_cast<uint32_t>(Instances.size()); }
+
+private:
+    struct FGpuOcclusionInstance {
+        glm::vec4 BoundingSphere;
+        uint32_t FirstIndex;
+        uint32_t IndexCount;
+        int32_t VertexOffset;
+        uint32_t Padding;
+    };
+
+    void WriteDescriptors();
+
+    FRHI &RHI;
+    bool bBuilt{false};
+    std::vector<FGpuOcclusionInstance> Instances;
+
+    const FDepthPyramid *Pyramid{nullptr};
+    /* Set once a late phase has run against the current pyramid. */
+    bool bHasHistory{false};
+    /* The camera of the last late phase, which the pyramid holds at the next early one. */
+    FOcclusionView HistoryView;
+
+    FBuffer ViewBuffer;
+    VkDeviceSize ViewStride{0};
+    FBuffer InstanceBuffer;
+    FBuffer VisibilityBuffer;
+    /* Commands of the early phase, then of the late phase. */
+    FBuffer DrawCommandBuffer;
+    /* One count per phase. */
+    FBuffer DrawCountBuffer;
+
+    VkDescriptorSetLayout DescriptorSetLayout{VK_NULL_HANDLE};
+    VkDescriptorPool DescriptorPool{VK_NULL_HANDLE};
+    VkDescriptorSet DescriptorSet{VK_NULL_HANDLE};
+    VkPipelineLayout PipelineLayout{VK_NULL_HANDLE};
+    VkPipeline EarlyPipeline{VK_NULL_HANDLE};
+    VkPipeline LatePipeline{VK_NULL_HANDLE};
+};
+}
@@ -0,0 +1,68 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+
+struct ImGuiContext;
+
+namespace RE {
+/*
+ * An ImGui window with the frame's CPU and GPU time graphs, the GPU profiler's pass
+ * timings, the RHI command counts and VMA memory per heap. Update builds the UI before
+ * the frame's render pass and Draw records it into the pass it was created for, usually
+ * the last one writing the swapchain image.
+ *
+ * While hidden neither does anything and the RHI statistics are off, so the overlay costs
+ * nothing unless shown. It shows its own CPU time to keep that honest.
+ */
+class RE_RENDER_EXPORT FPerformanceOverlay {
+public:
+    static constexpr uint32_t MaxFramesInFlight = 2;
+    /* Frames kept for the time graphs. */
+    static constexpr uint32_t HistoryLength = 120;
+
+    FPerformanceOverlay(
+        FRHI &RHI, VkRenderPass RenderPass, uint32_t Subpass, VkFormat TargetFormat);
+    ~FPerformanceOverlay();
+
+    FPerformanceOverlay(const FPerformanceOverlay &) = delete;
+    FPerformanceOverlay &operator=(const FPerformanceOverlay &) = delete;
+
+    /* Showing it turns the RHI statistics on, toggle it between frames. */
+    void SetVisible(bool bInVisible);
+    bool IsVisible() const { return bVisible; }
+
+    /* CPU time of the frame that just ended, and the size of the target. */
+    void Update(float DeltaSeconds, VkExtent2D Extent);
+    void Draw(VkCommandBuffer CommandBuffer, uint32_t Frame);
+
+private:
+    void CreateFontAtlas();
+    void CreatePipeline(VkRenderPass RenderPass, uint32_t Subpass, bool bSrgbTarget);
+    void BuildWindow();
+
+    FRHI &RHI;
+    ImGuiContext *Context{nullptr};
+    bool bVisible{false};
+    bool bBuilt{false};
+
+    float CpuTimes[HistoryLength]{};
+    float GpuTimes[HistoryLength]{};
+    uint32_t HistoryOffset{0};
+    FRHIStatistics Statistics;
+    /* CPU time of the previous Update and Draw, in milliseconds. */
+    float OverlayTime{0.0f};
+    uint64_t UpdateNs{0};
+
+    FImage FontImage;
+    VkImageView FontView{VK_NULL_HANDLE};
+    VkSampler FontSampler{VK_NULL_HANDLE};
+    VkDescriptorSetLayout DescriptorSetLayout{VK_NULL_HANDLE};
+    VkDescriptorPool DescriptorPool{VK_NULL_HANDLE};
+    VkDescriptorSet FontSet{VK_NULL_HANDLE};
+    VkPipelineLayout PipelineLayout{VK_NULL_HANDLE};
+    VkPipeline Pipeline{VK_NULL_HANDLE};
+    /* Host visible geometry per frame in flight, grown when a frame needs more. */
+    FBuffer VertexBuffers[MaxFramesInFlight];
+    FBuffer IndexBuffers[MaxFramesInFlight];
+};
+}
@@ -0,0 +1,110 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+
+#include <vector>
+
+namespace RE {
+struct FPostProcessSettings {
+    /* Brightness where bloom starts, with a soft knee of this width around it. */
+    float BloomThreshold{1.0f};
+    float BloomKnee{0.5f};
+    float BloomIntensity{0.05f};
+    /* Levels of the bloom chain, the first at half the output size. */
+    uint32_t BloomLevels{6};
+    /* Log2 luminance range covered by the exposure histogram. */
+    float MinLogLuminance{-10.0f};
+    float MaxLogLuminance{6.0f};
+    /* Rate the exposure adapts at, per second. */
+    float ExposureSpeed{1.5f};
+    /* Exposure compensation in stops. */
+    float ExposureBias{0.0f};
+};
+
+/*
+ * The post processing chain as compute passes: a luminance histogram built with subgroup
+ * ballots, auto exposure reduced with subgroup arithmetic, a bloom down and up sample
+ * chain and ACES tonemapping into a display ready image. Devices without the subgroup
+ * operations get shared memory fallbacks.
+ *
+ * Nothing in it needs the graphics queue, so with async compute the frame's upscale and
+ * Record go into a command buffer for the compute queue, which overlaps the next frame's
+ * depth and shadow passes instead of serializing after them. The outputs are shared
+ * between both queue families and need no ownership transfer; the submission must still
+ * signal a semaphore the graphics queue waits on before reading them.
+ */
+class RE_RENDER_EXPORT FPostProcess {
+public:
+    static constexpr uint32_t MaxFramesInFlight = 2;
+    /* UNORM holding sRGB encoded values, sRGB formats cannot be storage images. */
+    static constexpr VkFormat OutputFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+    FPostProcess(FRHI &RHI, VkExtent2D Extent, const FPostProcessSettings &Settings = {});
+    ~FPostProcess();
+
+    FPostProcess(const FPostProcess &) = delete;
+    FPostProcess &operator=(const FPostProcess &) = delete;
+
+    /* Reallocates the targets for a new output size, the device must be idle. */
+    void Resize(VkExtent2D Extent);
+    FPostProcessSettings &GetSettings() { return Settings; }
+
+    /*
+     * Records the chain for Source, an HDR view of the output size in
+     * SHADER_READ_ONLY_OPTIMAL, e.g. the temporal upscaler output. The frame's output is
+     * left in GENERAL.
+     */
+    void Record(
+        VkCommandBuffer CommandBuffer, uint32_t Frame, VkImageView Source,
+        float DeltaSeconds);
+
+    VkExtent2D GetExtent() const { return Extent; }
+    const FImage &GetOutputImage(uint32_t Frame) const {
+        return Outputs[Frame % MaxFramesInFlight];
+    }
+    VkImageView GetOutputView(uint32_t Frame) const {
+        return OutputViews[Frame % MaxFramesInFlight];
+    }
+
+private:
+    void CreateTargets();
+    void DestroyTargets();
+    void WriteSet(
+        VkDescriptorSet Set, VkImageView Source, VkImageLayout SourceLayout,
+        VkImageView Target);
+
+    FRHI &RHI;
+    FPostProcessSettings Settings;
+    VkExtent2D Extent{0, 0};
+
+    FImage Outputs[MaxFramesInFlight];
+    VkImageView OutputViews[MaxFramesInFlight]{};
+    /* Half the output size, every level is kept in GENERAL. */
+    FImage BloomImage;
+    std::vector<VkImageView> BloomViews;
+    /* The histogram and the adapted exposure, see Shaders/Include/PostProcess.glsl. */
+    FBuffer LuminanceBuffer;
+    bool bLuminanceInitialized{false};
+
+    VkSampler LinearSampler{VK_NULL_HANDLE};
+    VkDescriptorSetLayout DescriptorSetLayout{VK_NULL_HANDLE};
+    VkDescriptorPool DescriptorPool{VK_NULL_HANDLE};
+    /*
+     * Per frame the set of the histogram, exposure and tonemap passes and the one of the
+     * first bloom level, both reading the source. The source views last written into
+     * them skip rewriting when they repeat.
+     */
+    VkDescriptorSet FrameSets[MaxFramesInFlight]{};
+    VkDescriptorSet PrefilterSets[MaxFramesInFlight]{};
+    VkImageView FrameSources[MaxFramesInFlight]{};
+    /* Downsampling into level i + 1, and upsampling level i + 1 onto level i. */
+    std::vector<VkDescriptorSet> DownSets;
+    std::vector<VkDescriptorSet> UpSets;
+    VkPipelineLayout PipelineLayout{VK_NULL_HANDLE};
+    VkPipeline HistogramPipeline{VK_NULL_HANDLE};
+    VkPipeline ExposurePipeline{VK_NULL_HANDLE};
+    VkPipeline BloomDownPipeline{VK_NULL_HANDLE};
+    VkPipeline BloomUpPipeline{VK_NULL_HANDLE};
+    VkPipeline TonemapPipeline{VK_NULL_HANDLE};
+};
+}
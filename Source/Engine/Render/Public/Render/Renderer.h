@@ -1,6 +1,12 @@
 ﻿#pragma once
 #include "re-render_export.h"
 #include "RHI/RHI.h"
+#include "Render/DynamicResolution.h"
+#include "Render/PerformanceOverlay.h"
+#include "Render/PostProcess.h"
+#include "Render/TemporalUpscaler.h"
+
+#include <memory>
 
 namespace RE {
 class RE_RENDER_EXPORT FRenderer {
@@ -11,6 +17,14 @@ public:
 
     FRHI RHI;
 
+    FDynamicResolution &GetDynamicResolution() { return *DynamicResolution; }
+    /* Renders at the dynamic resolution and upscales to the swapchain extent. */
+    FTemporalUpscaler &GetUpscaler() { return *Upscaler; }
+    /* Bloom, exposure and tonemapping of the upscaled image, async when available. */
+    FPostProcess &GetPostProcess() { return *PostProcess; }
+    /* Frame times, pass timings, command counts and memory, drawn in the present pass. */
+    FPerformanceOverlay &GetOverlay() { return *Overlay; }
+
 private:
     void CreateSwapchain();
     void createRenderPass();
@@ -37,6 +51,11 @@ private:
         size_t currentFrame{0};
         const size_t MAX_FRAMES_IN_FLIGHT{2};
     } renderPassInfo;
+
+    std::unique_ptr<FDynamicResolution> DynamicResolution;
+    std::unique_ptr<FTemporalUpscaler> Upscaler;
+    std::unique_ptr<FPostProcess> PostProcess;
+    std::unique_ptr<FPerformanceOverlay> Overlay;
 };
 
 }
\ No newline at end of file
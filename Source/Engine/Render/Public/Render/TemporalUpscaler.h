@@ -0,0 +1,107 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+
+#include <glm/glm.hpp>
+
+namespace RE {
+/*
+ * Renders the scene at a variable internal resolution and reconstructs it at the output
+ * resolution from jittered samples accumulated over frames.
+ *
+ * The scene targets are allocated once at the largest render size and each frame draws
+ * into their top left corner at the current render size, so changing the resolution
+ * never reallocates. Only a new output size does, with the device idle. The history is
+ * kept at output resolution, which carries it across resolution changes.
+ *
+ * A frame goes: jitter the projection with ApplyJitter(GetJitter), BeginScenePass with
+ * the render size, the scene, EndScenePass, then Upscale; the result is left in
+ * SHADER_READ_ONLY_OPTIMAL for the compute passes that follow.
+ *
+ * With async compute Upscale is recorded for the compute queue, which waits on a
+ * semaphore for the graphics submission holding the scene pass. The history never
+ * leaves the compute queue, and the scene targets are cleared every frame, so only
+ * their hand over to the compute queue needs an ownership transfer.
+ */
+class RE_RENDER_EXPORT FTemporalUpscaler {
+public:
+    static constexpr VkFormat ColorFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+    static constexpr VkFormat DepthFormat = VK_FORMAT_D32_SFLOAT;
+
+    FTemporalUpscaler(FRHI &RHI, VkExtent2D OutputExtent, VkExtent2D MaxRenderExtent);
+    ~FTemporalUpscaler();
+
+    FTemporalUpscaler(const FTemporalUpscaler &) = delete;
+    FTemporalUpscaler &operator=(const FTemporalUpscaler &) = delete;
+
+    /* Reallocates the targets if either size changed, the device must be idle. */
+    void Resize(VkExtent2D OutputExtent, VkExtent2D MaxRenderExtent);
+    /* Records Upscale for the async compute queue, ignored when the device has none. */
+    void SetAsyncCompute(bool bEnable);
+    bool IsAsyncCompute() const { return bAsyncCompute; }
+    /* Drops the history, e.g. on camera cuts. */
+    void ResetHistory() { bHistoryValid = false; }
+
+    /*
+     * Offset of this frame's samples in render pixels, a Halton (2, 3) sequence whose
+     * length grows with the upscaling ratio so every output pixel sees enough samples.
+     */
+    glm::vec2 GetJitter(uint64_t FrameNumber, VkExtent2D RenderExtent) const;
+    /* Shifts a projection so pixel centers sample at center - Jitter. */
+    static glm::mat4 ApplyJitter(
+        const glm::mat4 &ViewToClip, glm::vec2 Jitter, VkExtent2D RenderExtent);
+
+    /* Color and depth render pass, pipelines use a dynamic viewport and scissor. */
+    VkRenderPass GetSceneRenderPass() const { return SceneRenderPass; }
+    void BeginScenePass(
+        VkCommandBuffer CommandBuffer, VkExtent2D RenderExtent,
+        const glm::vec4 &ClearColor);
+    void EndScenePass(VkCommandBuffer CommandBuffer);
+
+    /*
+     * Blends the scene into the history. ClipToPrevClip takes this frame's unjittered clip
+     * space to the previous frame's, reprojecting static geometry by its depth.
+     */
+    void Upscale(
+        VkCommandBuffer CommandBuffer, VkExtent2D RenderExtent, glm::vec2 Jitter,
+        const glm::mat4 &ClipToPrevClip);
+
+    VkExtent2D GetOutputExtent() const { return OutputExtent; }
+    VkExtent2D GetMaxRenderExtent() const { return MaxRenderExtent; }
+    const FImage &GetOutputImage() const { return History[HistoryIndex]; }
+    VkImageView GetOutputView() const { return HistoryViews[HistoryIndex]; }
+    VkImageView GetSceneDepthView() const { return SceneDepthView; }
+
+private:
+    void CreateTargets();
+    void DestroyTargets();
+
+    FRHI &RHI;
+    VkExtent2D OutputExtent{0, 0};
+    VkExtent2D MaxRenderExtent{0, 0};
+
+    /* At MaxRenderExtent, drawn into at the current render size. */
+    FImage SceneColor;
+    FImage SceneDepth;
+    VkImageView SceneColorView{VK_NULL_HANDLE};
+    VkImageView SceneDepthView{VK_NULL_HANDLE};
+    VkFramebuffer SceneFramebuffer{VK_NULL_HANDLE};
+    VkRenderPass SceneRenderPass{VK_NULL_HANDLE};
+
+    /* At OutputExtent, read and written in turn. */
+    FImage History[2];
+    VkImageView HistoryViews[2]{};
+    uint32_t HistoryIndex{0};
+    bool bHistoryValid{false};
+    bool bAsyncCompute{false};
+
+    VkSampler PointSampler{VK_NULL_HANDLE};
+    VkSampler LinearSampler{VK_NULL_HANDLE};
+    VkDescriptorSetLayout DescriptorSetLayout{VK_NULL_HANDLE};
+    VkDescriptorPool DescriptorPool{VK_NULL_HANDLE};
+    /* One per history index that is written. */
+    VkDescriptorSet DescriptorSets[2]{};
+    VkPipelineLayout PipelineLayout{VK_NULL_HANDLE};
+    VkPipeline Pipeline{VK_NULL_HANDLE};
+};
+}
@@ -0,0 +1,37 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+#include "Asset/VertexFormat.h"
+
+#include <string>
+
+namespace RE {
+/* Shader input locations are fixed per semantic, see Shaders/Include/VertexDecode.glsl. */
+constexpr uint32_t GetVertexInputLocation(EVertexSemantic Semantic) {
+    return static_cast<uint32_t>(Semantic);
+}
+
+/* The per instance transform takes four locations after the vertex semantics. */
+constexpr uint32_t InstanceTransformLocation =
+    static_cast<uint32_t>(EVertexSemantic::Count);
+
+struct FVertexInputState {
+    std::vector<VkVertexInputBindingDescription> Bindings;
+    std::vector<VkVertexInputAttributeDescription> Attributes;
+
+    /* The returned create info points into this object. */
+    VkPipelineVertexInputStateCreateInfo GetCreateInfo() const;
+};
+
+class RE_RENDER_EXPORT FVertexInput {
+public:
+    static VkFormat GetFormat(EVertexAttributeFormat Format);
+
+    static FVertexInputState CreateState(const FVertexLayout &Layout, uint32_t Binding = 0);
+    /* Adds a per instance mat4 binding, read by shaders defining RE_VERTEX_INSTANCED. */
+    static void AddInstanceTransform(FVertexInputState &State, uint32_t Binding = 1);
+
+    /* Preprocessor defines selecting the matching decode path in VertexDecode.glsl. */
+    static std::vector<std::string> GetShaderDefines(const FVertexLayout &Layout);
+};
+}
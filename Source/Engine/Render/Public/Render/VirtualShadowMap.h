@@ -0,0 +1,170 @@
+﻿#pragma once
+#include "re-render_export.h"
+#include "RHI/RHI.h"
+#include "Render/FrustumCulling.h"
+
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <tsl/robin_map.h>
+
+namespace RE {
+struct FVirtualShadowSettings {
+    /* Texels across the virtual shadow map. */
+    uint32_t VirtualResolution{16384};
+    /* Texels across a page, the virtual and physical resolutions must be multiples. */
+    uint32_t PageSize{128};
+    /* Texels across the physical page pool, which holds (Physical / PageSize)^2 pages. */
+    uint32_t PhysicalResolution{8192};
+    /* World space width covered by the virtual map around the camera. */
+    float WorldSize{256.0f};
+    /* Light space depth range rendered into pages, centered on the camera. */
+    float DepthRange{1000.0f};
+    /* Pages rendered per frame at most, further requests wait for later frames. */
+    uint32_t MaxPageRendersPerFrame{256};
+};
+
+/* A page to draw casters into this frame. */
+struct FVirtualShadowPage {
+    glm::mat4 WorldToClip{1.0f};
+    FFrustum CullFrustum{};
+    /* Where the page lives in the physical pool. */
+    VkRect2D PhysicalRect{};
+};
+
+/*
+ * A virtual shadow map for one directional light, a VirtualResolution^2 depth texture in
+ * light space that is only backed by physical memory where the camera sees receivers.
+ *
+ * The virtual texture is a window onto an unbounded grid of pages fixed in light space,
+ * which follows the camera in whole pages, so a page keeps its contents while it stays
+ * in use. Each frame MarkPages projects the scene depth buffer into the map and flags the
+ * pages it touches; a few frames later, when the frame slot comes round again, Update
+ * reads the flags back, maps requested pages to physical pages, evicting the least
+ * recently used ones when the pool is full, and lists the pages to render. Only newly
+ * mapped pages and those invalidated by moving casters are rendered, everything else is
+ * cached across frames.
+ *
+ * The physical pool is one depth atlas allocated from a memory pool of its own in FRHI,
+ * so its footprint can be budgeted and reported apart from the other resources.
+ *
+ * A frame goes: Update, then BeginPagePass, and for each of GetPagesToRender SetPage and
+ * the casters culled against the page's frustum, EndPagePass; after the depth prepass
+ * MarkPages; shading binds GetDescriptorSet and includes
+ * Shaders/Include/VirtualShadowMap.glsl. Receivers on unmapped pages are lit.
+ */
+class RE_RENDER_EXPORT FVirtualShadowMap {
+public:
+    static constexpr uint32_t MaxFramesInFlight = 2;
+
+    FVirtualShadowMap(FRHI &RHI, const FVirtualShadowSettings &Settings = {});
+    ~FVirtualShadowMap();
+
+    FVirtualShadowMap(const FVirtualShadowMap &) = delete;
+    FVirtualShadowMap &operator=(const FVirtualShadowMap &) = delete;
+
+    /*
+     * Maps the pages requested when this frame slot was last marked, after its fence has
+     * been waited on, and moves the window to the camera. LightDirection points from the
+     * light into the scene, turning it drops every page.
+     */
+    void Update(
+        const glm::vec3 &CameraPosition, const glm::vec3 &LightDirection, uint32_t Frame);
+
+    /* Casters inside the world space box moved, appeared or went away. */
+    void InvalidateBounds(const glm::vec3 &Center, const glm::vec3 &Extent);
+    void InvalidateAll();
+
+    std::span<const FVirtualShadowPage> GetPagesToRender() const { return PagesToRender; }
+    /* Clears the pages to render, returns false and begins nothing when there are none. */
+    bool BeginPagePass(VkCommandBuffer CommandBuffer);
+    /* Sets the viewport and scissor of a page, caster pipelines use them dynamically. */
+    void SetPage(VkCommandBuffer CommandBuffer, uint32_t Page);
+    void EndPagePass(VkCommandBuffer CommandBuffer);
+
+    /*
+     * Records the page requests of a depth buffer in SHADER_READ_ONLY_OPTIMAL, with the
+     * camera's 0..1 depth projection, outside of a render pass.
+     */
+    void MarkPages(
+        VkCommandBuffer CommandBuffer, VkImageView DepthView, VkExtent2D DepthSize,
+        const glm::mat4 &WorldToClip, uint32_t Frame);
+
+    /* Uniform buffer 0, page table storage buffer 1 and the shadow sampler at 2. */
+    VkDescriptorSetLayout GetDescriptorSetLayout() const { return DescriptorSetLayout; }
+    VkDescriptorSet GetDescriptorSet(uint32_t Frame) const {
+        return DescriptorSets[Frame % MaxFramesInFlight];
+    }
+    VkRenderPass GetRenderPass() const { return RenderPass; }
+
+    uint32_t GetMappedPageCount() const { return static_cast<uint32_t>(PageLookup.size()); }
+    uint32_t GetPhysicalPageCount() const {
+        return PhysicalPagesPerRow * PhysicalPagesPerRow;
+    }
+    /* Bytes of device memory held by the physical pool. */
+    VkDeviceSize GetPhysicalMemorySize() const;
+
+private:
+    struct FPhysicalPage {
+        glm::ivec2 VirtualPage{0};
+        uint64_t LastUsedFrame{0};
+        bool bMapped{false};
+        bool bDirty{false};
+    };
+
+    static uint64_t GetPageKey(glm::ivec2 VirtualPage);
+    /* Maps a virtual page, evicting the least recently used page if the pool is full. */
+    uint32_t MapPage(glm::ivec2 VirtualPage);
+    void UnmapAll();
+    void WritePageTable(uint32_t FrameIndex);
+
+    FRHI &RHI;
+    FVirtualShadowSettings Settings;
+    uint32_t PagesPerSide{0};
+    uint32_t PhysicalPagesPerRow{0};
+    float PageWorldSize{0.0f};
+
+    glm::mat4 WorldToLight{1.0f};
+    glm::vec3 LightDirection{0.0f, 0.0f, -1.0f};
+    bool bHasLight{false};
+    /* Light space depth the pages are rendered around, moved in steps to keep caching. */
+    float DepthCenter{0.0f};
+    /* Virtual page at the corner of the window, and the one each frame slot marked with. */
+    glm::ivec2 WindowOrigin{0};
+    glm::ivec2 MarkedOrigins[MaxFramesInFlight]{};
+    bool bMarked[MaxFramesInFlight]{};
+    uint64_t FrameCounter{0};
+
+    std::vector<FPhysicalPage> PhysicalPages;
+    tsl::robin_map<uint64_t, uint32_t> PageLookup;
+    std::vector<uint32_t> FreePages;
+    /* Mapped pages not used this frame, oldest last, built when the free list runs dry. */
+    std::vector<uint32_t> EvictionQueue;
+    std::vector<uint32_t> PageIndicesToRender;
+    std::vector<FVirtualShadowPage> PagesToRender;
+
+    FMemoryPool PhysicalMemory;
+    FImage PhysicalImage;
+    VkImageView PhysicalView{VK_NULL_HANDLE};
+    VkFramebuffer Framebuffer{VK_NULL_HANDLE};
+    VkRenderPass RenderPass{VK_NULL_HANDLE};
+    VkSampler ShadowSampler{VK_NULL_HANDLE};
+    VkSampler DepthSampler{VK_NULL_HANDLE};
+
+    /* Per frame in flight, params and page table written by the CPU, requests read back. */
+    FBuffer ParamsBuffers[MaxFramesInFlight];
+    FBuffer PageTableBuffers[MaxFramesInFlight];
+    FBuffer RequestBuffers[MaxFramesInFlight];
+
+    VkDescriptorSetLayout DescriptorSetLayout{VK_NULL_HANDLE};
+    VkDescriptorSetLayout MarkSetLayout{VK_NULL_HANDLE};
+    VkDescriptorPool DescriptorPool{VK_NULL_HANDLE};
+    VkDescriptorSet DescriptorSets[MaxFramesInFlight]{};
+    VkDescriptorSet MarkSets[MaxFramesInFlight]{};
+    /* The depth view each mark set points at, rewritten when the depth buffer changes. */
+    VkImageView MarkedDepthViews[MaxFramesInFlight]{};
+    VkPipelineLayout MarkPipelineLayout{VK_NULL_HANDLE};
+    VkPipeline MarkPipeline{VK_NULL_HANDLE};
+};
+}
@@ -0,0 +1,11 @@
+#version 450
+
+layout(location = 0) in vec3 InWorldNormal;
+layout(location = 1) in vec2 InTexCoord;
+
+layout(location = 0) out vec4 OutColor;
+
+void main() {
+    vec3 Normal = normalize(InWorldNormal);
+    OutColor = vec4(Normal * 0.5 + 0.5, 1.0);
+}
@@ -0,0 +1,22 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "Include/ClusterCommon.glsl"
+#include "Include/VertexDecode.glsl"
+
+layout(location = 0) out vec3 OutWorldNormal;
+layout(location = 1) out vec2 OutTexCoord;
+
+// Indirect path: FirstInstance of every cluster draw is its instance index.
+void main() {
+    FGpuInstance Instance = Instances[gl_InstanceIndex];
+    FVertexQuantization Quantization = FVertexQuantization(
+        Instance.PositionOffset, Instance.PositionScale, Instance.TexCoordOffsetScale);
+
+    vec4 WorldPosition = Instance.LocalToWorld * vec4(DecodePosition(Quantization), 1.0);
+    mat3 NormalMatrix = transpose(inverse(mat3(Instance.LocalToWorld)));
+
+    OutWorldNormal = normalize(NormalMatrix * DecodeNormal());
+    OutTexCoord = DecodeTexCoord(Quantization);
+    gl_Position = View.WorldToClip * WorldPosition;
+}
@@ -0,0 +1,47 @@
+#ifndef RE_CASCADED_SHADOWS_GLSL
+#define RE_CASCADED_SHADOWS_GLSL
+
+// Mirrors FShadowShaderParams in CascadedShadows.h, std140.
+struct FShadowParams {
+    mat4 WorldToShadow[4];
+    vec4 SplitDepths;
+    vec4 TexelSizes;
+    // Towards the scene in xyz, the cascade count in w.
+    vec4 LightDirection;
+};
+
+uint GetShadowCascade(FShadowParams Params, float ViewDepth) {
+    uint Count = uint(Params.LightDirection.w);
+    for(uint i = 0; i + 1u < Count; i++) {
+        if(ViewDepth < Params.SplitDepths[i]) { return i; }
+    }
+    return Count - 1u;
+}
+
+// Fraction of light reaching the point, 1 beyond the last cascade. The lookup point is
+// pushed out along the normal by a texel scaled by the slope, and a 3x3 tent of linear
+// comparisons softens the edges.
+float SampleCascadedShadow(
+    sampler2DArrayShadow ShadowMap, FShadowParams Params, vec3 WorldPosition,
+    vec3 Normal, float ViewDepth) {
+    uint Count = uint(Params.LightDirection.w);
+    if(ViewDepth >= Params.SplitDepths[Count - 1u]) { return 1.0; }
+
+    uint Cascade = GetShadowCascade(Params, ViewDepth);
+    float CosTheta = clamp(dot(Normal, -Params.LightDirection.xyz), 0.0, 1.0);
+    float Offset = Params.TexelSizes[Cascade] * (1.0 + 2.0 * (1.0 - CosTheta));
+    vec4 Position = vec4(WorldPosition + Normal * Offset, 1.0);
+    vec3 Coord = (Params.WorldToShadow[Cascade] * Position).xyz;
+
+    vec2 TexelUv = 1.0 / vec2(textureSize(ShadowMap, 0).xy);
+    float Lit = 0.0;
+    for(int y = -1; y <= 1; y++) {
+        for(int x = -1; x <= 1; x++) {
+            vec2 Uv = Coord.xy + vec2(x, y) * TexelUv;
+            Lit += texture(ShadowMap, vec4(Uv, float(Cascade), Coord.z));
+        }
+    }
+    return Lit / 9.0;
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef RE_CLUSTER_COMMON_GLSL
+#define RE_CLUSTER_COMMON_GLSL
+
+// Mirrors the FGpu* structs in ClusterCulling.cpp.
+struct FGpuCluster {
+    vec4 BoundingSphere;
+    vec4 ConeApexCutoff;
+    vec4 ConeAxis;
+    uint FirstIndex;
+    uint IndexCount;
+    uint MeshletIndex;
+    uint InstanceIndex;
+};
+
+struct FGpuMeshlet {
+    uint VertexOffset;
+    uint TriangleOffset;
+    uint VertexCount;
+    uint TriangleCount;
+};
+
+struct FGpuInstance {
+    mat4 LocalToWorld;
+    vec4 PositionOffset;
+    vec4 PositionScale;
+    vec4 TexCoordOffsetScale;
+    // Base vertex of the mesh in the shared vertex buffer.
+    uvec4 VertexBase;
+};
+
+layout(set = 0, binding = 0) uniform FCullView {
+    mat4 WorldToClip;
+    mat4 WorldToView;
+    vec4 FrustumPlanes[6];
+    vec4 CameraPosition;
+    // x: P[0][0], y: P[1][1], z: near plane distance, w: unused
+    vec4 Projection;
+    // xy: P[2][2], P[3][2] for depth reconstruction, zw: pyramid size in texels
+    vec4 PyramidParams;
+    uint ClusterCount;
+    uint Flags;
+} View;
+
+const uint CULL_FRUSTUM = 1u;
+const uint CULL_CONE = 2u;
+const uint CULL_OCCLUSION = 4u;
+
+layout(std430, set = 0, binding = 1) readonly buffer FClusterBuffer {
+    FGpuCluster Clusters[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer FInstanceBuffer {
+    FGpuInstance Instances[];
+};
+
+#ifdef RE_CLUSTER_OCCLUSION
+#include "DepthPyramid.glsl"
+
+// Previous frame depth, each texel holding the farthest depth of its footprint.
+layout(set = 0, binding = 9) uniform sampler2D DepthPyramid;
+#endif
+
+vec4 TransformSphere(FGpuInstance Instance, vec4 Sphere) {
+    vec3 Center = (Instance.LocalToWorld * vec4(Sphere.xyz, 1.0)).xyz;
+    float Scale = max(
+        length(Instance.LocalToWorld[0].xyz),
+        max(length(Instance.LocalToWorld[1].xyz), length(Instance.LocalToWorld[2].xyz)));
+    return vec4(Center, Sphere.w * Scale);
+}
+
+bool IsInsideFrustum(vec4 Sphere) {
+    for(int i = 0; i < 6; i++) {
+        if(dot(View.FrustumPlanes[i].xyz, Sphere.xyz) + View.FrustumPlanes[i].w < -Sphere.w) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IsConeBackfacing(FGpuInstance Instance, FGpuCluster Cluster) {
+    if(Cluster.ConeApexCutoff.w >= 1.0) { return false; }
+    vec3 Apex = (Instance.LocalToWorld * vec4(Cluster.ConeApexCutoff.xyz, 1.0)).xyz;
+    vec3 Axis = normalize(mat3(Instance.LocalToWorld) * Cluster.ConeAxis.xyz);
+    return dot(normalize(Apex - View.CameraPosition.xyz), Axis) >= Cluster.ConeApexCutoff.w;
+}
+
+#ifdef RE_CLUSTER_OCCLUSION
+bool IsOccluded(vec4 Sphere) {
+    vec3 Center = (View.WorldToView * vec4(Sphere.xyz, 1.0)).xyz;
+    return IsSphereOccluded(
+        DepthPyramid, View.PyramidParams, View.Projection.xyz, Center, Sphere.w);
+}
+#endif
+
+bool IsClusterVisible(FGpuCluster Cluster) {
+    FGpuInstance Instance = Instances[Cluster.InstanceIndex];
+    vec4 Sphere = TransformSphere(Instance, Cluster.BoundingSphere);
+
+    if((View.Flags & CULL_FRUSTUM) != 0u && !IsInsideFrustum(Sphere)) { return false; }
+    if((View.Flags & CULL_CONE) != 0u && IsConeBackfacing(Instance, Cluster)) { return false; }
+#ifdef RE_CLUSTER_OCCLUSION
+    if((View.Flags & CULL_OCCLUSION) != 0u && IsOccluded(Sphere)) { return false; }
+#endif
+    return true;
+}
+
+#endif
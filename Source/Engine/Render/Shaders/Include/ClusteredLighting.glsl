@@ -0,0 +1,103 @@
+#ifndef RE_CLUSTERED_LIGHTING_GLSL
+#define RE_CLUSTERED_LIGHTING_GLSL
+
+// Mirrors FClusterLight in ClusteredLighting.h.
+struct FClusterLight {
+    vec3 Position;
+    float Radius;
+    vec3 Color;
+    uint Type;
+    vec3 Direction;
+    float SpotCosOuter;
+    float SpotCosInner;
+    uint Padding0;
+    uint Padding1;
+    uint Padding2;
+};
+
+const uint LIGHT_TYPE_POINT = 0u;
+const uint LIGHT_TYPE_SPOT = 1u;
+
+// Mirrors FClusterParams in ClusteredLighting.cpp, std140.
+struct FClusterParams {
+    mat4 WorldToView;
+    mat4 ClipToView;
+    // Tiles in x and y, depth slices and the light count.
+    uvec4 GridSize;
+    // Viewport width and height and their reciprocals.
+    vec4 Viewport;
+    // Near and far plane, then scale and bias taking log(depth) to a slice.
+    vec4 DepthSlicing;
+    // Lights per cluster and entries in the index list.
+    uvec4 Limits;
+};
+
+uint GetClusterIndex(uvec3 Cluster, uvec4 GridSize) {
+    return (Cluster.z * GridSize.y + Cluster.y) * GridSize.x + Cluster.x;
+}
+
+// Inverse square falloff windowed to reach zero at the radius, Karis 2013.
+float GetLightFalloff(float DistanceSquared, float Radius) {
+    float Ratio = DistanceSquared / (Radius * Radius);
+    float Window = clamp(1.0 - Ratio * Ratio, 0.0, 1.0);
+    return Window * Window / max(DistanceSquared, 1e-4);
+}
+
+#ifdef RE_CLUSTERED_LIGHTING_SET
+// Forward passes bind FClusteredLighting::GetDescriptorSet here.
+layout(std140, set = RE_CLUSTERED_LIGHTING_SET, binding = 0)
+uniform FClusterParamsBuffer {
+    FClusterParams ClusterParams;
+};
+
+layout(std430, set = RE_CLUSTERED_LIGHTING_SET, binding = 1)
+readonly buffer FClusterLights {
+    FClusterLight ClusterLights[];
+};
+
+// Offset into ClusterLightIndices and light count of every cluster.
+layout(std430, set = RE_CLUSTERED_LIGHTING_SET, binding = 2)
+readonly buffer FClusterGrid {
+    uvec2 ClusterGrid[];
+};
+
+layout(std430, set = RE_CLUSTERED_LIGHTING_SET, binding = 3)
+readonly buffer FClusterIndices {
+    uint ClusterLightIndices[];
+};
+
+uint GetFragmentCluster(vec2 FragCoord, float ViewDepth) {
+    uvec4 GridSize = ClusterParams.GridSize;
+    vec2 Tile = FragCoord * ClusterParams.Viewport.zw * vec2(GridSize.xy);
+    vec4 Slicing = ClusterParams.DepthSlicing;
+    float Slice = log(ViewDepth) * Slicing.z - Slicing.w;
+    Slice = clamp(Slice, 0.0, float(GridSize.z - 1u));
+    uvec3 Cluster = uvec3(min(uvec2(Tile), GridSize.xy - 1u), uint(Slice));
+    return GetClusterIndex(Cluster, GridSize);
+}
+
+// Lambertian irradiance from the lights of the fragment's cluster.
+vec3 EvaluateClusteredLights(vec3 WorldPosition, vec3 Normal, vec2 FragCoord) {
+    float ViewDepth = -(ClusterParams.WorldToView * vec4(WorldPosition, 1.0)).z;
+    uvec2 Range = ClusterGrid[GetFragmentCluster(FragCoord, ViewDepth)];
+
+    vec3 Irradiance = vec3(0.0);
+    for(uint i = 0; i < Range.y; i++) {
+        FClusterLight Light = ClusterLights[ClusterLightIndices[Range.x + i]];
+        vec3 ToLight = Light.Position - WorldPosition;
+        float DistanceSquared = dot(ToLight, ToLight);
+        if(DistanceSquared >= Light.Radius * Light.Radius) { continue; }
+
+        vec3 L = ToLight * inversesqrt(max(DistanceSquared, 1e-8));
+        float Attenuation = GetLightFalloff(DistanceSquared, Light.Radius);
+        if(Light.Type == LIGHT_TYPE_SPOT) {
+            float CosAngle = dot(-L, Light.Direction);
+            Attenuation *= smoothstep(Light.SpotCosOuter, Light.SpotCosInner, CosAngle);
+        }
+        Irradiance += Light.Color * (Attenuation * max(dot(Normal, L), 0.0));
+    }
+    return Irradiance;
+}
+#endif
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef RE_DEPTH_PYRAMID_GLSL
+#define RE_DEPTH_PYRAMID_GLSL
+
+// Screen space bounds of a view space sphere, Mara and McGuire 2013. Projection holds
+// P[0][0], P[1][1] and the near plane distance of a y-up projection, the rectangle is
+// returned in texture space with y pointing down.
+bool ProjectSphere(vec3 ViewCenter, float Radius, vec3 Projection, out vec4 Rect) {
+    // Distances along the view direction are positive from here on.
+    vec3 C = vec3(ViewCenter.xy, -ViewCenter.z);
+    if(C.z < Radius + Projection.z) { return false; }
+
+    vec3 CR = C * Radius;
+    float CZR2 = C.z * C.z - Radius * Radius;
+    float VX = sqrt(C.x * C.x + CZR2);
+    float MinX = (VX * C.x - CR.z) / (VX * C.z + CR.x);
+    float MaxX = (VX * C.x + CR.z) / (VX * C.z - CR.x);
+    float VY = sqrt(C.y * C.y + CZR2);
+    float MinY = (VY * C.y - CR.z) / (VY * C.z + CR.y);
+    float MaxY = (VY * C.y + CR.z) / (VY * C.z - CR.y);
+
+    Rect = vec4(MinX * Projection.x, MinY * Projection.y, MaxX * Projection.x,
+                MaxY * Projection.y);
+    Rect = Rect.xwzy * vec4(0.5, -0.5, 0.5, -0.5) + vec4(0.5);
+    return true;
+}
+
+// Pyramid texels hold the farthest depth of their footprint. PyramidParams holds
+// P[2][2], P[3][2] for the sphere depth and the pyramid size in texels. Spheres crossing
+// the near plane are never occluded.
+bool IsSphereOccluded(
+    sampler2D Pyramid, vec4 PyramidParams, vec3 Projection, vec3 ViewCenter,
+    float Radius) {
+    vec4 Rect;
+    if(!ProjectSphere(ViewCenter, Radius, Projection, Rect)) { return false; }
+
+    // At this level the rectangle spans at most 2x2 texels, so its corners cover it.
+    vec2 Size = (Rect.zw - Rect.xy) * PyramidParams.zw;
+    float Level = ceil(log2(max(max(Size.x, Size.y), 1.0)));
+    float PyramidDepth = max(
+        max(textureLod(Pyramid, Rect.xy, Level).x, textureLod(Pyramid, Rect.zy, Level).x),
+        max(textureLod(Pyramid, Rect.xw, Level).x, textureLod(Pyramid, Rect.zw, Level).x));
+
+    // Depth of the sphere point closest to the camera.
+    float NearestZ = ViewCenter.z + Radius;
+    float SphereDepth = (PyramidParams.x * NearestZ + PyramidParams.y) / -NearestZ;
+    return SphereDepth > PyramidDepth;
+}
+
+#endif
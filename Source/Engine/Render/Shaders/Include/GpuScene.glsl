@@ -0,0 +1,38 @@
+#ifndef RE_GPU_SCENE_GLSL
+#define RE_GPU_SCENE_GLSL
+
+// Mirrors FGpuSceneInstance in GpuScene.h.
+struct FGpuSceneInstance {
+    mat4 LocalToWorld;
+    // World space bounding sphere.
+    vec4 BoundingSphere;
+    // Draw slot of the instance's mesh and material, INVALID_SLOT for freed instances.
+    uint DrawSlot;
+    uint MeshId;
+    uint MaterialId;
+    uint Padding;
+};
+
+const uint INVALID_SLOT = 0xFFFFFFFFu;
+
+#ifdef RE_GPU_SCENE_DRAW
+// Material shaders draw with FGpuScene::DrawMaterial and bind the scene set here.
+#ifndef RE_GPU_SCENE_SET
+#define RE_GPU_SCENE_SET 0
+#endif
+
+layout(std430, set = RE_GPU_SCENE_SET, binding = 0) readonly buffer FGpuSceneInstances {
+    FGpuSceneInstance SceneInstances[];
+};
+
+layout(std430, set = RE_GPU_SCENE_SET, binding = 1) readonly buffer FGpuSceneVisible {
+    uint VisibleInstances[];
+};
+
+// The draw slot's FirstInstance points at its run of visible instance ids.
+FGpuSceneInstance GetSceneInstance() {
+    return SceneInstances[VisibleInstances[gl_InstanceIndex]];
+}
+#endif
+
+#endif
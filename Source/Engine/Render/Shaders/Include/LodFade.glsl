@@ -0,0 +1,21 @@
+#ifndef RE_LOD_FADE_GLSL
+#define RE_LOD_FADE_GLSL
+
+// Ordered dither threshold of the pixel, uniformly spread over 0..1 in every 4x4 block.
+float GetLodDither(vec2 FragCoord) {
+    const float Bayer[16] = float[16](
+        0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+        3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 Pixel = ivec2(FragCoord) & 3;
+    return (Bayer[Pixel.y * 4 + Pixel.x] + 0.5) / 16.0;
+}
+
+// Cross-fade between two levels of detail as from FLodState. The incoming level passes
+// its progress 0..1, the outgoing one the progress minus one, and the two keep
+// complementary sets of pixels so every pixel is covered by exactly one of them.
+bool IsLodFadeDiscarded(float Fade, vec2 FragCoord) {
+    float Dither = GetLodDither(FragCoord);
+    return Fade >= 0.0 ? Dither >= Fade : Dither < Fade + 1.0;
+}
+
+#endif
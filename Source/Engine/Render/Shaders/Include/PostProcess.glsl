@@ -0,0 +1,25 @@
+#ifndef RE_POST_PROCESS_GLSL
+#define RE_POST_PROCESS_GLSL
+
+// Shared by the post processing compute passes, mirrors FPostProcess.cpp.
+#define RE_HISTOGRAM_BINS 256
+
+layout(push_constant) uniform FPostConstants {
+    vec4 Params;
+    uvec4 Size;
+};
+
+layout(set = 0, binding = 0) uniform sampler2D Source;
+layout(set = 0, binding = 1) uniform sampler2D Bloom;
+
+// Bin 0 counts black pixels, the others split the log2 luminance range evenly.
+layout(std430, set = 0, binding = 3) buffer FLuminanceBuffer {
+    uint Histogram[RE_HISTOGRAM_BINS];
+    float Exposure;
+};
+
+float Luminance(vec3 Color) {
+    return dot(Color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+#endif
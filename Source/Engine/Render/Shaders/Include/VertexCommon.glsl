@@ -0,0 +1,18 @@
+#ifndef RE_VERTEX_COMMON_GLSL
+#define RE_VERTEX_COMMON_GLSL
+
+// Mirrors FVertexQuantization in Asset/VertexFormat.h.
+struct FVertexQuantization {
+    vec4 PositionOffset;
+    vec4 PositionScale;
+    vec4 TexCoordOffsetScale;
+};
+
+vec3 DecodeOctahedral(vec2 Encoded) {
+    vec3 Result = vec3(Encoded, 1.0 - abs(Encoded.x) - abs(Encoded.y));
+    float T = max(-Result.z, 0.0);
+    Result.xy += mix(vec2(T), vec2(-T), greaterThanEqual(Result.xy, vec2(0.0)));
+    return normalize(Result);
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef RE_VERTEX_DECODE_GLSL
+#define RE_VERTEX_DECODE_GLSL
+
+#include "VertexCommon.glsl"
+
+// Locations match GetVertexInputLocation, unused components are filled in by the
+// input assembler so every attribute can be read as a vec4.
+layout(location = 0) in vec4 InPosition;
+#ifdef RE_VERTEX_HAS_NORMAL
+layout(location = 1) in vec4 InNormal;
+#endif
+#ifdef RE_VERTEX_HAS_TANGENT
+layout(location = 2) in vec4 InTangent;
+#endif
+#ifdef RE_VERTEX_HAS_TEXCOORD
+layout(location = 3) in vec4 InTexCoord;
+#endif
+// Per instance transform of batched draws, see FVertexInput::AddInstanceTransform.
+#ifdef RE_VERTEX_INSTANCED
+layout(location = 4) in mat4 InLocalToWorld;
+#endif
+
+vec3 DecodePosition(FVertexQuantization Quantization) {
+#ifdef RE_VERTEX_POSITION_QUANTIZED
+    return Quantization.PositionOffset.xyz + InPosition.xyz * Quantization.PositionScale.xyz;
+#else
+    return InPosition.xyz;
+#endif
+}
+
+vec3 DecodeNormal() {
+#if defined(RE_VERTEX_NORMAL_OCTAHEDRAL)
+    return DecodeOctahedral(InNormal.xy);
+#elif defined(RE_VERTEX_HAS_NORMAL)
+    return InNormal.xyz;
+#else
+    return vec3(0.0, 0.0, 1.0);
+#endif
+}
+
+// xyz is the tangent, w the bitangent sign.
+vec4 DecodeTangent() {
+#if defined(RE_VERTEX_TANGENT_OCTAHEDRAL)
+    return vec4(DecodeOctahedral(InTangent.xy), InPosition.w * 2.0 - 1.0);
+#elif defined(RE_VERTEX_HAS_TANGENT)
+    return InTangent;
+#else
+    return vec4(1.0, 0.0, 0.0, 1.0);
+#endif
+}
+
+vec2 DecodeTexCoord(FVertexQuantization Quantization) {
+#if defined(RE_VERTEX_TEXCOORD_QUANTIZED)
+    return Quantization.TexCoordOffsetScale.xy +
+           InTexCoord.xy * Quantization.TexCoordOffsetScale.zw;
+#elif defined(RE_VERTEX_HAS_TEXCOORD)
+    return InTexCoord.xy;
+#else
+    return vec2(0.0);
+#endif
+}
+
+#endif
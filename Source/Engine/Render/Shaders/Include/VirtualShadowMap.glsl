@@ -0,0 +1,68 @@
+#ifndef RE_VIRTUAL_SHADOW_MAP_GLSL
+#define RE_VIRTUAL_SHADOW_MAP_GLSL
+
+// Mirrors FVirtualShadowParams in VirtualShadowMap.cpp, std140.
+struct FVirtualShadowParams {
+    // Light space x and y in pages, z the depth the pages were rendered with.
+    mat4 WorldToVirtual;
+    // Virtual page at the window corner, pages across the window and physical pages
+    // per atlas row.
+    ivec4 Window;
+    // Page size and texel size in atlas texture space, world size of a texel.
+    vec4 Atlas;
+    // Towards the scene in xyz.
+    vec4 LightDirection;
+};
+
+const uint VIRTUAL_PAGE_VALID = 0x80000000u;
+
+// Index into the page table, or -1 outside of the window.
+int GetVirtualPageIndex(FVirtualShadowParams Params, ivec2 Page) {
+    ivec2 Local = Page - Params.Window.xy;
+    if(any(lessThan(Local, ivec2(0))) || any(greaterThanEqual(Local, Params.Window.zz))) {
+        return -1;
+    }
+    return Local.y * Params.Window.z + Local.x;
+}
+
+#ifdef RE_VIRTUAL_SHADOW_SET
+// Shading passes bind FVirtualShadowMap::GetDescriptorSet here.
+layout(std140, set = RE_VIRTUAL_SHADOW_SET, binding = 0)
+uniform FVirtualShadowParamsBuffer {
+    FVirtualShadowParams VirtualShadowParams;
+};
+
+layout(std430, set = RE_VIRTUAL_SHADOW_SET, binding = 1)
+readonly buffer FVirtualPageTable {
+    uint VirtualPageTable[];
+};
+
+layout(set = RE_VIRTUAL_SHADOW_SET, binding = 2)
+uniform sampler2DShadow VirtualShadowAtlas;
+
+// Fraction of light reaching the point, 1 where no page is mapped. The lookup point is
+// pushed out along the normal by a texel scaled by the slope, and the bilinear comparison
+// stays half a texel inside the page, whose neighbours in the atlas are unrelated.
+float SampleVirtualShadow(vec3 WorldPosition, vec3 Normal) {
+    FVirtualShadowParams Params = VirtualShadowParams;
+    float CosTheta = clamp(dot(Normal, -Params.LightDirection.xyz), 0.0, 1.0);
+    float Offset = Params.Atlas.z * (1.0 + 2.0 * (1.0 - CosTheta));
+    vec3 Coord = (Params.WorldToVirtual * vec4(WorldPosition + Normal * Offset, 1.0)).xyz;
+
+    ivec2 Page = ivec2(floor(Coord.xy));
+    int Index = GetVirtualPageIndex(Params, Page);
+    if(Index < 0) { return 1.0; }
+    uint Entry = VirtualPageTable[Index];
+    if((Entry & VIRTUAL_PAGE_VALID) == 0u) { return 1.0; }
+
+    uint Physical = Entry & ~VIRTUAL_PAGE_VALID;
+    uint PagesPerRow = uint(Params.Window.w);
+    vec2 Tile = vec2(Physical % PagesPerRow, Physical / PagesPerRow);
+    float HalfTexel = 0.5 * Params.Atlas.y;
+    vec2 InPage = fract(Coord.xy) * Params.Atlas.x;
+    InPage = clamp(InPage, vec2(HalfTexel), vec2(Params.Atlas.x - HalfTexel));
+    return texture(VirtualShadowAtlas, vec3(Tile * Params.Atlas.x + InPage, Coord.z));
+}
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "Include/VertexDecode.glsl"
+
+layout(set = 0, binding = 0) uniform FViewUniforms {
+    mat4 WorldToClip;
+} View;
+
+layout(push_constant) uniform FMeshConstants {
+    mat4 LocalToWorld;
+    FVertexQuantization Quantization;
+} Mesh;
+
+layout(location = 0) out vec3 OutWorldNormal;
+layout(location = 1) out vec4 OutWorldTangent;
+layout(location = 2) out vec2 OutTexCoord;
+
+void main() {
+    vec4 WorldPosition = Mesh.LocalToWorld * vec4(DecodePosition(Mesh.Quantization), 1.0);
+    mat3 NormalMatrix = transpose(inverse(mat3(Mesh.LocalToWorld)));
+    vec4 Tangent = DecodeTangent();
+
+    OutWorldNormal = normalize(NormalMatrix * DecodeNormal());
+    OutWorldTangent = vec4(normalize(mat3(Mesh.LocalToWorld) * Tangent.xyz), Tangent.w);
+    OutTexCoord = DecodeTexCoord(Mesh.Quantization);
+    gl_Position = View.WorldToClip * WorldPosition;
+}
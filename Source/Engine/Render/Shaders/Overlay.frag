@@ -0,0 +1,13 @@
+#version 450
+
+// The font atlas holds coverage only, every other element samples its white texel.
+layout(set = 0, binding = 0) uniform sampler2D FontAtlas;
+
+layout(location = 0) in vec4 InColor;
+layout(location = 1) in vec2 InTexCoord;
+
+layout(location = 0) out vec4 OutColor;
+
+void main() {
+    OutColor = vec4(InColor.rgb, InColor.a * texture(FontAtlas, InTexCoord).r);
+}
@@ -0,0 +1,24 @@
+#version 450
+
+// Mirrors FOverlayConstants in PerformanceOverlay.cpp.
+layout(push_constant) uniform FOverlayConstants {
+    vec2 Scale;
+    vec2 Translate;
+};
+
+layout(location = 0) in vec2 InPosition;
+layout(location = 1) in vec2 InTexCoord;
+layout(location = 2) in vec4 InColor;
+
+layout(location = 0) out vec4 OutColor;
+layout(location = 1) out vec2 OutTexCoord;
+
+void main() {
+    OutColor = InColor;
+#ifdef RE_OVERLAY_SRGB_TARGET
+    // UI colors are authored in sRGB, the target encodes again on write.
+    OutColor.rgb = pow(InColor.rgb, vec3(2.2));
+#endif
+    OutTexCoord = InTexCoord;
+    gl_Position = vec4(InPosition * Scale + Translate, 0.0, 1.0);
+}
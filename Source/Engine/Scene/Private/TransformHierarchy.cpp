@@ -0,0 +1,305 @@
+﻿#include "Scene/TransformHierarchy.h"
+#include "Core/Logging.h"
+#include "Core/TaskSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86)
+    #include <xmmintrin.h>
+    #define RE_TRANSFORM_SSE 1
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define RE_TRANSFORM_NEON 1
+#endif
+
+namespace RE {
+namespace {
+/* Levels narrower than this are not worth waking the workers for. */
+constexpr uint32_t ParallelLevelSize = 8192;
+constexpr uint32_t UpdateBatchSize = 2048;
+
+/* Out = A * B for column major matrices, one column of Out per SIMD register. */
+void MultiplyMatrix(const glm::mat4 &A, const glm::mat4 &B, glm::mat4 &Out) {
+#if defined(RE_TRANSFORM_SSE)
+    const __m128 A0 = _mm_loadu_ps(&A[0][0]);
+    const __m128 A1 = _mm_loadu_ps(&A[1][0]);
+    const __m128 A2 = _mm_loadu_ps(&A[2][0]);
+    const __m128 A3 = _mm_loadu_ps(&A[3][0]);
+    for(int Column = 0; Column < 4; Column++) {
+        __m128 Result = _mm_mul_ps(A0, _mm_set1_ps(B[Column][0]));
+        Result = _mm_add_ps(Result, _mm_mul_ps(A1, _mm_set1_ps(B[Column][1])));
+        Result = _mm_add_ps(Result, _mm_mul_ps(A2, _mm_set1_ps(B[Column][2])));
+        Result = _mm_add_ps(Result, _mm_mul_ps(A3, _mm_set1_ps(B[Column][3])));
+        _mm_storeu_ps(&Out[Column][0], Result);
+    }
+#elif defined(RE_TRANSFORM_NEON)
+    const float32x4_t A0 = vld1q_f32(&A[0][0]);
+    const float32x4_t A1 = vld1q_f32(&A[1][0]);
+    const float32x4_t A2 = vld1q_f32(&A[2][0]);
+    const float32x4_t A3 = vld1q_f32(&A[3][0]);
+    for(int Column = 0; Column < 4; Column++) {
+        float32x4_t Result = vmulq_n_f32(A0, B[Column][0]);
+        Result = vmlaq_n_f32(Result, A1, B[Column][1]);
+        Result = vmlaq_n_f32(Result, A2, B[Column][2]);
+        Result = vmlaq_n_f32(Result, A3, B[Column][3]);
+        vst1q_f32(&Out[Column][0], Result);
+    }
+#else
+    Out = A * B;
+#endif
+}
+
+glm::mat4 ComposeMatrix(
+    const glm::vec3 &Position, const glm::quat &Rotation, const glm::vec3 &Scale) {
+    const glm::mat3 R = glm::mat3_cast(Rotation);
+    return glm::mat4(
+        glm::vec4(R[0] * Scale.x, 0.0f), glm::vec4(R[1] * Scale.y, 0.0f),
+        glm::vec4(R[2] * Scale.z, 0.0f), glm::vec4(Position, 1.0f));
+}
+}
+
+glm::mat4 FTransform::ToMatrix() const {
+    return ComposeMatrix(Position, Rotation, Scale);
+}
+
+FNodeId FTransformHierarchy::Create(FNodeId Parent, const FTransform &Local) {
+    uint32_t ParentIndex = NoParent;
+    if(Parent != InvalidNode) {
+        if(!IsValid(Parent)) {
+            RE_LOGE("Cannot create a transform under invalid node {}.", Parent);
+            return InvalidNode;
+        }
+        ParentIndex = IdToIndex[Parent];
+    }
+
+    FNodeId Id;
+    if(!FreeIds.empty()) {
+        Id = FreeIds.back();
+        FreeIds.pop_back();
+    } else {
+        Id = static_cast<FNodeId>(IdToIndex.size());
+        IdToIndex.push_back(0);
+    }
+
+    const auto Index = static_cast<uint32_t>(Ids.size());
+    const uint32_t Depth = ParentIndex == NoParent ? 0 : Depths[ParentIndex] + 1;
+    // Appending keeps the levels contiguous as long as the hierarchy is built top down.
+    const uint32_t LevelCount = static_cast<uint32_t>(LevelOffsets.size()) - 1;
+    if(Depth + 1 < LevelCount) {
+        bNeedsSort = true;
+    } else if(!bNeedsSort) {
+        if(Depth == LevelCount) { LevelOffsets.push_back(Index); }
+        LevelOffsets.back() = Index + 1;
+    }
+
+    IdToIndex[Id] = Index;
+    Ids.push_back(Id);
+    Parents.push_back(ParentIndex);
+    Depths.push_back(Depth);
+    Positions.push_back(Local.Position);
+    Rotations.push_back(Local.Rotation);
+    Scales.push_back(Local.Scale);
+    WorldMatrices.emplace_back(1.0f);
+    DirtyFlags.push_back(1);
+    return Id;
+}
+
+void FTransformHierarchy::Destroy(FNodeId Node) {
+    if(!IsValid(Node)) { return; }
+    if(bNeedsSort) { Sort(); }
+
+    // Parents precede children, so one forward pass finds the whole subtree.
+    const uint32_t Root = IdToIndex[Node];
+    std::vector<uint8_t> Removed(Ids.size(), 0);
+    Removed[Root] = 1;
+    std::vector<uint32_t> Remap(Ids.size(), NoParent);
+    uint32_t Count = 0;
+    for(uint32_t i = 0; i < Root; i++) {
+        Remap[i] = Count++;
+    }
+    for(uint32_t i = Root; i < Ids.size(); i++) {
+        if(Parents[i] != NoParent && Removed[Parents[i]]) { Removed[i] = 1; }
+        if(Removed[i]) {
+            FreeIds.push_back(Ids[i]);
+            IdToIndex[Ids[i]] = NoParent;
+            continue;
+        }
+        const uint32_t Target = Count++;
+        Remap[i] = Target;
+        Parents[Target] = Parents[i] == NoParent ? NoParent : Remap[Parents[i]];
+        Depths[Target] = Depths[i];
+        Positions[Target] = Positions[i];
+        Rotations[Target] = Rotations[i];
+        Scales[Target] = Scales[i];
+        WorldMatrices[Target] = WorldMatrices[i];
+        DirtyFlags[Target] = DirtyFlags[i];
+        Ids[Target] = Ids[i];
+        IdToIndex[Ids[i]] = Target;
+    }
+
+    Parents.resize(Count);
+    Depths.resize(Count);
+    Positions.resize(Count);
+    Rotations.resize(Count);
+    Scales.resize(Count);
+    WorldMatrices.resize(Count);
+    DirtyFlags.resize(Count);
+    Ids.resize(Count);
+    RebuildLevels();
+}
+
+bool FTransformHierarchy::SetParent(FNodeId Node, FNodeId Parent) {
+    if(!IsValid(Node) || (Parent != InvalidNode && !IsValid(Parent))) { return false; }
+
+    const uint32_t Index = IdToIndex[Node];
+    const uint32_t ParentIndex = Parent == InvalidNode ? NoParent : IdToIndex[Parent];
+    for(uint32_t Ancestor = ParentIndex; Ancestor != NoParent;
+        Ancestor = Parents[Ancestor]) {
+        if(Ancestor == Index) {
+            RE_LOGE("Cannot parent transform {} to its own descendant {}.", Node, Parent);
+            return false;
+        }
+    }
+    Parents[Index] = ParentIndex;
+    DirtyFlags[Index] = 1;
+    bNeedsSort = true;
+    return true;
+}
+
+void FTransformHierarchy::SetLocal(FNodeId Node, const FTransform &Local) {
+    const uint32_t Index = IdToIndex[Node];
+    Positions[Index] = Local.Position;
+    Rotations[Index] = Local.Rotation;
+    Scales[Index] = Local.Scale;
+    DirtyFlags[Index] = 1;
+}
+
+FTransform FTransformHierarchy::GetLocal(FNodeId Node) const {
+    const uint32_t Index = IdToIndex[Node];
+    return {Positions[Index], Rotations[Index], Scales[Index]};
+}
+
+FNodeId FTransformHierarchy::GetParent(FNodeId Node) const {
+    const uint32_t ParentIndex = Parents[IdToIndex[Node]];
+    return ParentIndex == NoParent ? InvalidNode : Ids[ParentIndex];
+}
+
+bool FTransformHierarchy::IsValid(FNodeId Node) const {
+    return Node < IdToIndex.size() && IdToIndex[Node] != NoParent;
+}
+
+void FTransformHierarchy::Sort() {
+    const auto Count = static_cast<uint32_t>(Ids.size());
+
+    // Reparenting may have put children before their parents, so depths are resolved by
+    // walking up to the nearest ancestor with a known depth.
+    constexpr uint32_t Unknown = UINT32_MAX;
+    std::vector<uint32_t> NewDepths(Count, Unknown);
+    std::vector<uint32_t> Chain;
+    for(uint32_t i = 0; i < Count; i++) {
+        uint32_t Node = i;
+        while(NewDepths[Node] == Unknown && Parents[Node] != NoParent) {
+            Chain.push_back(Node);
+            Node = Parents[Node];
+        }
+        if(NewDepths[Node] == Unknown) { NewDepths[Node] = 0; }
+        for(uint32_t Depth = NewDepths[Node]; !Chain.empty(); Chain.pop_back()) {
+            NewDepths[Chain.back()] = ++Depth;
+        }
+    }
+
+    // Stable counting sort by depth keeps siblings in their relative order.
+    uint32_t LevelCount = 0;
+    for(uint32_t Depth: NewDepths) {
+        LevelCount = std::max(LevelCount, Depth + 1);
+    }
+    LevelOffsets.assign(LevelCount + 1, 0);
+    for(uint32_t Depth: NewDepths) {
+        LevelOffsets[Depth + 1]++;
+    }
+    for(uint32_t Level = 0; Level < LevelCount; Level++) {
+        LevelOffsets[Level + 1] += LevelOffsets[Level];
+    }
+    std::vector<uint32_t> Cursor(LevelOffsets.begin(), LevelOffsets.end() - 1);
+    std::vector<uint32_t> Remap(Count);
+    for(uint32_t i = 0; i < Count; i++) {
+        Remap[i] = Cursor[NewDepths[i]]++;
+    }
+
+    auto Permute = [&Remap, Count](auto &Array) {
+        std::remove_reference_t<decltype(Array)> Sorted(Count);
+        for(uint32_t i = 0; i < Count; i++) {
+            Sorted[Remap[i]] = std::move(Array[i]);
+        }
+        Array = std::move(Sorted);
+    };
+    for(uint32_t &Parent: Parents) {
+        if(Parent != NoParent) { Parent = Remap[Parent]; }
+    }
+    Permute(Parents);
+    Permute(NewDepths);
+    Permute(Positions);
+    Permute(Rotations);
+    Permute(Scales);
+    Permute(WorldMatrices);
+    Permute(DirtyFlags);
+    Permute(Ids);
+    Depths = std::move(NewDepths);
+    for(uint32_t i = 0; i < Count; i++) {
+        IdToIndex[Ids[i]] = i;
+    }
+    bNeedsSort = false;
+}
+
+void FTransformHierarchy::RebuildLevels() {
+    LevelOffsets.assign(1, 0);
+    for(uint32_t i = 0; i < Depths.size(); i++) {
+        if(Depths[i] + 1 >= LevelOffsets.size()) { LevelOffsets.push_back(i); }
+        LevelOffsets.back() = i + 1;
+    }
+}
+
+uint32_t FTransformHierarchy::UpdateRange(uint32_t Begin, uint32_t End) {
+    uint32_t Updated = 0;
+    for(uint32_t i = Begin; i < End; i++) {
+        const uint32_t Parent = Parents[i];
+        const bool bParentDirty = Parent != NoParent && DirtyFlags[Parent];
+        if(!DirtyFlags[i] && !bParentDirty) { continue; }
+
+        const glm::mat4 Local = ComposeMatrix(Positions[i], Rotations[i], Scales[i]);
+        if(Parent == NoParent) {
+            WorldMatrices[i] = Local;
+        } else {
+            MultiplyMatrix(WorldMatrices[Parent], Local, WorldMatrices[i]);
+        }
+        // Read by the children on the next level.
+        DirtyFlags[i] = 1;
+        Updated++;
+    }
+    return Updated;
+}
+
+uint32_t FTransformHierarchy::Update() {
+    if(bNeedsSort) { Sort(); }
+
+    uint32_t Updated = 0;
+    for(size_t Level = 0; Level + 1 < LevelOffsets.size(); Level++) {
+        const uint32_t Begin = LevelOffsets[Level];
+        const uint32_t End = LevelOffsets[Level + 1];
+        if(End - Begin < ParallelLevelSize) {
+            Updated += UpdateRange(Begin, End);
+            continue;
+        }
+        std::atomic<uint32_t> LevelUpdated{0};
+        FTaskSystem::Get().ParallelFor(
+            End - Begin, UpdateBatchSize, [&](uint32_t BatchBegin, uint32_t BatchEnd) {
+                LevelUpdated += UpdateRange(Begin + BatchBegin, Begin + BatchEnd);
+            });
+        Updated += LevelUpdated;
+    }
+    std::fill(DirtyFlags.begin(), DirtyFlags.end(), 0);
+    return Updated;
+}
+}
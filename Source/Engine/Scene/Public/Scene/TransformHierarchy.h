@@ -0,0 +1,84 @@
+﻿#pragma once
+#include "re-scene_export.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace RE {
+using FNodeId = uint32_t;
+constexpr FNodeId InvalidNode = UINT32_MAX;
+
+struct FTransform {
+    glm::vec3 Position{0.0f};
+    glm::quat Rotation{1.0f, 0.0f, 0.0f, 0.0f};
+    glm::vec3 Scale{1.0f};
+
+    glm::mat4 ToMatrix() const;
+};
+
+/*
+ * Scene node transforms in structure of arrays form. Nodes are kept sorted by depth, so
+ * every parent precedes its children and each depth level is a contiguous range; Update
+ * then walks the levels front to back, recomputing only nodes that changed or whose
+ * parent did, and runs wide levels on the task system.
+ *
+ * Node ids stay stable, dense indices change whenever the hierarchy is restructured.
+ */
+class RE_SCENE_EXPORT FTransformHierarchy {
+public:
+    FNodeId Create(FNodeId Parent = InvalidNode, const FTransform &Local = {});
+    /* Destroys the node together with its whole subtree. */
+    void Destroy(FNodeId Node);
+    /* Fails if Parent is the node itself or one of its descendants. */
+    bool SetParent(FNodeId Node, FNodeId Parent);
+
+    void SetLocal(FNodeId Node, const FTransform &Local);
+    FTransform GetLocal(FNodeId Node) const;
+    /* World matrix as of the last Update. */
+    const glm::mat4 &GetWorld(FNodeId Node) const {
+        return WorldMatrices[IdToIndex[Node]];
+    }
+    FNodeId GetParent(FNodeId Node) const;
+
+    bool IsValid(FNodeId Node) const;
+    uint32_t GetNodeCount() const { return static_cast<uint32_t>(Ids.size()); }
+
+    /* Returns the number of world matrices that were recomputed. */
+    uint32_t Update();
+
+    /* Dense views in hierarchy order, valid until the hierarchy is restructured. */
+    std::span<const glm::mat4> GetWorldMatrices() const { return WorldMatrices; }
+    std::span<const FNodeId> GetNodeIds() const { return Ids; }
+    uint32_t GetIndex(FNodeId Node) const { return IdToIndex[Node]; }
+
+private:
+    static constexpr uint32_t NoParent = UINT32_MAX;
+
+    void Sort();
+    void RebuildLevels();
+    uint32_t UpdateRange(uint32_t Begin, uint32_t End);
+
+    /* Per node, indexed densely. */
+    std::vector<uint32_t> Parents;
+    std::vector<uint32_t> Depths;
+    std::vector<glm::vec3> Positions;
+    std::vector<glm::quat> Rotations;
+    std::vector<glm::vec3> Scales;
+    std::vector<glm::mat4> WorldMatrices;
+    /* Set by SetLocal, and during Update for every node whose world matrix changed. */
+    std::vector<uint8_t> DirtyFlags;
+    std::vector<FNodeId> Ids;
+
+    /* Indexed by node id. */
+    std::vector<uint32_t> IdToIndex;
+    std::vector<FNodeId> FreeIds;
+
+    /* Level d spans [LevelOffsets[d], LevelOffsets[d + 1]). */
+    std::vector<uint32_t> LevelOffsets{0};
+    bool bNeedsSort{false};
+};
+}
@@ -0,0 +1,45 @@
+﻿#include "Spatial/Bounds.h"
+
+#include <algorithm>
+
+namespace RE {
+float FAabb::GetSurfaceArea() const {
+    if(!IsValid()) { return 0.0f; }
+    const glm::vec3 Size = Max - Min;
+    return 2.0f * (Size.x * Size.y + Size.y * Size.z + Size.z * Size.x);
+}
+
+bool FAabb::Overlaps(const FAabb &Other) const {
+    return Min.x <= Other.Max.x && Other.Min.x <= Max.x && Min.y <= Other.Max.y &&
+           Other.Min.y <= Max.y && Min.z <= Other.Max.z && Other.Min.z <= Max.z;
+}
+
+float FAabb::GetDistanceSquared(const glm::vec3 &Point) const {
+    const glm::vec3 Outside =
+        glm::max(glm::max(Min - Point, Point - Max), glm::vec3(0.0f));
+    return glm::dot(Outside, Outside);
+}
+
+bool FAabb::IntersectRay(const FRay &Ray, float &OutDistance) const {
+    const glm::vec3 InvDirection = 1.0f / Ray.Direction;
+    const glm::vec3 T0 = (Min - Ray.Origin) * InvDirection;
+    const glm::vec3 T1 = (Max - Ray.Origin) * InvDirection;
+    const glm::vec3 Near = glm::min(T0, T1);
+    const glm::vec3 Far = glm::max(T0, T1);
+    const float Entry = std::max({Near.x, Near.y, Near.z, Ray.MinDistance});
+    const float Exit = std::min({Far.x, Far.y, Far.z, Ray.MaxDistance});
+    if(Entry > Exit || !IsValid()) { return false; }
+    OutDistance = Entry;
+    return true;
+}
+
+FAabb FAabb::Transform(const glm::mat4 &Matrix) const {
+    if(!IsValid()) { return {}; }
+    const glm::vec3 Center = glm::vec3(Matrix * glm::vec4(GetCenter(), 1.0f));
+    const glm::mat3 Linear(Matrix);
+    const glm::mat3 AbsLinear(
+        glm::abs(Linear[0]), glm::abs(Linear[1]), glm::abs(Linear[2]));
+    const glm::vec3 Extent = AbsLinear * GetExtent();
+    return {Center - Extent, Center + Extent};
+}
+}
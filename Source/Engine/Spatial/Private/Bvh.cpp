@@ -0,0 +1,868 @@
+﻿#include "Spatial/Bvh.h"
+#include "Core/Logging.h"
+#include "Core/TaskSystem.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86)
+    #include <xmmintrin.h>
+    #define RE_BVH_SSE 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+    #define RE_BVH_NEON 1
+#endif
+
+namespace RE {
+namespace {
+constexpr uint32_t BinCount = 16;
+/* Ranges above this are reduced in batches and split on the task system. */
+constexpr uint32_t ParallelThreshold = 64 * 1024;
+constexpr uint32_t ReduceBatchSize = 16 * 1024;
+/* Deeper nodes split at the median, which bounds the depth for degenerate inputs. */
+constexpr uint32_t MaxSahDepth = 48;
+/*
+ * Traversal leaves at most three siblings behind per level, and the tree is at most
+ * MaxSahDepth plus 32 median splits deep.
+ */
+constexpr uint32_t StackSize = 256;
+/* Cost of visiting a node relative to testing a primitive. */
+constexpr float TraversalCost = 1.0f;
+
+#if defined(RE_BVH_SSE)
+struct FSimdOps {
+    using FVec = __m128;
+    static FVec Load(const float *Data) { return _mm_load_ps(Data); }
+    static FVec Set(float Value) { return _mm_set1_ps(Value); }
+    static FVec Add(FVec A, FVec B) { return _mm_add_ps(A, B); }
+    static FVec Sub(FVec A, FVec B) { return _mm_sub_ps(A, B); }
+    static FVec Mul(FVec A, FVec B) { return _mm_mul_ps(A, B); }
+    static FVec Min(FVec A, FVec B) { return _mm_min_ps(A, B); }
+    static FVec Max(FVec A, FVec B) { return _mm_max_ps(A, B); }
+    static FVec LessEqual(FVec A, FVec B) { return _mm_cmple_ps(A, B); }
+    static FVec And(FVec A, FVec B) { return _mm_and_ps(A, B); }
+    static FVec Or(FVec A, FVec B) { return _mm_or_ps(A, B); }
+    static uint32_t MoveMask(FVec A) { return static_cast<uint32_t>(_mm_movemask_ps(A)); }
+    static void Store(float *Data, FVec A) { _mm_storeu_ps(Data, A); }
+};
+#elif defined(RE_BVH_NEON)
+struct FSimdOps {
+    using FVec = float32x4_t;
+    static FVec Load(const float *Data) { return vld1q_f32(Data); }
+    static FVec Set(float Value) { return vdupq_n_f32(Value); }
+    static FVec Add(FVec A, FVec B) { return vaddq_f32(A, B); }
+    static FVec Sub(FVec A, FVec B) { return vsubq_f32(A, B); }
+    static FVec Mul(FVec A, FVec B) { return vmulq_f32(A, B); }
+    static FVec Min(FVec A, FVec B) { return vminq_f32(A, B); }
+    static FVec Max(FVec A, FVec B) { return vmaxq_f32(A, B); }
+    static FVec LessEqual(FVec A, FVec B) {
+        return vreinterpretq_f32_u32(vcleq_f32(A, B));
+    }
+    static FVec And(FVec A, FVec B) {
+        return vreinterpretq_f32_u32(
+            vandq_u32(vreinterpretq_u32_f32(A), vreinterpretq_u32_f32(B)));
+    }
+    static FVec Or(FVec A, FVec B) {
+        return vreinterpretq_f32_u32(
+            vorrq_u32(vreinterpretq_u32_f32(A), vreinterpretq_u32_f32(B)));
+    }
+    static uint32_t MoveMask(FVec A) {
+        static const uint32_t LaneBits[4] = {1, 2, 4, 8};
+        const uint32x4_t Bits = vandq_u32(vreinterpretq_u32_f32(A), vld1q_u32(LaneBits));
+        return vaddvq_u32(Bits);
+    }
+    static void Store(float *Data, FVec A) { vst1q_f32(Data, A); }
+};
+#else
+/* Plain lanes, masks hold one or zero. */
+struct FSimdOps {
+    struct FVec {
+        float Lanes[4];
+    };
+    template<typename FOp>
+    static FVec Map(FVec A, FVec B, FOp Op) {
+        return {Op(A.Lanes[0], B.Lanes[0]), Op(A.Lanes[1], B.Lanes[1]),
+                Op(A.Lanes[2], B.Lanes[2]), Op(A.Lanes[3], B.Lanes[3])};
+    }
+    static FVec Load(const float *Data) { return {Data[0], Data[1], Data[2], Data[3]}; }
+    static FVec Set(float Value) { return {Value, Value, Value, Value}; }
+    static FVec Add(FVec A, FVec B) {
+        return Map(A, B, [](float X, float Y) { return X + Y; });
+    }
+    static FVec Sub(FVec A, FVec B) {
+        return Map(A, B, [](float X, float Y) { return X - Y; });
+    }
+    static FVec Mul(FVec A, FVec B) {
+        return Map(A, B, [](float X, float Y) { return X * Y; });
+    }
+    static FVec Min(FVec A, FVec B) {
+        return Map(A, B, [](float X, float Y) { return X < Y ? X : Y; });
+    }
+    static FVec Max(FVec A, FVec B) {
+        return Map(A, B, [](float X, float Y) { return X > Y ? X : Y; });
+    }
+    static FVec LessEqual(FVec A, FVec B) {
+        return Map(A, B, [](float X, float Y) { return X <= Y ? 1.0f : 0.0f; });
+    }
+    static FVec And(FVec A, FVec B) { return Mul(A, B); }
+    static FVec Or(FVec A, FVec B) { return Max(A, B); }
+    static uint32_t MoveMask(FVec A) {
+        uint32_t Mask = 0;
+        for(uint32_t Lane = 0; Lane < 4; Lane++) {
+            if(A.Lanes[Lane] != 0.0f) { Mask |= 1u << Lane; }
+        }
+        return Mask;
+    }
+    static void Store(float *Data, FVec A) { std::copy_n(A.Lanes, 4, Data); }
+};
+#endif
+
+struct FBuildNode {
+    FAabb Bounds;
+    /* Inner nodes keep their children at Left and Left + 1. */
+    uint32_t Left{0};
+    uint32_t First{0};
+    /* Zero for inner nodes. */
+    uint32_t Count{0};
+};
+
+/* Partitioned in place during the build, so every pass reads its range contiguously. */
+struct FBuildPrimitive {
+    FAabb Bounds;
+    uint32_t Primitive;
+};
+
+struct FBin {
+    FAabb Bounds;
+    uint32_t Count{0};
+};
+using FBinSet = std::array<std::array<FBin, BinCount>, 3>;
+
+struct FRangeBounds {
+    FAabb Bounds;
+    FAabb Centroids;
+
+    void Grow(const FAabb &Primitive) {
+        Bounds.Grow(Primitive);
+        Centroids.Grow(Primitive.GetCenter());
+    }
+    void Grow(const FRangeBounds &Other) {
+        Bounds.Grow(Other.Bounds);
+        Centroids.Grow(Other.Centroids);
+    }
+};
+
+struct FStackEntry {
+    uint32_t Node;
+    /* Ray entry or squared point distance of the node's box, for pruning on pop. */
+    float Distance;
+};
+
+/*
+ * Runs Func(Begin, End, Result) over [First, First + Count) and folds the results with
+ * Merge, in batches on the task system for large ranges.
+ */
+template<typename T, typename FFunc, typename FMerge>
+T ParallelReduce(uint32_t First, uint32_t Count, const FFunc &Func, const FMerge &Merge) {
+    T Result{};
+    if(Count <= ParallelThreshold) {
+        Func(First, First + Count, Result);
+        return Result;
+    }
+    const uint32_t BatchCount = (Count + ReduceBatchSize - 1) / ReduceBatchSize;
+    std::vector<T> Partials(BatchCount);
+    FTaskSystem::Get().ParallelFor(BatchCount, 1, [&](uint32_t Begin, uint32_t End) {
+        for(uint32_t Batch = Begin; Batch < End; Batch++) {
+            const uint32_t BatchFirst = First + Batch * ReduceBatchSize;
+            Func(BatchFirst, std::min(BatchFirst + ReduceBatchSize, First + Count),
+                 Partials[Batch]);
+        }
+    });
+    for(const T &Partial: Partials) {
+        Merge(Result, Partial);
+    }
+    return Result;
+}
+
+uint32_t GetBin(float Centroid, float Min, float Scale) {
+    return static_cast<uint32_t>(std::min(float(BinCount - 1), (Centroid - Min) * Scale));
+}
+
+/* Top down binned SAH build of a binary tree over leaf ranges of the primitives. */
+class FBinaryBuilder {
+public:
+    explicit FBinaryBuilder(std::span<const FAabb> Bounds) {
+        const uint32_t Count = static_cast<uint32_t>(Bounds.size());
+        Primitives.resize(Count);
+        FTaskSystem::Get().ParallelFor(
+            Count, ReduceBatchSize, [&](uint32_t Begin, uint32_t End) {
+                for(uint32_t i = Begin; i < End; i++) {
+                    Primitives[i] = {Bounds[i], i};
+                }
+            });
+        // Every inner node has two children, so a tree over Count leaves has fewer nodes.
+        Nodes.resize(size_t(Count) * 2 - 1);
+    }
+
+    FRangeBounds ComputeRange(uint32_t First, uint32_t Count) const;
+    void BuildNode(
+        uint32_t Index, uint32_t First, uint32_t Count, const FRangeBounds &Range,
+        uint32_t Depth);
+
+    const std::vector<FBuildNode> &GetNodes() const { return Nodes; }
+    /* In leaf order once built. */
+    const std::vector<FBuildPrimitive> &GetPrimitives() const { return Primitives; }
+    uint32_t GetNodeCount() const { return NodeCount.load(); }
+
+private:
+    std::vector<FBuildPrimitive> Primitives;
+    std::vector<FBuildNode> Nodes;
+    /* The root takes index 0, children are allocated in pairs after it. */
+    std::atomic<uint32_t> NodeCount{1};
+};
+
+FRangeBounds FBinaryBuilder::ComputeRange(uint32_t First, uint32_t Count) const {
+    return ParallelReduce<FRangeBounds>(
+        First, Count,
+        [this](uint32_t Begin, uint32_t End, FRangeBounds &Result) {
+            for(uint32_t i = Begin; i < End; i++) {
+                Result.Grow(Primitives[i].Bounds);
+            }
+        },
+        [](FRangeBounds &Result, const FRangeBounds &Partial) { Result.Grow(Partial); });
+}
+
+void FBinaryBuilder::BuildNode(
+    uint32_t Index, uint32_t First, uint32_t Count, const FRangeBounds &Range,
+    uint32_t Depth) {
+    FBuildNode &Node = Nodes[Index];
+    Node.Bounds = Range.Bounds;
+    Node.First = First;
+    Node.Count = Count;
+    if(Count == 1) { return; }
+
+    const glm::vec3 Extent = Range.Centroids.Max - Range.Centroids.Min;
+    const int Axis = Extent.x >= Extent.y && Extent.x >= Extent.z ? 0
+                     : Extent.y >= Extent.z                      ? 1
+                                                                 : 2;
+    FBuildPrimitive *RangeBegin = Primitives.data() + First;
+    FBuildPrimitive *RangeEnd = RangeBegin + Count;
+    FBuildPrimitive *Middle;
+    FRangeBounds ChildRanges[2];
+    bool bChildRanges = false;
+    if(Extent[Axis] <= 0.0f) {
+        // Every centroid coincides, so no split is better than another.
+        if(Count <= FBvh::MaxLeafSize) { return; }
+        Middle = RangeBegin + Count / 2;
+    } else if(Depth >= MaxSahDepth) {
+        Middle = RangeBegin + Count / 2;
+        std::nth_element(
+            RangeBegin, Middle, RangeEnd,
+            [Axis](const FBuildPrimitive &A, const FBuildPrimitive &B) {
+                return A.Bounds.GetCenter()[Axis] < B.Bounds.GetCenter()[Axis];
+            });
+    } else {
+        glm::vec3 Scale;
+        for(int i = 0; i < 3; i++) {
+            Scale[i] = Extent[i] > 0.0f ? float(BinCount) / Extent[i] : 0.0f;
+        }
+        const glm::vec3 Origin = Range.Centroids.Min;
+        const FBinSet Bins = ParallelReduce<FBinSet>(
+            First, Count,
+            [&](uint32_t Begin, uint32_t End, FBinSet &Result) {
+                for(uint32_t i = Begin; i < End; i++) {
+                    const FAabb &Bounds = Primitives[i].Bounds;
+                    const glm::vec3 Centroid = Bounds.GetCenter();
+                    for(int BinAxis = 0; BinAxis < 3; BinAxis++) {
+                        if(Scale[BinAxis] <= 0.0f) { continue; }
+                        const uint32_t Bin =
+                            GetBin(Centroid[BinAxis], Origin[BinAxis], Scale[BinAxis]);
+                        FBin &Target = Result[BinAxis][Bin];
+                        Target.Bounds.Grow(Bounds);
+                        Target.Count++;
+                    }
+                }
+            },
+            [](FBinSet &Result, const FBinSet &Partial) {
+                for(int BinAxis = 0; BinAxis < 3; BinAxis++) {
+                    for(uint32_t Bin = 0; Bin < BinCount; Bin++) {
+                        Result[BinAxis][Bin].Bounds.Grow(Partial[BinAxis][Bin].Bounds);
+                        Result[BinAxis][Bin].Count += Partial[BinAxis][Bin].Count;
+                    }
+                }
+            });
+
+        // Sweep the split planes between bins, with the right sides accumulated first.
+        int BestAxis = -1;
+        uint32_t BestSplit = 0;
+        float BestCost = FLT_MAX;
+        for(int SplitAxis = 0; SplitAxis < 3; SplitAxis++) {
+            if(Scale[SplitAxis] <= 0.0f) { continue; }
+            float RightAreas[BinCount];
+            uint32_t RightCounts[BinCount];
+            FAabb Accumulated;
+            uint32_t AccumulatedCount = 0;
+            for(uint32_t Bin = BinCount - 1; Bin > 0; Bin--) {
+                Accumulated.Grow(Bins[SplitAxis][Bin].Bounds);
+                AccumulatedCount += Bins[SplitAxis][Bin].Count;
+                RightAreas[Bin] = Accumulated.GetSurfaceArea();
+                RightCounts[Bin] = AccumulatedCount;
+            }
+            Accumulated = {};
+            AccumulatedCount = 0;
+            for(uint32_t Bin = 0; Bin < BinCount - 1; Bin++) {
+                Accumulated.Grow(Bins[SplitAxis][Bin].Bounds);
+                AccumulatedCount += Bins[SplitAxis][Bin].Count;
+                if(AccumulatedCount == 0 || RightCounts[Bin + 1] == 0) { continue; }
+                const float Cost = Accumulated.GetSurfaceArea() * float(AccumulatedCount) +
+                                   RightAreas[Bin + 1] * float(RightCounts[Bin + 1]);
+                if(Cost < BestCost) {
+                    BestCost = Cost;
+                    BestAxis = SplitAxis;
+                    BestSplit = Bin;
+                }
+            }
+        }
+        checkf(BestAxis >= 0, "The widest centroid axis always has two filled bins.");
+
+        const float Area = Range.Bounds.GetSurfaceArea();
+        const float SplitCost = TraversalCost + (Area > 0.0f ? BestCost / Area : 0.0f);
+        if(SplitCost >= float(Count) && Count <= FBvh::MaxLeafSize) { return; }
+
+        // Partition by hand to gather the bounds of both sides on the way.
+        FBuildPrimitive *Low = RangeBegin;
+        FBuildPrimitive *High = RangeEnd;
+        while(Low < High) {
+            const float Centroid = Low->Bounds.GetCenter()[BestAxis];
+            if(GetBin(Centroid, Origin[BestAxis], Scale[BestAxis]) <= BestSplit) {
+                ChildRanges[0].Grow(Low->Bounds);
+                Low++;
+            } else {
+                std::swap(*Low, *--High);
+                ChildRanges[1].Grow(High->Bounds);
+            }
+        }
+        Middle = Low;
+        bChildRanges = true;
+    }
+
+    const uint32_t Left = NodeCount.fetch_add(2);
+    const uint32_t LeftCount = static_cast<uint32_t>(Middle - RangeBegin);
+    Node.Left = Left;
+    Node.Count = 0;
+    auto BuildChild = [&](uint32_t Child) {
+        const uint32_t ChildFirst = Child == 0 ? First : First + LeftCount;
+        const uint32_t ChildCount = Child == 0 ? LeftCount : Count - LeftCount;
+        if(!bChildRanges) { ChildRanges[Child] = ComputeRange(ChildFirst, ChildCount); }
+        BuildNode(Left + Child, ChildFirst, ChildCount, ChildRanges[Child], Depth + 1);
+    };
+    if(Count > ParallelThreshold) {
+        FTaskSystem::Get().ParallelFor(2, 1, [&](uint32_t Begin, uint32_t End) {
+            for(uint32_t Child = Begin; Child < End; Child++) {
+                BuildChild(Child);
+            }
+        });
+    } else {
+        BuildChild(0);
+        BuildChild(1);
+    }
+}
+
+FAabb GetSlotBounds(const FBvhNode &Node, uint32_t Slot) {
+    return {{Node.MinX[Slot], Node.MinY[Slot], Node.MinZ[Slot]},
+            {Node.MaxX[Slot], Node.MaxY[Slot], Node.MaxZ[Slot]}};
+}
+
+void SetSlotBounds(FBvhNode &Node, uint32_t Slot, const FAabb &Bounds) {
+    Node.MinX[Slot] = Bounds.Min.x;
+    Node.MinY[Slot] = Bounds.Min.y;
+    Node.MinZ[Slot] = Bounds.Min.z;
+    Node.MaxX[Slot] = Bounds.Max.x;
+    Node.MaxY[Slot] = Bounds.Max.y;
+    Node.MaxZ[Slot] = Bounds.Max.z;
+}
+
+/* Unused slots hold inverted boxes, which drop out of the union. */
+FAabb GetNodeBounds(const FBvhNode &Node) {
+    FAabb Bounds;
+    for(uint32_t Slot = 0; Slot < 4; Slot++) {
+        Bounds.Grow(GetSlotBounds(Node, Slot));
+    }
+    return Bounds;
+}
+
+FBvhNode MakeEmptyNode() {
+    FBvhNode Node;
+    for(uint32_t Slot = 0; Slot < 4; Slot++) {
+        SetSlotBounds(Node, Slot, FAabb());
+        Node.Children[Slot] = FBvh::InvalidIndex;
+        Node.Counts[Slot] = 0;
+    }
+    return Node;
+}
+
+/* Emits the wide node for a binary inner node and, depth first, everything below it. */
+uint32_t CollapseNode(
+    const std::vector<FBuildNode> &BuildNodes, uint32_t Index,
+    std::vector<FBvhNode> &Nodes) {
+    // Pull up the children of the largest inner child until all four slots are used.
+    uint32_t Slots[4] = {BuildNodes[Index].Left, BuildNodes[Index].Left + 1};
+    uint32_t SlotCount = 2;
+    while(SlotCount < 4) {
+        int Largest = -1;
+        float LargestArea = -1.0f;
+        for(uint32_t Slot = 0; Slot < SlotCount; Slot++) {
+            const FBuildNode &Child = BuildNodes[Slots[Slot]];
+            const float Area = Child.Bounds.GetSurfaceArea();
+            if(Child.Count == 0 && Area > LargestArea) {
+                Largest = static_cast<int>(Slot);
+                LargestArea = Area;
+            }
+        }
+        if(Largest < 0) { break; }
+        const uint32_t Left = BuildNodes[Slots[Largest]].Left;
+        Slots[Largest] = Left;
+        Slots[SlotCount++] = Left + 1;
+    }
+
+    const uint32_t NodeIndex = static_cast<uint32_t>(Nodes.size());
+    Nodes.push_back(MakeEmptyNode());
+    for(uint32_t Slot = 0; Slot < SlotCount; Slot++) {
+        const FBuildNode &Child = BuildNodes[Slots[Slot]];
+        const uint32_t ChildIndex =
+            Child.Count > 0 ? Child.First : CollapseNode(BuildNodes, Slots[Slot], Nodes);
+        FBvhNode &Node = Nodes[NodeIndex];
+        SetSlotBounds(Node, Slot, Child.Bounds);
+        Node.Children[Slot] = ChildIndex;
+        Node.Counts[Slot] = Child.Count;
+    }
+    return NodeIndex;
+}
+
+FSimdOps::FVec GetPlaneDistances(
+    const glm::vec4 &Plane, const float *X, const float *Y, const float *Z) {
+    using FOps = FSimdOps;
+    return FOps::Add(
+        FOps::Add(
+            FOps::Mul(FOps::Load(X), FOps::Set(Plane.x)),
+            FOps::Mul(FOps::Load(Y), FOps::Set(Plane.y))),
+        FOps::Add(FOps::Mul(FOps::Load(Z), FOps::Set(Plane.z)), FOps::Set(Plane.w)));
+}
+
+/* Squared distances from a point to the four slot boxes, zero inside them. */
+FSimdOps::FVec GetDistancesSquared(
+    const FBvhNode &Node, FSimdOps::FVec X, FSimdOps::FVec Y, FSimdOps::FVec Z) {
+    using FOps = FSimdOps;
+    const FOps::FVec Zero = FOps::Set(0.0f);
+    auto AxisDistance = [Zero](const float *Min, const float *Max, FOps::FVec Point) {
+        const FOps::FVec Below = FOps::Sub(FOps::Load(Min), Point);
+        const FOps::FVec Above = FOps::Sub(Point, FOps::Load(Max));
+        return FOps::Max(FOps::Max(Below, Above), Zero);
+    };
+    const FOps::FVec Dx = AxisDistance(Node.MinX, Node.MaxX, X);
+    const FOps::FVec Dy = AxisDistance(Node.MinY, Node.MaxY, Y);
+    const FOps::FVec Dz = AxisDistance(Node.MinZ, Node.MaxZ, Z);
+    return FOps::Add(FOps::Add(FOps::Mul(Dx, Dx), FOps::Mul(Dy, Dy)), FOps::Mul(Dz, Dz));
+}
+
+/* Ray distances to the planes of one slab of the four slot boxes. */
+FSimdOps::FVec GetSlabDistances(
+    const float *Plane, FSimdOps::FVec Origin, FSimdOps::FVec InvDirection) {
+    return FSimdOps::Mul(FSimdOps::Sub(FSimdOps::Load(Plane), Origin), InvDirection);
+}
+
+bool IsOutsideFrustum(std::span<const glm::vec4, 6> Planes, const FAabb &Box) {
+    for(const glm::vec4 &Plane: Planes) {
+        const glm::vec3 Normal(Plane);
+        const glm::vec3 Far =
+            glm::mix(Box.Min, Box.Max, glm::greaterThanEqual(Normal, glm::vec3(0.0f)));
+        if(glm::dot(Normal, Far) + Plane.w <= 0.0f) { return true; }
+    }
+    return false;
+}
+
+/*
+ * Depth first traversal for the overlap queries. NodeMask returns the slots of a node
+ * whose boxes pass, PrimitiveTest decides on the primitives in passing leaves.
+ */
+template<typename FNodeMask, typename FPrimitiveTest>
+void QueryOverlap(
+    const std::vector<FBvhNode> &Nodes, const std::vector<uint32_t> &Order,
+    const std::vector<FAabb> &OrderedBounds, const FNodeMask &NodeMask,
+    const FPrimitiveTest &PrimitiveTest, std::vector<uint32_t> &Out) {
+    Out.clear();
+    if(Nodes.empty()) { return; }
+    uint32_t Stack[StackSize];
+    uint32_t StackCount = 0;
+    Stack[StackCount++] = 0;
+    while(StackCount > 0) {
+        const FBvhNode &Node = Nodes[Stack[--StackCount]];
+        uint32_t Mask = NodeMask(Node);
+        while(Mask != 0) {
+            const uint32_t Slot = std::countr_zero(Mask);
+            Mask &= Mask - 1;
+            const uint32_t Child = Node.Children[Slot];
+            if(Child == FBvh::InvalidIndex) { continue; }
+            if(Node.Counts[Slot] == 0) {
+                Stack[StackCount++] = Child;
+                continue;
+            }
+            for(uint32_t i = Child; i < Child + Node.Counts[Slot]; i++) {
+                if(PrimitiveTest(OrderedBounds[i])) { Out.push_back(Order[i]); }
+            }
+        }
+    }
+}
+}
+
+void FBvh::Build(std::span<const FAabb> Bounds) {
+    Clear();
+    const uint32_t Count = static_cast<uint32_t>(Bounds.size());
+    if(Count == 0) { return; }
+
+    FBinaryBuilder Builder(Bounds);
+    Builder.BuildNode(0, 0, Count, Builder.ComputeRange(0, Count), 0);
+
+    const std::vector<FBuildNode> &BuildNodes = Builder.GetNodes();
+    Nodes.reserve(Builder.GetNodeCount() / 2 + 1);
+    if(BuildNodes[0].Count > 0) {
+        // Too few primitives to split, the root holds a single leaf.
+        Nodes.push_back(MakeEmptyNode());
+        SetSlotBounds(Nodes[0], 0, BuildNodes[0].Bounds);
+        Nodes[0].Children[0] = 0;
+        Nodes[0].Counts[0] = Count;
+    } else {
+        CollapseNode(BuildNodes, 0, Nodes);
+    }
+
+    const std::vector<FBuildPrimitive> &Primitives = Builder.GetPrimitives();
+    Order.resize(Count);
+    OrderedBounds.resize(Count);
+    FTaskSystem::Get().ParallelFor(
+        Count, ReduceBatchSize, [&](uint32_t Begin, uint32_t End) {
+            for(uint32_t i = Begin; i < End; i++) {
+                Order[i] = Primitives[i].Primitive;
+                OrderedBounds[i] = Primitives[i].Bounds;
+            }
+        });
+}
+
+void FBvh::Refit(std::span<const FAabb> Bounds) {
+    checkf(Bounds.size() == Order.size(), "Refit needs the primitives of the last build.");
+    const uint32_t Count = static_cast<uint32_t>(Order.size());
+    FTaskSystem &TaskSystem = FTaskSystem::Get();
+    TaskSystem.ParallelFor(Count, ReduceBatchSize, [&](uint32_t Begin, uint32_t End) {
+        for(uint32_t i = Begin; i < End; i++) {
+            OrderedBounds[i] = Bounds[Order[i]];
+        }
+    });
+
+    // Leaf slots only read primitive boxes and refit in parallel. Children always follow
+    // their parent, so a backwards sweep then completes the inner slots bottom up.
+    const uint32_t NodeCount = static_cast<uint32_t>(Nodes.size());
+    TaskSystem.ParallelFor(NodeCount, 1024, [this](uint32_t Begin, uint32_t End) {
+        for(uint32_t Index = Begin; Index < End; Index++) {
+            FBvhNode &Node = Nodes[Index];
+            for(uint32_t Slot = 0; Slot < 4; Slot++) {
+                if(Node.Counts[Slot] == 0) { continue; }
+                FAabb Box;
+                const uint32_t First = Node.Children[Slot];
+                for(uint32_t i = First; i < First + Node.Counts[Slot]; i++) {
+                    Box.Grow(OrderedBounds[i]);
+                }
+                SetSlotBounds(Node, Slot, Box);
+            }
+        }
+    });
+    for(uint32_t Index = NodeCount; Index-- > 0;) {
+        FBvhNode &Node = Nodes[Index];
+        for(uint32_t Slot = 0; Slot < 4; Slot++) {
+            if(Node.Counts[Slot] != 0 || Node.Children[Slot] == InvalidIndex) { continue; }
+            SetSlotBounds(Node, Slot, GetNodeBounds(Nodes[Node.Children[Slot]]));
+        }
+    }
+}
+
+void FBvh::Clear() {
+    Nodes.clear();
+    Order.clear();
+    OrderedBounds.clear();
+}
+
+void FBvh::QueryFrustum(
+    std::span<const glm::vec4, 6> Planes, std::vector<uint32_t> &Out) const {
+    using FOps = FSimdOps;
+    using FVec = FOps::FVec;
+    Out.clear();
+    if(Nodes.empty()) { return; }
+
+    uint32_t Stack[StackSize];
+    uint32_t StackCount = 0;
+    Stack[StackCount++] = 0;
+    const FVec Zero = FOps::Set(0.0f);
+    while(StackCount > 0) {
+        const FBvhNode &Node = Nodes[Stack[--StackCount]];
+        FVec Outside = Zero;
+        FVec Crossing = Zero;
+        for(const glm::vec4 &Plane: Planes) {
+            // The corner furthest along the normal decides whether a box is outside the
+            // plane, the opposite one whether it is entirely inside.
+            const bool bX = Plane.x >= 0.0f;
+            const bool bY = Plane.y >= 0.0f;
+            const bool bZ = Plane.z >= 0.0f;
+            const FVec Far = GetPlaneDistances(
+                Plane, bX ? Node.MaxX : Node.MinX, bY ? Node.MaxY : Node.MinY,
+                bZ ? Node.MaxZ : Node.MinZ);
+            const FVec Near = GetPlaneDistances(
+                Plane, bX ? Node.MinX : Node.MaxX, bY ? Node.MinY : Node.MaxY,
+                bZ ? Node.MinZ : Node.MaxZ);
+            Outside = FOps::Or(Outside, FOps::LessEqual(Far, Zero));
+            Crossing = FOps::Or(Crossing, FOps::LessEqual(Near, Zero));
+        }
+
+        uint32_t Mask = ~FOps::MoveMask(Outside) & 0xF;
+        const uint32_t CrossingMask = FOps::MoveMask(Crossing);
+        while(Mask != 0) {
+            const uint32_t Slot = std::countr_zero(Mask);
+            Mask &= Mask - 1;
+            const uint32_t Child = Node.Children[Slot];
+            if(Child == InvalidIndex) { continue; }
+            const bool bInside = (CrossingMask & (1u << Slot)) == 0;
+            if(Node.Counts[Slot] == 0) {
+                // Whole subtrees inside the frustum need no further tests.
+                if(bInside) {
+                    CollectSubtree(Child, Out);
+                } else {
+                    Stack[StackCount++] = Child;
+                }
+                continue;
+            }
+            for(uint32_t i = Child; i < Child + Node.Counts[Slot]; i++) {
+                if(bInside || !IsOutsideFrustum(Planes, OrderedBounds[i])) {
+                    Out.push_back(Order[i]);
+                }
+            }
+        }
+    }
+}
+
+void FBvh::QueryBox(const FAabb &Box, std::vector<uint32_t> &Out) const {
+    using FOps = FSimdOps;
+    using FVec = FOps::FVec;
+    const FVec QueryMinX = FOps::Set(Box.Min.x), QueryMaxX = FOps::Set(Box.Max.x);
+    const FVec QueryMinY = FOps::Set(Box.Min.y), QueryMaxY = FOps::Set(Box.Max.y);
+    const FVec QueryMinZ = FOps::Set(Box.Min.z), QueryMaxZ = FOps::Set(Box.Max.z);
+    auto NodeMask = [&](const FBvhNode &Node) {
+        const FVec X = FOps::And(
+            FOps::LessEqual(FOps::Load(Node.MinX), QueryMaxX),
+            FOps::LessEqual(QueryMinX, FOps::Load(Node.MaxX)));
+        const FVec Y = FOps::And(
+            FOps::LessEqual(FOps::Load(Node.MinY), QueryMaxY),
+            FOps::LessEqual(QueryMinY, FOps::Load(Node.MaxY)));
+        const FVec Z = FOps::And(
+            FOps::LessEqual(FOps::Load(Node.MinZ), QueryMaxZ),
+            FOps::LessEqual(QueryMinZ, FOps::Load(Node.MaxZ)));
+        return FOps::MoveMask(FOps::And(FOps::And(X, Y), Z));
+    };
+    QueryOverlap(
+        Nodes, Order, OrderedBounds, NodeMask,
+        [&Box](const FAabb &Bounds) { return Box.Overlaps(Bounds); }, Out);
+}
+
+void FBvh::QuerySphere(
+    const glm::vec3 &Center, float Radius, std::vector<uint32_t> &Out) const {
+    using FOps = FSimdOps;
+    using FVec = FOps::FVec;
+    const float RadiusSquared = Radius * Radius;
+    const FVec Cx = FOps::Set(Center.x), Cy = FOps::Set(Center.y), Cz = FOps::Set(Center.z);
+    auto NodeMask = [&](const FBvhNode &Node) {
+        const FVec DistanceSquared = GetDistancesSquared(Node, Cx, Cy, Cz);
+        return FOps::MoveMask(FOps::LessEqual(DistanceSquared, FOps::Set(RadiusSquared)));
+    };
+    QueryOverlap(
+        Nodes, Order, OrderedBounds, NodeMask,
+        [&](const FAabb &Bounds) {
+            return Bounds.GetDistanceSquared(Center) <= RadiusSquared;
+        },
+        Out);
+}
+
+bool FBvh::Raycast(const FRay &Ray, FBvhRayHit &OutHit, const FRayTestFunc &Test) const {
+    using FOps = FSimdOps;
+    using FVec = FOps::FVec;
+    if(Nodes.empty()) { return false; }
+
+    // Per axis the slab a ray enters first is fixed by the sign of its direction.
+    const glm::vec3 InvDirection = 1.0f / Ray.Direction;
+    const bool bNegX = InvDirection.x < 0.0f;
+    const bool bNegY = InvDirection.y < 0.0f;
+    const bool bNegZ = InvDirection.z < 0.0f;
+    const FVec Ox = FOps::Set(Ray.Origin.x), Oy = FOps::Set(Ray.Origin.y);
+    const FVec Oz = FOps::Set(Ray.Origin.z);
+    const FVec Ix = FOps::Set(InvDirection.x), Iy = FOps::Set(InvDirection.y);
+    const FVec Iz = FOps::Set(InvDirection.z);
+    const FVec MinDistance = FOps::Set(Ray.MinDistance);
+
+    // MaxDistance shrinks to the closest hit so far, pruning everything behind it.
+    FRay Clipped = Ray;
+    uint32_t Hit = InvalidIndex;
+    FStackEntry Stack[StackSize];
+    uint32_t StackCount = 0;
+    Stack[StackCount++] = {0, Ray.MinDistance};
+    while(StackCount > 0) {
+        const FStackEntry Entry = Stack[--StackCount];
+        if(Entry.Distance > Clipped.MaxDistance) { continue; }
+        const FBvhNode &Node = Nodes[Entry.Node];
+        const FVec EnterX = GetSlabDistances(bNegX ? Node.MaxX : Node.MinX, Ox, Ix);
+        const FVec EnterY = GetSlabDistances(bNegY ? Node.MaxY : Node.MinY, Oy, Iy);
+        const FVec EnterZ = GetSlabDistances(bNegZ ? Node.MaxZ : Node.MinZ, Oz, Iz);
+        const FVec ExitX = GetSlabDistances(bNegX ? Node.MinX : Node.MaxX, Ox, Ix);
+        const FVec ExitY = GetSlabDistances(bNegY ? Node.MinY : Node.MaxY, Oy, Iy);
+        const FVec ExitZ = GetSlabDistances(bNegZ ? Node.MinZ : Node.MaxZ, Oz, Iz);
+        const FVec Enter =
+            FOps::Max(FOps::Max(EnterX, EnterY), FOps::Max(EnterZ, MinDistance));
+        const FVec Exit = FOps::Min(
+            FOps::Min(ExitX, ExitY), FOps::Min(ExitZ, FOps::Set(Clipped.MaxDistance)));
+        uint32_t Mask = FOps::MoveMask(FOps::LessEqual(Enter, Exit));
+        float Distances[4];
+        FOps::Store(Distances, Enter);
+
+        // Sort the hit slots nearest first.
+        uint32_t Slots[4];
+        uint32_t SlotCount = 0;
+        while(Mask != 0) {
+            const uint32_t Slot = std::countr_zero(Mask);
+            Mask &= Mask - 1;
+            if(Node.Children[Slot] == InvalidIndex) { continue; }
+            uint32_t Position = SlotCount++;
+            while(Position > 0 && Distances[Slots[Position - 1]] > Distances[Slot]) {
+                Slots[Position] = Slots[Position - 1];
+                Position--;
+            }
+            Slots[Position] = Slot;
+        }
+
+        for(uint32_t i = 0; i < SlotCount; i++) {
+            const uint32_t Slot = Slots[i];
+            const uint32_t First = Node.Children[Slot];
+            for(uint32_t i = First; i < First + Node.Counts[Slot]; i++) {
+                float Distance;
+                if(!OrderedBounds[i].IntersectRay(Clipped, Distance)) { continue; }
+                if(Test) {
+                    Distance = Clipped.MaxDistance;
+                    if(!Test(Order[i], Clipped, Distance)) { continue; }
+                }
+                Clipped.MaxDistance = Distance;
+                Hit = Order[i];
+            }
+        }
+        // Inner slots go on farthest first, so the nearest is visited next.
+        for(uint32_t i = SlotCount; i-- > 0;) {
+            const uint32_t Slot = Slots[i];
+            if(Node.Counts[Slot] != 0) { continue; }
+            Stack[StackCount++] = {Node.Children[Slot], Distances[Slot]};
+        }
+    }
+
+    if(Hit == InvalidIndex) { return false; }
+    OutHit.Primitive = Hit;
+    OutHit.Distance = Clipped.MaxDistance;
+    return true;
+}
+
+uint32_t FBvh::FindNearest(
+    const glm::vec3 &Point, float MaxDistance, float *OutDistance) const {
+    using FOps = FSimdOps;
+    using FVec = FOps::FVec;
+    if(Nodes.empty()) { return InvalidIndex; }
+
+    const FVec Px = FOps::Set(Point.x), Py = FOps::Set(Point.y), Pz = FOps::Set(Point.z);
+    float BestSquared = MaxDistance * MaxDistance;
+    uint32_t Best = InvalidIndex;
+    FStackEntry Stack[StackSize];
+    uint32_t StackCount = 0;
+    Stack[StackCount++] = {0, 0.0f};
+    while(StackCount > 0) {
+        const FStackEntry Entry = Stack[--StackCount];
+        if(Entry.Distance > BestSquared) { continue; }
+        const FBvhNode &Node = Nodes[Entry.Node];
+        const FVec DistanceSquared = GetDistancesSquared(Node, Px, Py, Pz);
+        float Distances[4];
+        FOps::Store(Distances, DistanceSquared);
+
+        uint32_t Slots[4];
+        uint32_t SlotCount = 0;
+        for(uint32_t Slot = 0; Slot < 4; Slot++) {
+            if(Node.Children[Slot] == InvalidIndex || Distances[Slot] > BestSquared) {
+                continue;
+            }
+            if(Node.Counts[Slot] > 0) {
+                const uint32_t First = Node.Children[Slot];
+                for(uint32_t i = First; i < First + Node.Counts[Slot]; i++) {
+                    const float Distance = OrderedBounds[i].GetDistanceSquared(Point);
+                    if(Distance <= BestSquared) {
+                        BestSquared = Distance;
+                        Best = Order[i];
+                    }
+                }
+                continue;
+            }
+            uint32_t Position = SlotCount++;
+            while(Position > 0 && Distances[Slots[Position - 1]] < Distances[Slot]) {
+                Slots[Position] = Slots[Position - 1];
+                Position--;
+            }
+            Slots[Position] = Slot;
+        }
+        // Sorted farthest first, so the nearest inner slot is popped next.
+        for(uint32_t i = 0; i < SlotCount; i++) {
+            Stack[StackCount++] = {Node.Children[Slots[i]], Distances[Slots[i]]};
+        }
+    }
+
+    if(Best != InvalidIndex && OutDistance) { *OutDistance = std::sqrt(BestSquared); }
+    return Best;
+}
+
+float FBvh::GetCost() const {
+    const float RootArea = GetBounds().GetSurfaceArea();
+    if(RootArea <= 0.0f) { return 0.0f; }
+    float Cost = TraversalCost;
+    for(const FBvhNode &Node: Nodes) {
+        for(uint32_t Slot = 0; Slot < 4; Slot++) {
+            if(Node.Children[Slot] == InvalidIndex) { continue; }
+            const float Weight =
+                Node.Counts[Slot] > 0 ? float(Node.Counts[Slot]) : TraversalCost;
+            Cost += GetSlotBounds(Node, Slot).GetSurfaceArea() / RootArea * Weight;
+        }
+    }
+    return Cost;
+}
+
+FAabb FBvh::GetBounds() const {
+    return Nodes.empty() ? FAabb() : GetNodeBounds(Nodes[0]);
+}
+
+void FBvh::CollectSubtree(uint32_t Node, std::vector<uint32_t> &Out) const {
+    uint32_t Stack[StackSize];
+    uint32_t StackCount = 0;
+    Stack[StackCount++] = Node;
+    while(StackCount > 0) {
+        const FBvhNode &Current = Nodes[Stack[--StackCount]];
+        for(uint32_t Slot = 0; Slot < 4; Slot++) {
+            const uint32_t Child = Current.Children[Slot];
+            if(Child == InvalidIndex) { continue; }
+            if(Current.Counts[Slot] == 0) {
+                Stack[StackCount++] = Child;
+                continue;
+            }
+            for(uint32_t i = Child; i < Child + Current.Counts[Slot]; i++) {
+                Out.push_back(Order[i]);
+            }
+        }
+    }
+}
+}
@@ -0,0 +1,52 @@
+﻿#pragma once
+#include "re-spatial_export.h"
+
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+namespace RE {
+struct FRay {
+    glm::vec3 Origin{0.0f};
+    /* Need not be normalized, distances along the ray are in multiples of it. */
+    glm::vec3 Direction{0.0f, 0.0f, 1.0f};
+    float MinDistance{0.0f};
+    float MaxDistance{FLT_MAX};
+};
+
+/* Axis aligned box, default constructed empty so that growing it starts from nothing. */
+struct RE_SPATIAL_EXPORT FAabb {
+    glm::vec3 Min{FLT_MAX};
+    glm::vec3 Max{-FLT_MAX};
+
+    FAabb() = default;
+    FAabb(const glm::vec3 &InMin, const glm::vec3 &InMax) : Min(InMin), Max(InMax) {}
+
+    static FAabb FromSphere(const glm::vec3 &Center, float Radius) {
+        return {Center - Radius, Center + Radius};
+    }
+
+    bool IsValid() const { return Min.x <= Max.x && Min.y <= Max.y && Min.z <= Max.z; }
+    glm::vec3 GetCenter() const { return (Min + Max) * 0.5f; }
+    glm::vec3 GetExtent() const { return (Max - Min) * 0.5f; }
+    /* Zero for an empty box. */
+    float GetSurfaceArea() const;
+
+    void Grow(const glm::vec3 &Point) {
+        Min = glm::min(Min, Point);
+        Max = glm::max(Max, Point);
+    }
+    void Grow(const FAabb &Other) {
+        Min = glm::min(Min, Other.Min);
+        Max = glm::max(Max, Other.Max);
+    }
+
+    bool Overlaps(const FAabb &Other) const;
+    /* Squared distance from Point to the box, zero inside it. */
+    float GetDistanceSquared(const glm::vec3 &Point) const;
+    /* Writes the entry distance, or MinDistance if the ray starts inside. */
+    bool IntersectRay(const FRay &Ray, float &OutDistance) const;
+    /* Box enclosing this one after the transform, loose under rotation. */
+    FAabb Transform(const glm::mat4 &Matrix) const;
+};
+}
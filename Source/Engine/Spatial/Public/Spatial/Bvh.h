@@ -0,0 +1,90 @@
+﻿#pragma once
+#include "re-spatial_export.h"
+#include "Spatial/Bounds.h"
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+namespace RE {
+/*
+ * Four children with their boxes stored by component, so one SIMD instruction handles a
+ * coordinate of all of them. Unused slots hold an inverted box no test accepts.
+ */
+struct alignas(64) FBvhNode {
+    float MinX[4], MinY[4], MinZ[4];
+    float MaxX[4], MaxY[4], MaxZ[4];
+    /* Child node index, or for a leaf the first entry of its primitive range. */
+    uint32_t Children[4];
+    /* Primitive count of a leaf, zero for inner children and unused slots. */
+    uint32_t Counts[4];
+};
+static_assert(sizeof(FBvhNode) == 128, "Nodes should span exactly two cache lines.");
+
+struct FBvhRayHit {
+    uint32_t Primitive{UINT32_MAX};
+    float Distance{FLT_MAX};
+};
+
+/*
+ * Bounding volume hierarchy over primitive boxes for culling, picking and proximity
+ * queries.
+ *
+ * Build splits by the binned surface area heuristic into a binary tree, running large
+ * ranges and both halves of large splits on the task system, then collapses it into
+ * four wide nodes laid out depth first. Moving primitives are handled by Refit, which
+ * keeps the topology; rebuild once GetCost has grown well past its value after Build.
+ *
+ * Queries are const and may run concurrently. Result lists are overwritten and hold
+ * primitive ids in no particular order.
+ */
+class RE_SPATIAL_EXPORT FBvh {
+public:
+    static constexpr uint32_t InvalidIndex = UINT32_MAX;
+    static constexpr uint32_t MaxLeafSize = 4;
+
+    /*
+     * Narrows a hit on a primitive's box down to the primitive. Returns true and lowers
+     * Distance, which holds the closest hit so far, if the primitive is hit before it.
+     */
+    using FRayTestFunc =
+        std::function<bool(uint32_t Primitive, const FRay &Ray, float &Distance)>;
+
+    /* Primitive ids are indices into Bounds. */
+    void Build(std::span<const FAabb> Bounds);
+    /* Bounds must hold the same primitives as at the last Build. */
+    void Refit(std::span<const FAabb> Bounds);
+    void Clear();
+
+    /* Planes point inwards and are normalized, as in FFrustum. */
+    void QueryFrustum(
+        std::span<const glm::vec4, 6> Planes, std::vector<uint32_t> &Out) const;
+    void QueryBox(const FAabb &Box, std::vector<uint32_t> &Out) const;
+    void QuerySphere(
+        const glm::vec3 &Center, float Radius, std::vector<uint32_t> &Out) const;
+    /* Closest hit along the ray; without a test function the primitive boxes are hit. */
+    bool Raycast(
+        const FRay &Ray, FBvhRayHit &OutHit, const FRayTestFunc &Test = nullptr) const;
+    /* The primitive whose box is closest to Point within MaxDistance, or InvalidIndex. */
+    uint32_t FindNearest(
+        const glm::vec3 &Point, float MaxDistance = FLT_MAX,
+        float *OutDistance = nullptr) const;
+
+    /* Expected cost of a query in primitive tests, by the surface area heuristic. */
+    float GetCost() const;
+    FAabb GetBounds() const;
+    uint32_t GetPrimitiveCount() const { return static_cast<uint32_t>(Order.size()); }
+    std::span<const FBvhNode> GetNodes() const { return Nodes; }
+    /* Primitive ids in leaf order, the ranges of leaves index into it. */
+    std::span<const uint32_t> GetPrimitiveOrder() const { return Order; }
+
+private:
+    void CollectSubtree(uint32_t Node, std::vector<uint32_t> &Out) const;
+
+    std::vector<FBvhNode> Nodes;
+    std::vector<uint32_t> Order;
+    /* Primitive boxes in leaf order, for the exact tests inside leaves. */
+    std::vector<FAabb> OrderedBounds;
+};
+}
@@ -0,0 +1,216 @@
+﻿#include "Core/BinaryLog.h"
+#include "Core/Logging.h"
+
+#include <spdlog/fmt/bundled/args.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <tsl/robin_map.h>
+
+#include <algorithm>
+
+using namespace RE;
+
+namespace {
+using EArgType = FBinaryLog::EArgType;
+
+struct FSite {
+    uint32_t Line;
+    std::vector<EArgType> Args;
+    std::string File;
+    std::string Format;
+};
+
+struct FLine {
+    uint64_t TimeNs;
+    uint32_t Thread;
+    std::string Text;
+};
+
+// Reads the file's bytes front to back, failing once anything runs past the end.
+class FReader {
+public:
+    explicit FReader(std::span<const uint8_t> Bytes): Bytes(Bytes) {}
+
+    template<typename T>
+    bool Read(T &Value) {
+        if(Bytes.size() - Offset < sizeof(T)) { return false; }
+        std::memcpy(&Value, &Bytes[Offset], sizeof(T));
+        Offset += sizeof(T);
+        return true;
+    }
+
+    bool ReadString(std::string &Text) {
+        uint16_t Length;
+        if(!Read(Length) || Bytes.size() - Offset < Length) { return false; }
+        Text.assign(reinterpret_cast<const char *>(&Bytes[Offset]), Length);
+        Offset += Length;
+        return true;
+    }
+
+    bool Skip(size_t Size) {
+        if(Bytes.size() - Offset < Size) { return false; }
+        Offset += Size;
+        return true;
+    }
+
+    bool IsEnd() const { return Offset == Bytes.size(); }
+    size_t GetOffset() const { return Offset; }
+
+private:
+    std::span<const uint8_t> Bytes;
+    size_t Offset{0};
+};
+
+template<typename T>
+bool ReadArg(FReader &Reader, fmt::dynamic_format_arg_store<fmt::format_context> &Store) {
+    T Value;
+    if(!Reader.Read(Value)) { return false; }
+    Store.push_back(Value);
+    return true;
+}
+
+bool ReadArgs(
+    FReader &Reader, const FSite &Site,
+    fmt::dynamic_format_arg_store<fmt::format_context> &Store) {
+    for(EArgType Type: Site.Args) {
+        bool bRead = false;
+        switch(Type) {
+        case EArgType::Bool: bRead = ReadArg<bool>(Reader, Store); break;
+        case EArgType::Int8: bRead = ReadArg<int8_t>(Reader, Store); break;
+        case EArgType::UInt8: bRead = ReadArg<uint8_t>(Reader, Store); break;
+        case EArgType::Int16: bRead = ReadArg<int16_t>(Reader, Store); break;
+        case EArgType::UInt16: bRead = ReadArg<uint16_t>(Reader, Store); break;
+        case EArgType::Int32: bRead = ReadArg<int32_t>(Reader, Store); break;
+        case EArgType::UInt32: bRead = ReadArg<uint32_t>(Reader, Store); break;
+        case EArgType::Int64: bRead = ReadArg<int64_t>(Reader, Store); break;
+        case EArgType::UInt64: bRead = ReadArg<uint64_t>(Reader, Store); break;
+        case EArgType::Float: bRead = ReadArg<float>(Reader, Store); break;
+        case EArgType::Double: bRead = ReadArg<double>(Reader, Store); break;
+        case EArgType::Pointer: {
+            uint64_t Address;
+            bRead = Reader.Read(Address);
+            if(bRead) { Store.push_back(reinterpret_cast<const void *>(Address)); }
+            break;
+        }
+        case EArgType::String: {
+            std::string Text;
+            bRead = Reader.ReadString(Text);
+            if(bRead) { Store.push_back(std::move(Text)); }
+            break;
+        }
+        }
+        if(!bRead) { return false; }
+    }
+    return true;
+}
+
+std::vector<uint8_t> ReadFile(const char *Path) {
+    std::vector<uint8_t> Bytes;
+    std::ifstream Stream(Path, std::ios::binary | std::ios::ate);
+    if(!Stream) { return Bytes; }
+    Bytes.resize(size_t(Stream.tellg()));
+    Stream.seekg(0);
+    Stream.read(reinterpret_cast<char *>(Bytes.data()), std::streamsize(Bytes.size()));
+    return Bytes;
+}
+}
+
+// Prints the records of a binary log in time order, one line each.
+int main(int argc, char **argv) {
+    // Messages go to stderr, leaving stdout to the decoded records.
+    auto logger = spdlog::stderr_color_mt("logger");
+    logger->set_pattern(RE_LOGGER_FORMAT);
+    spdlog::set_default_logger(logger);
+    if(argc != 2) {
+        RE_LOGI("Usage: RE-LogDecoder <binary log>");
+        return 1;
+    }
+
+    const std::vector<uint8_t> Bytes = ReadFile(argv[1]);
+    FReader Reader(Bytes);
+    FBinaryLog::FFileHeader Header;
+    if(!Reader.Read(Header) || Header.Magic != FBinaryLog::Magic) {
+        RE_LOGE("{} is not a binary log", argv[1]);
+        return 1;
+    }
+    if(Header.Version != FBinaryLog::Version) {
+        RE_LOGE(
+            "{} is version {}, expected {}", argv[1], Header.Version, FBinaryLog::Version);
+        return 1;
+    }
+
+    tsl::robin_map<uint32_t, FSite> Sites;
+    tsl::robin_map<uint32_t, std::string> Threads;
+    std::vector<FLine> Lines;
+    bool bTruncated = false;
+    while(!Reader.IsEnd() && !bTruncated) {
+        FBinaryLog::EChunk Chunk;
+        if(!Reader.Read(Chunk)) { break; }
+
+        if(Chunk == FBinaryLog::EChunk::Site) {
+            uint32_t Id;
+            FSite Site;
+            uint8_t ArgCount = 0;
+            bTruncated =
+                !Reader.Read(Id) || !Reader.Read(Site.Line) || !Reader.Read(ArgCount);
+            Site.Args.resize(ArgCount);
+            for(EArgType &Type: Site.Args) {
+                bTruncated = bTruncated || !Reader.Read(Type);
+            }
+            bTruncated = bTruncated || !Reader.ReadString(Site.File) ||
+                         !Reader.ReadString(Site.Format);
+            if(!bTruncated) { Sites.insert_or_assign(Id, std::move(Site)); }
+        } else if(Chunk == FBinaryLog::EChunk::Thread) {
+            uint32_t Thread;
+            std::string Name;
+            bTruncated = !Reader.Read(Thread) || !Reader.ReadString(Name);
+            if(!bTruncated) { Threads.insert_or_assign(Thread, std::move(Name)); }
+        } else if(Chunk == FBinaryLog::EChunk::Records) {
+            uint32_t Thread;
+            uint32_t Size;
+            bTruncated = !Reader.Read(Thread) || !Reader.Read(Size);
+            const size_t End = Reader.GetOffset() + Size;
+            while(!bTruncated && Reader.GetOffset() < End) {
+                uint32_t Id;
+                uint64_t TimeNs;
+                bTruncated = !Reader.Read(Id) || !Reader.Read(TimeNs);
+                if(bTruncated) { break; }
+                auto It = Sites.find(Id);
+                if(It == Sites.end()) {
+                    // Without the site the size of the arguments is unknown.
+                    RE_LOGW("Record of unknown site {:#x}, skipping its chunk", Id);
+                    bTruncated = !Reader.Skip(End - Reader.GetOffset());
+                    break;
+                }
+                fmt::dynamic_format_arg_store<fmt::format_context> Store;
+                bTruncated = !ReadArgs(Reader, It->second, Store);
+                if(bTruncated) { break; }
+                std::string Text;
+                try {
+                    Text = fmt::vformat(It->second.Format, Store);
+                } catch(const fmt::format_error &Error) {
+                    Text = fmt::format("{} <{}>", It->second.Format, Error.what());
+                }
+                Lines.push_back(
+                    {TimeNs > Header.StartNs ? TimeNs - Header.StartNs : 0, Thread,
+                     std::move(Text)});
+            }
+        } else {
+            RE_LOGE(
+                "Unknown chunk {} at byte {}", uint32_t(Chunk), Reader.GetOffset() - 1);
+            return 1;
+        }
+    }
+    if(bTruncated) { RE_LOGW("{} ends in the middle of a chunk", argv[1]); }
+
+    // Chunks hold one thread each, merge them back into one timeline.
+    std::stable_sort(Lines.begin(), Lines.end(), [](const FLine &A, const FLine &B) {
+        return A.TimeNs < B.TimeNs;
+    });
+    for(const FLine &Line: Lines) {
+        auto It = Threads.find(Line.Thread);
+        const std::string Thread =
+            It != Threads.end() ? It->second : fmt::format("Thread {}", Line.Thread);
+        fmt::print("[{:12.6f} ms] [{}] {}\n", Line.TimeNs * 1e-6, Thread, Line.Text);
+    }
+    return 0;
+}
@@ -3,6 +3,8 @@ set(RE_VULKAN_DEBUG ON CACHE BOOL "Enable VK_EXT_debug_utils or VK_EXT_debug_mar
 set(RE_VALIDATION_LAYERS_GPU_ASSISTED OFF CACHE BOOL "Enable GPU assisted validation layers for every application (implicitly enables VKB_VALIDATION_LAYERS).")
 set(RE_VALIDATION_LAYERS_BEST_PRACTICES OFF CACHE BOOL "Enable best practices validation layers for every application (implicitly enables VKB_VALIDATION_LAYERS).")
 set(RE_VALIDATION_LAYERS_SYNCHRONIZATION OFF CACHE BOOL "Enable synchronization validation layers for every application (implicitly enables VKB_VALIDATION_LAYERS).")
+set(RE_PROFILING ON CACHE BOOL "Compile the RE_PROFILE_* scopes in, they only record while a capture runs.")
+set(RE_BINARY_LOGGING ON CACHE BOOL "Compile the RE_BINARY_LOG sites in, they only record while a binary log is open.")
 
 set(CMAKE_CXX_STANDARD 20)
 set(CMAKE_VERBOSE_MAKEFILE ON)